@@ -0,0 +1,52 @@
+#include "stdio.h"
+#include "pico/stdlib.h"
+#include "binary_out.h"
+#include "crc32.h"
+#include "usb_ports.h"
+
+//CRC of the frame currently being written in parts.
+static uint32_t frame_crc = 0;
+//The frame being written goes to the USB data port
+static bool to_data_port = false;
+
+//Writes raw bytes to the console without any newline translation.
+void binary_write(const void *data, size_t length){
+  if (to_data_port){
+    usb_port_write(USB_DATA, data, length);
+    return;
+  }
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < length; i++){
+    putchar_raw(bytes[i]);
+  }
+}
+
+//Starts a frame whose payload is written with binary_frame_part.
+//The parts must add up to length.
+void binary_frame_begin(const char tag[4], uint32_t length){
+  to_data_port = usb_port_connected(USB_DATA);
+  if (to_data_port){
+    printf("Frame: %.4s %lu\n", tag, length);
+  }
+  binary_write(tag, 4);
+  binary_write(&length, sizeof(length));
+  frame_crc = 0;
+}
+
+void binary_frame_part(const void *data, size_t length){
+  frame_crc = crc32_update(frame_crc, data, length);
+  binary_write(data, length);
+}
+
+void binary_frame_end(){
+  binary_write(&frame_crc, sizeof(frame_crc));
+  to_data_port = false;
+  stdio_flush();
+}
+
+//Writes a whole frame from one buffer.
+void binary_frame(const char tag[4], const void *payload, uint32_t length){
+  binary_frame_begin(tag, length);
+  binary_frame_part(payload, length);
+  binary_frame_end();
+}
@@ -0,0 +1,20 @@
+#ifndef BINARY_OUT_H
+#define BINARY_OUT_H
+
+#include "pico/stdlib.h"
+
+//Binary data goes out in frames so a host can pick it out of the
+//text console:
+//  4 byte tag, uint32 payload length, payload, uint32 CRC-32 of payload
+//All multi-byte fields are little endian.
+//
+//While a host has the USB data port open the frames go there instead,
+//each announced on the console by a "Frame: <tag> <length>" line
+//printed when it starts, see usb_ports.h.
+void binary_write(const void *data, size_t length);
+void binary_frame(const char tag[4], const void *payload, uint32_t length);
+void binary_frame_begin(const char tag[4], uint32_t length);
+void binary_frame_part(const void *data, size_t length);
+void binary_frame_end();
+
+#endif
@@ -0,0 +1,97 @@
+#include "string.h"
+#include "pico/stdlib.h"
+#include "boot_record.h"
+#include "flash_ops.h"
+#include "crc32.h"
+
+#define RECORD_SIZE (sizeof(boot_record) + sizeof(uint32_t))
+//Where a slot is mapped on the board, which is what its image is
+//linked for
+#define SLOT_ADDRESS(slot) (0x10000000u + FLASH_SLOT_OFFSET(slot))
+#define SRAM_START 0x20000000u
+#define SRAM_END 0x20042000u
+
+//Sector the record in use was read from or written to, -1 with none
+static int record_sector = -1;
+
+static uint32_t sector_offset(int sector){
+  return FLASH_BOOT_RECORD_OFFSET + sector*FLASH_SECTOR_SIZE;
+}
+
+static bool read_sector(int sector, boot_record *record){
+  const uint8_t *stored = flash_ops_read(sector_offset(sector));
+  uint32_t stored_crc;
+  memcpy(record, stored, sizeof(*record));
+  memcpy(&stored_crc, stored + sizeof(*record), sizeof(stored_crc));
+  return (record->magic == BOOT_RECORD_MAGIC) && (record->length == sizeof(*record)) &&
+    (crc32_update(0, record, sizeof(*record)) == stored_crc) &&
+    (record->active < FLASH_SLOT_COUNT) && (record->state <= BOOT_TRYING);
+}
+
+void boot_record_load(boot_record *record){
+  record_sector = -1;
+  for (int sector = 0; sector < FLASH_BOOT_RECORD_SECTORS; sector++){
+    boot_record candidate;
+    if (read_sector(sector, &candidate) &&
+      ((record_sector < 0) || ((int32_t)(candidate.sequence - record->sequence) > 0))){
+      *record = candidate;
+      record_sector = sector;
+    }
+  }
+  if (record_sector < 0){
+    *record = (boot_record){
+      .magic = BOOT_RECORD_MAGIC,
+      .version = BOOT_RECORD_VERSION,
+      .length = sizeof(boot_record),
+      .active = 0,
+      .state = BOOT_CONFIRMED,
+    };
+  }
+}
+
+bool boot_record_store(boot_record *record){
+  static uint8_t stored[RECORD_SIZE];
+  int sector = record_sector < 0 ? 0 : (record_sector + 1) % FLASH_BOOT_RECORD_SECTORS;
+  record->sequence++;
+  memcpy(stored, record, sizeof(*record));
+  uint32_t crc = crc32_update(0, record, sizeof(*record));
+  memcpy(stored + sizeof(*record), &crc, sizeof(crc));
+  if (!flash_ops_write_sector(sector_offset(sector), stored, sizeof(stored))){
+    return false;
+  }
+  record_sector = sector;
+  return true;
+}
+
+//The initial stack pointer in SRAM and the reset handler, a Thumb
+//address, inside the slot.
+bool boot_image_startable(int slot){
+  uint32_t vectors[2];
+  memcpy(vectors, flash_ops_read(FLASH_SLOT_OFFSET(slot) + BOOT_IMAGE_VECTORS), sizeof(vectors));
+  uint32_t entry = vectors[1] & ~1u;
+  return (vectors[0] > SRAM_START) && (vectors[0] <= SRAM_END) && (vectors[1] & 1) &&
+    (entry >= SLOT_ADDRESS(slot)) && (entry < SLOT_ADDRESS(slot) + FLASH_SLOT_SIZE);
+}
+
+int boot_record_select(boot_record *record, bool (*startable)(int slot)){
+  boot_record before = *record;
+  if (record->state == BOOT_TRYING){
+    record->active = (record->active + 1) % FLASH_SLOT_COUNT;
+    record->state = BOOT_CONFIRMED;
+  } else if (record->state == BOOT_TRIAL){
+    record->state = BOOT_TRYING;
+  }
+  if (!startable(record->active)){
+    record->active = (record->active + 1) % FLASH_SLOT_COUNT;
+    record->state = BOOT_CONFIRMED;
+    if (!startable(record->active)){
+      return -1;
+    }
+  }
+  if (memcmp(&before, record, sizeof(before)) != 0){
+    //Started either way, a record that cannot be written is only
+    //decided again at the next boot
+    boot_record_store(record);
+  }
+  return record->active;
+}
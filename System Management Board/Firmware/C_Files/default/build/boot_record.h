@@ -0,0 +1,57 @@
+#ifndef BOOT_RECORD_H
+#define BOOT_RECORD_H
+
+#include "pico/stdlib.h"
+#include "flash_ops.h"
+
+//Which slot the bootloader starts, shared by the bootloader and the
+//firmware. Kept like the settings: the two boot record sectors take
+//turns, so a reset while one is written leaves the last record.
+
+#define BOOT_RECORD_VERSION 1
+//"SMBB" as stored
+#define BOOT_RECORD_MAGIC 0x42424d53
+//The image starts with the 256 byte second stage boot loader, as
+//linked for the start of flash, and its vector table follows
+#define BOOT_IMAGE_VECTORS 0x100
+
+typedef enum boot_state{
+  //The active image passed its health check, or is the one the board
+  //was programmed with
+  BOOT_CONFIRMED,
+  //The active image was just received and has not run yet
+  BOOT_TRIAL,
+  //The bootloader has started it once. If the board resets again
+  //before the image confirms itself, the other slot is started.
+  BOOT_TRYING,
+} boot_state;
+
+//Stored as is, then the CRC-32 of it.
+typedef struct boot_record{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint32_t sequence;
+  uint8_t active;
+  uint8_t state;
+  uint16_t reserved;
+  //Of the image in each slot, length 0 if not known, like slot A as
+  //programmed over BOOTSEL
+  uint32_t image_length[FLASH_SLOT_COUNT];
+  uint32_t image_crc[FLASH_SLOT_COUNT];
+} boot_record;
+
+//Reads the newest valid record, or a new one for slot A confirmed.
+void boot_record_load(boot_record *record);
+//Writes the record with the next sequence to the sector not in use.
+bool boot_record_store(boot_record *record);
+//Whether slot holds an image linked to run from it, by its vector
+//table. The CRC is checked before an image is made active.
+bool boot_image_startable(int slot);
+//The bootloader's choice: moves a trial on to trying, and a trying
+//image that did not confirm itself, or an active slot that startable
+//turns down, back to the other slot. Stores the record if it changed
+//and returns the slot to start, or -1 if neither can be.
+int boot_record_select(boot_record *record, bool (*startable)(int slot));
+
+#endif
@@ -0,0 +1,56 @@
+#include "pico/stdlib.h"
+#include "pico/bootrom.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/scb.h"
+#include "hardware/structs/systick.h"
+#include "hardware/regs/m0plus.h"
+#include "boot_record.h"
+#include "flash_ops.h"
+#include "capture_hw.h"
+
+//Resident bootloader for the field update, at the start of flash.
+//It starts the slot the boot record says, see boot_record.h, and
+//leaves the watchdog scratch registers alone so the firmware's warm
+//restart works through it.
+
+//Long enough for the image to reach supervisor_init, which sets the
+//watchdog to its own timeout
+#define TRIAL_WATCHDOG_MS 8000
+
+//flash_ops.c holds the capture off flash while it writes. Nothing
+//runs on core 1 here.
+void capture_hw_hold(){
+}
+
+void capture_hw_resume(){
+}
+
+//Hands the core over to the image as if it had been reset into it.
+static void __attribute__((noreturn)) start_image(int slot){
+  const uint32_t *vectors = (const uint32_t *)flash_ops_read(FLASH_SLOT_OFFSET(slot) + BOOT_IMAGE_VECTORS);
+  systick_hw->csr = 0;
+  *(volatile uint32_t *)(PPB_BASE + M0PLUS_NVIC_ICER_OFFSET) = 0xffffffff;
+  *(volatile uint32_t *)(PPB_BASE + M0PLUS_NVIC_ICPR_OFFSET) = 0xffffffff;
+  scb_hw->vtor = (uintptr_t)vectors;
+  __asm volatile(
+    "msr msp, %0\n"
+    "bx %1\n"
+    : : "r"(vectors[0]), "r"(vectors[1]));
+  __builtin_unreachable();
+}
+
+int main(){
+  boot_record record;
+  boot_record_load(&record);
+  int slot = boot_record_select(&record, boot_image_startable);
+  if (slot < 0){
+    //Nothing to start, wait for an image over USB
+    reset_usb_boot(0, 0);
+  }
+  if (record.state == BOOT_TRYING){
+    //A trial image that hangs before its supervisor starts is reset
+    //too, and the next boot goes back to the other slot
+    watchdog_enable(TRIAL_WATCHDOG_MS, 1);
+  }
+  start_image(slot);
+}
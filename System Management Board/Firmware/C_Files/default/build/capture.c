@@ -0,0 +1,306 @@
+#include "string.h"
+#include "pico/stdlib.h"
+#include "capture.h"
+#include "capture_hw.h"
+#include "console.h"
+#include "binary_out.h"
+
+//Run-length data bigger than this is sent raw instead
+#define CAPTURE_RLE_BYTES 16384
+//How far before the word it was seen in the trigger is looked for in
+//the data, to cover the time the sampler takes to notice it
+#define CAPTURE_TRIGGER_SEARCH_WORDS 64
+//Words still in the PIO FIFO when the trigger is seen
+#define CAPTURE_FIFO_WORDS 8
+#define CAPTURE_DEFAULT_PRE 10
+//GPIO0 to GPIO29
+#define CAPTURE_GPIO_MASK 0x3fffffff
+
+uint32_t capture_buffer[CAPTURE_WORDS];
+volatile capture_state capture_status = CAPTURE_IDLE;
+volatile bool capture_stop_request = false;
+
+static capture_config config;
+static capture_header header;
+static uint8_t rle_data[CAPTURE_RLE_BYTES];
+//Ring index of the first valid word
+static uint32_t start_word;
+
+static const char *const state_names[] = {"idle", "filling", "waiting", "triggered", "done"};
+
+static uint32_t width_mask(uint width){
+  return width == 32 ? 0xffffffff : (1u << width) - 1;
+}
+
+//Sample i of the valid data, in order of capture.
+static uint32_t sample_at(uint32_t i){
+  uint32_t per_word = 32/config.width;
+  uint32_t word = capture_buffer[(start_word + i/per_word) % CAPTURE_WORDS];
+  return (word >> ((i % per_word)*config.width)) & width_mask(config.width);
+}
+
+//The sampler only knows roughly when the trigger happened. If the
+//trigger pins were captured, this finds the sample where it actually
+//did: the last one near where it was seen that starts a match.
+static uint32_t find_trigger(uint32_t trigger_word, uint32_t words){
+  uint32_t per_word = 32/config.width;
+  uint32_t offset = (trigger_word + CAPTURE_WORDS - start_word) % CAPTURE_WORDS;
+  uint32_t seen = offset*per_word;
+  uint32_t captured = width_mask(config.width) << config.base;
+  if ((config.trigger == CAPTURE_TRIGGER_NONE) || (config.trigger_mask & ~captured)){
+    return seen;
+  }
+  capture_config onset = config;
+  if (onset.trigger == CAPTURE_TRIGGER_LEVEL){
+    onset.trigger = CAPTURE_TRIGGER_EDGE;
+  }
+  uint32_t last = offset + CAPTURE_FIFO_WORDS;
+  last = (last > words ? words : last)*per_word;
+  uint32_t first = offset > CAPTURE_TRIGGER_SEARCH_WORDS ? (offset - CAPTURE_TRIGGER_SEARCH_WORDS)*per_word : 1;
+  for (uint32_t i = last - 1; i >= first; i--){
+    uint32_t previous = sample_at(i - 1) << config.base;
+    uint32_t pins = sample_at(i) << config.base;
+    if (capture_trigger_hit(&onset, previous, pins)){
+      return i;
+    }
+  }
+  return seen;
+}
+
+static size_t put_uleb128(uint8_t *out, uint32_t value){
+  size_t length = 0;
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    out[length++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return length;
+}
+
+//Encodes the samples as runs of the masked pins. Returns false if
+//they do not fit in rle_data.
+static bool encode_runs(uint32_t samples){
+  uint32_t pins = (config.pins >> config.base) & width_mask(config.width);
+  size_t value_bytes = (config.width + 7)/8;
+  size_t length = 0;
+  uint32_t i = 0;
+  while (i < samples){
+    uint32_t value = sample_at(i) & pins;
+    uint32_t run = 1;
+    while ((i + run < samples) && ((sample_at(i + run) & pins) == value)){
+      run++;
+    }
+    if (length + value_bytes + 5 > CAPTURE_RLE_BYTES){
+      return false;
+    }
+    memcpy(&rle_data[length], &value, value_bytes);
+    length += value_bytes;
+    length += put_uleb128(&rle_data[length], run);
+    i += run;
+  }
+  header.data_bytes = length;
+  return true;
+}
+
+//Runs on the sampling core, so encoding a big capture does not hold
+//up the main loop.
+void capture_hw_done(uint32_t end_word, uint32_t words, uint32_t trigger_word){
+  start_word = (end_word + CAPTURE_WORDS - words) % CAPTURE_WORDS;
+  uint32_t samples = words*(32/config.width);
+  header = (capture_header){
+    .version = CAPTURE_VERSION,
+    .format = CAPTURE_FORMAT_RLE,
+    .base = config.base,
+    .width = config.width,
+    .pins = config.pins,
+    .rate_hz = config.rate_hz,
+    .samples = samples,
+    .trigger_sample = CAPTURE_NO_TRIGGER,
+    .chunk_bytes = CAPTURE_CHUNK_BYTES,
+    .trigger = config.trigger,
+    .trigger_mask = config.trigger_mask,
+    .trigger_value = config.trigger_value,
+  };
+  if ((trigger_word != CAPTURE_NO_TRIGGER) && words){
+    header.trigger_sample = find_trigger(trigger_word, words);
+  }
+  if (!encode_runs(samples)){
+    header.format = CAPTURE_FORMAT_RAW;
+    header.data_bytes = words*4;
+  }
+  //The console on the other core reads the header once it sees DONE
+  __sync_synchronize();
+  capture_status = CAPTURE_DONE;
+}
+
+void capture_poll(){
+  if ((capture_status != CAPTURE_IDLE) && (capture_status != CAPTURE_DONE)){
+    capture_hw_poll();
+  }
+}
+
+bool capture_running(){
+  return (capture_status != CAPTURE_IDLE) && (capture_status != CAPTURE_DONE);
+}
+
+//Reads "none", "rise:12", "change:0x1c00" or "edge:0x1c00=0x400".
+static bool parse_trigger(const char *arg, capture_config *target){
+  char text[CONSOLE_LINE_MAX];
+  strncpy(text, arg, sizeof(text) - 1);
+  text[sizeof(text) - 1] = 0;
+  char *operand = strchr(text, ':');
+  if (strcmp(text, "none") == 0){
+    target->trigger = CAPTURE_TRIGGER_NONE;
+    return true;
+  }
+  if (!operand){
+    return false;
+  }
+  *operand++ = 0;
+  char *value = strchr(operand, '=');
+  if (value){
+    *value++ = 0;
+  }
+  uint32_t number;
+  if (!console_arg_uint(operand, &number)){
+    return false;
+  }
+  if ((strcmp(text, "rise") == 0) || (strcmp(text, "fall") == 0)){
+    if (value || (number > 29)){
+      return false;
+    }
+    target->trigger = CAPTURE_TRIGGER_EDGE;
+    target->trigger_mask = 1u << number;
+    target->trigger_value = text[0] == 'r' ? target->trigger_mask : 0;
+    return true;
+  }
+  target->trigger_mask = number;
+  if (strcmp(text, "change") == 0){
+    target->trigger = CAPTURE_TRIGGER_CHANGE;
+    return !value;
+  }
+  if (!value || !console_arg_uint(value, &target->trigger_value) || (target->trigger_value & ~number)){
+    return false;
+  }
+  if (strcmp(text, "level") == 0){
+    target->trigger = CAPTURE_TRIGGER_LEVEL;
+  } else if (strcmp(text, "edge") == 0){
+    target->trigger = CAPTURE_TRIGGER_EDGE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+//Picks the smallest power of two run of GPIOs covering the pins.
+static void fit_pins(capture_config *target){
+  uint lowest = __builtin_ctz(target->pins);
+  uint span = 32 - __builtin_clz(target->pins) - lowest;
+  uint width = 1;
+  while (width < span){
+    width <<= 1;
+  }
+  target->width = width;
+  target->base = lowest + width > 32 ? 32 - width : lowest;
+}
+
+//"cap arm <pins> <rate_hz> [trigger] [pre_percent]"
+static bool capture_arm(int argc, char *argv[]){
+  capture_config armed = {0};
+  uint32_t pre = CAPTURE_DEFAULT_PRE;
+  if ((argc < 3) || !console_arg_uint(argv[1], &armed.pins) || !console_arg_uint(argv[2], &armed.rate_hz)){
+    return false;
+  }
+  if (!armed.pins || (armed.pins & ~CAPTURE_GPIO_MASK)){
+    return false;
+  }
+  if ((argc > 3) && !parse_trigger(argv[3], &armed)){
+    return false;
+  }
+  if ((argc > 4) && (!console_arg_uint(argv[4], &pre) || (pre > 100))){
+    return false;
+  }
+  fit_pins(&armed);
+  if (armed.trigger == CAPTURE_TRIGGER_NONE){
+    pre = 0;
+  }
+  armed.pre_words = CAPTURE_WORDS*pre/100;
+  armed.post_words = CAPTURE_WORDS - armed.pre_words;
+  capture_stop_request = true;
+  while ((capture_status != CAPTURE_IDLE) && (capture_status != CAPTURE_DONE)){
+    capture_hw_poll();
+  }
+  capture_hw_release();
+  config = armed;
+  capture_stop_request = false;
+  capture_status = CAPTURE_FILLING;
+  if (!capture_hw_start(&config)){
+    capture_status = CAPTURE_IDLE;
+    console_printf("Capture: rate not possible\n");
+    return false;
+  }
+  console_printf("Capture: GPIO%u-%u at %luHz\n", config.base, config.base + config.width - 1, config.rate_hz);
+  return true;
+}
+
+//"cap read" sends the header, "cap read N" chunk N of the data.
+static bool capture_read(int argc, char *argv[]){
+  if (capture_status != CAPTURE_DONE){
+    console_printf("Capture: nothing to read\n");
+    return false;
+  }
+  if (argc == 1){
+    binary_frame("LAH1", &header, sizeof(header));
+    return true;
+  }
+  uint32_t chunk;
+  if (!console_arg_uint(argv[1], &chunk) || (chunk*CAPTURE_CHUNK_BYTES >= header.data_bytes)){
+    return false;
+  }
+  uint32_t offset = chunk*CAPTURE_CHUNK_BYTES;
+  uint32_t length = header.data_bytes - offset;
+  length = length > CAPTURE_CHUNK_BYTES ? CAPTURE_CHUNK_BYTES : length;
+  binary_frame_begin("LAD1", sizeof(chunk) + length);
+  binary_frame_part(&chunk, sizeof(chunk));
+  if (header.format == CAPTURE_FORMAT_RLE){
+    binary_frame_part(&rle_data[offset], length);
+  } else {
+    //The raw words start at start_word and wrap around the ring
+    const uint8_t *ring = (const uint8_t *)capture_buffer;
+    uint32_t ring_offset = (start_word*4 + offset) % sizeof(capture_buffer);
+    uint32_t first = sizeof(capture_buffer) - ring_offset;
+    first = first > length ? length : first;
+    binary_frame_part(&ring[ring_offset], first);
+    binary_frame_part(ring, length - first);
+  }
+  binary_frame_end();
+  return true;
+}
+
+bool capture_command(int argc, char *argv[]){
+  if (strcmp(argv[0], "arm") == 0){
+    return capture_arm(argc, argv);
+  }
+  if ((strcmp(argv[0], "read") == 0) && (argc <= 2)){
+    return capture_read(argc, argv);
+  }
+  if ((strcmp(argv[0], "stop") == 0) && (argc == 1)){
+    if (capture_status != CAPTURE_IDLE){
+      capture_stop_request = true;
+    }
+    return true;
+  }
+  if ((strcmp(argv[0], "status") == 0) && (argc == 1)){
+    capture_state state = capture_status;
+    console_printf("Capture: %s", state_names[state]);
+    if (state == CAPTURE_DONE){
+      console_printf(", %lu samples, %lu bytes", header.samples, header.data_bytes);
+      if (header.trigger_sample != CAPTURE_NO_TRIGGER){
+        console_printf(", trigger at %lu", header.trigger_sample);
+      }
+    }
+    console_printf("\n");
+    return true;
+  }
+  return false;
+}
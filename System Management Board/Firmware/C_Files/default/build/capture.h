@@ -0,0 +1,60 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "pico/stdlib.h"
+
+//Logic analyzer on the board's own GPIOs, for looking at the Jetson
+//handshake without an external analyzer. The state machine keeps
+//running while a capture is armed. Driven from the console:
+//
+//  cap arm <pins> <rate_hz> [trigger] [pre_percent]
+//  cap status
+//  cap read [chunk]
+//  cap stop
+//
+//trigger is none, rise:<gpio>, fall:<gpio>, change:<mask>,
+//level:<mask>=<value> or edge:<mask>=<value>, and pre_percent (default
+//10) is how much of the buffer is kept from before it.
+//
+//"cap read" sends the "LAH1" header frame and "cap read N" the "LAD1"
+//frame with chunk N of the data, so no single reply holds up the main
+//loop for long. All fields are little endian.
+#define CAPTURE_VERSION 1
+#define CAPTURE_CHUNK_BYTES 2048
+
+typedef enum capture_format{
+  //The packed sample words as captured
+  CAPTURE_FORMAT_RAW,
+  //Runs: the sample masked to pins (width/8 rounded up bytes) then
+  //the run length as an unsigned LEB128
+  CAPTURE_FORMAT_RLE,
+} capture_format;
+
+//Payload of the "LAH1" frame. Sample values are the GPIO bank shifted
+//down by base, so bit i is GPIO base+i.
+typedef struct capture_header{
+  uint8_t version;
+  uint8_t format;
+  uint8_t base;
+  uint8_t width;
+  uint32_t pins;
+  uint32_t rate_hz;
+  uint32_t samples;
+  //Sample index of the trigger, 0xffffffff for none
+  uint32_t trigger_sample;
+  uint32_t data_bytes;
+  uint16_t chunk_bytes;
+  uint8_t trigger;
+  uint8_t reserved;
+  uint32_t trigger_mask;
+  uint32_t trigger_value;
+} capture_header;
+
+//Keeps a capture moving, call from the main loop.
+void capture_poll();
+//A capture is armed and not finished yet.
+bool capture_running();
+//The "cap" command, argv[0] is the subcommand.
+bool capture_command(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef CAPTURE_HW_H
+#define CAPTURE_HW_H
+
+#include "pico/stdlib.h"
+
+//Between capture.c and the part that does the sampling: capture_pio.c
+//on the board (PIO, DMA and core 1), or a stand-in in the emulator.
+//
+//Samples are width bits of the GPIO bank starting at base, packed
+//32/width to a word with the oldest in the low bits, into a ring of
+//CAPTURE_WORDS words.
+#define CAPTURE_WORDS 8192
+#define CAPTURE_NO_TRIGGER 0xffffffff
+
+typedef enum capture_trigger{
+  //Capture a full buffer straight away
+  CAPTURE_TRIGGER_NONE,
+  //(pins & mask) == value, including when it already is at arming
+  CAPTURE_TRIGGER_LEVEL,
+  //(pins & mask) == value starts to hold
+  CAPTURE_TRIGGER_EDGE,
+  //Any pin in mask changes
+  CAPTURE_TRIGGER_CHANGE,
+} capture_trigger;
+
+typedef enum capture_state{
+  CAPTURE_IDLE,
+  //Filling the pre-trigger part of the buffer
+  CAPTURE_FILLING,
+  CAPTURE_WAITING,
+  //Filling the rest after the trigger, then encoding
+  CAPTURE_TRIGGERED,
+  CAPTURE_DONE,
+} capture_state;
+
+typedef struct capture_config{
+  uint32_t pins;
+  uint8_t base;
+  uint8_t width;
+  uint32_t rate_hz;
+  capture_trigger trigger;
+  uint32_t trigger_mask;
+  uint32_t trigger_value;
+  //Words kept before the trigger and captured after it
+  uint32_t pre_words;
+  uint32_t post_words;
+} capture_config;
+
+extern uint32_t capture_buffer[CAPTURE_WORDS];
+//Written by whichever core samples, read by the console
+extern volatile capture_state capture_status;
+//Set by "cap stop", the sampler ends the capture early with what it has
+extern volatile bool capture_stop_request;
+
+//Whether the pins fire the trigger, given the pins one sample earlier.
+static inline bool capture_trigger_hit(const capture_config *config, uint32_t previous, uint32_t pins){
+  bool was = (previous & config->trigger_mask) == config->trigger_value;
+  bool is = (pins & config->trigger_mask) == config->trigger_value;
+  switch (config->trigger){
+    case CAPTURE_TRIGGER_LEVEL: return is;
+    case CAPTURE_TRIGGER_EDGE: return is && !was;
+    case CAPTURE_TRIGGER_CHANGE: return ((previous ^ pins) & config->trigger_mask) != 0;
+    default: return true;
+  }
+}
+
+//Starts sampling. rate_hz is changed to the nearest rate the sampler
+//can do, and false returned if it is out of its range.
+bool capture_hw_start(capture_config *config);
+//Called from the main loop, for samplers that need the CPU.
+void capture_hw_poll();
+//Frees what the last capture claimed, if anything.
+void capture_hw_release();
+//Keeps the sampler off flash while it is erased or programmed. A
+//running capture goes on in hardware but is not watched until
+//capture_hw_resume, so it loses count if the ring laps meanwhile.
+void capture_hw_hold();
+void capture_hw_resume();
+
+//Called by the sampler once it has stopped. end_word is the ring index
+//after the last word written, words how many before it are valid and
+//trigger_word the ring index the trigger was seen at, or
+//CAPTURE_NO_TRIGGER.
+void capture_hw_done(uint32_t end_word, uint32_t words, uint32_t trigger_word);
+
+#endif
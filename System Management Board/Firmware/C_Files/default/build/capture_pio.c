@@ -0,0 +1,194 @@
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/structs/sio.h"
+#include "capture_hw.h"
+
+//Sampler for the logic analyzer. A one instruction PIO program,
+//"in pins, width" with autopush, takes a sample every divided system
+//clock. One DMA channel moves the words into the ring and a second
+//one restarts it at the top of the ring each time it finishes, so
+//the CPU is not involved. Core 1 watches the GPIOs for the trigger
+//and stops everything once enough words have come in after it.
+#define CAPTURE_PIO pio1
+//The DMA can move about one word every 4 system clocks with the rest
+//of the system running
+#define CAPTURE_MAX_WORD_DIVIDER 4
+
+static capture_config active;
+static uint16_t program_instructions[1];
+static const struct pio_program program = {program_instructions, 1, -1};
+static int program_offset = -1;
+static int sm = -1;
+static int data_channel = -1;
+static int control_channel = -1;
+//What the control channel writes to the data channel's write address
+static uint32_t *ring_start = capture_buffer;
+//Core 1 is in capture_watch and answers the multicore lockout
+static volatile bool watching = false;
+//capture_hw_hold locked core 1 out rather than parking it
+static bool held = false;
+
+static inline uint32_t __not_in_flash_func(write_index)(){
+  uint32_t *address = (uint32_t *)dma_hw->ch[data_channel].write_addr;
+  return (uint32_t)(address - capture_buffer) % CAPTURE_WORDS;
+}
+
+//Core 1. Counts the words written by how far the DMA write address
+//has moved, which works as long as it is read more than once per
+//lap of the ring, and runs from SRAM so it does not wait on flash
+//behind core 0.
+static void __not_in_flash_func(capture_watch)(){
+  multicore_lockout_victim_init();
+  watching = true;
+  uint32_t last = 0;
+  uint32_t total = 0;
+  uint32_t trigger_word = CAPTURE_NO_TRIGGER;
+  uint32_t trigger_total = 0;
+  dma_channel_start(data_channel);
+  pio_sm_set_enabled(CAPTURE_PIO, sm, true);
+  if (active.trigger == CAPTURE_TRIGGER_NONE){
+    capture_status = CAPTURE_TRIGGERED;
+  }
+  uint32_t previous = sio_hw->gpio_in;
+  while (!capture_stop_request){
+    uint32_t index = write_index();
+    total += (index + CAPTURE_WORDS - last) % CAPTURE_WORDS;
+    last = index;
+    uint32_t pins = sio_hw->gpio_in;
+    if (capture_status == CAPTURE_FILLING){
+      if (total >= active.pre_words){
+        capture_status = CAPTURE_WAITING;
+      }
+    } else if (capture_status == CAPTURE_WAITING){
+      if (capture_trigger_hit(&active, previous, pins)){
+        trigger_word = index;
+        trigger_total = total;
+        capture_status = CAPTURE_TRIGGERED;
+      }
+    } else if (total - trigger_total >= active.post_words){
+      break;
+    }
+    previous = pins;
+  }
+  //Let the DMA empty the FIFO, then stop it. Chaining is turned off
+  //first as aborting a channel can still start the one it chains to
+  //(RP2040-E13).
+  pio_sm_set_enabled(CAPTURE_PIO, sm, false);
+  while (!pio_sm_is_rx_fifo_empty(CAPTURE_PIO, sm)){
+  }
+  hw_write_masked(&dma_hw->ch[data_channel].al1_ctrl, (uint)data_channel << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB,
+    DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS);
+  dma_channel_abort(control_channel);
+  dma_channel_abort(data_channel);
+  uint32_t index = write_index();
+  total += (index + CAPTURE_WORDS - last) % CAPTURE_WORDS;
+  capture_hw_done(index, total < CAPTURE_WORDS ? total : CAPTURE_WORDS, trigger_word);
+  //Wait in SRAM, still answering the lockout, until the core is reset
+  while (true){
+    __wfe();
+  }
+}
+
+bool capture_hw_start(capture_config *config){
+  uint32_t sys_hz = clock_get_hz(clk_sys);
+  if ((config->rate_hz == 0) || (config->rate_hz > sys_hz)){
+    return false;
+  }
+  if ((uint64_t)config->rate_hz*config->width > (uint64_t)sys_hz*32/CAPTURE_MAX_WORD_DIVIDER){
+    return false;
+  }
+  //Clock divider in 1/256ths, 1.0 to 65535.99
+  uint32_t divider = (uint32_t)(((uint64_t)sys_hz*256)/config->rate_hz);
+  if (divider >= (65536u << 8)){
+    return false;
+  }
+  divider = divider < 256 ? 256 : divider;
+  config->rate_hz = (uint32_t)(((uint64_t)sys_hz*256)/divider);
+  active = *config;
+
+  program_instructions[0] = pio_encode_in(pio_pins, config->width);
+  if (!pio_can_add_program(CAPTURE_PIO, &program)){
+    return false;
+  }
+  sm = pio_claim_unused_sm(CAPTURE_PIO, false);
+  if (sm < 0){
+    return false;
+  }
+  program_offset = pio_add_program(CAPTURE_PIO, &program);
+  pio_sm_config sm_config = pio_get_default_sm_config();
+  sm_config_set_in_pins(&sm_config, config->base);
+  sm_config_set_wrap(&sm_config, program_offset, program_offset);
+  sm_config_set_clkdiv_int_frac(&sm_config, divider >> 8, divider & 0xff);
+  //Shifting right puts the oldest sample in the low bits
+  sm_config_set_in_shift(&sm_config, true, true, 32);
+  sm_config_set_fifo_join(&sm_config, PIO_FIFO_JOIN_RX);
+  pio_sm_init(CAPTURE_PIO, sm, program_offset, &sm_config);
+
+  data_channel = dma_claim_unused_channel(true);
+  control_channel = dma_claim_unused_channel(true);
+  dma_channel_config data_config = dma_channel_get_default_config(data_channel);
+  channel_config_set_transfer_data_size(&data_config, DMA_SIZE_32);
+  channel_config_set_read_increment(&data_config, false);
+  channel_config_set_write_increment(&data_config, true);
+  channel_config_set_dreq(&data_config, pio_get_dreq(CAPTURE_PIO, sm, false));
+  channel_config_set_chain_to(&data_config, control_channel);
+  dma_channel_configure(data_channel, &data_config, capture_buffer, &CAPTURE_PIO->rxf[sm], CAPTURE_WORDS, false);
+  dma_channel_config control_config = dma_channel_get_default_config(control_channel);
+  channel_config_set_transfer_data_size(&control_config, DMA_SIZE_32);
+  channel_config_set_read_increment(&control_config, false);
+  channel_config_set_write_increment(&control_config, false);
+  dma_channel_configure(control_channel, &control_config, &dma_hw->ch[data_channel].al2_write_addr_trig,
+    &ring_start, 1, false);
+
+  multicore_reset_core1();
+  multicore_launch_core1(capture_watch);
+  //Until then capture_hw_hold could not stop it
+  while (!watching){
+  }
+  return true;
+}
+
+//Everything happens on core 1 and in hardware.
+void capture_hw_poll(){
+}
+
+void capture_hw_release(){
+  multicore_reset_core1();
+  watching = false;
+  if (sm >= 0){
+    pio_sm_set_enabled(CAPTURE_PIO, sm, false);
+    pio_sm_unclaim(CAPTURE_PIO, sm);
+    sm = -1;
+  }
+  if (program_offset >= 0){
+    pio_remove_program(CAPTURE_PIO, &program, program_offset);
+    program_offset = -1;
+  }
+  if (data_channel >= 0){
+    dma_channel_unclaim(data_channel);
+    dma_channel_unclaim(control_channel);
+    data_channel = control_channel = -1;
+  }
+}
+
+//A watching core 1 is paused in SRAM by the lockout, otherwise it is
+//parked by a reset.
+void capture_hw_hold(){
+  held = watching;
+  if (held){
+    multicore_lockout_start_blocking();
+  } else {
+    multicore_reset_core1();
+  }
+}
+
+void capture_hw_resume(){
+  if (held){
+    multicore_lockout_end_blocking();
+    held = false;
+  }
+}
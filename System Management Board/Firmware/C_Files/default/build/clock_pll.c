@@ -0,0 +1,90 @@
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/uart.h"
+#include "clock_policy.h"
+
+//Clock backend for the board. clocks_init leaves clk_sys and clk_peri
+//on the system PLL at 125MHz and clk_usb, clk_adc and clk_rtc on the
+//USB PLL. From then on clk_peri is on the USB PLL too, which runs in
+//every profile but the crystal, and the system PLL only runs for the
+//full profile.
+
+#define USB_PLL_HZ (48*MHZ)
+
+static uart_inst_t *const uarts[] = {uart0, uart1};
+static uint bauds[2];
+static clock_profile applied = CLOCK_FULL;
+
+//Baud rate a UART is set to from the divisors and clk_peri, 0 if it
+//is not set up.
+static uint uart_baud(uart_inst_t *uart){
+  uart_hw_t *hw = uart_get_hw(uart);
+  if (!hw->ibrd){
+    return 0;
+  }
+  return (uint)(4ull*clock_get_hz(clk_peri)/(64*hw->ibrd + hw->fbrd));
+}
+
+//A UART keeps its baud rate over a change of clk_peri. What is still
+//being sent goes out first, at the old rate.
+static void save_bauds(){
+  for (int i = 0; i < 2; i++){
+    bauds[i] = uart_baud(uarts[i]);
+    if (bauds[i]){
+      uart_tx_wait_blocking(uarts[i]);
+    }
+  }
+}
+
+static void restore_bauds(){
+  for (int i = 0; i < 2; i++){
+    if (bauds[i]){
+      uart_set_baudrate(uarts[i], bauds[i]);
+    }
+  }
+}
+
+static void peripherals_from_usb_pll(){
+  clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_PLL_HZ, USB_PLL_HZ);
+}
+
+void clock_policy_hw_init(){
+  save_bauds();
+  peripherals_from_usb_pll();
+  restore_bauds();
+}
+
+void clock_policy_hw_apply(clock_profile profile){
+  uint32_t xosc_hz = XOSC_MHZ*MHZ;
+  save_bauds();
+  if (profile == CLOCK_CRYSTAL){
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, 0, xosc_hz, xosc_hz);
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, xosc_hz, xosc_hz);
+    clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, xosc_hz, xosc_hz);
+    clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, xosc_hz, 46875);
+    clock_stop(clk_usb);
+    pll_deinit(pll_sys);
+    pll_deinit(pll_usb);
+  } else {
+    if (applied == CLOCK_CRYSTAL){
+      //The same as clocks_init
+      pll_init(pll_usb, 1, 480*MHZ, 5, 2);
+      clock_configure(clk_usb, 0, CLOCKS_CLK_USB_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_PLL_HZ, USB_PLL_HZ);
+      clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_PLL_HZ, USB_PLL_HZ);
+      clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_PLL_HZ, 46875);
+      peripherals_from_usb_pll();
+    }
+    if (profile == CLOCK_FULL){
+      pll_init(pll_sys, 1, 1500*MHZ, 6, 2);
+      clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, CLOCK_FULL_KHZ*KHZ, CLOCK_FULL_KHZ*KHZ);
+    } else {
+      clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_PLL_HZ, USB_PLL_HZ);
+      pll_deinit(pll_sys);
+    }
+  }
+  restore_bauds();
+  applied = profile;
+}
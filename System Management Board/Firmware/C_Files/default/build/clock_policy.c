@@ -0,0 +1,52 @@
+#include "pico/stdlib.h"
+#include "clock_policy.h"
+#include "console.h"
+#include "probe.h"
+
+static clock_profile current = CLOCK_FULL;
+//When the current profile was switched to
+static uint64_t since;
+static uint64_t time_in[CLOCK_PROFILE_COUNT];
+static uint32_t switches, worst_switch_us;
+
+static const char *const profile_names[] = {"full", "monitor", "crystal"};
+static const uint32_t profile_khz[] = {CLOCK_FULL_KHZ, CLOCK_MONITOR_KHZ, CLOCK_CRYSTAL_KHZ};
+
+void clock_policy_init(){
+  since = time_us_64();
+  clock_policy_hw_init();
+}
+
+void clock_policy_set(clock_profile profile){
+  if (profile == current){
+    return;
+  }
+  uint64_t start = time_us_64();
+  time_in[current] += start - since;
+  clock_policy_hw_apply(profile);
+  probe_clock_changed();
+  since = time_us_64();
+  if (since - start > worst_switch_us){
+    worst_switch_us = (uint32_t)(since - start);
+  }
+  current = profile;
+  switches++;
+}
+
+clock_profile clock_policy_current(){
+  return current;
+}
+
+uint64_t clock_policy_time_us(clock_profile profile){
+  return time_in[profile] + (profile == current ? time_us_64() - since : 0);
+}
+
+bool clock_policy_command(int argc, char *argv[]){
+  console_printf("Clock: %s at %lu kHz, %lu switches, worst %lu us\n", profile_names[current], profile_khz[current],
+    switches, worst_switch_us);
+  for (int profile = 0; profile < CLOCK_PROFILE_COUNT; profile++){
+    console_printf("Clock: %s %lu kHz %lu s\n", profile_names[profile], profile_khz[profile],
+      (uint32_t)(clock_policy_time_us((clock_profile)profile)/1000000));
+  }
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef CLOCK_POLICY_H
+#define CLOCK_POLICY_H
+
+#include "pico/stdlib.h"
+
+//Clock profiles for the lifecycle phases. Watching the key and the
+//Jetson pins needs a fraction of 125MHz, so the main loop asks for the
+//monitor profile whenever nothing faster is under way, and for full
+//speed in a shutdown, a debug session, a capture or an update. The
+//crystal profile is standby's, see standby.h.
+//
+//clk_peri and clk_adc stay at 48MHz from the USB PLL in the full and
+//monitor profiles, so the UART baud rates and ADC timing do not move
+//when clk_sys does. Only the crystal profile changes them, and the
+//UART divisors are set again to match.
+//
+//  clk
+//
+//prints the profile in use, how often it changed and the time spent
+//in each.
+typedef enum clock_profile{
+  //125MHz from the system PLL
+  CLOCK_FULL,
+  //48MHz from the USB PLL, the system PLL off
+  CLOCK_MONITOR,
+  //12MHz from the crystal, both PLLs and USB off
+  CLOCK_CRYSTAL,
+  CLOCK_PROFILE_COUNT
+} clock_profile;
+
+#define CLOCK_FULL_KHZ 125000
+#define CLOCK_MONITOR_KHZ 48000
+#define CLOCK_CRYSTAL_KHZ 12000
+
+//RP2040 supply current in each profile in microamps, for the budget
+//"sby" prints. Estimates from the RP2040 and Pico datasheets, not
+//measured on this board.
+#define CLOCK_FULL_UA 25000
+#define CLOCK_MONITOR_UA 12000
+#define CLOCK_CRYSTAL_UA 4000
+
+//Moves clk_peri and clk_adc to the USB PLL. Call once at boot, before
+//the UARTs are set up.
+void clock_policy_init();
+//Switches to profile if it is not the one in use. Not while a
+//capture is running, its sample clock is divided from clk_sys.
+void clock_policy_set(clock_profile profile);
+clock_profile clock_policy_current();
+//Time spent in profile since boot, the current stretch included.
+uint64_t clock_policy_time_us(clock_profile profile);
+//The "clk" command.
+bool clock_policy_command(int argc, char *argv[]);
+
+//Clock backend, clock_pll.c on the board.
+void clock_policy_hw_init();
+void clock_policy_hw_apply(clock_profile profile);
+
+#endif
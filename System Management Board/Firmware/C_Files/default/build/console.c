@@ -0,0 +1,259 @@
+#include "stdio.h"
+#include "stdarg.h"
+#include "string.h"
+#include "pico/stdlib.h"
+#include "console.h"
+#include "hot_path.h"
+#include "probe.h"
+
+#define CONSOLE_PRINTF_MAX 256
+
+//The console whose command is running, so handlers can answer on
+//the port the command came in on without being told which one.
+static console *active = NULL;
+static char printf_buffer[CONSOLE_PRINTF_MAX];
+
+void console_init(console *con, const console_command *commands, size_t command_count,
+  int (*read)(void), void (*write)(const char *text, size_t length)){
+  con->commands = commands;
+  con->command_count = command_count;
+  con->read = read;
+  con->write = write;
+  con->length = 0;
+  con->overflow = false;
+  con->last_char_us = 0;
+}
+
+//Swaps the command table, for example when entering debug mode.
+//Anything already buffered is parsed with the new table.
+void console_set_commands(console *con, const console_command *commands, size_t command_count){
+  con->commands = commands;
+  con->command_count = command_count;
+}
+
+int console_stdio_read(){
+  return getchar_timeout_us(0);
+}
+
+void console_stdio_write(const char *text, size_t length){
+  fwrite(text, 1, length, stdout);
+}
+
+//Writes to the port of the running command, or stdio otherwise.
+void console_write(const char *text, size_t length){
+  if (active){
+    active->write(text, length);
+  } else {
+    console_stdio_write(text, length);
+  }
+}
+
+//printf into a fixed buffer, longer output is cut short.
+void console_printf(const char *format, ...){
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(printf_buffer, CONSOLE_PRINTF_MAX, format, args);
+  va_end(args);
+  if (length < 0){
+    return;
+  }
+  if (length >= CONSOLE_PRINTF_MAX){
+    length = CONSOLE_PRINTF_MAX-1;
+  }
+  console_write(printf_buffer, length);
+}
+
+//Parses a decimal or 0x-prefixed hex number.
+bool console_arg_uint(const char *arg, uint32_t *value){
+  uint32_t result = 0;
+  int base = 10;
+  if ((arg[0] == '0') && ((arg[1] == 'x') || (arg[1] == 'X'))){
+    base = 16;
+    arg += 2;
+  }
+  if (*arg == 0){
+    return false;
+  }
+  for (; *arg; arg++){
+    int digit;
+    if ((*arg >= '0') && (*arg <= '9')){
+      digit = *arg - '0';
+    } else if ((base == 16) && (*arg >= 'a') && (*arg <= 'f')){
+      digit = *arg - 'a' + 10;
+    } else if ((base == 16) && (*arg >= 'A') && (*arg <= 'F')){
+      digit = *arg - 'A' + 10;
+    } else {
+      return false;
+    }
+    result = result*base + digit;
+  }
+  *value = result;
+  return true;
+}
+
+//Parses exactly count characters of '0'/'1', MSB first, like "001".
+bool console_arg_bits(const char *arg, int count, uint32_t *value){
+  uint32_t result = 0;
+  for (int i = 0; i < count; i++){
+    if ((arg[i] != '0') && (arg[i] != '1')){
+      return false;
+    }
+    result = (result << 1) | (arg[i] - '0');
+  }
+  if (arg[count] != 0){
+    return false;
+  }
+  *value = result;
+  return true;
+}
+
+static const console_command *find_command(console *con, const char *name){
+  for (size_t i = 0; i < con->command_count; i++){
+    if (strcmp(con->commands[i].name, name) == 0){
+      return &con->commands[i];
+    }
+  }
+  return NULL;
+}
+
+//Finds a single-letter command for the compact forms like "O001".
+static const console_command *find_letter(console *con, char letter){
+  for (size_t i = 0; i < con->command_count; i++){
+    const char *name = con->commands[i].name;
+    if ((name[0] == letter) && (name[1] == 0)){
+      return &con->commands[i];
+    }
+  }
+  return NULL;
+}
+
+static void HOT_FUNC(execute)(console *con, const console_command *cmd, int argc, char *argv[]){
+  PROBE_SCOPE(PROBE_PARSER);
+  active = con;
+  if ((argc < cmd->min_args) || (argc > cmd->max_args)){
+    console_printf("Error \"%s\": expected %d to %d arguments\n", cmd->name, cmd->min_args, cmd->max_args);
+  } else if (!cmd->handler(argc, argv, cmd->param)){
+    console_printf("Error \"%s\": invalid arguments\n", cmd->name);
+  } else {
+    console_printf("Input \"%s\": done\n", cmd->name);
+  }
+  active = NULL;
+}
+
+//Runs one command and its arguments. A name that is not in the table
+//is read as the compact form: single-letter commands without
+//arguments can be run together ("MSC"), and for a letter that takes
+//arguments the rest of the word is its first one ("O001", "V3").
+static void HOT_FUNC(run_command)(console *con, int argc, char *argv[]){
+  char *name = argv[0];
+  //"#tag" is echoed back as is. Host tools append one to each request
+  //so they can tell where its replies end.
+  if (name[0] == '#'){
+    active = con;
+    console_printf("%s\n", name);
+    active = NULL;
+    return;
+  }
+  const console_command *cmd = find_command(con, name);
+  if (cmd){
+    execute(con, cmd, argc-1, argv+1);
+    return;
+  }
+  while (*name){
+    cmd = find_letter(con, *name);
+    if (!cmd){
+      active = con;
+      console_printf("Error \"%s\": unknown command\n", name);
+      active = NULL;
+      return;
+    }
+    if (name[1] == 0){
+      execute(con, cmd, argc-1, argv+1);
+      return;
+    }
+    if (cmd->max_args == 0){
+      char *args[1] = {NULL};
+      execute(con, cmd, 0, args);
+      name++;
+    } else {
+      argv[0] = name+1;
+      execute(con, cmd, argc, argv);
+      return;
+    }
+  }
+}
+
+//Splits the line in place. Commands are separated by ';' and their
+//arguments by spaces, tabs or commas.
+static void HOT_FUNC(run_line)(console *con){
+  con->line[con->length] = 0;
+  if (con->overflow){
+    active = con;
+    console_printf("Error: line longer than %d characters\n", CONSOLE_LINE_MAX-1);
+    active = NULL;
+  } else {
+    char *cursor = con->line;
+    while (*cursor){
+      char *argv[CONSOLE_MAX_ARGS+1];
+      int argc = 0;
+      bool too_many = false;
+      while (*cursor && (*cursor != ';')){
+        while ((*cursor == ' ') || (*cursor == '\t') || (*cursor == ',')){
+          *cursor++ = 0;
+        }
+        if ((*cursor == 0) || (*cursor == ';')){
+          break;
+        }
+        if (argc <= CONSOLE_MAX_ARGS){
+          argv[argc++] = cursor;
+        } else {
+          too_many = true;
+        }
+        while (*cursor && (*cursor != ';') && (*cursor != ' ') && (*cursor != '\t') && (*cursor != ',')){
+          cursor++;
+        }
+      }
+      if (*cursor == ';'){
+        *cursor++ = 0;
+      }
+      if (too_many){
+        active = con;
+        console_printf("Error \"%s\": too many arguments\n", argv[0]);
+        active = NULL;
+      } else if (argc > 0){
+        run_command(con, argc, argv);
+      }
+    }
+  }
+  con->length = 0;
+  con->overflow = false;
+}
+
+//Adds one character to the line and runs the line on a terminator.
+void HOT_FUNC(console_feed)(console *con, int input_char){
+  con->last_char_us = time_us_64();
+  if ((input_char == '\n') || (input_char == '\r')){
+    if (con->length || con->overflow){
+      run_line(con);
+    }
+  } else if (con->length < (CONSOLE_LINE_MAX-1)){
+    con->line[con->length++] = (char)input_char;
+  } else {
+    con->overflow = true;
+  }
+}
+
+//Takes whatever the port has waiting without blocking, then runs a
+//partial line that has been idle long enough.
+void HOT_FUNC(console_poll)(console *con){
+  for (int i = 0; i < CONSOLE_POLL_MAX; i++){
+    int input_char = con->read();
+    if (input_char < 0){
+      break;
+    }
+    console_feed(con, input_char);
+  }
+  if ((con->length || con->overflow) && ((time_us_64() - con->last_char_us) > CONSOLE_IDLE_US)){
+    run_line(con);
+  }
+}
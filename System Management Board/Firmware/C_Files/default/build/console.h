@@ -0,0 +1,53 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "pico/stdlib.h"
+
+#define CONSOLE_LINE_MAX 128
+#define CONSOLE_MAX_ARGS 6
+//Most characters taken from the port per console_poll call
+#define CONSOLE_POLL_MAX 64
+//A partial line with no terminator is run after this much silence,
+//so single characters typed into a terminal still work.
+#define CONSOLE_IDLE_US 50000
+
+//Handlers get the arguments after the command name and the param
+//from their table entry. Returning false reports bad arguments.
+typedef bool (*console_handler)(int argc, char *argv[], int param);
+
+typedef struct console_command{
+  const char *name;
+  uint8_t min_args;
+  uint8_t max_args;
+  console_handler handler;
+  int param;
+} console_command;
+
+//One console per port. read returns a character or a negative
+//value when nothing is waiting, and must not block.
+typedef struct console{
+  const console_command *commands;
+  size_t command_count;
+  int (*read)(void);
+  void (*write)(const char *text, size_t length);
+  char line[CONSOLE_LINE_MAX];
+  size_t length;
+  bool overflow;
+  uint64_t last_char_us;
+} console;
+
+void console_init(console *con, const console_command *commands, size_t command_count,
+  int (*read)(void), void (*write)(const char *text, size_t length));
+void console_set_commands(console *con, const console_command *commands, size_t command_count);
+void console_poll(console *con);
+void console_feed(console *con, int input_char);
+void console_printf(const char *format, ...);
+void console_write(const char *text, size_t length);
+
+int console_stdio_read();
+void console_stdio_write(const char *text, size_t length);
+
+bool console_arg_uint(const char *arg, uint32_t *value);
+bool console_arg_bits(const char *arg, int count, uint32_t *value);
+
+#endif
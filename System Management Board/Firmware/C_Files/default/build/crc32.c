@@ -0,0 +1,16 @@
+#include "pico/stdlib.h"
+#include "crc32.h"
+
+//Bitwise version. It is slower than a table but costs no flash or
+//RAM, and nothing that uses it is time critical.
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length){
+  const uint8_t *bytes = (const uint8_t *)data;
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++){
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; bit++){
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include "pico/stdlib.h"
+
+//Standard CRC-32 (IEEE 802.3, reflected, as used by zlib). Pass 0
+//as crc for the first block and the previous result to continue.
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+
+//The M0+ has no cycle counter, so SysTick is left free running
+//from the processor clock as one. It is 24 bits and counts down.
+#define CYCLES_MASK 0x00ffffff
+
+static inline void cycles_init(){
+  systick_hw->csr = 0;
+  systick_hw->rvr = CYCLES_MASK;
+  systick_hw->cvr = 0;
+  //ENABLE and CLKSOURCE = processor clock, no interrupt
+  systick_hw->csr = 0x5;
+}
+
+static inline uint32_t cycles_now(){
+  return systick_hw->cvr;
+}
+
+//Cycles elapsed since start. Only valid below 2^24 cycles,
+//about 134ms at 125MHz.
+static inline uint32_t cycles_since(uint32_t start){
+  return (start - systick_hw->cvr) & CYCLES_MASK;
+}
+
+#endif
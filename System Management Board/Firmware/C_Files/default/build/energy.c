@@ -0,0 +1,73 @@
+#include "stdio.h"
+#include "pico/stdlib.h"
+#include "energy.h"
+#include "energy_model.h"
+#include "settings.h"
+#include "console.h"
+#include "hot_path.h"
+
+static uint64_t next_sample;
+static energy_model model;
+static bool started;
+
+bool HOT_FUNC(energy_due)(uint64_t now){
+  if (now < next_sample){
+    return false;
+  }
+  next_sample = now + ENERGY_SAMPLE_US;
+  return true;
+}
+
+//A monitor reads below zero with its regulator off.
+static uint32_t monitor_ma(double amps){
+  return amps > 0 ? (uint32_t)(amps*1000.0) : 0;
+}
+
+void energy_sample(uint64_t now, uint32_t counts, double comp_amps, double switch_amps){
+  if (!started){
+    energy_model_reset(&model);
+    started = true;
+  }
+  uint32_t load_ma = ENERGY_BASE_MA + monitor_ma(comp_amps) + monitor_ma(switch_amps);
+  energy_model_add(&model, (uint32_t)(now/1000), counts, load_ma, settings.tte_empty);
+}
+
+uint32_t energy_tte_ms(){
+  return started ? model.tte_ms : ENERGY_UNKNOWN;
+}
+
+bool energy_enabled(){
+  return settings.tte_reserve != 0;
+}
+
+uint64_t HOT_FUNC(energy_shutdown_delay)(uint64_t waited){
+  if (!energy_enabled()){
+    return settings.shutdown_delay;
+  }
+  uint64_t longest = settings.tte_hold > settings.shutdown_delay ? settings.tte_hold : settings.shutdown_delay;
+  uint32_t tte_ms = energy_tte_ms();
+  if ((tte_ms != ENERGY_UNKNOWN) && ((uint64_t)tte_ms*1000 <= settings.tte_reserve)){
+    return waited ? waited - 1 : 0;
+  }
+  return longest;
+}
+
+bool energy_command(int argc, char *argv[]){
+  uint32_t last = model.counts[(model.next + ENERGY_WINDOW - 1) % ENERGY_WINDOW];
+  console_printf("Energy: read %lu counts, level %lu falling %.1f counts/s, load %lu mA, ", last,
+    (uint32_t)(model.level + 0.5), model.fall == 0 ? 0.0 : model.fall, model.load_ma_now);
+  uint32_t tte_ms = energy_tte_ms();
+  if (tte_ms == ENERGY_UNKNOWN){
+    console_printf("time to empty unknown\n");
+  } else {
+    console_printf("time to empty %lu ms\n", tte_ms);
+  }
+  if (energy_enabled()){
+    uint64_t longest = settings.tte_hold > settings.shutdown_delay ? settings.tte_hold : settings.shutdown_delay;
+    console_printf("Energy: shutdown signal at %lu ms left, or after %lu ms\n",
+      (uint32_t)(settings.tte_reserve/1000), (uint32_t)(longest/1000));
+  } else {
+    console_printf("Energy: shutdown signal after shutdown_delay\n");
+  }
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include "pico/stdlib.h"
+
+//Time-to-empty of the supply the board runs from, and the shutdown
+//signal timed by it. Every ENERGY_SAMPLE_US the supply is read on mux
+//input tte_mux and the load on the two current monitors, plus
+//ENERGY_BASE_MA for the board, the relay and what no monitor sees,
+//and energy_model.h works out how long until the supply is down to
+//tte_empty.
+//
+//With tte_reserve set, the shutdown signal no longer waits out
+//shutdown_delay regardless: it goes as soon as the time to empty is
+//below tte_reserve, the time the Jetson needs from the signal to
+//halted, and otherwise waits up to the longer of shutdown_delay and
+//tte_hold for the key to come back. A collapsing supply is signalled
+//straight away and a strong one rides out a longer loss. The power
+//button and the forced shutdown keep their times from the signal.
+//
+//  tte
+//
+//prints the last supply reading, the level and fall from the fitted
+//line, the load and the time to empty.
+#define ENERGY_SAMPLE_US 100000
+#define ENERGY_BASE_MA 200
+
+//True once ENERGY_SAMPLE_US has passed since the last sample.
+bool energy_due(uint64_t now);
+//Takes a raw reading of the supply and the two current monitors in
+//amps.
+void energy_sample(uint64_t now, uint32_t counts, double comp_amps, double switch_amps);
+//Estimated time to empty in ms, ENERGY_UNKNOWN if the supply is not
+//falling or there are too few readings yet.
+uint32_t energy_tte_ms();
+//Whether tte_reserve is set.
+bool energy_enabled();
+//Key off to the shutdown signal for a shutdown that has waited so far
+//without it: less than waited to signal now.
+uint64_t energy_shutdown_delay(uint64_t waited);
+//The "tte" command.
+bool energy_command(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,60 @@
+#include "string.h"
+#include "energy_model.h"
+
+void energy_model_reset(energy_model *model){
+  memset(model, 0, sizeof(*model));
+  model->tte_ms = ENERGY_UNKNOWN;
+}
+
+//Least squares line through the window, times taken from the oldest
+//reading so a wrap of time_ms does not matter.
+static void fit(energy_model *model){
+  uint32_t n = model->samples < ENERGY_WINDOW ? model->samples : ENERGY_WINDOW;
+  uint32_t oldest = model->samples < ENERGY_WINDOW ? 0 : model->next;
+  uint32_t newest = (model->next + ENERGY_WINDOW - 1) % ENERGY_WINDOW;
+  double sum_t = 0, sum_v = 0, sum_tt = 0, sum_tv = 0;
+  for (uint32_t i = 0; i < n; i++){
+    uint32_t at = (oldest + i) % ENERGY_WINDOW;
+    double t = (double)(uint32_t)(model->time_ms[at] - model->time_ms[oldest]);
+    double v = model->counts[at];
+    sum_t += t;
+    sum_v += v;
+    sum_tt += t*t;
+    sum_tv += t*v;
+  }
+  double spread = n*sum_tt - sum_t*sum_t;
+  double slope = spread > 0 ? (n*sum_tv - sum_t*sum_v)/spread : 0;
+  double newest_t = (double)(uint32_t)(model->time_ms[newest] - model->time_ms[oldest]);
+  model->level = sum_v/n + slope*(newest_t - sum_t/n);
+  model->fall = -slope*1000.0;
+}
+
+void energy_model_add(energy_model *model, uint32_t time_ms, uint32_t counts, uint32_t load_ma,
+  uint32_t empty_counts){
+  model->time_ms[model->next] = time_ms;
+  model->counts[model->next] = (uint16_t)counts;
+  model->load_ma[model->next] = load_ma;
+  model->next = (model->next + 1) % ENERGY_WINDOW;
+  model->samples++;
+  model->load_ma_now = load_ma;
+  fit(model);
+
+  //A supply that has already dropped out needs no window
+  if ((counts <= empty_counts) || (model->level <= empty_counts)){
+    model->tte_ms = 0;
+    return;
+  }
+  if ((model->samples < ENERGY_MIN_SAMPLES) || (model->fall < ENERGY_MIN_FALL)){
+    model->tte_ms = ENERGY_UNKNOWN;
+    return;
+  }
+  uint32_t n = model->samples < ENERGY_WINDOW ? model->samples : ENERGY_WINDOW;
+  double window_load = 0;
+  for (uint32_t i = 0; i < n; i++){
+    window_load += model->load_ma[i];
+  }
+  window_load /= n;
+  double scale = (load_ma && window_load) ? window_load/load_ma : 1.0;
+  double ms = (model->level - empty_counts)/model->fall*scale*1000.0;
+  model->tte_ms = ms >= (double)(ENERGY_UNKNOWN - 1) ? ENERGY_UNKNOWN - 1 : (uint32_t)ms;
+}
@@ -0,0 +1,49 @@
+#ifndef ENERGY_MODEL_H
+#define ENERGY_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Time-to-empty of the supply from its voltage trend and the load on
+//it. Plain C with no SDK calls, so the host replays recorded traces
+//through the same code (smbtte, see the Host README).
+//
+//A straight line is fitted to the last ENERGY_WINDOW supply readings,
+//which gives the level, taken from the line at the newest reading,
+//and how fast it is falling. A battery falls in proportion to the
+//charge taken out of it, so the fall is scaled by the load now over
+//the average load the window was taken at:
+//
+//  time to empty = (level - empty) / fall * (window load / load now)
+//
+//A load that was shed or a Jetson that has halted therefore stretches
+//the estimate straight away, rather than after a window of readings.
+#define ENERGY_WINDOW 32
+//Readings needed before there is an estimate
+#define ENERGY_MIN_SAMPLES 8
+//Slower than this, in counts per second, is taken as noise, not a fall
+#define ENERGY_MIN_FALL 1.0
+//No estimate, or a supply that is not falling
+#define ENERGY_UNKNOWN UINT32_MAX
+
+typedef struct energy_model{
+  //Readings, oldest at next once the window is full
+  uint32_t time_ms[ENERGY_WINDOW];
+  uint16_t counts[ENERGY_WINDOW];
+  uint32_t load_ma[ENERGY_WINDOW];
+  uint32_t samples;
+  uint32_t next;
+  //From the last reading: the fitted level, the fall in counts per
+  //second (negative while rising), the load and the time to empty
+  double level;
+  double fall;
+  uint32_t load_ma_now;
+  uint32_t tte_ms;
+} energy_model;
+
+void energy_model_reset(energy_model *model);
+//Adds a reading and works the estimate out again. time_ms may wrap.
+void energy_model_add(energy_model *model, uint32_t time_ms, uint32_t counts, uint32_t load_ma,
+  uint32_t empty_counts);
+
+#endif
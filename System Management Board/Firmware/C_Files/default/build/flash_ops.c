@@ -0,0 +1,34 @@
+#include "string.h"
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "flash_ops.h"
+#include "capture_hw.h"
+
+//The flash cannot be read while it is erased or programmed, so
+//nothing may run from it meanwhile: interrupts are off on core 0,
+//whose flash routines the SDK keeps in SRAM, and core 1 is held by
+//the capture backend.
+
+static uint8_t page[FLASH_PAGE_SIZE];
+
+bool flash_ops_write_sector(uint32_t offset, const void *data, size_t length){
+  if ((offset % FLASH_SECTOR_SIZE) || (length > FLASH_SECTOR_SIZE) ||
+    (offset + FLASH_SECTOR_SIZE > PICO_FLASH_SIZE_BYTES)){
+    return false;
+  }
+  const uint8_t *bytes = data;
+  capture_hw_hold();
+  uint32_t interrupts = save_and_disable_interrupts();
+  flash_range_erase(offset, FLASH_SECTOR_SIZE);
+  //Programmed a page at a time, the last one padded with erased bytes
+  for (size_t done = 0; done < length; done += FLASH_PAGE_SIZE){
+    size_t part = length - done < FLASH_PAGE_SIZE ? length - done : FLASH_PAGE_SIZE;
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, bytes + done, part);
+    flash_range_program(offset + done, page, FLASH_PAGE_SIZE);
+  }
+  restore_interrupts(interrupts);
+  capture_hw_resume();
+  return memcmp(flash_ops_read(offset), data, length) == 0;
+}
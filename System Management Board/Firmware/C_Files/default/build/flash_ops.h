@@ -0,0 +1,37 @@
+#ifndef FLASH_OPS_H
+#define FLASH_OPS_H
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+
+//The top of flash holds data the firmware writes itself, below it is
+//the program. Offsets are from the start of flash.
+#define FLASH_SETTINGS_SECTORS 2
+#define FLASH_SETTINGS_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SETTINGS_SECTORS*FLASH_SECTOR_SIZE)
+//Below them, the flight recorder's frozen recording, see
+//flight_recorder.h
+#define FLASH_RECORDER_SECTORS 5
+#define FLASH_RECORDER_OFFSET (FLASH_SETTINGS_OFFSET - FLASH_RECORDER_SECTORS*FLASH_SECTOR_SIZE)
+
+//With the field update bootloader, see update.h, the program is one
+//of two images. The bootloader is at the start of flash, then the two
+//sectors the boot record takes turns in, then slot A and slot B, each
+//a whole image linked to run where it is.
+#define FLASH_BOOTLOADER_SIZE (32*1024)
+#define FLASH_BOOT_RECORD_SECTORS 2
+#define FLASH_BOOT_RECORD_OFFSET FLASH_BOOTLOADER_SIZE
+#define FLASH_SLOT_COUNT 2
+#define FLASH_SLOT_SIZE (960*1024)
+#define FLASH_SLOT_OFFSET(slot) (64*1024 + (slot)*FLASH_SLOT_SIZE)
+
+//Where flash at offset can be read.
+static inline const uint8_t *flash_ops_read(uint32_t offset){
+  return (const uint8_t *)(XIP_BASE + offset);
+}
+
+//Erases the sector at offset and programs length bytes of data into
+//it, then reads them back. The main loop stops for the whole erase,
+//about 45ms.
+bool flash_ops_write_sector(uint32_t offset, const void *data, size_t length);
+
+#endif
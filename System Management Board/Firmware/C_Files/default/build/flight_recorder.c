@@ -0,0 +1,471 @@
+#include "stdio.h"
+#include "string.h"
+#include "stddef.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "flight_recorder.h"
+#include "power_quality.h"
+#include "supervisor.h"
+#include "settings.h"
+#include "console.h"
+#include "binary_out.h"
+#include "flash_ops.h"
+#include "crc32.h"
+#include "pins.h"
+#include "hot_path.h"
+
+typedef enum fr_state{
+  FR_RECORDING,
+  //Recording what comes after the trigger
+  FR_TRIGGERED,
+  FR_FROZEN,
+} fr_state;
+
+//What outlasts a reset, in RAM the C runtime leaves alone
+typedef struct fr_kept{
+  uint32_t magic;
+  uint8_t state;
+  uint8_t trigger;
+  //Loaded from flash, and written to flash
+  bool loaded;
+  bool flashed;
+  //Ring index written next, samples in the ring, and where the
+  //trigger came
+  uint32_t next;
+  uint32_t count;
+  uint32_t trigger_index;
+  //Samples still to record after the trigger
+  uint32_t post;
+  uint32_t last_ms;
+  uint32_t trigger_ms;
+  fr_sample ring[FR_SAMPLES];
+} fr_kept;
+static fr_kept __uninitialized_ram(kept);
+
+static const char *const trigger_names[FR_TRIGGER_COUNT] = {"none", "sag", "overcurrent", "shutdown", "watchdog",
+  "hand"};
+
+//Of the frozen recording
+static fr_header header;
+static uint32_t data_bytes;
+static uint8_t chunk_buffer[FR_CHUNK_MAX];
+
+//Trigger conditions at the last sample, so only their start fires
+static bool primed, was_sag, was_over;
+static uint16_t last_gpio;
+
+//The flash copy being written: sector next written, chunk next
+//encoded, the part of chunk_buffer not yet copied and the CRC so far
+static bool saving, crc_added;
+static uint32_t save_sector, save_chunk, pending, pending_at, save_crc;
+
+//Flash copy: magic, data_bytes, the header, the chunks, then the
+//CRC-32 of the header and chunks
+typedef struct fr_record{
+  uint32_t magic;
+  uint32_t data_bytes;
+  fr_header header;
+} fr_record;
+
+static void start(){
+  saving = false;
+  kept.magic = FR_MAGIC;
+  kept.state = FR_RECORDING;
+  kept.trigger = FR_TRIGGER_NONE;
+  kept.loaded = false;
+  kept.flashed = false;
+  kept.next = 0;
+  kept.count = 0;
+  primed = false;
+}
+
+static inline const fr_sample *HOT_FUNC(recorded)(uint32_t i){
+  return &kept.ring[(kept.next + FR_SAMPLES - kept.count + i) % FR_SAMPLES];
+}
+
+static uint8_t *put_unsigned(uint8_t *at, uint32_t value){
+  while (value >= 0x80){
+    *at++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *at++ = (uint8_t)value;
+  return at;
+}
+
+static uint8_t *put_signed(uint8_t *at, int32_t value){
+  return put_unsigned(at, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+//Returns the end of the value, or NULL if it runs past end.
+static const uint8_t *get_unsigned(const uint8_t *at, const uint8_t *end, uint32_t *value){
+  uint32_t result = 0;
+  for (uint32_t shift = 0; (shift < 32) && (at < end); shift += 7){
+    uint8_t byte = *at++;
+    result |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)){
+      *value = result;
+      return at;
+    }
+  }
+  return NULL;
+}
+
+static const uint8_t *get_signed(const uint8_t *at, const uint8_t *end, int32_t *value){
+  uint32_t zigzag;
+  at = get_unsigned(at, end, &zigzag);
+  *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+  return at;
+}
+
+//Encodes chunk of the frozen ring into chunk_buffer, returns its
+//length.
+static uint32_t encode_chunk(uint32_t chunk){
+  uint8_t *at = chunk_buffer;
+  fr_sample previous = {0};
+  uint32_t end = (chunk + 1)*FR_CHUNK_SAMPLES < kept.count ? (chunk + 1)*FR_CHUNK_SAMPLES : kept.count;
+  for (uint32_t i = chunk*FR_CHUNK_SAMPLES; i < end; i++){
+    const fr_sample *sample = recorded(i);
+    at = put_signed(at, (int32_t)sample->key - previous.key);
+    at = put_signed(at, (int32_t)sample->comp - previous.comp);
+    at = put_signed(at, (int32_t)sample->sw - previous.sw);
+    at = put_unsigned(at, sample->gpio ^ previous.gpio);
+    previous = *sample;
+  }
+  return at - chunk_buffer;
+}
+
+//Decodes samples from data into out, which may be NULL to only check
+//that they are all there.
+static bool decode_chunk(const uint8_t *data, uint32_t length, fr_sample *out, uint32_t samples){
+  const uint8_t *end = data + length;
+  fr_sample previous = {0};
+  for (uint32_t i = 0; i < samples; i++){
+    int32_t key, comp, sw;
+    uint32_t gpio;
+    if (!(data = get_signed(data, end, &key)) || !(data = get_signed(data, end, &comp)) ||
+      !(data = get_signed(data, end, &sw)) || !(data = get_unsigned(data, end, &gpio))){
+      return false;
+    }
+    previous = (fr_sample){(uint16_t)(previous.key + key), (uint16_t)(previous.comp + comp),
+      (uint16_t)(previous.sw + sw), (uint16_t)(previous.gpio ^ gpio)};
+    if (out){
+      out[i] = previous;
+    }
+  }
+  return data == end;
+}
+
+//Works out the header and chunk lengths of the frozen ring.
+static void describe(){
+  header = (fr_header){FR_VERSION, kept.trigger, 0, kept.loaded, (uint16_t)kept.count, 0, FR_INTERVAL_US,
+    kept.trigger_ms, {0}};
+  header.chunks = (kept.count + FR_CHUNK_SAMPLES - 1)/FR_CHUNK_SAMPLES;
+  header.trigger_sample = (uint16_t)((kept.trigger_index + FR_SAMPLES - (kept.next + FR_SAMPLES - kept.count))
+    % FR_SAMPLES);
+  data_bytes = 0;
+  for (uint32_t chunk = 0; chunk < header.chunks; chunk++){
+    header.chunk_bytes[chunk] = (uint16_t)encode_chunk(chunk);
+    data_bytes += header.chunk_bytes[chunk];
+  }
+}
+
+static void begin_save(){
+  saving = true;
+  save_sector = 0;
+}
+
+static void freeze(){
+  kept.state = FR_FROZEN;
+  describe();
+  printf("Recorder: frozen by %s at %lu.%03lu s, %u samples\n", trigger_names[kept.trigger], kept.trigger_ms/1000,
+    kept.trigger_ms % 1000, header.samples);
+  if (settings.fr_save){
+    begin_save();
+  }
+}
+
+//Samples after the trigger, short of a whole ring so the trigger
+//itself is kept.
+static uint32_t HOT_FUNC(post_samples)(){
+  return (FR_SAMPLES - 1)*(100 - settings.fr_pre)/100;
+}
+
+//Starts the post-trigger part, or freezes straight away if there is
+//none to wait for.
+static void trigger(fr_trigger cause, uint32_t post){
+  kept.trigger = cause;
+  kept.trigger_ms = kept.last_ms;
+  kept.trigger_index = (kept.next + FR_SAMPLES - 1) % FR_SAMPLES;
+  kept.post = post;
+  kept.state = FR_TRIGGERED;
+  if (!post){
+    freeze();
+  }
+}
+
+void flight_recorder_init(){
+  if ((kept.magic != FR_MAGIC) || (kept.state > FR_FROZEN) || (kept.next >= FR_SAMPLES) ||
+    (kept.count > FR_SAMPLES) || (kept.trigger >= FR_TRIGGER_COUNT)){
+    start();
+    return;
+  }
+  if (kept.state == FR_FROZEN){
+    describe();
+    if (settings.fr_save && !kept.flashed){
+      begin_save();
+    }
+    return;
+  }
+  //A trigger the reset cut short keeps what it has
+  if (kept.state == FR_TRIGGERED){
+    freeze();
+    return;
+  }
+  supervisor_reason reason = supervisor_last_reset()->reason;
+  bool stalled = (reason == SUPERVISOR_STALL) || (reason == SUPERVISOR_RUNNING);
+  if (stalled && kept.count && (settings.fr_triggers & FR_TRIGGER_BIT(FR_TRIGGER_WATCHDOG))){
+    trigger(FR_TRIGGER_WATCHDOG, 0);
+    return;
+  }
+  start();
+}
+
+bool HOT_FUNC(flight_recorder_recording)(){
+  return kept.state != FR_FROZEN;
+}
+
+//The trigger the sample fires, if any.
+static fr_trigger HOT_FUNC(fired)(uint16_t gpio, double amps){
+  pq_kind event = power_quality_event();
+  bool sag = (event == PQ_SAG) || (event == PQ_DROPOUT);
+  bool over = amps > settings.fr_current;
+  fr_trigger cause = FR_TRIGGER_NONE;
+  if (primed){
+    uint32_t enabled = settings.fr_triggers;
+    bool unasked = !(gpio & (1 << SHUTDOWN_WRITE_PIN));
+    if ((enabled & FR_TRIGGER_BIT(FR_TRIGGER_SAG)) && sag && !was_sag){
+      cause = FR_TRIGGER_SAG;
+    } else if ((enabled & FR_TRIGGER_BIT(FR_TRIGGER_OVERCURRENT)) && over && !was_over){
+      cause = FR_TRIGGER_OVERCURRENT;
+    } else if ((enabled & FR_TRIGGER_BIT(FR_TRIGGER_SHUTDOWN)) && unasked &&
+      ((gpio ^ last_gpio) & (1 << SHUTDOWN_READ_PIN))){
+      cause = FR_TRIGGER_SHUTDOWN;
+    }
+  }
+  primed = true;
+  was_sag = sag;
+  was_over = over;
+  last_gpio = gpio;
+  return cause;
+}
+
+void HOT_FUNC(flight_recorder_sample)(uint64_t now, uint32_t key, uint32_t comp, uint32_t sw, double amps){
+  if (kept.state == FR_FROZEN){
+    return;
+  }
+  uint16_t gpio = (uint16_t)gpio_get_all();
+  kept.ring[kept.next] = (fr_sample){(uint16_t)key, (uint16_t)comp, (uint16_t)sw, gpio};
+  kept.next = (kept.next + 1) % FR_SAMPLES;
+  if (kept.count < FR_SAMPLES){
+    kept.count++;
+  }
+  kept.last_ms = (uint32_t)(now/1000);
+  if (kept.state == FR_TRIGGERED){
+    if (!--kept.post){
+      freeze();
+    }
+    return;
+  }
+  fr_trigger cause = fired(gpio, amps);
+  if (cause != FR_TRIGGER_NONE){
+    trigger(cause, post_samples());
+  }
+}
+
+bool flight_recorder_busy(){
+  return saving;
+}
+
+void flight_recorder_poll(){
+  static uint8_t sector[FLASH_SECTOR_SIZE];
+  if (!saving){
+    return;
+  }
+  uint32_t fill = 0;
+  if (!save_sector){
+    fr_record record = {FR_MAGIC, data_bytes, header};
+    record.header.saved = 0;
+    memcpy(sector, &record, sizeof(record));
+    fill = sizeof(record);
+    save_crc = crc32_update(0, &record.header, sizeof(record.header));
+    save_chunk = 0;
+    pending = 0;
+    pending_at = 0;
+    crc_added = false;
+  }
+  while (fill < FLASH_SECTOR_SIZE){
+    if (pending_at == pending){
+      if (save_chunk < header.chunks){
+        pending = encode_chunk(save_chunk++);
+        save_crc = crc32_update(save_crc, chunk_buffer, pending);
+      } else if (!crc_added){
+        memcpy(chunk_buffer, &save_crc, sizeof(save_crc));
+        pending = sizeof(save_crc);
+        crc_added = true;
+      } else {
+        break;
+      }
+      pending_at = 0;
+      continue;
+    }
+    uint32_t part = pending - pending_at < FLASH_SECTOR_SIZE - fill ? pending - pending_at : FLASH_SECTOR_SIZE - fill;
+    memcpy(&sector[fill], &chunk_buffer[pending_at], part);
+    fill += part;
+    pending_at += part;
+  }
+  if (!flash_ops_write_sector(FLASH_RECORDER_OFFSET + save_sector*FLASH_SECTOR_SIZE, sector, fill)){
+    saving = false;
+    printf("Recorder: flash write failed\n");
+    return;
+  }
+  save_sector++;
+  if (crc_added && (pending_at == pending)){
+    saving = false;
+    kept.flashed = true;
+    printf("Recorder: saved to flash, %lu bytes\n", data_bytes);
+  }
+}
+
+//The flash copy's record if it is whole and valid, else NULL.
+static const fr_record *stored(){
+  const uint8_t *flash = flash_ops_read(FLASH_RECORDER_OFFSET);
+  fr_record record;
+  memcpy(&record, flash, sizeof(record));
+  if ((record.magic != FR_MAGIC) || (record.data_bytes > FR_CHUNKS*FR_CHUNK_MAX) ||
+    (record.header.version != FR_VERSION) || (record.header.samples > FR_SAMPLES) ||
+    (record.header.chunks != (record.header.samples + FR_CHUNK_SAMPLES - 1)/FR_CHUNK_SAMPLES) ||
+    (record.header.trigger >= FR_TRIGGER_COUNT)){
+    return NULL;
+  }
+  uint32_t stored_crc;
+  memcpy(&stored_crc, flash + sizeof(record) + record.data_bytes, sizeof(stored_crc));
+  uint32_t crc = crc32_update(0, flash + offsetof(fr_record, header), sizeof(record.header) + record.data_bytes);
+  return crc == stored_crc ? (const fr_record *)flash : NULL;
+}
+
+//Decodes the flash copy into the ring and freezes it.
+static bool load(){
+  const fr_record *found = stored();
+  if (!found){
+    return false;
+  }
+  fr_header loaded;
+  memcpy(&loaded, &found->header, sizeof(loaded));
+  const uint8_t *data = (const uint8_t *)found + sizeof(fr_record);
+  uint32_t total = 0;
+  for (int pass = 0; pass < 2; pass++){
+    const uint8_t *chunk_data = data;
+    for (uint32_t chunk = 0; chunk < loaded.chunks; chunk++){
+      uint32_t first = chunk*FR_CHUNK_SAMPLES;
+      uint32_t samples = loaded.samples - first < FR_CHUNK_SAMPLES ? loaded.samples - first : FR_CHUNK_SAMPLES;
+      if (!decode_chunk(chunk_data, loaded.chunk_bytes[chunk], pass ? &kept.ring[first] : NULL, samples)){
+        return false;
+      }
+      chunk_data += loaded.chunk_bytes[chunk];
+    }
+    total = chunk_data - data;
+    if (total != found->data_bytes){
+      return false;
+    }
+  }
+  saving = false;
+  kept.state = FR_FROZEN;
+  kept.trigger = loaded.trigger;
+  kept.trigger_ms = loaded.trigger_ms;
+  kept.loaded = true;
+  kept.flashed = true;
+  kept.count = loaded.samples;
+  kept.next = loaded.samples % FR_SAMPLES;
+  kept.trigger_index = loaded.trigger_sample;
+  describe();
+  return true;
+}
+
+//"fr read" sends the header, "fr read N" chunk N.
+static bool send_recording(int argc, char *argv[]){
+  if ((kept.state != FR_FROZEN) || saving){
+    console_printf("Recorder: nothing to read\n");
+    return false;
+  }
+  if (argc == 1){
+    binary_frame("FRH1", &header, sizeof(header));
+    return true;
+  }
+  uint32_t chunk;
+  if (!console_arg_uint(argv[1], &chunk) || (chunk >= header.chunks)){
+    return false;
+  }
+  uint32_t length = encode_chunk(chunk);
+  binary_frame_begin("FRD1", sizeof(chunk) + length);
+  binary_frame_part(&chunk, sizeof(chunk));
+  binary_frame_part(chunk_buffer, length);
+  binary_frame_end();
+  return true;
+}
+
+static void print_state(){
+  if (kept.state == FR_RECORDING){
+    console_printf("Recorder: recording, %lu samples, triggers 0x%lx\n", kept.count, settings.fr_triggers);
+  } else if (kept.state == FR_TRIGGERED){
+    console_printf("Recorder: triggered by %s at %lu.%03lu s, %lu samples to go\n", trigger_names[kept.trigger],
+      kept.trigger_ms/1000, kept.trigger_ms % 1000, kept.post);
+  } else {
+    console_printf("Recorder: frozen by %s at %lu.%03lu s%s, %u samples, trigger at %u, %lu bytes, %s\n",
+      trigger_names[kept.trigger], kept.trigger_ms/1000, kept.trigger_ms % 1000, kept.loaded ? " (from flash)" : "",
+      header.samples, header.trigger_sample, data_bytes, saving ? "saving" : (kept.flashed ? "in flash" : "not saved"));
+  }
+  const fr_record *found = stored();
+  if (found){
+    fr_header flashed;
+    memcpy(&flashed, &found->header, sizeof(flashed));
+    console_printf("Recorder: flash holds one by %s at %lu.%03lu s, %u samples\n", trigger_names[flashed.trigger],
+      flashed.trigger_ms/1000, flashed.trigger_ms % 1000, flashed.samples);
+  } else {
+    console_printf("Recorder: flash holds none\n");
+  }
+}
+
+bool flight_recorder_command(int argc, char *argv[]){
+  if (argc == 0){
+    print_state();
+    return true;
+  }
+  if (strcmp(argv[0], "read") == 0){
+    return (argc <= 2) && send_recording(argc, argv);
+  }
+  if (argc != 1){
+    return false;
+  }
+  if (strcmp(argv[0], "arm") == 0){
+    start();
+  } else if (strcmp(argv[0], "trigger") == 0){
+    if (kept.state != FR_RECORDING){
+      return false;
+    }
+    trigger(FR_TRIGGER_MANUAL, post_samples());
+  } else if (strcmp(argv[0], "save") == 0){
+    if ((kept.state != FR_FROZEN) || saving){
+      return false;
+    }
+    begin_save();
+  } else if (strcmp(argv[0], "load") == 0){
+    if (!load()){
+      console_printf("Recorder: nothing in flash\n");
+      return false;
+    }
+  } else {
+    return false;
+  }
+  print_state();
+  return true;
+}
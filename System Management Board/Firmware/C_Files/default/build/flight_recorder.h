@@ -0,0 +1,100 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "pico/stdlib.h"
+
+//Flight recorder for power faults. Every 1ms reading of KEY_Voltage
+//the load shedding takes, the recorder adds the two current monitors
+//and GPIO0-15 and keeps the last FR_SAMPLES of them in a ring. A
+//trigger in fr_triggers freezes the ring fr_pre percent of the way
+//through, once the rest has been recorded after it:
+//
+//  sag          a power quality sag or dropout starts, see
+//               power_quality.h
+//  overcurrent  either regulator above fr_current
+//  shutdown     SHUTDOWN_READ_PIN changes while the board is not
+//               signalling a shutdown on SHUTDOWN_WRITE_PIN
+//  watchdog     a stall or watchdog reset, frozen at the reboot with
+//               what was recorded up to it
+//
+//The ring is in RAM that is not cleared at boot, so a recording
+//outlasts a watchdog reset and the reboot at the end of a shutdown. A
+//frozen recording is compressed and written to flash if fr_save is
+//set, a sector per main loop pass, and is held until "fr arm".
+//
+//  fr [arm|trigger|save|load|read [chunk]]
+//
+//prints the state, starts recording again, freezes the ring now,
+//writes it to flash, loads the one in flash instead, or sends it: "fr
+//read" sends the "FRH1" header frame and "fr read N" the "FRD1" frame
+//with chunk N, a uint32 chunk number then its data.
+//
+//Chunks are FR_CHUNK_SAMPLES samples each. A sample is the change in
+//key, comp and switch counts from the one before as zigzag LEB128,
+//then GPIO0-15 XOR the ones before as LEB128, starting from zero at
+//each chunk so every chunk decodes on its own. All fields are little
+//endian.
+#define FR_SAMPLES 2048
+#define FR_CHUNK_SAMPLES 256
+#define FR_CHUNKS (FR_SAMPLES/FR_CHUNK_SAMPLES)
+//Largest a chunk can encode to: 2 bytes per count, 3 for the GPIOs
+#define FR_CHUNK_MAX (FR_CHUNK_SAMPLES*9)
+#define FR_INTERVAL_US 1000
+#define FR_VERSION 1
+//"SMBF" as stored
+#define FR_MAGIC 0x46424d53
+
+typedef enum fr_trigger{
+  FR_TRIGGER_NONE,
+  FR_TRIGGER_SAG,
+  FR_TRIGGER_OVERCURRENT,
+  FR_TRIGGER_SHUTDOWN,
+  FR_TRIGGER_WATCHDOG,
+  //"fr trigger"
+  FR_TRIGGER_MANUAL,
+  FR_TRIGGER_COUNT
+} fr_trigger;
+
+//fr_triggers bit of a trigger
+#define FR_TRIGGER_BIT(trigger) (1u << ((trigger) - 1))
+
+typedef struct fr_sample{
+  uint16_t key;
+  uint16_t comp;
+  uint16_t sw;
+  uint16_t gpio;
+} fr_sample;
+
+//Payload of the "FRH1" frame, and what the flash copy starts with.
+typedef struct fr_header{
+  uint8_t version;
+  uint8_t trigger;
+  uint8_t chunks;
+  //Loaded from flash rather than frozen since
+  uint8_t saved;
+  uint16_t samples;
+  //Index of the sample the trigger came at
+  uint16_t trigger_sample;
+  uint32_t interval_us;
+  //Time since boot of the trigger, in ms
+  uint32_t trigger_ms;
+  uint16_t chunk_bytes[FR_CHUNKS];
+} fr_header;
+
+//Freezes what the last reset cut short, if it was a stall. Call once
+//at boot, after supervisor_init.
+void flight_recorder_init();
+//Whether samples are being taken, so the caller can skip passing them.
+bool flight_recorder_recording();
+//Takes the 1ms readings, raw, and the higher regulator current in
+//amps.
+void flight_recorder_sample(uint64_t now, uint32_t key, uint32_t comp, uint32_t sw, double amps);
+//Writes a frozen recording to flash a sector at a time, call from the
+//main loop.
+void flight_recorder_poll();
+//Whether a flash write is under way.
+bool flight_recorder_busy();
+//The "fr" command.
+bool flight_recorder_command(int argc, char *argv[]);
+
+#endif
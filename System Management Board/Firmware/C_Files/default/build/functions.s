@@ -1,22 +1,33 @@
-.thumb_func
-.global state_enforce
+.syntax unified
+.cpu cortex-m0plus
+.thumb
 
-.align 4
-.equ RETURN_ADDR 0
-.equ MAX_PIN, -29
+.equ SIO_BASE, 0xd0000000
+.equ GPIO_OUT, 0x10
+.equ GPIO_OUT_XOR, 0x1c
 
-@R0 has pointer to the pins to activate
-@the two addresses following that pointer
-@have the output pins and then a blank return address
-state_enforce:  LDR R1, [R0], #1
-                LDR R2, [R0], #1
-                STR R7, [R0]
-                STR R0, =RETURN_ADDR
-                MOV R6, R0
-                MOV R3, #1
-                MOV R4, #0
-loop1:          AND R5, R3, R1
-                
-                
-                LDR R7, [R0]
-                B R7
+@R0 has a pointer to a state_map: the requested output levels
+@followed by the mask of pins to apply them to. Pins in the mask
+@that are not in output_pins are rejected and returned in R0, the
+@rest are applied with a single write to the SIO xor register so
+@pins outside the mask are never touched.
+@Lives in .time_critical like __not_in_flash_func so it runs from RAM.
+.section .time_critical.state_enforce, "ax"
+.align 2
+.global state_enforce
+.thumb_func
+state_enforce:  LDR R1, [R0, #0]
+                LDR R2, [R0, #4]
+                LDR R3, =output_pins
+                LDR R3, [R3]
+                LDR R0, =SIO_BASE
+                LDR R0, [R0, #GPIO_OUT]
+                EORS R0, R1
+                ANDS R0, R2
+                ANDS R0, R3
+                LDR R1, =SIO_BASE
+                STR R0, [R1, #GPIO_OUT_XOR]
+                MOVS R0, R2
+                BICS R0, R3
+                BX LR
+.ltorg
@@ -0,0 +1,16 @@
+#ifndef HOT_PATH_H
+#define HOT_PATH_H
+
+#include "pico/stdlib.h"
+
+//Functions on the power-control hot path are wrapped in HOT_FUNC.
+//With SMB_RUN_FROM_RAM they land in .time_critical and are copied
+//to SRAM at boot, so an XIP cache miss or a flash write can not
+//stall them. Otherwise they stay in flash as usual.
+#ifdef SMB_RUN_FROM_RAM
+#define HOT_FUNC(func_name) __not_in_flash_func(func_name)
+#else
+#define HOT_FUNC(func_name) func_name
+#endif
+
+#endif
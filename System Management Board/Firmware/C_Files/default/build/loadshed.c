@@ -0,0 +1,167 @@
+#include "stdio.h"
+#include "string.h"
+#include "pico/stdlib.h"
+#include "loadshed.h"
+#include "outputs.h"
+#include "settings.h"
+#include "console.h"
+#include "pins.h"
+#include "hot_path.h"
+
+//The key reading is smoothed by an exponential average over about
+//1 << FILTER_SHIFT samples, kept in 1/16 counts, and the slope taken
+//over the last SLOPE_SAMPLES smoothed readings.
+#define FILTER_SHIFT 2
+#define SLOPE_SAMPLES 8
+
+#define LIGHT_PINS ((1 << LIGHT_A) | (1 << LIGHT_B))
+#define OUTPUT_PINS ((1 << OUT0) | (1 << OUT2))
+#define POE_PINS (1 << SWITCH_PWR_EN)
+
+static uint64_t next_sample;
+static uint32_t filtered16;
+static uint32_t history[SLOPE_SAMPLES];
+static uint64_t history_us[SLOPE_SAMPLES];
+static uint32_t samples;
+//Fall in counts per millisecond, negative while rising
+static int32_t slope;
+static int stage;
+//When the key came back above the current stage's level, 0 if not
+static uint64_t above_since;
+static bool in_event;
+static loadshed_event event;
+static loadshed_event events[LOADSHED_LOG];
+static uint32_t event_count;
+
+bool HOT_FUNC(loadshed_due)(uint64_t now){
+  if (now < next_sample){
+    return false;
+  }
+  next_sample = now + LOADSHED_SAMPLE_US;
+  return true;
+}
+
+//The pins shed at a stage, from the settings' table.
+static uint32_t HOT_FUNC(stage_pins)(int at){
+  uint32_t pins = 0;
+  if (settings.shed_lights && ((int)settings.shed_lights <= at)){
+    pins |= LIGHT_PINS;
+  }
+  if (settings.shed_outputs && ((int)settings.shed_outputs <= at)){
+    pins |= OUTPUT_PINS;
+  }
+  if (settings.shed_poe && ((int)settings.shed_poe <= at)){
+    pins |= POE_PINS;
+  }
+  return pins;
+}
+
+//Deepest stage whose level counts is below.
+static int HOT_FUNC(level_stage)(uint32_t counts){
+  int wanted = 0;
+  for (int i = 0; i < LOADSHED_STAGES; i++){
+    if (settings.shed_level[i] && (counts < settings.shed_level[i])){
+      wanted = i + 1;
+    }
+  }
+  return wanted;
+}
+
+static void end_event(uint64_t now){
+  event.length_ms = (uint32_t)((now - event.start_us)/1000);
+  events[event_count % LOADSHED_LOG] = event;
+  event_count++;
+  in_event = false;
+  printf("Shed: ride-through over after %lu ms, down to %u counts, stage %u\n", event.length_ms,
+    event.min_counts, event.stage);
+}
+
+void HOT_FUNC(loadshed_sample)(uint64_t now, uint32_t counts){
+  if (!samples){
+    filtered16 = counts << 4;
+  }
+  filtered16 += (int32_t)((counts << 4) - filtered16) >> FILTER_SHIFT;
+  uint32_t level = filtered16 >> 4;
+  uint32_t oldest = samples % SLOPE_SAMPLES;
+  if ((samples >= SLOPE_SAMPLES) && (now > history_us[oldest])){
+    slope = (int32_t)(((int64_t)history[oldest] - level)*1000/(int64_t)(now - history_us[oldest]));
+  }
+  history[oldest] = level;
+  history_us[oldest] = now;
+  samples++;
+
+  int wanted = level_stage(level);
+  bool falling = settings.shed_slope && (slope >= (int32_t)settings.shed_slope);
+  bool by_slope = false;
+  if (falling && (stage < LOADSHED_STAGES) && (wanted <= stage)){
+    wanted = stage + 1;
+    by_slope = true;
+  }
+  //Nothing to shed and nothing shed, not a ride-through
+  if (!stage && !(output_state() & stage_pins(LOADSHED_STAGES))){
+    wanted = 0;
+  }
+  if (wanted > stage){
+    if (!in_event){
+      in_event = true;
+      event = (loadshed_event){now, 0, (uint16_t)level, 0, by_slope};
+    }
+    stage = wanted;
+    above_since = 0;
+  } else if (stage){
+    //Restored one stage at a time, each after shed_restore back above
+    //its level
+    uint32_t lowered = level > LOADSHED_HYSTERESIS ? level - LOADSHED_HYSTERESIS : 0;
+    if ((level_stage(lowered) >= stage) || falling){
+      above_since = 0;
+    } else if (!above_since){
+      above_since = now;
+    } else if (now - above_since >= settings.shed_restore){
+      stage--;
+      above_since = stage ? now : 0;
+    }
+  }
+  if (in_event){
+    if (level < event.min_counts){
+      event.min_counts = (uint16_t)level;
+    }
+    if (stage > event.stage){
+      event.stage = (uint8_t)stage;
+    }
+  }
+  uint32_t pins = stage_pins(stage);
+  if (pins != output_shed_pins()){
+    output_shed(pins);
+  }
+  if (in_event && !stage){
+    end_event(now);
+  }
+}
+
+int loadshed_stage(){
+  return stage;
+}
+
+bool loadshed_command(int argc, char *argv[]){
+  if (argc == 1){
+    if (strcmp(argv[0], "clear") != 0){
+      return false;
+    }
+    event_count = 0;
+  }
+  console_printf("Shed: stage %d, key %lu counts falling %ld counts/ms, shed pins 0x%08lx\n", stage,
+    filtered16 >> 4, slope, output_shed_pins());
+  if (in_event){
+    console_printf("Shed: ride-through for %lu ms so far, down to %u counts\n",
+      (uint32_t)((time_us_64() - event.start_us)/1000), event.min_counts);
+  }
+  console_printf("Shed: %lu ride-throughs\n", event_count);
+  uint32_t first = event_count > LOADSHED_LOG ? event_count - LOADSHED_LOG : 0;
+  for (uint32_t i = first; i < event_count; i++){
+    const loadshed_event *logged = &events[i % LOADSHED_LOG];
+    console_printf("Shed: at %lu.%03lu s for %lu ms, down to %u counts, stage %u%s\n",
+      (uint32_t)(logged->start_us/1000000), (uint32_t)(logged->start_us/1000 % 1000), logged->length_ms,
+      logged->min_counts, logged->stage, logged->by_slope ? ", on the slope" : "");
+  }
+  return true;
+}
@@ -0,0 +1,56 @@
+#ifndef LOADSHED_H
+#define LOADSHED_H
+
+#include "pico/stdlib.h"
+
+//Load shedding on a sag of KEY_Voltage. The state machine only starts
+//its shutdown_delay watch when the key drops below volt_threshold, and
+//everything stays powered meanwhile. This samples the key every
+//LOADSHED_SAMPLE_US and sheds loads in up to three stages, so what is
+//left holds up longer and the Jetson can finish writing:
+//
+//  lights  LIGHT_A and LIGHT_B
+//  outputs OUT0 and OUT2
+//  poe     the PoE switch regulator
+//
+//Settings shed_lights, shed_outputs and shed_poe give the stage each
+//group goes at, 0 for never. A stage sheds once the filtered key
+//reading is below its shed_level, or ahead of it, one stage per
+//sample, while the key is falling faster than shed_slope. The Jetson's
+//regulator, the main relay, JET_ON and the shutdown signal on OUT1 are
+//never shed.
+//
+//A stage is restored once the key has been LOADSHED_HYSTERESIS above
+//its level for shed_restore, one stage at a time. Each ride-through,
+//from the first load shed to the last one restored, is printed when
+//it ends and kept in a log of the last LOADSHED_LOG:
+//
+//  shed [clear]
+//
+//prints the stage, the key reading and slope, and the log.
+#define LOADSHED_SAMPLE_US 1000
+#define LOADSHED_STAGES 3
+#define LOADSHED_HYSTERESIS 50
+#define LOADSHED_LOG 8
+
+typedef struct loadshed_event{
+  //time_us_64 when the first load was shed
+  uint64_t start_us;
+  uint32_t length_ms;
+  //Lowest filtered key reading and deepest stage
+  uint16_t min_counts;
+  uint8_t stage;
+  //The first stage went on the slope rather than the level
+  bool by_slope;
+} loadshed_event;
+
+//True once LOADSHED_SAMPLE_US has passed since the last sample.
+bool loadshed_due(uint64_t now);
+//Takes a raw KEY_Voltage reading and sheds or restores loads.
+void loadshed_sample(uint64_t now, uint32_t counts);
+//Stage in effect, 0 with nothing shed.
+int loadshed_stage();
+//The "shed" command.
+bool loadshed_command(int argc, char *argv[]);
+
+#endif
@@ -6,36 +6,31 @@
 #include "hardware/adc.h"
 #include "hardware/watchdog.h"
 #include "hardware/uart.h"
+#include "hardware/clocks.h"
 #include "math.h"
+#include "pins.h"
+#include "outputs.h"
+#include "hot_path.h"
+#include "cycles.h"
+#include "probe.h"
+#include "console.h"
+#include "capture.h"
+#include "settings.h"
+#include "uart_console.h"
+#include "supervisor.h"
+#include "update.h"
+#include "usb_ports.h"
+#include "standby.h"
+#include "clock_policy.h"
+#include "loadshed.h"
+#include "energy.h"
+#include "power_quality.h"
+#include "flight_recorder.h"
+#include "scope.h"
+#include "rollups.h"
 
 #define BLINKER_COMPLEXITY 10
 
-#define IN0 12
-#define IN1 10
-#define IN2 11
-#define OUT0 7
-#define OUT1 5
-#define OUT2 6
-#define LEDA 22
-#define LEDB 21
-#define SWITCH_PWR_EN 0
-#define COMP_PWR_EN 1
-#define MAIN_RELAY 2
-#define LIGHT_A 3
-#define LIGHT_B 4
-#define MUX_S2 20
-#define MUX_S1 19
-#define MUX_S0 18
-#define AUX_SW 13
-#define ADC_MUX 26
-#define ADC_MUX_CHANNEL 0
-#define JET_ON 15
-#define BUILT_IN_LED 25
-#define COMP_I_MONITOR 28
-#define SWITCH_I_MONITOR 27
-
-#define UART_TX_PIN 8
-#define UART_RX_PIN 9
 #define UARTID uart1
 #define BAUDRATE 115200
 
@@ -46,7 +41,6 @@
 #define InitialPower 0x00000000
 #define MainRelay 0x00000004
 #define CompAndSwitch (1 << COMP_PWR_EN) | (1<< SWITCH_PWR_EN) | (1 << JET_ON)
-uint32_t current_state = 0;
 uint32_t all_pins = (
   (1<<IN0) | (1<<IN1) | (1<<IN2) | (1<<OUT0) | (1<<OUT1) | 
   (1<<OUT2) | (1<<LEDA) | (1<<LEDB) | (1<<SWITCH_PWR_EN) | 
@@ -69,8 +63,6 @@ uint32_t input_pins = (
 
 bool last_aux_sw_state = false;
 
-int volt_threshold = 1000;
-
 typedef struct bit_holder{
     int S2, S1, S0;
 } bits;
@@ -78,30 +70,38 @@ const bits KEY_Voltage = {0,0,0};
 const bits Temp_Sensor1 = {1,1,0};
 const bits Temp_Sensor2 = {1,1,1};
 
-#define Lights_Pin IN0
-
 typedef struct process_monitor{
     bool in_process;
     uint64_t start_time;
 } monitor;
 monitor sd_now = {false, 0};
+//Key off to the shutdown signal for the shutdown under way:
+//shutdown_delay, unless the time to empty moves it, see energy.h
+uint64_t sd_delay = 0;
 bool end_sd = false;
 bool early_start = true;
-//Time in microseconds between cutting power and shutdown sequence start. 
-const uint64_t shutdown_delay = 10 * 1000000; 
-//Time the Jetson holds the pin high
-const uint64_t jetson_signal_time = 5 * 1000000;
-//Minimum time the Jetson is expected to take to shutdown
-const uint64_t jetson_sd_delay = 5 * 1000000;
+//The timings and thresholds are in settings, see settings.h
 double jetson_current = 0.0;
-const double delta_current_thresh = 0.5;
-#define SHUTDOWN_READ_PIN IN2
-#define SHUTDOWN_WRITE_PIN OUT1
 bool coordinated_sd = false;
+//The debug console runs alongside the state machine, start_time is
+//when the session began
 monitor debug = {false, 0};
 monitor engage = {true, 0};
+//Offset of the state machine's timebase from time_us_64, moved on
+//by "R" and at the end of a shutdown
 uint64_t debug_time = 0;
 bool debug_force_sd = false;
+//Worst main loop iteration since the last "L" report, in cycles of
+//the clock at boot, see probe_scale. Used to compare flash and SRAM
+//builds.
+uint32_t loop_worst_cycles = 0;
+//Command console on USB/UART stdio. It uses run_commands normally
+//and debug_commands while in debug mode. 
+console usb_console;
+extern const console_command run_commands[];
+extern const size_t run_command_count;
+//Console on uart1 for the Jetson, with jetson_commands only
+console jetson_console;
 
 typedef struct blinker{
   int pulses; 
@@ -117,7 +117,7 @@ blink_type end_sd_blink = {3,{0.0,0.05,0.1,0.15,0.2,0.25},{1,0,1,0,1,0},1.0};
 blink_type early_startup = {2,{0.0,0.43,0.5,0.93,1.0},{1,0,1,0},1.5};
 
 //A simple function to set the selector pins of the ADC mux. 
-void set_mux(bits pins){
+void HOT_FUNC(set_mux)(bits pins){
   sleep_us(10);
   gpio_put(MUX_S2,pins.S2);
   gpio_put(MUX_S1,pins.S1);
@@ -127,7 +127,7 @@ void set_mux(bits pins){
 
 //A function to return the ADC channel on the Pico from
 //the input pin number. 
-uint get_channel_from_pin(uint pin){
+uint HOT_FUNC(get_channel_from_pin)(uint pin){
   if (pin == 26){
     return 0;
   } else if (pin == 27){
@@ -146,20 +146,38 @@ double convt_time(uint64_t time){
   return millis;
 }
 
+//Select bits for ADC mux input 0-7.
+bits mux_input(uint32_t input){
+  bits selector = {(input >> 2) & 1, (input >> 1) & 1, input & 1};
+  return selector;
+}
+
+//Last reading of each mux input and ADC input, which the state
+//machine carries on with while the scope has the ADC.
+uint mux_readings[8];
+uint adc_readings[3];
+
 //Calls the function to set the select bits of the ADC mux
-//and then reads and returns the raw ADC value. 
-uint read_ADC_MUX(bits pins){
+//and then reads and returns the raw ADC value. While the scope
+//has the ADC, its newest sample or the last reading stands in.
+uint HOT_FUNC(read_ADC_MUX)(bits pins){
+  PROBE_SCOPE(PROBE_READ_ADC_MUX);
+  uint input = (pins.S2 << 2) | (pins.S1 << 1) | pins.S0;
+  if (scope_running()){
+    return scope_reading(ADC_MUX_CHANNEL, input, mux_readings[input]);
+  }
   adc_select_input(get_channel_from_pin(ADC_MUX));
   set_mux(pins);
   uint data = adc_read();
+  mux_readings[input] = data;
   return data;
 }
 
 //This function compares the system input voltage from the key
 //to the threshold and returns 1 if greater. 
-int check_pow(){
+int HOT_FUNC(check_pow)(){
   uint voltage = read_ADC_MUX(KEY_Voltage);
-  if (voltage > volt_threshold){
+  if (voltage > settings.volt_threshold){
     return 1;
   }
   else {
@@ -169,16 +187,20 @@ int check_pow(){
 
 //The normal operating function. This function controls the startup
 //and basic monitoring of the system power input. After the Pico 
-//engages, it waits for 10 seconds, and then turns on the main relay.
-//After 10 more seconds, it turns on the Jetson and the POE Switch. 
-void evaluate_state(uint64_t time, bool shutdown_request){
+//engages, it waits for relay_engage (10 seconds), and then turns on
+//the main relay. At power_engage (20 seconds), it turns on the Jetson
+//and the POE Switch. 
+void HOT_FUNC(evaluate_state)(uint64_t time, bool shutdown_request){
+  PROBE_SCOPE(PROBE_EVALUATE_STATE);
   time -= engage.start_time;
+  sd_delay = settings.shutdown_delay;
   bool holder = (bool)check_pow() &&(!shutdown_request);
   if (!holder){
     sd_now.start_time = (time_us_64()-debug_time);
-    if (time < (20000000-1000)) {
-      sd_now.start_time -= 19000000;
-      if (time > (10000000-1000)) {
+    if (time < (settings.power_engage-1000)) {
+      //Straight to a second before the power button press
+      sd_now.start_time -= settings.shutdown_delay+9000000;
+      if (time > (settings.relay_engage-1000)) {
         sd_now.in_process = true;
         end_sd = true;
         early_start = false;
@@ -196,60 +218,60 @@ void evaluate_state(uint64_t time, bool shutdown_request){
       early_start = false;
     }
   }
-  else if ((time > 20000000) && holder){
-    current_state |= MainRelay | CompAndSwitch;
+  else if ((time > settings.power_engage) && holder){
+    output_set(OWNER_STATE, MainRelay | CompAndSwitch);
     early_start = false;
   }
-  else if ((time > 10000000) && holder) {
-    current_state |= MainRelay;
+  else if ((time > settings.relay_engage) && holder) {
+    output_set(OWNER_STATE, MainRelay);
     early_start = false;
   }
   else if ((time > 0) && holder) {
-    current_state = InitialPower;
+    output_write(OWNER_STATE, output_owner_mask(OWNER_STATE), InitialPower);
     early_start = false;
   }
 }
 
+//Raw ADC value of a current monitor pin.
+uint HOT_FUNC(current_monitor_counts)(int pin){
+  uint channel = get_channel_from_pin(pin);
+  if (scope_running()){
+    return scope_reading(channel, 0, adc_readings[channel]);
+  }
+  adc_select_input(channel);
+  adc_readings[channel] = adc_read();
+  return adc_readings[channel];
+}
+
+//Converts a raw current monitor value to the current using the
+//formula from the regulator datasheet.
+double HOT_FUNC(current_from_counts)(uint data){
+  double voltage = (double)data*((double)V_REF/4096.0);
+  return ((voltage-0.23)/0.055);
+}
+
 //Function to read the current monitor pin on the voltage
 //regulators for the Jetson and POE Switch and convert the
 //raw ADC value to the current using the formula from the 
 //regulator datasheet. 
-double current_monitor_read(int pin){
-  adc_select_input(get_channel_from_pin(pin));
-  uint data = adc_read();
-  double voltage = (double)data*((double)V_REF/4096.0);
-  return ((voltage-0.23)/0.055);
+double HOT_FUNC(current_monitor_read)(int pin){
+  PROBE_SCOPE(PROBE_CURRENT_MONITOR_READ);
+  return current_from_counts(current_monitor_counts(pin));
 }
 
 //This reads the input pins to determine if the Jetson wants the
 //Pico to enable the lights, or it also can detect if the Jetson
 //is ready to be shutdown, returning true if so. 
-bool check_input_pattern(){
+bool HOT_FUNC(check_input_pattern)(){
+  PROBE_SCOPE(PROBE_CHECK_INPUT_PATTERN);
   int lights_holder = gpio_get(Lights_Pin);
-  int cur_lights_holder = current_state & (1<<LIGHT_A);
   if (lights_holder){
-    current_state |= ((1 << LIGHT_A) | (1 << LIGHT_B));
+    output_set(OWNER_LIGHTS, (1 << LIGHT_A) | (1 << LIGHT_B));
   }
   else{
-    current_state &= (~(1<<LIGHT_A))&(~(1<<LIGHT_B));
-  }
-  int SD_Finish = gpio_get(SHUTDOWN_READ_PIN);
-  if (debug.in_process && SD_Finish){
-    printf("Shutdown Done");
+    output_clear(OWNER_LIGHTS, (1 << LIGHT_A) | (1 << LIGHT_B));
   }
-  else if (SD_Finish){
-    return true;
-  }
-  else if (debug.in_process && (!lights_holder)){
-    printf("Lights Off");
-  }
-  else if (debug.in_process && (lights_holder)){
-    printf("Lights On");
-  }
-  else if (debug.in_process){
-    printf("No Commands");
-  }
-  return false;
+  return gpio_get(SHUTDOWN_READ_PIN);
 }
 
 //This is the controlled shutdown function. It initially waits
@@ -257,19 +279,28 @@ bool check_input_pattern(){
 //to turn off and there was no momentary lapse in power.
 //There are two different shutdown procedures running in parallel.
 //The system will shutdown in 45 seconds regardless if the Jetson
-//does not coordinate the shutdown after power is cut. 
-void shutdown_process(uint64_t input_time, bool shutdown_request){
+//does not coordinate the shutdown after power is cut. Until the
+//shutdown signal goes, the time to empty can bring it forward or hold
+//it back, see energy.h.
+void HOT_FUNC(shutdown_process)(uint64_t input_time, bool shutdown_request){
+  PROBE_SCOPE(PROBE_SHUTDOWN_PROCESS);
   uint64_t relative_time = input_time - (sd_now.start_time);
+  if (coordinated_sd || debug_force_sd){
+    sd_delay = settings.shutdown_delay;
+  }
+  else if ((relative_time <= sd_delay) || !energy_enabled()){
+    sd_delay = energy_shutdown_delay(relative_time);
+  }
   engage.in_process = (bool)check_pow() && (!shutdown_request) && (!coordinated_sd);
   if (debug_force_sd){
     engage.in_process = false;
   }
   if (engage.in_process){
-    if ((input_time - engage.start_time) > 20000000){
-      engage.start_time = input_time-20000000;
+    if ((input_time - engage.start_time) > settings.power_engage){
+      engage.start_time = input_time-settings.power_engage;
     }
-    else if ((input_time - engage.start_time) > 10000000){
-      engage.start_time = input_time - 10000000;
+    else if ((input_time - engage.start_time) > settings.relay_engage){
+      engage.start_time = input_time - settings.relay_engage;
     }
     else {
       engage.start_time = input_time;
@@ -281,72 +312,71 @@ void shutdown_process(uint64_t input_time, bool shutdown_request){
     jetson_current = current_monitor_read(COMP_I_MONITOR);
   }
   else if ((!shutdown_request) && coordinated_sd && (!sd_now.in_process)){
-    sd_now.start_time = input_time - (shutdown_delay);
+    sd_now.start_time = input_time - (settings.shutdown_delay);
     sd_now.in_process = true;
   }
-  else if ((relative_time > (shutdown_delay + jetson_signal_time)) && coordinated_sd){
-    if ((jetson_current - current_monitor_read(COMP_I_MONITOR))>delta_current_thresh){
-      current_state = InitialPower;
-      watchdog_enable(500,1);
-      //Once this passes to the gpio_puts_masked, this will be end of program.
+  else if ((relative_time > (sd_delay + settings.jetson_signal_time)) && coordinated_sd){
+    if ((jetson_current - current_monitor_read(COMP_I_MONITOR))>settings.delta_current_thresh){
+      supervisor_reboot(500);
+      //Once this passes to the output_reset, this will be end of program.
       //If it does not shutdown, then a watchdog is enabled
       //to force a reboot because an error has likely occured.
       //Watchdog is having an issue, so as a substitute
       sd_now.in_process = false;
       sd_now.start_time = 0;
       engage.in_process = true;
-      engage.start_time = input_time;
       debug_force_sd = false;
       coordinated_sd = false;
       //Acts as universal offset in this code, effectively resetting the hardware clock
       debug_time = input_time;
-      gpio_put_masked(output_pins,current_state);
+      //Engage counts from now on the new time base, not the old one
+      engage.start_time = time_us_64() - debug_time;
+      output_reset();
     }
   }
-  //Wait 45s after "pressing" power button
-  if (relative_time > (shutdown_delay + 45000000)){
-    current_state = InitialPower;
-    watchdog_enable(500,1);
-    //Once this passes to the gpio_puts_masked, this will be end of program.
+  //Wait forced_shutdown (45s) after the shutdown signal
+  if (relative_time > (sd_delay + settings.forced_shutdown)){
+    supervisor_reboot(500);
+    //Once this passes to the output_reset, this will be end of program.
     //If it does not shutdown, then a watchdog is enabled
     //to force a reboot because an error has likely occured.
     //Watchdog is having an issue, so as a substitute
     sd_now.in_process = false;
     sd_now.start_time = 0;
     engage.in_process = true;
-    engage.start_time = input_time;
     debug_force_sd = false;
     coordinated_sd = false;
     //Acts as universal offset in this code, effectively resetting the hardware clock
     debug_time = input_time;
-    gpio_put_masked(output_pins,current_state);
+    //Engage counts from now on the new time base, not the old one
+    engage.start_time = time_us_64() - debug_time;
+    output_reset();
   }
   //After 500ms more, stop "pressing" the power button
-  else if (relative_time > (shutdown_delay + 10500000)){
-    current_state = current_state | (1<<JET_ON);
+  else if (relative_time > (sd_delay + 10500000)){
+    output_set(OWNER_STATE, 1<<JET_ON);
   }
   //After 20s, start "pressing" power button
-  else if ((relative_time > (shutdown_delay+10000000))&&(!engage.in_process)){    
-    current_state = current_state & ~(1<<JET_ON);
+  else if ((relative_time > (sd_delay+10000000))&&(!engage.in_process)){    
+    output_clear(OWNER_STATE, 1<<JET_ON);
     end_sd = true;
   }
   //After 10 s, turn on the shutdown signal to Jetson
-  else if ((relative_time>shutdown_delay)){
-    current_state |= (1 << SHUTDOWN_WRITE_PIN);
+  else if ((relative_time>sd_delay)){
+    output_set(OWNER_STATE, 1 << SHUTDOWN_WRITE_PIN);
   }
   //Wait 10 seconds to see if power was only lost momentarily
-  else if ((relative_time <= shutdown_delay) && (engage.in_process)){
+  else if ((relative_time <= sd_delay) && (engage.in_process)){
     sd_now.in_process = false;
     sd_now.start_time = 0;
   }
 }
 
-//Inverts the state of the pin by clearing or setting the
-//corresponding bit in the current_state global variable. 
-void toggle_pin(int pin){
+//Inverts the state of the pin through the SIO xor register
+//on behalf of the debug console. 
+void HOT_FUNC(toggle_pin)(int pin){
   uint32_t pin_mask = (1 << pin);
-  current_state = current_state ^ pin_mask;
-  gpio_put_masked(output_pins,current_state);
+  output_toggle(OWNER_DEBUG, pin_mask);
 }
 
 //Converts ADC value to temperature using datasheet-given equation. 
@@ -376,147 +406,336 @@ float check_temp(int sensor){
   return temp;
 }
 
-//The core of debug mode that parses the char input and 
-//determines the proper test that has been requested. Char
-//command usages are listed next to each check below. 
-void parser(int input_char){
-  bool valid_command = false;
-  switch (input_char) {
-    //"M" toggles the main relay
-    case 77:
-      toggle_pin(MAIN_RELAY);
-      valid_command = true;
-    break;
-    case 83:
-      //"S" toggles the switch relay
-      toggle_pin(SWITCH_PWR_EN);
-      valid_command = true;
-    break;
-    //"C" toggles the computer relay
-    case 67:
-      toggle_pin(COMP_PWR_EN);
-      valid_command = true;
-    break;
-    //"U" reads current monitor pins
-    case 85:{
-      double holder[2];
-      valid_command = true;
-      holder[0] = current_monitor_read(COMP_I_MONITOR);
-      holder[1] = current_monitor_read(SWITCH_I_MONITOR);
-      printf("Comp I-Monitor: %.2fA\nSwitch I-Monitor: %.2fA\n",holder[0],holder[1]);
-    }
-    break;
-    //"J" toggles the Jetson on pin
-    case 74:
-      toggle_pin(JET_ON);
-      valid_command = true;
-    break;
-    //"j" provides an interface for the testing mode of the Jetson
-    case 106:{
-        int holder[3];
-        holder[0] = gpio_get(IN0);
-        holder[1] = gpio_get(IN1);
-        holder[2] = gpio_get(IN2);
-        printf("I%1d%1d%1d|",holder[2],holder[1],holder[0]);
-        check_input_pattern();
-        valid_command = true;
-    break;}
-    //"T" prints temperatures over serial
-    case 84:{
-      printf("%.4f°C  ",check_temp(1));
-      printf("%.4f°C\n",check_temp(2));
-      valid_command = true;
-    break;}
-    //"a" toggles LEDA
-    case 97:
-      toggle_pin(LEDA);
-      valid_command = true;
-    break;
-    //"b" toggles LEDB
-    case 98:
-      toggle_pin(LEDB);
-      valid_command = true;
-    break;
-    //"A" toggles LIGHT_A
-    case 65:
-      toggle_pin(LIGHT_A);
-      valid_command = true;
-    break;
-    //"B" toggles LIGHT_B
-    case 66:
-      toggle_pin(LIGHT_B);
-      valid_command = true;
-    break;
-    //"O" enables output pin control parsing expects 4 chars like "O001" MSB (2) to LSB (0)
-    case 79:{
-      uint32_t input_string[3];
-      valid_command = true;
-      input_string[2] = getchar_timeout_us(5000000)-48;
-      input_string[1] = getchar_timeout_us(5000000)-48;
-      input_string[0] = getchar_timeout_us(5000000)-48;
-      if ((input_string[2]==(uint32_t)-49)||(input_string[1]==(uint32_t)-49)||(input_string[0]==(uint32_t)-49)) break;
-      uint32_t state_update = (input_string[0] << OUT0) + (input_string[1] << OUT1) + (input_string[2] << OUT2);
-      uint32_t outputs = (1 << OUT0) + (1 << OUT1) + (1 << OUT2);
-      current_state = (current_state & (~outputs))+state_update;
-      gpio_put_masked(output_pins,current_state);
-      printf("\n");
-    }
-    break;
-    //"I" enables input pin value reading
-    case 73:{
-      int holder[3];
-      holder[0] = gpio_get(IN0);
-      holder[1] = gpio_get(IN1);
-      holder[2] = gpio_get(IN2);
-      printf("I%1d%1d%1d\n",holder[2],holder[1],holder[0]);
-      valid_command = true;
-    }
-    break;
-    //"K" runs shutdown procedure
-    case 75:
-      debug.in_process = false;
-      sd_now.in_process = true;
-      debug_force_sd = true;
-      end_sd = true;
-      valid_command = true;
-      break;
-    //"V" reads voltage of input from ADC mux with optional choice of which
-    //pin to read. Defaults to reading Pin 1 on the mux. 
-    case 86:
-    {
-      int holder = getchar_timeout_us(5000000);
-      if (holder == PICO_ERROR_TIMEOUT){
-        uint voltage = read_ADC_MUX(KEY_Voltage);
-        printf("%d\n",voltage);
-      }
-      else{
-        if ((holder >= 48)&&(holder <= 57)){
-          holder -= 48;
-          bits selector = {0,0,0};
-          selector.S2 = ((holder&4) >> 2);
-          selector.S1 = ((holder&2) >> 1);
-          selector.S0 = (holder&1);
-          uint voltage = read_ADC_MUX(selector);
-          printf("MUX Pin %d: %d\n",holder,voltage);
-        }
-      }
-      valid_command = true;
-    }
-    
-    break;
-    case 100:
-      debug.in_process = false;
-      valid_command = true;
-      break;
+//Debug console command handlers. Each one is listed in
+//debug_commands below with its name and number of arguments.
+
+//"M", "S", "C", "J", "a", "b", "A", "B" toggle the pin in param
+bool cmd_toggle(int argc, char *argv[], int param){
+  toggle_pin(param);
+  return true;
+}
+
+//"U" reads current monitor pins
+bool cmd_current(int argc, char *argv[], int param){
+  double holder[2];
+  holder[0] = current_monitor_read(COMP_I_MONITOR);
+  holder[1] = current_monitor_read(SWITCH_I_MONITOR);
+  console_printf("Comp I-Monitor: %.2fA\nSwitch I-Monitor: %.2fA\n",holder[0],holder[1]);
+  return true;
+}
+
+//"j" provides an interface for the testing mode of the Jetson. The
+//state machine acts on the same inputs, so a shutdown request
+//raised here is a real one. 
+bool cmd_jetson_inputs(int argc, char *argv[], int param){
+  int holder[3];
+  holder[0] = gpio_get(IN0);
+  holder[1] = gpio_get(IN1);
+  holder[2] = gpio_get(IN2);
+  console_printf("I%1d%1d%1d|",holder[2],holder[1],holder[0]);
+  if (gpio_get(SHUTDOWN_READ_PIN)){
+    console_printf("Shutdown Done\n");
+  }
+  else if (gpio_get(Lights_Pin)){
+    console_printf("Lights On\n");
+  }
+  else {
+    console_printf("Lights Off\n");
+  }
+  return true;
+}
+
+//"T" prints temperatures over serial
+bool cmd_temperature(int argc, char *argv[], int param){
+  console_printf("%.4f°C  ",check_temp(1));
+  console_printf("%.4f°C\n",check_temp(2));
+  return true;
+}
+
+//"O" sets the output pins from 3 bits MSB (2) to LSB (0), like "O001" or "O 001"
+bool cmd_outputs(int argc, char *argv[], int param){
+  uint32_t input_bits;
+  if (!console_arg_bits(argv[0], 3, &input_bits)){
+    return false;
+  }
+  uint32_t state_update = (((input_bits >> 0)&1) << OUT0) + (((input_bits >> 1)&1) << OUT1) + (((input_bits >> 2)&1) << OUT2);
+  uint32_t outputs = (1 << OUT0) + (1 << OUT1) + (1 << OUT2);
+  output_enforce(OWNER_DEBUG, outputs, state_update);
+  return true;
+}
+
+//"I" enables input pin value reading
+bool cmd_inputs(int argc, char *argv[], int param){
+  int holder[3];
+  holder[0] = gpio_get(IN0);
+  holder[1] = gpio_get(IN1);
+  holder[2] = gpio_get(IN2);
+  console_printf("I%1d%1d%1d\n",holder[2],holder[1],holder[0]);
+  return true;
+}
+
+//Ends the debug session and hands every pin it took over back to
+//its owner. 
+void leave_debug(){
+  debug.in_process = false;
+  output_release(output_overrides());
+  console_set_commands(&usb_console, run_commands, run_command_count);
+  printf("Exiting debug mode\n");
+}
+
+//"K" runs shutdown procedure
+bool cmd_shutdown(int argc, char *argv[], int param){
+  if (!sd_now.in_process){
+    sd_now.start_time = time_us_64() - debug_time;
+  }
+  sd_now.in_process = true;
+  debug_force_sd = true;
+  end_sd = true;
+  leave_debug();
+  return true;
+}
+
+//"V" reads voltage of input from ADC mux with optional choice of which
+//pin to read, like "V3". Defaults to reading the key voltage. 
+bool cmd_voltage(int argc, char *argv[], int param){
+  if (argc == 0){
+    uint voltage = read_ADC_MUX(KEY_Voltage);
+    console_printf("%d\n",voltage);
+    return true;
+  }
+  uint32_t holder;
+  if ((!console_arg_uint(argv[0], &holder)) || (holder > 7)){
+    return false;
+  }
+  uint voltage = read_ADC_MUX(mux_input(holder));
+  console_printf("MUX Pin %d: %d\n",holder,voltage);
+  return true;
+}
+
+//"E" compares the cycle cost of the output fast paths
+bool cmd_enforce_benchmark(int argc, char *argv[], int param){
+  output_enforce_benchmark();
+  return true;
+}
+
+//"P" sends the hot-path probe table as a binary frame
+bool cmd_probe_dump(int argc, char *argv[], int param){
+  probe_dump();
+  return true;
+}
+
+//"p" clears the probe table
+bool cmd_probe_reset(int argc, char *argv[], int param){
+  probe_reset();
+  return true;
+}
+
+//"cap" runs the logic analyzer, see capture.h. Also available
+//outside debug mode.
+bool cmd_capture(int argc, char *argv[], int param){
+  //The sample clock is divided from clk_sys, which has to be at full
+  //speed before it is worked out
+  clock_policy_set(CLOCK_FULL);
+  return capture_command(argc, argv);
+}
+
+//"cfg" reads and changes the settings, see settings.h. Available in
+//every mode and on uart1.
+bool cmd_settings(int argc, char *argv[], int param){
+  return settings_command(argc, argv);
+}
+
+//"wd" reports what the last watchdog reset left behind, see
+//supervisor.h. Available in every mode and on uart1.
+bool cmd_watchdog(int argc, char *argv[], int param){
+  supervisor_print();
+  return true;
+}
+
+//"upd" receives and starts a new image from the Jetson, see update.h.
+//Available in every mode and on uart1.
+bool cmd_update(int argc, char *argv[], int param){
+  return update_command(argc, argv);
+}
+
+//"sby" reports the time spent in standby, see standby.h. Available in
+//every mode and on uart1.
+bool cmd_standby(int argc, char *argv[], int param){
+  return standby_command(argc, argv);
+}
+
+//"clk" reports the clock profile and the time spent in each, see
+//clock_policy.h. Available in every mode and on uart1.
+bool cmd_clock(int argc, char *argv[], int param){
+  return clock_policy_command(argc, argv);
+}
+
+//"shed" reports the load shedding and its ride-throughs, see
+//loadshed.h. Available in every mode and on uart1.
+bool cmd_shed(int argc, char *argv[], int param){
+  return loadshed_command(argc, argv);
+}
+
+//"tte" reports the supply's time to empty, see energy.h. Available in
+//every mode and on uart1.
+bool cmd_tte(int argc, char *argv[], int param){
+  return energy_command(argc, argv);
+}
+
+//"pq" reports the power quality of the key voltage, see
+//power_quality.h. Available in every mode and on uart1.
+bool cmd_power_quality(int argc, char *argv[], int param){
+  return power_quality_command(argc, argv);
+}
+
+//"fr" drives the flight recorder for power faults, see
+//flight_recorder.h. Available in every mode and on uart1.
+bool cmd_flight_recorder(int argc, char *argv[], int param){
+  return flight_recorder_command(argc, argv);
+}
+
+//"roll" reads the history of the board's readings, see rollups.h.
+//Available in every mode and on uart1.
+bool cmd_rollups(int argc, char *argv[], int param){
+  return rollups_command(argc, argv);
+}
+
+//"scope" takes high rate ADC bursts, see scope.h. Also available
+//outside debug mode.
+bool cmd_scope(int argc, char *argv[], int param){
+  //The rate is divided from clk_adc, which must not move to the
+  //crystal mid-burst, and the trigger is looked for by the CPU
+  clock_policy_set(CLOCK_FULL);
+  return scope_command(argc, argv);
+}
+
+//"ovr" lists the pins taken over by hand, "ovr clear" hands them back
+//to the state machine, lights and LED without leaving debug mode
+bool cmd_overrides(int argc, char *argv[], int param){
+  if (argc == 1){
+    if (strcmp(argv[0], "clear") != 0){
+      return false;
     }
-  if (valid_command){
-    printf("Input \"%c\": done\n", input_char);
+    output_release(output_overrides());
   }
+  console_printf("Overrides: 0x%08lx\n", output_overrides());
+  return true;
+}
+
+//"d" leaves debug mode
+bool cmd_debug_exit(int argc, char *argv[], int param){
+  leave_debug();
+  return true;
+}
+
+const console_command debug_commands[] = {
+  {"M", 0, 0, cmd_toggle, MAIN_RELAY},
+  {"S", 0, 0, cmd_toggle, SWITCH_PWR_EN},
+  {"C", 0, 0, cmd_toggle, COMP_PWR_EN},
+  {"J", 0, 0, cmd_toggle, JET_ON},
+  {"a", 0, 0, cmd_toggle, LEDA},
+  {"b", 0, 0, cmd_toggle, LEDB},
+  {"A", 0, 0, cmd_toggle, LIGHT_A},
+  {"B", 0, 0, cmd_toggle, LIGHT_B},
+  {"U", 0, 0, cmd_current, 0},
+  {"j", 0, 0, cmd_jetson_inputs, 0},
+  {"T", 0, 0, cmd_temperature, 0},
+  {"O", 1, 1, cmd_outputs, 0},
+  {"I", 0, 0, cmd_inputs, 0},
+  {"K", 0, 0, cmd_shutdown, 0},
+  {"V", 0, 1, cmd_voltage, 0},
+  {"E", 0, 0, cmd_enforce_benchmark, 0},
+  {"P", 0, 0, cmd_probe_dump, 0},
+  {"p", 0, 0, cmd_probe_reset, 0},
+  {"cap", 1, 5, cmd_capture, 0},
+  {"scope", 1, 5, cmd_scope, 0},
+  {"cfg", 0, 3, cmd_settings, 0},
+  {"wd", 0, 0, cmd_watchdog, 0},
+  {"upd", 0, 3, cmd_update, 0},
+  {"sby", 0, 0, cmd_standby, 0},
+  {"clk", 0, 0, cmd_clock, 0},
+  {"shed", 0, 1, cmd_shed, 0},
+  {"tte", 0, 0, cmd_tte, 0},
+  {"pq", 0, 1, cmd_power_quality, 0},
+  {"fr", 0, 2, cmd_flight_recorder, 0},
+  {"roll", 0, 3, cmd_rollups, 0},
+  {"ovr", 0, 1, cmd_overrides, 0},
+  {"d", 0, 0, cmd_debug_exit, 0},
+};
+const size_t debug_command_count = count_of(debug_commands);
+
+//Commands available outside debug mode.
+
+//"d" enters debug mode. The state machine keeps running, only the
+//pins the debug commands switch are taken out of its hands. 
+bool cmd_debug_enter(int argc, char *argv[], int param){
+  debug.in_process = true;
+  debug.start_time = time_us_64();
+  console_set_commands(&usb_console, debug_commands, debug_command_count);
+  printf("Entering debug mode\n");
+  printf("Ready!\n");
+  return true;
+}
+
+//"T" prints the reference time
+bool cmd_reference_time(int argc, char *argv[], int param){
+  uint64_t time_ref = time_us_64() - debug_time;
+  console_printf("Reference time: %lu\n", (uint32_t)(time_ref&0xffffffff));
+  return true;
+}
+
+//"R" has the effect of resetting time references
+bool cmd_reset_time(int argc, char *argv[], int param){
+  debug_time = time_us_64();
+  return true;
+}
+
+//"L" reports and clears the worst loop latency
+bool cmd_loop_latency(int argc, char *argv[], int param){
+  console_printf("Loop worst: %lu cycles, %lu us\n", loop_worst_cycles, loop_worst_cycles/probe_cycles_per_us());
+  loop_worst_cycles = 0;
+  return true;
 }
 
+const console_command run_commands[] = {
+  {"d", 0, 0, cmd_debug_enter, 0},
+  {"T", 0, 0, cmd_reference_time, 0},
+  {"R", 0, 0, cmd_reset_time, 0},
+  {"L", 0, 0, cmd_loop_latency, 0},
+  {"cap", 1, 5, cmd_capture, 0},
+  {"scope", 1, 5, cmd_scope, 0},
+  {"cfg", 0, 3, cmd_settings, 0},
+  {"wd", 0, 0, cmd_watchdog, 0},
+  {"upd", 0, 3, cmd_update, 0},
+  {"sby", 0, 0, cmd_standby, 0},
+  {"clk", 0, 0, cmd_clock, 0},
+  {"shed", 0, 1, cmd_shed, 0},
+  {"tte", 0, 0, cmd_tte, 0},
+  {"pq", 0, 1, cmd_power_quality, 0},
+  {"fr", 0, 2, cmd_flight_recorder, 0},
+  {"roll", 0, 3, cmd_rollups, 0},
+};
+const size_t run_command_count = count_of(run_commands);
+
+//Commands the Jetson can send over uart1.
+const console_command jetson_commands[] = {
+  {"T", 0, 0, cmd_reference_time, 0},
+  {"cfg", 0, 3, cmd_settings, 0},
+  {"wd", 0, 0, cmd_watchdog, 0},
+  {"upd", 0, 3, cmd_update, 0},
+  {"sby", 0, 0, cmd_standby, 0},
+  {"clk", 0, 0, cmd_clock, 0},
+  {"shed", 0, 1, cmd_shed, 0},
+  {"tte", 0, 0, cmd_tte, 0},
+  {"pq", 0, 1, cmd_power_quality, 0},
+  {"fr", 0, 2, cmd_flight_recorder, 0},
+  {"roll", 0, 3, cmd_rollups, 0},
+};
+const size_t jetson_command_count = count_of(jetson_commands);
+
 //This is a function to handle inputs for the AUX switch on the 
 //power board. Currently with PLACEHOLDER behavior
-void check_aux_switch(){
+void HOT_FUNC(check_aux_switch)(){
   gpio_set_pulls(AUX_SW,true,false);
   bool holder = gpio_get(AUX_SW);
   if ((holder != last_aux_sw_state) && (holder == false)){
@@ -530,7 +749,8 @@ void check_aux_switch(){
 //This function takes the current time and determines the time within 
 //the pulses of the pre-defined blink patterns and whether LED should 
 //be set high or low given the time within the period of the signal. 
-void blink_pattern(){
+void HOT_FUNC(blink_pattern)(){
+  PROBE_SCOPE(PROBE_BLINK_PATTERN);
   int state_changes;
   double time = (double)(time_us_64())/1000000.0;
   double time_in_pulse;
@@ -568,29 +788,128 @@ void blink_pattern(){
   for (int i = (state_changes-1); i >=0; i--){
       //printf("%f   %f   %d   i:%d\n",(holder.times[i]*holder.length),time_in_pulse, holder.states[i],i);
       if (time_in_pulse > (holder.times[i]*holder.length)){
-        current_state = current_state & (~(1 << BUILT_IN_LED));
-        current_state = current_state | ((holder.states[i]) << BUILT_IN_LED);
+        output_write(OWNER_LED, 1 << BUILT_IN_LED, (holder.states[i]) << BUILT_IN_LED);
         break;
       }
     }
 }
 
-//Separate loop from the main loop to listen for input
-//over serial. 
-uint64_t debug_mode(){
-    printf("Ready!\n");
-    while (debug.in_process) {
-        int holder;
-        holder = getchar_timeout_us(0);
-        if (holder != -1){
-            parser(holder);
-        }
-        blink_pattern();
-        gpio_put_masked(output_pins,current_state);
-        check_aux_switch();
-    }
-    printf("Exiting debug mode\n");
-    return time_us_64() - debug_time;
+//The state machine flags for the supervisor's breadcrumbs. 
+#define PHASE_EARLY_START (1 << 0)
+#define PHASE_ENGAGE (1 << 1)
+#define PHASE_SHUTDOWN (1 << 2)
+#define PHASE_END_SD (1 << 3)
+#define PHASE_COORDINATED_SD (1 << 4)
+#define PHASE_DEBUG (1 << 5)
+#define PHASE_FORCE_SD (1 << 6)
+uint8_t HOT_FUNC(state_phase)(){
+  return (early_start ? PHASE_EARLY_START : 0) | (engage.in_process ? PHASE_ENGAGE : 0) |
+    (sd_now.in_process ? PHASE_SHUTDOWN : 0) | (end_sd ? PHASE_END_SD : 0) |
+    (coordinated_sd ? PHASE_COORDINATED_SD : 0) | (debug.in_process ? PHASE_DEBUG : 0) |
+    (debug_force_sd ? PHASE_FORCE_SD : 0);
+}
+
+//Milliseconds from start to time. evaluate_state stamps its starts
+//with a fresh reading, later than the loop's time, so one that has
+//only just started comes out as 0 rather than wrapping.
+static uint32_t age_ms(uint64_t time, uint64_t start){
+  int64_t age = (int64_t)(time - start);
+  if (age <= 0){
+    return 0;
+  }
+  uint64_t ms = (uint64_t)age/1000;
+  return ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+}
+
+//Hands the state machine's lifecycle to the supervisor, for a warm
+//restart if the board is reset. Called after each run of it. 
+void keep_state(uint64_t time){
+  double jetson_ca = jetson_current*100.0;
+  supervisor_state state = {
+    .phase = state_phase(),
+    .engage_ms = age_ms(time, engage.start_time),
+    .shutdown_ms = sd_now.in_process ? age_ms(time, sd_now.start_time) : 0,
+    .jetson_ca = (int16_t)(jetson_ca > INT16_MAX ? INT16_MAX : (jetson_ca < INT16_MIN ? INT16_MIN : jetson_ca)),
+  };
+  supervisor_keep(&state);
+}
+
+//After a reset by the supervisor, puts back the outputs that were on
+//and picks the state machine up where it was, so the relays,
+//regulators and lights are only off for as long as the reboot took
+//and an engage or a shutdown carries on rather than starting over.
+//Without a kept lifecycle the engage timer is moved on to match the
+//power outputs, and the state machine goes into a shutdown from there
+//if the key is off. A kept shutdown older than the longest one can
+//take is not believed either. Debug mode is not resumed. 
+void restore_state(uint32_t pins){
+  pins &= output_owner_mask(OWNER_STATE) | output_owner_mask(OWNER_LIGHTS);
+  if (!pins){
+    return;
+  }
+  output_set(OWNER_STATE, pins);
+  output_set(OWNER_LIGHTS, pins);
+  output_flush();
+  uint64_t now = time_us_64();
+  supervisor_state state;
+  uint64_t longest_sd = energy_enabled() && (settings.tte_hold > settings.shutdown_delay) ? settings.tte_hold :
+    settings.shutdown_delay;
+  bool resumed = supervisor_resume(&state);
+  if (resumed && (state.phase & PHASE_SHUTDOWN) &&
+    ((uint64_t)state.shutdown_ms*1000 > longest_sd + settings.forced_shutdown)){
+    resumed = false;
+  }
+  if (resumed){
+    early_start = state.phase & PHASE_EARLY_START;
+    engage.in_process = state.phase & PHASE_ENGAGE;
+    engage.start_time = now - (uint64_t)state.engage_ms*1000;
+    sd_now.in_process = state.phase & PHASE_SHUTDOWN;
+    sd_now.start_time = sd_now.in_process ? now - (uint64_t)state.shutdown_ms*1000 : 0;
+    end_sd = state.phase & PHASE_END_SD;
+    coordinated_sd = state.phase & PHASE_COORDINATED_SD;
+    debug_force_sd = state.phase & PHASE_FORCE_SD;
+    jetson_current = (double)state.jetson_ca/100.0;
+    return;
+  }
+  if ((pins & (CompAndSwitch)) == (CompAndSwitch)){
+    engage.start_time = now - settings.power_engage - 1;
+  } else if (pins & MainRelay){
+    engage.start_time = now - settings.relay_engage - 1;
+  }
+  early_start = false;
+}
+
+//The key is off, any shutdown is over and nothing is powered, and
+//no one is using the board: no debug session or overrides, no host
+//on the USB console, no capture, scope burst or update under way.
+bool parked(){
+  uint32_t powered = output_owner_mask(OWNER_STATE) | output_owner_mask(OWNER_LIGHTS);
+  return early_start && !sd_now.in_process && !end_sd && !debug.in_process && !(output_state() & powered) &&
+    !output_overrides() && !usb_port_connected(USB_CONSOLE) && !capture_running() && !update_busy() &&
+    !flight_recorder_busy() && !scope_running();
+}
+
+//Sleeps until the key is on or the aux switch is pressed. The engage
+//sequence then starts over from the wake, as it would from power on.
+void standby(){
+  printf("Standby: entering\n");
+  output_write(OWNER_LED, 1 << BUILT_IN_LED, 0);
+  output_flush();
+  standby_run(1u << AUX_SW, check_pow);
+  engage.start_time = time_us_64() - debug_time;
+  printf("Standby: awake\n");
+}
+
+//Full speed while timing or throughput matters: a shutdown, a debug
+//session, a capture, a scope burst or an update. The monitor clock the rest of the
+//time, engaged or parked, is plenty for watching the key and the
+//Jetson's pins.
+clock_profile wanted_profile(){
+  if (sd_now.in_process || end_sd || coordinated_sd || debug.in_process || capture_running() || update_busy() ||
+    scope_running()){
+    return CLOCK_FULL;
+  }
+  return CLOCK_MONITOR;
 }
 
 //Function to setup the UART communication with the Jetson. 
@@ -598,34 +917,51 @@ uint8_t init_uart_jetson(){
     uart_init(UARTID, BAUDRATE);
     gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
     gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
+    uart_console_init(UARTID);
 }
 
 //Main function to initialize all functions and then enter main
 //operation loop. 
 int main(){
-  stdio_init_all();
+  //After a reset by the supervisor the outputs go back on before
+  //anything slow, stdio included. Their levels are written before
+  //the pins are made outputs, so they never drive low in between. 
+  settings_init();
+  sd_delay = settings.shutdown_delay;
   //Found these neat predefined functions in the SDK
   //for setting pins from a bitmap.
   gpio_init_mask(all_pins);
+  outputs_init(output_pins);
+  restore_state(supervisor_init(SUPERVISOR_RUN_TASKS));
   gpio_set_dir_out_masked(output_pins);
   gpio_set_dir_in_masked(input_pins);
+  clock_policy_init();
+  stdio_init_all();
+  usb_ports_init();
+  supervisor_print();
   init_uart_jetson();
+  update_init();
   //Configuring ADC input is separate
   adc_init();
   adc_gpio_init(ADC_MUX);
+  cycles_init();
+  probes_init();
+  power_quality_init();
+  flight_recorder_init();
+  rollups_init();
+  console_init(&usb_console, run_commands, run_command_count, console_stdio_read, console_stdio_write);
+  console_init(&jetson_console, jetson_commands, jetson_command_count, update_read, uart_console_write);
   bool checked_priority = false;
   while (1) {
     uint64_t time_ref = time_us_64() - debug_time;
-    if (debug.in_process) {
-      bool holder = sd_now.in_process; 
-      printf("Entering debug mode\n");
-      debug.start_time = time_ref;
-      debug_time += debug_mode() - debug.start_time;
-      if ((!holder)&&(sd_now.in_process)){
-        sd_now.start_time = time_us_64()-debug_time;
-      }
-    }
-    if (((time_ref % PRIORITY_CONST)>(PRIORITY_CONST/2)) && (!checked_priority)){
+    uint32_t loop_start = cycles_now();
+    PROBE_SCOPE(PROBE_MAIN_LOOP);
+    //After the final power cut, neither the state machine nor anything
+    //else runs the outputs until the watchdog reboots the board
+    if (supervisor_rebooting()){
+      checked_priority = true;
+    } else if (((time_ref % PRIORITY_CONST)>(PRIORITY_CONST/2)) && (!checked_priority)){
+      supervisor_begin(SUPERVISOR_STATE);
       bool input_holder = check_input_pattern();
       if (!sd_now.in_process){
         evaluate_state(time_ref, input_holder);
@@ -633,22 +969,63 @@ int main(){
       else {
         shutdown_process(time_ref, input_holder);
       }
+      keep_state(time_ref);
       check_aux_switch();
+      supervisor_end(SUPERVISOR_STATE);
       checked_priority = true;
     } else if ((time_ref % PRIORITY_CONST)<(PRIORITY_CONST/4)){
       checked_priority = false;
     }
-    blink_pattern();
-    gpio_put_masked(output_pins,current_state);
-    int char_holder = getchar_timeout_us(0);
-    if (char_holder==100){
-      debug.in_process = true;
-    } else if (char_holder == 84){
-      printf("Reference time: %lu\n", (uint32_t)(time_ref&0xffffffff));
-    } else if (char_holder == 82){
-      //This has the effect of resetting time references
-      debug_time = time_us_64();
+    supervisor_begin(SUPERVISOR_OUTPUTS);
+    uint64_t now = time_us_64();
+    if (loadshed_due(now)){
+      uint key_counts = read_ADC_MUX(KEY_Voltage);
+      uint comp_counts = current_monitor_counts(COMP_I_MONITOR);
+      uint switch_counts = current_monitor_counts(SWITCH_I_MONITOR);
+      loadshed_sample(now, key_counts);
+      power_quality_sample(now, key_counts);
+      if (flight_recorder_recording()){
+        flight_recorder_sample(now, key_counts, comp_counts, switch_counts,
+          current_from_counts(comp_counts > switch_counts ? comp_counts : switch_counts));
+      }
+      rollups_sample(now, key_counts, comp_counts, switch_counts, gpio_get_all());
+    }
+    if (rollups_due(now)){
+      rollups_temperatures(now, read_ADC_MUX(Temp_Sensor1), read_ADC_MUX(Temp_Sensor2));
+    }
+    if (energy_due(now)){
+      energy_sample(now, read_ADC_MUX(mux_input(settings.tte_mux)), current_monitor_read(COMP_I_MONITOR),
+        current_monitor_read(SWITCH_I_MONITOR));
+    }
+    if (supervisor_rebooting()){
+      output_reset();
+    } else {
+      blink_pattern();
+      output_flush();
+    }
+    supervisor_end(SUPERVISOR_OUTPUTS);
+    uint32_t loop_cycles = probe_scale(cycles_since(loop_start));
+    if (loop_cycles > loop_worst_cycles){
+      loop_worst_cycles = loop_cycles;
+    }
+    supervisor_begin(SUPERVISOR_CONSOLE);
+    console_poll(&usb_console);
+    supervisor_end(SUPERVISOR_CONSOLE);
+    supervisor_begin(SUPERVISOR_JETSON_CONSOLE);
+    console_poll(&jetson_console);
+    update_poll();
+    uart_console_flush();
+    supervisor_end(SUPERVISOR_JETSON_CONSOLE);
+    supervisor_begin(SUPERVISOR_CAPTURE);
+    capture_poll();
+    flight_recorder_poll();
+    scope_poll();
+    supervisor_end(SUPERVISOR_CAPTURE);
+    supervisor_service(state_phase());
+    if (standby_due(parked())){
+      standby();
     }
+    clock_policy_set(wanted_profile());
   }
   //Code should NEVER go beyond here. If it does, reboot. 
   watchdog_enable(1,1);
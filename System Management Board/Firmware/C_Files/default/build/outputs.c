@@ -0,0 +1,249 @@
+#include "stdio.h"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/structs/sio.h"
+#include "pins.h"
+#include "outputs.h"
+#include "hot_path.h"
+#include "cycles.h"
+
+#define ENFORCE_BENCH_RUNS 1000
+
+extern uint32_t output_pins;
+
+//The Thumb routine in functions.s is used when it is part of the
+//build, otherwise the C version below does the same job.
+#ifdef SMB_ASM_STATE_ENFORCE
+#define apply_state_map state_enforce
+#else
+#define apply_state_map state_enforce_c
+#endif
+
+//The pins each owner is allowed to drive. The state machine owns
+//the relays and the Jetson signals, the lights follow the Jetson
+//request, the LED shows the blink patterns and debug can touch all.
+static const uint32_t owner_masks[OWNER_COUNT] = {
+  [OWNER_STATE] = (1<<MAIN_RELAY) | (1<<COMP_PWR_EN) |
+    (1<<SWITCH_PWR_EN) | (1<<JET_ON) | (1<<SHUTDOWN_WRITE_PIN),
+  [OWNER_LIGHTS] = (1<<LIGHT_A) | (1<<LIGHT_B),
+  [OWNER_LED] = (1<<BUILT_IN_LED),
+  [OWNER_DEBUG] = 0xffffffff
+};
+
+//Shadow of the requested output levels and the bits that differ
+//from what was last written to the SIO. The overrides are the pins
+//debug has taken over, and requested what the other owners last
+//asked for, which the shadow goes back to when they are released.
+//The shed pins are driven low whatever the shadow says. All are only
+//touched while holding output_lock, which also masks interrupts on
+//this core.
+static uint32_t managed_pins = 0;
+static uint32_t shadow = 0;
+static uint32_t dirty = 0;
+static uint32_t overrides = 0;
+static uint32_t requested = 0;
+static uint32_t shed = 0;
+static spin_lock_t *output_lock;
+
+//Records the owner's request for pins at the levels in values and
+//returns the pins it may change now. Call with output_lock held.
+static inline uint32_t HOT_FUNC(claim)(output_owner owner, uint32_t pins, uint32_t values){
+  if (owner == OWNER_DEBUG){
+    overrides |= pins;
+    return pins;
+  }
+  requested = (requested & ~pins) | (values & pins);
+  return pins & ~overrides;
+}
+
+//Claims a hardware spin lock so the outputs can be changed from
+//either core or from interrupts. Every managed pin starts dirty so
+//the first flush drives the whole mask to a known level.
+void outputs_init(uint32_t pins){
+  output_lock = spin_lock_init(spin_lock_claim_unused(true));
+  managed_pins = pins;
+  shadow = 0;
+  dirty = pins;
+  overrides = 0;
+  requested = 0;
+  shed = 0;
+}
+
+//Requests the pins go high. Only bits that change are marked dirty.
+void HOT_FUNC(output_set)(output_owner owner, uint32_t pins){
+  pins &= owner_masks[owner] & managed_pins;
+  uint32_t save = spin_lock_blocking(output_lock);
+  pins = claim(owner, pins, pins);
+  dirty |= pins & ~shadow;
+  shadow |= pins;
+  spin_unlock(output_lock, save);
+}
+
+//Requests the pins go low. Only bits that change are marked dirty.
+void HOT_FUNC(output_clear)(output_owner owner, uint32_t pins){
+  pins &= owner_masks[owner] & managed_pins;
+  uint32_t save = spin_lock_blocking(output_lock);
+  pins = claim(owner, pins, 0);
+  dirty |= pins & shadow;
+  shadow &= ~pins;
+  spin_unlock(output_lock, save);
+}
+
+//Sets the masked pins to the matching bits of values.
+void HOT_FUNC(output_write)(output_owner owner, uint32_t pins, uint32_t values){
+  pins &= owner_masks[owner] & managed_pins;
+  uint32_t save = spin_lock_blocking(output_lock);
+  pins = claim(owner, pins, values);
+  uint32_t next = (shadow & ~pins) | (values & pins);
+  dirty |= shadow ^ next;
+  shadow = next;
+  spin_unlock(output_lock, save);
+}
+
+//Inverts the pins right away through the SIO xor register. A pin
+//with a pending change is left to the next flush instead, since the
+//hardware does not match the shadow for that bit yet.
+void HOT_FUNC(output_toggle)(output_owner owner, uint32_t pins){
+  pins &= owner_masks[owner] & managed_pins;
+  uint32_t save = spin_lock_blocking(output_lock);
+  pins = claim(owner, pins, ~requested);
+  shadow ^= pins;
+  sio_hw->gpio_togl = pins & ~dirty & ~shed;
+  spin_unlock(output_lock, save);
+}
+
+//C version of state_enforce from functions.s. Applies the masked
+//levels with a single write to the SIO xor register and returns the
+//requested pins that are not outputs.
+uint32_t __not_in_flash_func(state_enforce_c)(const state_map *map){
+  uint32_t valid = map->pins & output_pins;
+  sio_hw->gpio_togl = (sio_hw->gpio_out ^ map->values) & valid;
+  return map->pins & ~output_pins;
+}
+
+//Applies the levels to the pins immediately, bypassing the flush.
+//The hardware matches the shadow afterwards, so those pins are no
+//longer dirty. Returns the pins that were refused.
+uint32_t HOT_FUNC(output_enforce)(output_owner owner, uint32_t pins, uint32_t values){
+  uint32_t allowed = owner_masks[owner] & managed_pins;
+  uint32_t save = spin_lock_blocking(output_lock);
+  uint32_t claimed = claim(owner, pins & allowed, values);
+  state_map map = {values, claimed & ~shed};
+  uint32_t rejected = apply_state_map(&map);
+  uint32_t applied = claimed & ~rejected;
+  shadow = (shadow & ~applied) | (values & applied);
+  dirty &= ~applied;
+  spin_unlock(output_lock, save);
+  return rejected | (pins & ~allowed);
+}
+
+//Drops every managed pin at once and writes it out immediately,
+//overrides included. This is the final power cut at the end of a
+//shutdown.
+void HOT_FUNC(output_reset)(){
+  uint32_t save = spin_lock_blocking(output_lock);
+  shadow = 0;
+  dirty = 0;
+  overrides = 0;
+  requested = 0;
+  shed = 0;
+  sio_hw->gpio_clr = managed_pins;
+  spin_unlock(output_lock, save);
+}
+
+//Returns the requested output levels.
+uint32_t HOT_FUNC(output_state)(){
+  return shadow;
+}
+
+//Returns the pins the owner is allowed to drive.
+uint32_t output_owner_mask(output_owner owner){
+  return owner_masks[owner] & managed_pins;
+}
+
+//Returns the pins debug has taken over.
+uint32_t output_overrides(){
+  return overrides;
+}
+
+//Hands the pins back to their owners at the levels they last asked
+//for, applied at the next flush.
+void output_release(uint32_t pins){
+  uint32_t save = spin_lock_blocking(output_lock);
+  pins &= overrides;
+  overrides &= ~pins;
+  uint32_t next = (shadow & ~pins) | (requested & pins);
+  dirty |= shadow ^ next;
+  shadow = next;
+  spin_unlock(output_lock, save);
+}
+
+//Makes pins the shed pins. Newly shed ones go low straight away,
+//those no longer shed go back to the shadow at the next flush.
+void HOT_FUNC(output_shed)(uint32_t pins){
+  pins &= managed_pins;
+  uint32_t save = spin_lock_blocking(output_lock);
+  sio_hw->gpio_clr = pins & ~shed;
+  dirty |= shed & ~pins;
+  shed = pins;
+  spin_unlock(output_lock, save);
+}
+
+//Returns the pins held low by output_shed.
+uint32_t output_shed_pins(){
+  return shed;
+}
+
+//Writes only the pins that changed since the last flush, using the
+//atomic set and clear registers so other pins are never disturbed.
+void HOT_FUNC(output_flush)(){
+  uint32_t save = spin_lock_blocking(output_lock);
+  if (dirty){
+    sio_hw->gpio_set = dirty & shadow & ~shed;
+    sio_hw->gpio_clr = dirty & ~(shadow & ~shed);
+    dirty = 0;
+  }
+  spin_unlock(output_lock, save);
+}
+
+//Measures the best and average SysTick cycle count of one call to
+//each state_enforce version. The map rewrites the current levels of
+//the output pins, so nothing visibly changes while it runs.
+static void benchmark_one(const char *name, uint32_t (*enforce)(const state_map *)){
+  state_map map = {sio_hw->gpio_out, output_pins};
+  uint32_t best = CYCLES_MASK;
+  uint32_t total = 0;
+  uint32_t overhead = CYCLES_MASK;
+  for (int i = 0; i < ENFORCE_BENCH_RUNS; i++){
+    uint32_t start = cycles_now();
+    uint32_t empty = cycles_since(start);
+    if (empty < overhead){
+      overhead = empty;
+    }
+  }
+  for (int i = 0; i < ENFORCE_BENCH_RUNS; i++){
+    uint32_t save = spin_lock_blocking(output_lock);
+    uint32_t start = cycles_now();
+    enforce(&map);
+    uint32_t cycles = cycles_since(start) - overhead;
+    spin_unlock(output_lock, save);
+    total += cycles;
+    if (cycles < best){
+      best = cycles;
+    }
+  }
+  printf("%s: best %lu cycles, mean %lu.%02lu cycles\n", name, best,
+    total/ENFORCE_BENCH_RUNS, (total%ENFORCE_BENCH_RUNS)*100/ENFORCE_BENCH_RUNS);
+}
+
+//Compares the Thumb routine against the C fallback. SysTick is
+//already running from main, and starting it over here would upset
+//the main loop's probe and any other open probe scope.
+void output_enforce_benchmark(){
+#ifdef SMB_ASM_STATE_ENFORCE
+  benchmark_one("state_enforce (asm)", state_enforce);
+#else
+  printf("state_enforce (asm): not built\n");
+#endif
+  benchmark_one("state_enforce_c", state_enforce_c);
+}
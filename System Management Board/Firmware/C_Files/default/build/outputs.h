@@ -0,0 +1,51 @@
+#ifndef OUTPUTS_H
+#define OUTPUTS_H
+
+#include "pico/stdlib.h"
+
+//Every part of the firmware that drives output pins does so as an
+//owner, and can only change the pins in that owner's mask.
+//
+//A pin the debug console drives becomes a manual override: what the
+//other owners ask for it is remembered but not applied, until the
+//pin is released and goes back to that.
+//
+//A shed pin is held low over every owner and override alike, while
+//the level they ask for is kept, and goes back to it when it is no
+//longer shed. Used by the load shedding, see loadshed.h.
+typedef enum output_owner{
+  OWNER_STATE,
+  OWNER_LIGHTS,
+  OWNER_LED,
+  OWNER_DEBUG,
+  OWNER_COUNT
+} output_owner;
+
+//A pin map applied in one go: the requested levels and the pins
+//they apply to. The layout is shared with state_enforce in functions.s.
+typedef struct state_map{
+  uint32_t values;
+  uint32_t pins;
+} state_map;
+
+//Both return the requested pins that are not in output_pins.
+uint32_t state_enforce(const state_map *map);
+uint32_t state_enforce_c(const state_map *map);
+
+void outputs_init(uint32_t pins);
+void output_set(output_owner owner, uint32_t pins);
+void output_clear(output_owner owner, uint32_t pins);
+void output_toggle(output_owner owner, uint32_t pins);
+void output_write(output_owner owner, uint32_t pins, uint32_t values);
+uint32_t output_enforce(output_owner owner, uint32_t pins, uint32_t values);
+void output_reset();
+uint32_t output_state();
+uint32_t output_owner_mask(output_owner owner);
+uint32_t output_overrides();
+void output_release(uint32_t pins);
+void output_shed(uint32_t pins);
+uint32_t output_shed_pins();
+void output_flush();
+void output_enforce_benchmark();
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PINS_H
+#define PINS_H
+
+//GPIO assignments for the System Management Board. Shared by
+//main.c and every module that touches the board pins.
+#define IN0 12
+#define IN1 10
+#define IN2 11
+#define OUT0 7
+#define OUT1 5
+#define OUT2 6
+#define LEDA 22
+#define LEDB 21
+#define SWITCH_PWR_EN 0
+#define COMP_PWR_EN 1
+#define MAIN_RELAY 2
+#define LIGHT_A 3
+#define LIGHT_B 4
+#define MUX_S2 20
+#define MUX_S1 19
+#define MUX_S0 18
+#define AUX_SW 13
+#define ADC_MUX 26
+#define ADC_MUX_CHANNEL 0
+#define JET_ON 15
+#define BUILT_IN_LED 25
+#define COMP_I_MONITOR 28
+#define SWITCH_I_MONITOR 27
+
+#define UART_TX_PIN 8
+#define UART_RX_PIN 9
+
+#define Lights_Pin IN0
+#define SHUTDOWN_READ_PIN IN2
+#define SHUTDOWN_WRITE_PIN OUT1
+
+#endif
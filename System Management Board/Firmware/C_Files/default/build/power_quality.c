@@ -0,0 +1,359 @@
+#include "stdio.h"
+#include "string.h"
+#include "pico/stdlib.h"
+#include "power_quality.h"
+#include "settings.h"
+#include "console.h"
+#include "binary_out.h"
+#include "hot_path.h"
+
+//The tracked nominal is an exponential average of the readings outside
+//events, in 1/65536 counts, over about 1 << NOMINAL_SHIFT readings, or
+//1 << SETTLE_SHIFT while the session settles. The levels in counts are
+//worked out again every LEVELS_EVERY readings.
+#define NOMINAL_SHIFT 12
+#define SETTLE_SHIFT 6
+#define LEVELS_EVERY 64
+
+static const uint32_t column_ms[PQ_DURATIONS - 1] = {10, 100, 500, 1000, 3000, 20000};
+
+//What outlasts a reset, in RAM the C runtime leaves alone
+typedef struct pq_kept{
+  uint32_t magic;
+  uint32_t boots;
+  //0 or 1, not a bool so a stale value can be told apart
+  uint8_t active;
+  pq_session session;
+  pq_session finished[PQ_SESSIONS];
+  uint32_t session_count, finished_count;
+  pq_event events[PQ_LOG];
+  uint32_t event_count;
+} pq_kept;
+static pq_kept __uninitialized_ram(kept);
+//A field update restarts without clearing RAM, so the size goes into
+//the magic and a build that lays kept out differently starts over
+#define KEPT_MAGIC (PQ_MAGIC ^ (uint32_t)sizeof(pq_kept))
+
+static uint64_t session_start;
+static uint32_t nominal16;
+//Levels in counts and the scale from counts to percent of nominal in
+//1/65536
+static uint32_t sag_level, sag_clear, swell_level, swell_clear, dropout_level, pct_scale;
+
+static bool in_event;
+static pq_event event;
+static uint64_t event_start;
+
+//Readings at or below volt_threshold are held back until the key comes
+//back, so the tail of a key off is not counted in the session.
+static uint64_t below_since;
+static uint32_t pending_samples, pending_sum, pending_min;
+static uint32_t pending_levels[PQ_LEVEL_BINS];
+
+static void bump(uint16_t *counter){
+  if (*counter < UINT16_MAX){
+    (*counter)++;
+  }
+}
+
+static void set_levels(){
+  uint32_t nominal = settings.pq_nominal ? settings.pq_nominal : (nominal16 >> 16);
+  if (!nominal){
+    nominal = 1;
+  }
+  kept.session.nominal = (uint16_t)nominal;
+  sag_level = nominal*settings.pq_sag/100;
+  sag_clear = nominal*(settings.pq_sag + PQ_HYSTERESIS)/100;
+  swell_level = nominal*settings.pq_swell/100;
+  swell_clear = nominal*(settings.pq_swell - PQ_HYSTERESIS)/100;
+  dropout_level = nominal*settings.pq_dropout/100;
+  pct_scale = (100u << 16)/nominal;
+}
+
+//Whether kept is this build's and holds together, the way the
+//sessions and the event log are written.
+static bool kept_valid(){
+  if ((kept.magic != KEPT_MAGIC) || (kept.active > 1) ||
+    (kept.finished_count + kept.active != kept.session_count)){
+    return false;
+  }
+  for (uint32_t i = 0; (i < kept.event_count) && (i < PQ_LOG); i++){
+    if (kept.events[i].kind >= PQ_KINDS){
+      return false;
+    }
+  }
+  return true;
+}
+
+void power_quality_init(){
+  if (!kept_valid()){
+    memset(&kept, 0, sizeof(kept));
+    kept.magic = KEPT_MAGIC;
+  }
+  kept.boots++;
+  //The session the reset cut short ends with the last reading it had
+  if (kept.active){
+    kept.finished[kept.finished_count % PQ_SESSIONS] = kept.session;
+    kept.finished_count++;
+    kept.active = false;
+  }
+}
+
+static uint32_t HOT_FUNC(level_bin)(uint32_t pct){
+  if (pct < 50){
+    return 0;
+  }
+  if (pct >= 120){
+    return PQ_LEVEL_BINS - 1;
+  }
+  return 1 + (pct - 50)/5;
+}
+
+static void start_session(uint64_t now, uint32_t counts){
+  memset(&kept.session, 0, sizeof(kept.session));
+  kept.session.start_s = (uint32_t)(now/1000000);
+  kept.session.boot = (uint16_t)kept.boots;
+  kept.session.min = UINT16_MAX;
+  kept.session.lowest_pct = 100;
+  kept.session.highest_pct = 100;
+  session_start = now;
+  nominal16 = counts << 16;
+  set_levels();
+  kept.session_count++;
+  kept.active = true;
+  in_event = false;
+  below_since = 0;
+  pending_samples = 0;
+}
+
+//The session ends where the key went off. A dip it ended on is the
+//key off, not an event.
+static void end_session(){
+  kept.session.length_ms = (uint32_t)((below_since - session_start)/1000);
+  kept.finished[kept.finished_count % PQ_SESSIONS] = kept.session;
+  kept.finished_count++;
+  kept.active = false;
+  in_event = false;
+}
+
+static void end_event(uint64_t now){
+  event.length_ms = (uint32_t)((now - event_start)/1000);
+  uint32_t column = 0;
+  while ((column < PQ_DURATIONS - 1) && (event.length_ms >= column_ms[column])){
+    column++;
+  }
+  if (event.kind == PQ_SWELL){
+    uint32_t row = event.extreme_pct <= 120 ? 0 : (event.extreme_pct <= 140 ? 1 : 2);
+    bump(&kept.session.swells[row][column]);
+    if (event.extreme_pct > kept.session.highest_pct){
+      kept.session.highest_pct = event.extreme_pct;
+    }
+  } else {
+    uint32_t row = PQ_SAG_ROWS - 1;
+    if (event.kind == PQ_SAG){
+      row = event.extreme_pct >= 80 ? 0 : (event.extreme_pct >= 70 ? 1 : (event.extreme_pct >= 40 ? 2 : 3));
+    }
+    bump(&kept.session.sags[row][column]);
+    if (event.extreme_pct < kept.session.lowest_pct){
+      kept.session.lowest_pct = event.extreme_pct;
+    }
+  }
+  bump(&kept.session.events[event.kind]);
+  if (event.length_ms > kept.session.longest_ms){
+    kept.session.longest_ms = event.length_ms;
+  }
+  kept.events[kept.event_count % PQ_LOG] = event;
+  kept.event_count++;
+  in_event = false;
+}
+
+//Adds a reading to the session's minimum, maximum, mean and histogram.
+static void HOT_FUNC(count_reading)(uint32_t counts, uint32_t bin){
+  kept.session.samples++;
+  kept.session.sum += counts;
+  if (counts < kept.session.min){
+    kept.session.min = (uint16_t)counts;
+  }
+  if (counts > kept.session.max){
+    kept.session.max = (uint16_t)counts;
+  }
+  kept.session.levels[bin]++;
+}
+
+void HOT_FUNC(power_quality_sample)(uint64_t now, uint32_t counts){
+  if (!kept.active){
+    if (counts <= settings.volt_threshold){
+      return;
+    }
+    start_session(now, counts);
+  }
+  uint32_t pct = (counts*pct_scale) >> 16;
+  uint32_t bin = level_bin(pct);
+  if (counts <= settings.volt_threshold){
+    if (!below_since){
+      below_since = now;
+      pending_samples = 0;
+      pending_sum = 0;
+      pending_min = counts;
+      memset(pending_levels, 0, sizeof(pending_levels));
+    } else if (now - below_since > settings.shutdown_delay){
+      end_session();
+      return;
+    }
+    pending_samples++;
+    pending_sum += counts;
+    if (counts < pending_min){
+      pending_min = counts;
+    }
+    pending_levels[bin]++;
+  } else {
+    if (below_since){
+      //The key came back, so what was held back was a dip
+      kept.session.samples += pending_samples;
+      kept.session.sum += pending_sum;
+      if (pending_min < kept.session.min){
+        kept.session.min = (uint16_t)pending_min;
+      }
+      for (int i = 0; i < PQ_LEVEL_BINS; i++){
+        kept.session.levels[i] += pending_levels[i];
+      }
+      below_since = 0;
+    }
+    count_reading(counts, bin);
+  }
+  kept.session.length_ms = (uint32_t)((now - session_start)/1000);
+
+  if (now - session_start < PQ_SETTLE_MS*1000){
+    nominal16 += (int32_t)((counts << 16) - nominal16) >> SETTLE_SHIFT;
+    set_levels();
+    return;
+  }
+  if (!in_event){
+    if ((counts < sag_level) || (counts > swell_level)){
+      in_event = true;
+      event_start = now;
+      event = (pq_event){(uint32_t)(now/1000), 0, (uint16_t)kept.boots, (uint16_t)pct,
+        counts > swell_level ? PQ_SWELL : PQ_SAG, {0}};
+    } else {
+      nominal16 += (int32_t)((counts << 16) - nominal16) >> NOMINAL_SHIFT;
+    }
+  }
+  if (in_event){
+    if (event.kind == PQ_SWELL){
+      if (pct > event.extreme_pct){
+        event.extreme_pct = (uint16_t)pct;
+      }
+      if (counts <= swell_clear){
+        end_event(now);
+      }
+    } else {
+      if (pct < event.extreme_pct){
+        event.extreme_pct = (uint16_t)pct;
+      }
+      if (counts < dropout_level){
+        event.kind = PQ_DROPOUT;
+      }
+      if (counts >= sag_clear){
+        end_event(now);
+      }
+    }
+  }
+  if (!(kept.session.samples % LEVELS_EVERY)){
+    set_levels();
+  }
+}
+
+pq_kind HOT_FUNC(power_quality_event)(){
+  return kept.active && in_event ? (pq_kind)event.kind : PQ_KINDS;
+}
+
+static void print_session(const pq_session *shown, uint32_t number, bool current){
+  uint32_t mean = shown->samples ? (uint32_t)(shown->sum/shown->samples) : 0;
+  console_printf("Power: session %lu%s, boot %u at %lu s for %lu s, nominal %u, min %u, max %u, mean %lu counts\n", number,
+    current ? " under way" : "", shown->boot, shown->start_s, shown->length_ms/1000, shown->nominal, shown->min, shown->max, mean);
+  console_printf("Power: %u sags, %u swells, %u dropouts, longest %lu ms, lowest %u%%, highest %u%%\n",
+    shown->events[PQ_SAG], shown->events[PQ_SWELL], shown->events[PQ_DROPOUT], shown->longest_ms,
+    shown->lowest_pct, shown->highest_pct);
+}
+
+static void print_tables(){
+  static const char *const sag_rows[PQ_SAG_ROWS] = {"sag >=80%", "sag >=70%", "sag >=40%", "sag", "dropout"};
+  static const char *const swell_rows[PQ_SWELL_ROWS] = {"swell <=120%", "swell <=140%", "swell"};
+  console_printf("Power: %-12s %5s %5s %5s %5s %5s %5s %5s\n", "", "10ms", "100ms", "500ms", "1s", "3s", "20s",
+    "more");
+  for (int row = 0; row < PQ_SAG_ROWS; row++){
+    const uint16_t *counts = kept.session.sags[row];
+    console_printf("Power: %-12s %5u %5u %5u %5u %5u %5u %5u\n", sag_rows[row], counts[0], counts[1], counts[2],
+      counts[3], counts[4], counts[5], counts[6]);
+  }
+  for (int row = 0; row < PQ_SWELL_ROWS; row++){
+    const uint16_t *counts = kept.session.swells[row];
+    console_printf("Power: %-12s %5u %5u %5u %5u %5u %5u %5u\n", swell_rows[row], counts[0], counts[1], counts[2],
+      counts[3], counts[4], counts[5], counts[6]);
+  }
+  console_printf("Power: levels");
+  for (int i = 0; i < PQ_LEVEL_BINS; i++){
+    console_printf(" %lu", kept.session.levels[i]);
+  }
+  console_printf("\n");
+}
+
+//Sends the sessions and events as a "PQS1" frame, see power_quality.h.
+static void send_frame(){
+  uint32_t shown = kept.finished_count < PQ_SESSIONS ? kept.finished_count : PQ_SESSIONS;
+  uint32_t logged = kept.event_count < PQ_LOG ? kept.event_count : PQ_LOG;
+  pq_header header = {PQ_VERSION, (uint8_t)(shown + kept.active), (uint8_t)logged, kept.active, sizeof(pq_session),
+    sizeof(pq_event), kept.session_count, kept.event_count, kept.boots};
+  binary_frame_begin("PQS1", sizeof(header) + (shown + kept.active)*sizeof(pq_session) + logged*sizeof(pq_event));
+  binary_frame_part(&header, sizeof(header));
+  if (kept.active){
+    binary_frame_part(&kept.session, sizeof(kept.session));
+  }
+  for (uint32_t i = 0; i < shown; i++){
+    binary_frame_part(&kept.finished[(kept.finished_count - 1 - i) % PQ_SESSIONS], sizeof(pq_session));
+  }
+  for (uint32_t i = kept.event_count - logged; i < kept.event_count; i++){
+    binary_frame_part(&kept.events[i % PQ_LOG], sizeof(pq_event));
+  }
+  binary_frame_end();
+}
+
+bool power_quality_command(int argc, char *argv[]){
+  static const char *const kind_names[PQ_KINDS] = {"sag", "swell", "dropout"};
+  if (argc == 1){
+    if (strcmp(argv[0], "table") == 0){
+      print_tables();
+      return true;
+    }
+    if (strcmp(argv[0], "events") == 0){
+      uint32_t first = kept.event_count > PQ_LOG ? kept.event_count - PQ_LOG : 0;
+      console_printf("Power: %lu events\n", kept.event_count);
+      for (uint32_t i = first; i < kept.event_count; i++){
+        const pq_event *logged = &kept.events[i % PQ_LOG];
+        console_printf("Power: %s, boot %u at %lu.%03lu s for %lu ms, %u%%\n", kind_names[logged->kind],
+          logged->boot, logged->start_ms/1000, logged->start_ms % 1000, logged->length_ms, logged->extreme_pct);
+      }
+      return true;
+    }
+    if (strcmp(argv[0], "frame") == 0){
+      send_frame();
+      return true;
+    }
+    if (strcmp(argv[0], "clear") != 0){
+      return false;
+    }
+    memset(&kept, 0, sizeof(kept));
+    kept.magic = KEPT_MAGIC;
+    kept.boots = 1;
+  }
+  if (kept.active){
+    print_session(&kept.session, kept.session_count, true);
+  } else {
+    console_printf("Power: no session under way\n");
+  }
+  uint32_t shown = kept.finished_count < PQ_SESSIONS ? kept.finished_count : PQ_SESSIONS;
+  for (uint32_t i = 0; i < shown; i++){
+    print_session(&kept.finished[(kept.finished_count - 1 - i) % PQ_SESSIONS], kept.session_count - kept.active - i, false);
+  }
+  return true;
+}
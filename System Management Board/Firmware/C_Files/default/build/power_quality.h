@@ -0,0 +1,121 @@
+#ifndef POWER_QUALITY_H
+#define POWER_QUALITY_H
+
+#include "pico/stdlib.h"
+
+//Power quality of KEY_Voltage, from the same 1ms readings the load
+//shedding takes. A power session runs from the key coming on until it
+//has been off for shutdown_delay. Within one, the reading is compared
+//with the nominal, pq_nominal or else a slow average of the session's
+//readings outside events, and three kinds of event are picked out:
+//
+//  sag      below pq_sag percent of nominal
+//  swell    above pq_swell percent
+//  dropout  a sag that went below pq_dropout percent
+//
+//Each event ends once the reading is PQ_HYSTERESIS percent back
+//inside its level, and is counted in a table of its depth against its
+//length, the way EN 50160 tables voltage dips. Every reading also goes
+//into a histogram of 5% bins of the nominal, and the session keeps
+//its minimum, maximum and mean. All of it is O(1) per reading.
+//
+//The finished sessions and the event log are kept in RAM that is not
+//cleared at boot, so they outlast the reboot at the end of a shutdown
+//and a watchdog reset, but not a loss of power. A session under way
+//at a reset is finished there. Times are from the start of the boot
+//they are numbered with.
+//
+//  pq [table|events|frame|clear]
+//
+//prints the session under way and the last PQ_SESSIONS finished ones,
+//the event tables of the one under way or the last PQ_LOG events,
+//sends everything as a "PQS1" binary frame, or starts over.
+#define PQ_HYSTERESIS 2
+//Readings at the start of a session before events are looked for,
+//while the nominal settles
+#define PQ_SETTLE_MS 1000
+#define PQ_SESSIONS 4
+#define PQ_LOG 8
+#define PQ_VERSION 1
+//"SMBQ" as stored
+#define PQ_MAGIC 0x51424d53
+
+//Table columns: events up to 10ms, 100ms, 500ms, 1s, 3s, 20s and
+//longer
+#define PQ_DURATIONS 7
+//Sag rows by the lowest reading, in percent of nominal: down to 80,
+//70, 40 and pq_dropout, then the dropouts
+#define PQ_SAG_ROWS 5
+//Swell rows by the highest reading: up to 120, 140 and above 140
+#define PQ_SWELL_ROWS 3
+//Histogram bins: below 50%, 5% bins from 50% to 120%, 120% and above
+#define PQ_LEVEL_BINS 16
+
+typedef enum pq_kind{
+  PQ_SAG,
+  PQ_SWELL,
+  PQ_DROPOUT,
+  PQ_KINDS
+} pq_kind;
+
+//One power session, sent as is in the "PQS1" frame. Readings in ADC
+//counts, times since the start of boot.
+typedef struct pq_session{
+  uint64_t sum;
+  uint32_t start_s;
+  uint32_t length_ms;
+  uint32_t samples;
+  uint32_t longest_ms;
+  uint16_t nominal;
+  uint16_t min;
+  uint16_t max;
+  //Lowest and highest reading in an event, percent of nominal, 100 if
+  //there was none
+  uint16_t lowest_pct;
+  uint16_t highest_pct;
+  uint16_t events[PQ_KINDS];
+  uint16_t boot;
+  uint16_t reserved;
+  uint16_t sags[PQ_SAG_ROWS][PQ_DURATIONS];
+  uint16_t swells[PQ_SWELL_ROWS][PQ_DURATIONS];
+  uint32_t levels[PQ_LEVEL_BINS];
+} pq_session;
+
+typedef struct pq_event{
+  uint32_t start_ms;
+  uint32_t length_ms;
+  uint16_t boot;
+  //Lowest reading of a sag or dropout, highest of a swell, percent
+  //of nominal
+  uint16_t extreme_pct;
+  uint8_t kind;
+  uint8_t reserved[3];
+} pq_event;
+
+//Header of the "PQS1" frame, followed by the session under way if
+//there is one, the finished sessions newest first, then the events
+//oldest first.
+typedef struct pq_header{
+  uint8_t version;
+  uint8_t sessions;
+  uint8_t events;
+  uint8_t current;
+  uint16_t session_bytes;
+  uint16_t event_bytes;
+  //Sessions and events since the log was last cleared, and boots
+  uint32_t session_count;
+  uint32_t event_count;
+  uint32_t boots;
+} pq_header;
+
+//Picks up what was kept over a reset, or starts afresh after a power
+//on. Call once at boot.
+void power_quality_init();
+//Takes a raw KEY_Voltage reading.
+void power_quality_sample(uint64_t now, uint32_t counts);
+//The kind of the event under way, PQ_KINDS if there is none.
+pq_kind power_quality_event();
+//The "pq" command.
+bool power_quality_command(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,93 @@
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "probe.h"
+#include "hot_path.h"
+#include "binary_out.h"
+
+//SysTick wraps after 2^24 cycles, so anything longer than this is
+//measured with the microsecond timer instead.
+#define PROBE_LONG_US 100000
+
+#define PROBE_VERSION 1
+
+//Header of the "PRB1" frame, followed by PROBE_COUNT probe_stats.
+typedef struct probe_header{
+  uint8_t version;
+  uint8_t probes;
+  uint8_t buckets;
+  uint8_t enabled;
+  uint32_t cycles_per_us;
+} probe_header;
+
+probe_stats probe_table[PROBE_COUNT];
+//Rate the table is kept at, clk_sys when probes_init ran, and the one
+//SysTick counts at now
+static uint32_t cycles_per_us = 125;
+static uint32_t running_per_us = 125;
+
+void probes_init(){
+  cycles_init();
+  cycles_per_us = clock_get_hz(clk_sys)/1000000;
+  running_per_us = cycles_per_us;
+  probe_reset();
+}
+
+void probe_clock_changed(){
+  running_per_us = clock_get_hz(clk_sys)/1000000;
+}
+
+uint32_t probe_cycles_per_us(){
+  return cycles_per_us;
+}
+
+uint32_t HOT_FUNC(probe_scale)(uint32_t cycles){
+  if (running_per_us == cycles_per_us){
+    return cycles;
+  }
+  //Below 2^24 cycles, so this fits for any clk_sys up to 256MHz
+  return cycles*cycles_per_us/running_per_us;
+}
+
+//Folds one duration into the probe's statistics. Each probe should
+//only be recorded from one core and one interrupt level.
+void HOT_FUNC(probe_record)(probe_id id, uint32_t start_cycles, uint32_t start_us){
+  uint32_t cycles = probe_scale(cycles_since(start_cycles));
+  uint32_t elapsed_us = time_us_32() - start_us;
+  if (elapsed_us > PROBE_LONG_US){
+    //Past about 34s at 125MHz, standby in the main loop say, the
+    //count no longer fits and is held at the largest
+    uint64_t long_cycles = (uint64_t)elapsed_us * cycles_per_us;
+    cycles = long_cycles > 0xffffffff ? 0xffffffff : (uint32_t)long_cycles;
+  }
+  probe_stats *stats = &probe_table[id];
+  stats->count++;
+  stats->total += cycles;
+  if (cycles < stats->min){
+    stats->min = cycles;
+  }
+  if (cycles > stats->max){
+    stats->max = cycles;
+  }
+  int bucket = (31 - __builtin_clz(cycles | 1)) / 2;
+  stats->buckets[bucket]++;
+}
+
+void probe_reset(){
+  for (int i = 0; i < PROBE_COUNT; i++){
+    probe_table[i] = (probe_stats){0};
+    probe_table[i].min = 0xffffffff;
+  }
+}
+
+//Sends the whole table as a "PRB1" binary frame. The mean is
+//total/count on the host side.
+void probe_dump(){
+  probe_header header = {PROBE_VERSION, PROBE_COUNT, PROBE_BUCKETS, 0, cycles_per_us};
+#ifdef SMB_PROBES
+  header.enabled = 1;
+#endif
+  binary_frame_begin("PRB1", sizeof(header) + sizeof(probe_table));
+  binary_frame_part(&header, sizeof(header));
+  binary_frame_part(probe_table, sizeof(probe_table));
+  binary_frame_end();
+}
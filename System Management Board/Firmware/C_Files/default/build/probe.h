@@ -0,0 +1,66 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "pico/stdlib.h"
+#include "cycles.h"
+
+//Hot-path functions that can be timed. The order is the order of
+//the table sent by probe_dump, so only append to it.
+typedef enum probe_id{
+  PROBE_MAIN_LOOP,
+  PROBE_EVALUATE_STATE,
+  PROBE_SHUTDOWN_PROCESS,
+  PROBE_CHECK_INPUT_PATTERN,
+  PROBE_BLINK_PATTERN,
+  PROBE_READ_ADC_MUX,
+  PROBE_CURRENT_MONITOR_READ,
+  PROBE_PARSER,
+  PROBE_COUNT
+} probe_id;
+
+//Bucket i of the histogram counts durations in [4^i, 4^(i+1)) cycles.
+#define PROBE_BUCKETS 16
+
+typedef struct probe_stats{
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint32_t reserved;
+  uint64_t total;
+  uint32_t buckets[PROBE_BUCKETS];
+} probe_stats;
+
+typedef struct probe_scope{
+  probe_id id;
+  uint32_t start_cycles;
+  uint32_t start_us;
+} probe_scope;
+
+void probes_init();
+//Durations are kept in cycles of clk_sys as it was at probes_init,
+//which the "PRB1" header gives, whatever the clock policy has moved it
+//to since. Call probe_clock_changed after every change of clk_sys.
+void probe_clock_changed();
+uint32_t probe_cycles_per_us();
+//Converts SysTick cycles counted at the clk_sys in use to the rate
+//the durations are kept at.
+uint32_t probe_scale(uint32_t cycles);
+void probe_record(probe_id id, uint32_t start_cycles, uint32_t start_us);
+void probe_reset();
+void probe_dump();
+
+static inline void probe_scope_end(probe_scope *scope){
+  probe_record(scope->id, scope->start_cycles, scope->start_us);
+}
+
+//PROBE_SCOPE(id) at the top of a block times everything until the
+//block is left, including early returns. With SMB_PROBES off it
+//compiles to nothing.
+#ifdef SMB_PROBES
+#define PROBE_SCOPE(id) probe_scope probe_scope_##id \
+  __attribute__((cleanup(probe_scope_end))) = {id, cycles_now(), time_us_32()}
+#else
+#define PROBE_SCOPE(id)
+#endif
+
+#endif
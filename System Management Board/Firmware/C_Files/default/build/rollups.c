@@ -0,0 +1,215 @@
+#include "string.h"
+#include "pico/stdlib.h"
+#include "rollups.h"
+#include "console.h"
+#include "binary_out.h"
+#include "pins.h"
+#include "hot_path.h"
+
+//Readings of one channel in the bucket under way
+typedef struct rollup_open{
+  uint64_t sum;
+  uint32_t count;
+  uint16_t min;
+  uint16_t max;
+  uint16_t last;
+} rollup_open;
+
+typedef struct rollup_level{
+  uint32_t period_s;
+  uint32_t size;
+  rollup_stat (*buckets)[ROLLUP_CHANNELS];
+  //Buckets finished since boot, the next one goes at finished % size
+  uint32_t finished;
+  //Number of the bucket under way, and when it ends
+  uint32_t number;
+  uint64_t end_us;
+  rollup_open open[ROLLUP_CHANNELS];
+} rollup_level;
+
+static rollup_stat seconds[ROLLUP_SECONDS][ROLLUP_CHANNELS];
+static rollup_stat minutes[ROLLUP_MINUTES][ROLLUP_CHANNELS];
+static rollup_stat hours[ROLLUP_HOURS][ROLLUP_CHANNELS];
+static rollup_level levels[ROLLUP_RESOLUTIONS] = {
+  {1, ROLLUP_SECONDS, seconds},
+  {60, ROLLUP_MINUTES, minutes},
+  {3600, ROLLUP_HOURS, hours},
+};
+static uint64_t next_temperatures;
+
+static const char *const resolution_names[ROLLUP_RESOLUTIONS] = {"1s", "1m", "1h"};
+static const char *const channel_names[ROLLUP_CHANNELS] = {"key", "temp1", "temp2", "comp", "switch", "in0", "in1",
+  "in2"};
+
+static void HOT_FUNC(open_bucket)(rollup_level *level){
+  for (int channel = 0; channel < ROLLUP_CHANNELS; channel++){
+    level->open[channel] = (rollup_open){0, 0, 0xffff, 0, 0};
+  }
+}
+
+//What is kept of a channel's readings in a bucket.
+static rollup_stat HOT_FUNC(stat_of)(const rollup_open *open){
+  if (!open->count){
+    return (rollup_stat){0xffff, 0, 0, 0};
+  }
+  return (rollup_stat){open->min, open->max, (uint16_t)(open->sum/open->count), open->last};
+}
+
+//Finishes the bucket under way, then any that passed without a
+//reading, at most a ring's worth of them.
+static void HOT_FUNC(roll)(rollup_level *level, uint64_t now){
+  uint64_t period_us = (uint64_t)level->period_s*1000000;
+  rollup_stat *bucket = level->buckets[level->finished % level->size];
+  for (int channel = 0; channel < ROLLUP_CHANNELS; channel++){
+    bucket[channel] = stat_of(&level->open[channel]);
+  }
+  level->finished++;
+  uint64_t skipped = (now - level->end_us)/period_us;
+  if (skipped > level->size){
+    level->finished += (uint32_t)(skipped - level->size);
+  }
+  for (uint64_t i = 0; (i < skipped) && (i < level->size); i++){
+    bucket = level->buckets[level->finished % level->size];
+    for (int channel = 0; channel < ROLLUP_CHANNELS; channel++){
+      bucket[channel] = (rollup_stat){0xffff, 0, 0, 0};
+    }
+    level->finished++;
+  }
+  level->number += (uint32_t)(skipped + 1);
+  level->end_us += (skipped + 1)*period_us;
+  open_bucket(level);
+}
+
+static inline void HOT_FUNC(advance)(uint64_t now){
+  for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++){
+    if (now >= levels[resolution].end_us){
+      roll(&levels[resolution], now);
+    }
+  }
+}
+
+static inline void HOT_FUNC(add)(rollup_channel channel, uint32_t value){
+  for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++){
+    rollup_open *open = &levels[resolution].open[channel];
+    open->sum += value;
+    open->count++;
+    if (value < open->min){
+      open->min = value;
+    }
+    if (value > open->max){
+      open->max = value;
+    }
+    open->last = value;
+  }
+}
+
+void rollups_init(){
+  uint64_t now = time_us_64();
+  for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++){
+    rollup_level *level = &levels[resolution];
+    uint64_t period_us = (uint64_t)level->period_s*1000000;
+    level->finished = 0;
+    level->number = (uint32_t)(now/period_us);
+    level->end_us = (level->number + 1)*period_us;
+    open_bucket(level);
+  }
+  next_temperatures = now;
+}
+
+void HOT_FUNC(rollups_sample)(uint64_t now, uint32_t key, uint32_t comp, uint32_t sw, uint32_t gpio){
+  advance(now);
+  add(ROLLUP_KEY, key);
+  add(ROLLUP_COMP, comp);
+  add(ROLLUP_SWITCH, sw);
+  add(ROLLUP_IN0, (gpio & (1u << IN0)) ? ROLLUP_DUTY_FULL : 0);
+  add(ROLLUP_IN1, (gpio & (1u << IN1)) ? ROLLUP_DUTY_FULL : 0);
+  add(ROLLUP_IN2, (gpio & (1u << IN2)) ? ROLLUP_DUTY_FULL : 0);
+}
+
+bool HOT_FUNC(rollups_due)(uint64_t now){
+  if (now < next_temperatures){
+    return false;
+  }
+  next_temperatures = now + ROLLUP_TEMP_MS*1000;
+  return true;
+}
+
+void rollups_temperatures(uint64_t now, uint32_t temp1, uint32_t temp2){
+  advance(now);
+  add(ROLLUP_TEMP1, temp1);
+  add(ROLLUP_TEMP2, temp2);
+}
+
+static uint32_t kept(const rollup_level *level){
+  return level->finished < level->size ? level->finished : level->size;
+}
+
+//Sends the last buckets of a resolution as a "RUP1" frame, see
+//rollups.h.
+static void send_frame(rollup_resolution resolution, uint32_t wanted){
+  const rollup_level *level = &levels[resolution];
+  uint32_t finished = kept(level);
+  finished = wanted - 1 < finished ? wanted - 1 : finished;
+  rollup_header header = {ROLLUP_VERSION, resolution, ROLLUP_CHANNELS, sizeof(rollup_stat), level->period_s,
+    level->number, (uint16_t)(finished + 1), 0};
+  rollup_stat under_way[ROLLUP_CHANNELS];
+  for (int channel = 0; channel < ROLLUP_CHANNELS; channel++){
+    under_way[channel] = stat_of(&level->open[channel]);
+  }
+  binary_frame_begin("RUP1", sizeof(header) + (finished + 1)*sizeof(under_way));
+  binary_frame_part(&header, sizeof(header));
+  for (uint32_t i = level->finished - finished; i < level->finished; i++){
+    binary_frame_part(level->buckets[i % level->size], sizeof(under_way));
+  }
+  binary_frame_part(under_way, sizeof(under_way));
+  binary_frame_end();
+}
+
+static void print_buckets(){
+  for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++){
+    const rollup_level *level = &levels[resolution];
+    console_printf("Rollup: %s, %lu of %lu buckets", resolution_names[resolution], kept(level), level->size);
+    if (!level->finished){
+      console_printf("\n");
+      continue;
+    }
+    console_printf(", last %lu min/max/mean/last\n", level->number - 1);
+    const rollup_stat *bucket = level->buckets[(level->finished - 1) % level->size];
+    for (int channel = 0; channel < ROLLUP_CHANNELS; channel++){
+      if (bucket[channel].min > bucket[channel].max){
+        console_printf("Rollup:   %-6s no readings\n", channel_names[channel]);
+      } else {
+        console_printf("Rollup:   %-6s %5u %5u %5u %5u\n", channel_names[channel], bucket[channel].min,
+          bucket[channel].max, bucket[channel].mean, bucket[channel].last);
+      }
+    }
+  }
+}
+
+bool rollups_command(int argc, char *argv[]){
+  if (argc == 0){
+    print_buckets();
+    return true;
+  }
+  if ((strcmp(argv[0], "clear") == 0) && (argc == 1)){
+    memset(seconds, 0, sizeof(seconds));
+    memset(minutes, 0, sizeof(minutes));
+    memset(hours, 0, sizeof(hours));
+    rollups_init();
+    return true;
+  }
+  if ((strcmp(argv[0], "read") != 0) || (argc < 2)){
+    return false;
+  }
+  for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++){
+    if (strcmp(argv[1], resolution_names[resolution]) == 0){
+      uint32_t wanted = levels[resolution].size + 1;
+      if ((argc > 2) && (!console_arg_uint(argv[2], &wanted) || !wanted)){
+        return false;
+      }
+      send_frame(resolution, wanted);
+      return true;
+    }
+  }
+  return false;
+}
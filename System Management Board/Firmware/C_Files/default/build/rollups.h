@@ -0,0 +1,88 @@
+#ifndef ROLLUPS_H
+#define ROLLUPS_H
+
+#include "pico/stdlib.h"
+
+//History of the board's readings in RAM, as rollups at three
+//resolutions: the last ROLLUP_SECONDS seconds, ROLLUP_MINUTES minutes
+//and ROLLUP_HOURS hours. Each bucket holds the minimum, maximum, mean
+//and last reading of every channel over its time. The channels are
+//fed from the readings the main loop already takes, KEY_Voltage, the
+//current monitors and IN0-2 every 1ms with the load shedding and the
+//temperatures every ROLLUP_TEMP_MS, and each reading goes straight
+//into the bucket under way at every resolution, so it costs O(1).
+//
+//Analog channels are raw ADC counts. The inputs are 0 while low and
+//ROLLUP_DUTY_FULL while high, so their mean is the duty in hundredths
+//of a percent. Buckets are numbered by their start since boot in
+//units of their length, and a bucket nothing was read in, while the
+//board was in standby say, has its minimum above its maximum. The
+//store starts over at every boot.
+//
+//  roll [clear]
+//  roll read <1s|1m|1h> [buckets]
+//
+//prints the last finished bucket of each resolution, or starts over.
+//"roll read" sends the last buckets of a resolution, by default all
+//it keeps, as a "RUP1" frame: a rollup_header then the buckets oldest
+//first, each a rollup_stat per channel in rollup_channel order. The
+//last one is the bucket under way. All fields are little endian.
+#define ROLLUP_SECONDS 120
+#define ROLLUP_MINUTES 120
+#define ROLLUP_HOURS 48
+#define ROLLUP_TEMP_MS 100
+#define ROLLUP_DUTY_FULL 10000
+#define ROLLUP_VERSION 1
+
+typedef enum rollup_channel{
+  ROLLUP_KEY,
+  ROLLUP_TEMP1,
+  ROLLUP_TEMP2,
+  ROLLUP_COMP,
+  ROLLUP_SWITCH,
+  ROLLUP_IN0,
+  ROLLUP_IN1,
+  ROLLUP_IN2,
+  ROLLUP_CHANNELS
+} rollup_channel;
+
+typedef enum rollup_resolution{
+  ROLLUP_1S,
+  ROLLUP_1M,
+  ROLLUP_1H,
+  ROLLUP_RESOLUTIONS
+} rollup_resolution;
+
+typedef struct rollup_stat{
+  uint16_t min;
+  uint16_t max;
+  uint16_t mean;
+  uint16_t last;
+} rollup_stat;
+
+//Header of the "RUP1" frame.
+typedef struct rollup_header{
+  uint8_t version;
+  uint8_t resolution;
+  uint8_t channels;
+  uint8_t stat_bytes;
+  //Bucket length, and the number of the bucket under way
+  uint32_t period_s;
+  uint32_t newest;
+  uint16_t buckets;
+  uint16_t reserved;
+} rollup_header;
+
+//Starts the buckets under way. Call once at boot.
+void rollups_init();
+//Takes the 1ms readings: raw KEY_Voltage and current monitors, and
+//the GPIO bank for IN0-2.
+void rollups_sample(uint64_t now, uint32_t key, uint32_t comp, uint32_t sw, uint32_t gpio);
+//Whether the temperatures are due.
+bool rollups_due(uint64_t now);
+//Takes raw readings of the two temperature sensors.
+void rollups_temperatures(uint64_t now, uint32_t temp1, uint32_t temp2);
+//The "roll" command.
+bool rollups_command(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,373 @@
+#include "string.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "scope.h"
+#include "scope_hw.h"
+#include "console.h"
+#include "binary_out.h"
+#include "pins.h"
+#include "hot_path.h"
+
+//Room left in the ring past the end of a burst, for the samples that
+//come in before the main loop gets round to stopping it: 4ms at
+//500kS/s
+#define SCOPE_SLACK 2048
+//Most samples of the trigger input looked at per main loop pass
+#define SCOPE_SCAN_MAX 1024
+//A burst that has run this long is ended with what it has, whatever
+//the state
+#define SCOPE_HOLD_US ((uint64_t)(2*SCOPE_WINDOW_MS + SCOPE_WAIT_MS)*1000 + 100000)
+#define SCOPE_DEFAULT_PRE 10
+
+typedef enum scope_state{
+  SCOPE_IDLE,
+  //Filling the pre-trigger part of the burst
+  SCOPE_FILLING,
+  SCOPE_WAITING,
+  //Filling the rest after the trigger
+  SCOPE_TRIGGERED,
+  SCOPE_DONE,
+} scope_state;
+
+typedef struct scope_input{
+  const char *name;
+  uint8_t adc_input;
+  uint8_t mux_input;
+} scope_input;
+
+static const scope_input input_names[] = {
+  {"key", ADC_MUX_CHANNEL, 0}, {"temp1", ADC_MUX_CHANNEL, 6}, {"temp2", ADC_MUX_CHANNEL, 7},
+  {"mux0", ADC_MUX_CHANNEL, 0}, {"mux1", ADC_MUX_CHANNEL, 1}, {"mux2", ADC_MUX_CHANNEL, 2},
+  {"mux3", ADC_MUX_CHANNEL, 3}, {"mux4", ADC_MUX_CHANNEL, 4}, {"mux5", ADC_MUX_CHANNEL, 5},
+  {"mux6", ADC_MUX_CHANNEL, 6}, {"mux7", ADC_MUX_CHANNEL, 7}, {"switch", 1, 0}, {"comp", 2, 0},
+};
+
+static const char *const state_names[] = {"idle", "filling", "waiting", "triggered", "done"};
+
+//The DMA ring on the board wraps on the low address bits, so the
+//buffer is aligned to its size
+uint16_t scope_buffer[SCOPE_SAMPLES] __attribute__((aligned(SCOPE_SAMPLES*2)));
+
+static volatile scope_state state = SCOPE_IDLE;
+static scope_config config;
+static scope_header header;
+static uint8_t mux;
+static uint32_t channels;
+static scope_trigger trigger;
+static uint8_t trigger_input;
+static uint16_t trigger_level;
+//Samples in a burst, and how many of them come before the trigger
+static uint32_t window;
+static uint32_t pre;
+//Next sample looked at for the trigger, the one it was found at and
+//where the burst ends, all counted from the start
+static uint32_t next_scan;
+static uint32_t trigger_at;
+static uint32_t end_sample;
+static uint64_t start_us;
+static uint64_t wait_start_us;
+//Ring index of the first sample of a finished burst
+static uint32_t start_index;
+
+//Where the ADC input comes in each round of the inputs.
+static inline uint32_t HOT_FUNC(slot)(uint adc_input){
+  return __builtin_popcount(config.inputs & ((1u << adc_input) - 1));
+}
+
+static uint32_t round_down(uint32_t sample){
+  return sample - sample % channels;
+}
+
+static uint32_t round_up(uint32_t sample){
+  return round_down(sample + channels - 1);
+}
+
+//Stops the ADC and keeps the burst ending at end, or as much of it as
+//the ring still holds.
+static void finish(uint32_t end){
+  scope_hw_stop();
+  uint32_t count = scope_hw_count();
+  if (end > count){
+    end = round_down(count);
+  }
+  uint32_t start = end > window ? end - window : 0;
+  uint32_t oldest = count > SCOPE_SAMPLES ? round_up(count - SCOPE_SAMPLES) : 0;
+  start = start < oldest ? oldest : start;
+  start = start > end ? end : start;
+  header = (scope_header){
+    .version = SCOPE_VERSION,
+    .inputs = config.inputs,
+    .mux = mux,
+    .trigger = trigger,
+    .rate_hz = config.rate_hz,
+    .samples = end - start,
+    .trigger_sample = SCOPE_NO_TRIGGER,
+    .trigger_level = trigger_level,
+    .trigger_input = trigger_input,
+    .chunk_bytes = SCOPE_CHUNK_BYTES,
+  };
+  if ((trigger_at != SCOPE_NO_TRIGGER) && (trigger_at >= start) && (trigger_at < end)){
+    header.trigger_sample = trigger_at - start;
+  }
+  start_index = start % SCOPE_SAMPLES;
+  state = SCOPE_DONE;
+}
+
+//Whether the trigger input crossed the level between two samples.
+static bool crossed(uint16_t previous, uint16_t value){
+  if (trigger == SCOPE_TRIGGER_RISE){
+    return (previous < trigger_level) && (value >= trigger_level);
+  }
+  return (previous > trigger_level) && (value <= trigger_level);
+}
+
+//Looks through the trigger input's samples since the last pass. If
+//the scan has fallen a lap behind, it skips to what is still in the
+//ring.
+static void scan(uint32_t count){
+  uint32_t kept = SCOPE_SAMPLES - SCOPE_SLACK;
+  uint32_t oldest = count > kept ? round_up(count - kept) : 0;
+  if (next_scan < oldest + channels){
+    next_scan = oldest + channels + slot(trigger_input);
+  }
+  for (uint32_t scanned = 0; (next_scan < count) && (scanned < SCOPE_SCAN_MAX); scanned++){
+    uint16_t previous = scope_buffer[(next_scan - channels) % SCOPE_SAMPLES];
+    uint16_t value = scope_buffer[next_scan % SCOPE_SAMPLES];
+    if (crossed(previous, value)){
+      trigger_at = next_scan;
+      end_sample = round_down(next_scan) + window - pre;
+      state = SCOPE_TRIGGERED;
+      return;
+    }
+    next_scan += channels;
+  }
+}
+
+void scope_poll(){
+  if (!scope_running()){
+    return;
+  }
+  uint32_t count = scope_hw_count();
+  uint64_t now = time_us_64();
+  if (now - start_us > SCOPE_HOLD_US){
+    finish(round_down(count));
+    return;
+  }
+  if ((state == SCOPE_FILLING) && (count >= pre)){
+    state = SCOPE_WAITING;
+    wait_start_us = now;
+  }
+  if (state == SCOPE_WAITING){
+    scan(count);
+    //No trigger in time: the latest burst, to be armed again
+    if ((state == SCOPE_WAITING) && (now - wait_start_us > SCOPE_WAIT_MS*1000)){
+      finish(round_down(count));
+      return;
+    }
+  }
+  if ((state == SCOPE_TRIGGERED) && (count >= end_sample)){
+    finish(end_sample);
+  }
+}
+
+bool HOT_FUNC(scope_running)(){
+  return (state != SCOPE_IDLE) && (state != SCOPE_DONE);
+}
+
+uint32_t HOT_FUNC(scope_reading)(uint adc_input, uint mux_input, uint32_t fallback){
+  if (!scope_running() || !(config.inputs & (1u << adc_input)) ||
+    ((adc_input == ADC_MUX_CHANNEL) && (mux_input != mux))){
+    return fallback;
+  }
+  uint32_t position = slot(adc_input);
+  uint32_t count = scope_hw_count();
+  if (count <= position){
+    return fallback;
+  }
+  uint32_t newest = (count - 1 - position)/channels*channels + position;
+  return scope_buffer[newest % SCOPE_SAMPLES];
+}
+
+//Reads an input name into its ADC input and mux input.
+static bool parse_input(const char *name, uint8_t *adc_input, uint8_t *mux_input){
+  for (size_t i = 0; i < sizeof(input_names)/sizeof(input_names[0]); i++){
+    if (strcmp(name, input_names[i].name) == 0){
+      *adc_input = input_names[i].adc_input;
+      *mux_input = input_names[i].mux_input;
+      return true;
+    }
+  }
+  return false;
+}
+
+//Reads "key+comp" into the armed inputs and the mux input.
+static bool parse_inputs(const char *arg, scope_config *target, uint8_t *mux_input){
+  char text[CONSOLE_LINE_MAX];
+  strncpy(text, arg, sizeof(text) - 1);
+  text[sizeof(text) - 1] = 0;
+  target->inputs = 0;
+  for (char *name = strtok(text, "+"); name; name = strtok(NULL, "+")){
+    uint8_t adc_input, muxed;
+    if (!parse_input(name, &adc_input, &muxed)){
+      return false;
+    }
+    if ((adc_input == ADC_MUX_CHANNEL) && (target->inputs & (1u << ADC_MUX_CHANNEL)) && (muxed != *mux_input)){
+      return false;
+    }
+    if (adc_input == ADC_MUX_CHANNEL){
+      *mux_input = muxed;
+    }
+    target->inputs |= 1u << adc_input;
+  }
+  return target->inputs != 0;
+}
+
+//Reads "none", "rise:key=2000" or "fall:comp=300" into the header's
+//trigger fields. The input has to be one of those sampled.
+static bool parse_trigger(const char *arg, const scope_config *target, uint8_t mux_input, scope_header *armed){
+  char text[CONSOLE_LINE_MAX];
+  strncpy(text, arg, sizeof(text) - 1);
+  text[sizeof(text) - 1] = 0;
+  if (strcmp(text, "none") == 0){
+    armed->trigger = SCOPE_TRIGGER_NONE;
+    return true;
+  }
+  char *operand = strchr(text, ':');
+  char *value = operand ? strchr(operand, '=') : NULL;
+  if (!value){
+    return false;
+  }
+  *operand++ = 0;
+  *value++ = 0;
+  uint8_t adc_input, muxed;
+  uint32_t level;
+  if (!parse_input(operand, &adc_input, &muxed) || !(target->inputs & (1u << adc_input)) ||
+    ((adc_input == ADC_MUX_CHANNEL) && (muxed != mux_input)) || !console_arg_uint(value, &level) ||
+    (level > 4095)){
+    return false;
+  }
+  if (strcmp(text, "rise") == 0){
+    armed->trigger = SCOPE_TRIGGER_RISE;
+  } else if (strcmp(text, "fall") == 0){
+    armed->trigger = SCOPE_TRIGGER_FALL;
+  } else {
+    return false;
+  }
+  armed->trigger_input = adc_input;
+  armed->trigger_level = level;
+  return true;
+}
+
+//"scope arm <inputs> <rate_hz> [trigger] [pre_percent]"
+static bool scope_arm(int argc, char *argv[]){
+  scope_config armed = {0};
+  scope_header armed_trigger = {0};
+  uint8_t armed_mux = 0;
+  uint32_t pre_percent = SCOPE_DEFAULT_PRE;
+  if ((argc < 3) || !parse_inputs(argv[1], &armed, &armed_mux) || !console_arg_uint(argv[2], &armed.rate_hz)){
+    return false;
+  }
+  if ((argc > 3) && !parse_trigger(argv[3], &armed, armed_mux, &armed_trigger)){
+    return false;
+  }
+  if ((argc > 4) && (!console_arg_uint(argv[4], &pre_percent) || (pre_percent > 100))){
+    return false;
+  }
+  if (scope_running()){
+    scope_hw_stop();
+  }
+  state = SCOPE_IDLE;
+  //The mux is held on the one input for the whole burst
+  if (armed.inputs & (1u << ADC_MUX_CHANNEL)){
+    gpio_put(MUX_S2, (armed_mux >> 2) & 1);
+    gpio_put(MUX_S1, (armed_mux >> 1) & 1);
+    gpio_put(MUX_S0, armed_mux & 1);
+    sleep_us(10);
+  }
+  if (!scope_hw_start(&armed)){
+    console_printf("Scope: rate not possible\n");
+    return false;
+  }
+  config = armed;
+  mux = armed_mux;
+  trigger = armed_trigger.trigger;
+  trigger_input = armed_trigger.trigger_input;
+  trigger_level = armed_trigger.trigger_level;
+  channels = __builtin_popcount(config.inputs);
+  window = (uint32_t)((uint64_t)config.rate_hz*SCOPE_WINDOW_MS/1000);
+  window = window > SCOPE_SAMPLES - SCOPE_SLACK ? SCOPE_SAMPLES - SCOPE_SLACK : window;
+  window = round_down(window);
+  pre = trigger == SCOPE_TRIGGER_NONE ? 0 : round_down(window*pre_percent/100);
+  trigger_at = SCOPE_NO_TRIGGER;
+  start_us = time_us_64();
+  if (trigger == SCOPE_TRIGGER_NONE){
+    end_sample = window;
+    state = SCOPE_TRIGGERED;
+  } else {
+    //A crossing needs the sample before it
+    next_scan = (pre > channels ? pre : channels) + slot(trigger_input);
+    state = SCOPE_FILLING;
+  }
+  console_printf("Scope: %lu inputs at %luHz, %lu samples\n", channels, config.rate_hz, window);
+  return true;
+}
+
+//"scope read" sends the header, "scope read N" chunk N of the samples.
+static bool scope_read(int argc, char *argv[]){
+  if (state != SCOPE_DONE){
+    console_printf("Scope: nothing to read\n");
+    return false;
+  }
+  if (argc == 1){
+    binary_frame("SCH1", &header, sizeof(header));
+    return true;
+  }
+  uint32_t data_bytes = header.samples*2;
+  uint32_t chunk;
+  if (!console_arg_uint(argv[1], &chunk) || (chunk*SCOPE_CHUNK_BYTES >= data_bytes)){
+    return false;
+  }
+  uint32_t offset = chunk*SCOPE_CHUNK_BYTES;
+  uint32_t length = data_bytes - offset;
+  length = length > SCOPE_CHUNK_BYTES ? SCOPE_CHUNK_BYTES : length;
+  //The samples start at start_index and wrap around the ring
+  const uint8_t *ring = (const uint8_t *)scope_buffer;
+  uint32_t ring_offset = (start_index*2 + offset) % sizeof(scope_buffer);
+  uint32_t first = sizeof(scope_buffer) - ring_offset;
+  first = first > length ? length : first;
+  binary_frame_begin("SCD1", sizeof(chunk) + length);
+  binary_frame_part(&chunk, sizeof(chunk));
+  binary_frame_part(&ring[ring_offset], first);
+  binary_frame_part(ring, length - first);
+  binary_frame_end();
+  return true;
+}
+
+bool scope_command(int argc, char *argv[]){
+  if (strcmp(argv[0], "arm") == 0){
+    return scope_arm(argc, argv);
+  }
+  if ((strcmp(argv[0], "read") == 0) && (argc <= 2)){
+    return scope_read(argc, argv);
+  }
+  if ((strcmp(argv[0], "stop") == 0) && (argc == 1)){
+    if (scope_running()){
+      finish(round_down(scope_hw_count()));
+    }
+    return true;
+  }
+  if ((strcmp(argv[0], "status") == 0) && (argc == 1)){
+    console_printf("Scope: %s", state_names[state]);
+    if (state == SCOPE_DONE){
+      console_printf(", %lu samples at %luHz", header.samples, header.rate_hz);
+      if (header.trigger_sample != SCOPE_NO_TRIGGER){
+        console_printf(", trigger at %lu", header.trigger_sample);
+      } else if (header.trigger != SCOPE_TRIGGER_NONE){
+        console_printf(", no trigger");
+      }
+    }
+    console_printf("\n");
+    return true;
+  }
+  return false;
+}
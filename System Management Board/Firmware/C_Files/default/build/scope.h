@@ -0,0 +1,75 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include "pico/stdlib.h"
+
+//Scope mode: a burst of ADC samples at up to 500kS/s into a 32KB RAM
+//buffer, for looking at the key voltage or the regulator currents
+//faster than the 1ms readings allow. Driven from the console:
+//
+//  scope arm <inputs> <rate_hz> [trigger] [pre_percent]
+//  scope status
+//  scope read [chunk]
+//  scope stop
+//
+//inputs are key, temp1, temp2, mux0-7, switch and comp joined by '+',
+//at most one of them on the mux, and rate_hz is over all of them.
+//trigger is none, rise:<input>=<counts> or fall:<input>=<counts>, and
+//pre_percent (default 10) is how much of the burst is kept from before
+//it.
+//
+//The ADC is the state machine's too, so a burst is kept short: it
+//lasts at most SCOPE_WINDOW_MS, and a trigger that has not come
+//SCOPE_WAIT_MS after the pre-trigger part filled ends it with the
+//latest samples and no trigger, to be armed again. Meanwhile the
+//state machine is given the newest sample of what it reads if that is
+//in the burst, else the last reading it took.
+//
+//"scope read" sends the "SCH1" header frame and "scope read N" the
+//"SCD1" frame with chunk N, a uint32 chunk number then the samples as
+//uint16s, the inputs in turn from the lowest ADC input. All fields are
+//little endian.
+#define SCOPE_VERSION 1
+#define SCOPE_CHUNK_BYTES 2048
+#define SCOPE_WINDOW_MS 100
+#define SCOPE_WAIT_MS 100
+#define SCOPE_NO_TRIGGER 0xffffffff
+
+typedef enum scope_trigger{
+  SCOPE_TRIGGER_NONE,
+  //The input's reading goes from below the level to at or above it
+  SCOPE_TRIGGER_RISE,
+  //From above to at or below
+  SCOPE_TRIGGER_FALL,
+} scope_trigger;
+
+//Payload of the "SCH1" frame.
+typedef struct scope_header{
+  uint8_t version;
+  //Mask of ADC inputs sampled, and the mux input on ADC input 0
+  uint8_t inputs;
+  uint8_t mux;
+  uint8_t trigger;
+  uint32_t rate_hz;
+  uint32_t samples;
+  //Sample index of the trigger, SCOPE_NO_TRIGGER for none
+  uint32_t trigger_sample;
+  uint16_t trigger_level;
+  //ADC input the trigger is on
+  uint8_t trigger_input;
+  uint8_t reserved;
+  uint16_t chunk_bytes;
+  uint16_t reserved2;
+} scope_header;
+
+//Keeps a burst moving, call from the main loop.
+void scope_poll();
+//A burst is armed and not finished yet, so the ADC is the scope's.
+bool scope_running();
+//While the scope has the ADC, the newest sample of ADC input adc_input
+//with the mux on mux_input, or fallback if it is not being sampled.
+uint32_t scope_reading(uint adc_input, uint mux_input, uint32_t fallback);
+//The "scope" command, argv[0] is the subcommand.
+bool scope_command(int argc, char *argv[]);
+
+#endif
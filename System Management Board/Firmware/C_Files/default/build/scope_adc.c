@@ -0,0 +1,94 @@
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "scope_hw.h"
+#include "hot_path.h"
+
+//Sampler for scope mode. The ADC runs free, in round robin over the
+//inputs when there is more than one, and pushes each reading into its
+//FIFO. One DMA channel paced by the FIFO writes them round
+//scope_buffer, wrapping on the low address bits, so the CPU is not
+//involved. The transfer count is started at its largest and counts
+//down with each sample, which tells how many have come in.
+#define SCOPE_TRANSFERS 0xffffffff
+//A conversion takes 96 ADC clocks, 500kS/s from the 48MHz USB PLL
+#define SCOPE_CONVERSION_CLOCKS 96
+
+static int channel = -1;
+//Samples written by the last burst, once it has stopped
+static uint32_t stopped_count;
+
+bool scope_hw_start(scope_config *config){
+  uint32_t adc_hz = clock_get_hz(clk_adc);
+  if ((config->rate_hz == 0) || !config->inputs || (config->inputs >> SCOPE_INPUTS)){
+    return false;
+  }
+  //Time between conversions in 1/256ths of an ADC clock. The divider
+  //adds one clock to what is written to it, and anything shorter than
+  //a conversion runs them back to back.
+  uint64_t period = ((uint64_t)adc_hz*256)/config->rate_hz;
+  uint32_t divider = 0;
+  if (period > SCOPE_CONVERSION_CLOCKS*256){
+    divider = (uint32_t)(period - 256);
+  } else {
+    period = SCOPE_CONVERSION_CLOCKS*256;
+  }
+  if (divider >= (65536u << 8)){
+    return false;
+  }
+  config->rate_hz = (uint32_t)(((uint64_t)adc_hz*256)/period);
+
+  channel = dma_claim_unused_channel(false);
+  if (channel < 0){
+    return false;
+  }
+  adc_run(false);
+  adc_select_input(__builtin_ctz(config->inputs));
+  adc_set_round_robin(__builtin_popcount(config->inputs) > 1 ? config->inputs : 0);
+  adc_hw->div = divider;
+  //The FIFO raises a DMA request for every sample, errors and all
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_fifo_drain();
+
+  dma_channel_config dma_config = dma_channel_get_default_config(channel);
+  channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_16);
+  channel_config_set_read_increment(&dma_config, false);
+  channel_config_set_write_increment(&dma_config, true);
+  channel_config_set_ring(&dma_config, true, __builtin_ctz(sizeof(scope_buffer)));
+  channel_config_set_dreq(&dma_config, DREQ_ADC);
+  dma_channel_configure(channel, &dma_config, scope_buffer, &adc_hw->fifo, SCOPE_TRANSFERS, true);
+  stopped_count = 0;
+  adc_run(true);
+  return true;
+}
+
+uint32_t HOT_FUNC(scope_hw_count)(){
+  if (channel < 0){
+    return stopped_count;
+  }
+  return SCOPE_TRANSFERS - dma_channel_hw_addr(channel)->transfer_count;
+}
+
+//Lets the conversion under way finish and the DMA take it, then puts
+//the ADC back the way adc_read expects it.
+void scope_hw_stop(){
+  if (channel < 0){
+    return;
+  }
+  adc_run(false);
+  while (!(adc_hw->cs & ADC_CS_READY_BITS)){
+    tight_loop_contents();
+  }
+  while (adc_fifo_get_level()){
+    tight_loop_contents();
+  }
+  dma_channel_abort(channel);
+  stopped_count = SCOPE_TRANSFERS - dma_channel_hw_addr(channel)->transfer_count;
+  dma_channel_unclaim(channel);
+  channel = -1;
+  adc_fifo_setup(false, false, 0, false, false);
+  adc_fifo_drain();
+  adc_set_round_robin(0);
+  adc_hw->div = 0;
+}
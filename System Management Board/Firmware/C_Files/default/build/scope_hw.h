@@ -0,0 +1,35 @@
+#ifndef SCOPE_HW_H
+#define SCOPE_HW_H
+
+#include "pico/stdlib.h"
+
+//Between scope.c and the part that drives the ADC: scope_adc.c on the
+//board (free running round robin and DMA), or a stand-in in the
+//emulator.
+//
+//Samples are the raw 12 bit readings as uint16s, the inputs in turn
+//from the lowest, written round a ring of SCOPE_SAMPLES. The first
+//sample is of the lowest input.
+#define SCOPE_SAMPLES 16384
+
+//ADC inputs 0 (the mux), 1 (SWITCH_I_MONITOR) and 2 (COMP_I_MONITOR)
+#define SCOPE_INPUTS 3
+
+typedef struct scope_config{
+  //Mask of ADC inputs
+  uint32_t inputs;
+  //Samples per second over all the inputs
+  uint32_t rate_hz;
+} scope_config;
+
+extern uint16_t scope_buffer[SCOPE_SAMPLES];
+
+//Starts sampling. rate_hz is changed to the nearest rate the ADC can
+//do, and false returned if it is out of its range.
+bool scope_hw_start(scope_config *config);
+//Samples written since the start, the newest at ring index count - 1.
+uint32_t scope_hw_count();
+//Stops sampling and gives the ADC back for single readings.
+void scope_hw_stop();
+
+#endif
@@ -0,0 +1,295 @@
+#include "string.h"
+#include "stddef.h"
+#include "pico/stdlib.h"
+#include "settings.h"
+#include "flash_ops.h"
+#include "crc32.h"
+#include "console.h"
+
+//Two flash sectors take turns holding the record. A save goes to the
+//one not in use, so a reset halfway through leaves the last good
+//record where it was.
+#define SETTINGS_SLOTS 2
+#define SETTINGS_RECORD_MAX (sizeof(settings_header) + sizeof(settings_values) + sizeof(uint32_t))
+
+typedef struct settings_field{
+  const char *name;
+  const char *unit;
+  size_t offset;
+  uint32_t min;
+  uint32_t max;
+  uint32_t fallback;
+} settings_field;
+
+//The ranges keep the board safe to run: a shutdown cannot be made so
+//quick that a dip in the key voltage cuts the Jetson, or so late that
+//the battery is left to drain.
+static const settings_field fields[] = {
+  {"shutdown_delay", "ms", offsetof(settings_values, shutdown_delay_ms), 1000, 120000, 10000},
+  {"jetson_signal_time", "ms", offsetof(settings_values, jetson_signal_time_ms), 500, 60000, 5000},
+  {"jetson_sd_delay", "ms", offsetof(settings_values, jetson_sd_delay_ms), 0, 120000, 5000},
+  {"forced_shutdown", "ms", offsetof(settings_values, forced_shutdown_ms), 15000, 600000, 45000},
+  {"relay_engage", "ms", offsetof(settings_values, relay_engage_ms), 1000, 60000, 10000},
+  {"power_engage", "ms", offsetof(settings_values, power_engage_ms), 2000, 120000, 20000},
+  {"volt_threshold", "counts", offsetof(settings_values, volt_threshold), 200, 4000, 1000},
+  {"delta_current_thresh", "mA", offsetof(settings_values, delta_current_ma), 50, 5000, 500},
+  {"standby_delay", "ms", offsetof(settings_values, standby_delay_ms), 0, 3600000, 30000},
+  {"shed_level1", "counts", offsetof(settings_values, shed_level1), 0, 4095, 1800},
+  {"shed_level2", "counts", offsetof(settings_values, shed_level2), 0, 4095, 1500},
+  {"shed_level3", "counts", offsetof(settings_values, shed_level3), 0, 4095, 1200},
+  {"shed_slope", "counts/ms", offsetof(settings_values, shed_slope), 0, 1000, 20},
+  {"shed_restore", "ms", offsetof(settings_values, shed_restore_ms), 10, 60000, 2000},
+  {"shed_lights", "stage", offsetof(settings_values, shed_lights), 0, 3, 1},
+  {"shed_outputs", "stage", offsetof(settings_values, shed_outputs), 0, 3, 2},
+  {"shed_poe", "stage", offsetof(settings_values, shed_poe), 0, 3, 3},
+  {"tte_mux", "input", offsetof(settings_values, tte_mux), 0, 5, 1},
+  {"tte_empty", "counts", offsetof(settings_values, tte_empty), 0, 4095, 900},
+  {"tte_reserve", "ms", offsetof(settings_values, tte_reserve_ms), 0, 600000, 0},
+  {"tte_hold", "ms", offsetof(settings_values, tte_hold_ms), 0, 600000, 0},
+  {"pq_sag", "%", offsetof(settings_values, pq_sag), 50, 99, 90},
+  {"pq_swell", "%", offsetof(settings_values, pq_swell), 101, 200, 110},
+  {"pq_dropout", "%", offsetof(settings_values, pq_dropout), 1, 49, 10},
+  {"pq_nominal", "counts", offsetof(settings_values, pq_nominal), 0, 4095, 0},
+  {"fr_triggers", "mask", offsetof(settings_values, fr_triggers), 0, 15, 15},
+  {"fr_pre", "%", offsetof(settings_values, fr_pre), 0, 100, 75},
+  {"fr_current", "mA", offsetof(settings_values, fr_current_ma), 100, 50000, 10000},
+  {"fr_save", "flag", offsetof(settings_values, fr_save), 0, 1, 1},
+};
+
+smb_settings settings;
+static settings_values values;
+//Slot holding the record in use and its sequence, -1 with none
+static int active_slot = -1;
+static uint32_t sequence = 0;
+//values differ from what is in flash
+static bool unsaved = false;
+
+static uint32_t *field_value(settings_values *target, const settings_field *field){
+  return (uint32_t *)((uint8_t *)target + field->offset);
+}
+
+static const settings_field *find_field(const char *name){
+  for (size_t i = 0; i < count_of(fields); i++){
+    if (strcmp(fields[i].name, name) == 0){
+      return &fields[i];
+    }
+  }
+  return NULL;
+}
+
+static uint32_t slot_offset(int slot){
+  return FLASH_SETTINGS_OFFSET + slot*FLASH_SECTOR_SIZE;
+}
+
+static void set_defaults(settings_values *target){
+  for (size_t i = 0; i < count_of(fields); i++){
+    *field_value(target, &fields[i]) = fields[i].fallback;
+  }
+}
+
+//Every field in range, the relay on before the rest and each shed
+//level that is set below the one before.
+static bool values_valid(settings_values *candidate){
+  for (size_t i = 0; i < count_of(fields); i++){
+    uint32_t value = *field_value(candidate, &fields[i]);
+    if ((value < fields[i].min) || (value > fields[i].max)){
+      return false;
+    }
+  }
+  uint32_t levels[] = {candidate->shed_level1, candidate->shed_level2, candidate->shed_level3};
+  uint32_t above = UINT32_MAX;
+  for (size_t i = 0; i < count_of(levels); i++){
+    if (levels[i]){
+      if (levels[i] >= above){
+        return false;
+      }
+      above = levels[i];
+    }
+  }
+  return candidate->relay_engage_ms < candidate->power_engage_ms;
+}
+
+//Converts to the state machine's units.
+static void apply(){
+  settings.shutdown_delay = (uint64_t)values.shutdown_delay_ms*1000;
+  settings.jetson_signal_time = (uint64_t)values.jetson_signal_time_ms*1000;
+  settings.jetson_sd_delay = (uint64_t)values.jetson_sd_delay_ms*1000;
+  settings.forced_shutdown = (uint64_t)values.forced_shutdown_ms*1000;
+  settings.relay_engage = (uint64_t)values.relay_engage_ms*1000;
+  settings.power_engage = (uint64_t)values.power_engage_ms*1000;
+  settings.volt_threshold = values.volt_threshold;
+  settings.delta_current_thresh = (double)values.delta_current_ma/1000.0;
+  settings.standby_delay = (uint64_t)values.standby_delay_ms*1000;
+  settings.shed_level[0] = values.shed_level1;
+  settings.shed_level[1] = values.shed_level2;
+  settings.shed_level[2] = values.shed_level3;
+  settings.shed_slope = values.shed_slope;
+  settings.shed_restore = (uint64_t)values.shed_restore_ms*1000;
+  settings.shed_lights = values.shed_lights;
+  settings.shed_outputs = values.shed_outputs;
+  settings.shed_poe = values.shed_poe;
+  settings.tte_mux = values.tte_mux;
+  settings.tte_empty = values.tte_empty;
+  settings.tte_reserve = (uint64_t)values.tte_reserve_ms*1000;
+  settings.tte_hold = (uint64_t)values.tte_hold_ms*1000;
+  settings.pq_sag = values.pq_sag;
+  settings.pq_swell = values.pq_swell;
+  settings.pq_dropout = values.pq_dropout;
+  settings.pq_nominal = values.pq_nominal;
+  settings.fr_triggers = values.fr_triggers;
+  settings.fr_pre = values.fr_pre;
+  settings.fr_current = (double)values.fr_current_ma/1000.0;
+  settings.fr_save = values.fr_save;
+}
+
+//Reads the record in a slot into target if it is whole and valid, and
+//returns its sequence through found.
+static bool read_slot(int slot, settings_values *target, uint32_t *found){
+  const uint8_t *record = flash_ops_read(slot_offset(slot));
+  settings_header header;
+  memcpy(&header, record, sizeof(header));
+  if ((header.magic != SETTINGS_MAGIC) ||
+    (header.length > FLASH_SECTOR_SIZE - sizeof(header) - sizeof(uint32_t))){
+    return false;
+  }
+  uint32_t stored_crc;
+  memcpy(&stored_crc, record + sizeof(header) + header.length, sizeof(stored_crc));
+  if (crc32_update(0, record, sizeof(header) + header.length) != stored_crc){
+    return false;
+  }
+  set_defaults(target);
+  size_t known = header.length < sizeof(*target) ? header.length : sizeof(*target);
+  memcpy(target, record + sizeof(header), known);
+  *found = header.sequence;
+  return values_valid(target);
+}
+
+//Loads the newest valid slot. Returns false, leaving values alone, if
+//neither is.
+static bool load(){
+  int best = -1;
+  uint32_t best_sequence = 0;
+  settings_values best_values;
+  for (int slot = 0; slot < SETTINGS_SLOTS; slot++){
+    settings_values candidate;
+    uint32_t candidate_sequence;
+    if (read_slot(slot, &candidate, &candidate_sequence) &&
+      ((best < 0) || ((int32_t)(candidate_sequence - best_sequence) > 0))){
+      best = slot;
+      best_sequence = candidate_sequence;
+      best_values = candidate;
+    }
+  }
+  if (best < 0){
+    return false;
+  }
+  values = best_values;
+  active_slot = best;
+  sequence = best_sequence;
+  unsaved = false;
+  apply();
+  return true;
+}
+
+static bool save(){
+  static uint8_t record[SETTINGS_RECORD_MAX];
+  int slot = active_slot < 0 ? 0 : (active_slot + 1) % SETTINGS_SLOTS;
+  settings_header header = {
+    .magic = SETTINGS_MAGIC,
+    .version = SETTINGS_VERSION,
+    .length = sizeof(values),
+    .sequence = sequence + 1,
+  };
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + sizeof(header), &values, sizeof(values));
+  uint32_t crc = crc32_update(0, record, sizeof(header) + sizeof(values));
+  memcpy(record + sizeof(header) + sizeof(values), &crc, sizeof(crc));
+  if (!flash_ops_write_sector(slot_offset(slot), record, sizeof(record))){
+    return false;
+  }
+  active_slot = slot;
+  sequence = header.sequence;
+  unsaved = false;
+  return true;
+}
+
+void settings_init(){
+  if (!load()){
+    set_defaults(&values);
+    apply();
+  }
+}
+
+static void print_field(const settings_field *field){
+  console_printf("%s %lu %s %lu %lu\n", field->name, *field_value(&values, field), field->unit, field->min, field->max);
+}
+
+//"cfg set <name> <value>"
+static bool settings_set(int argc, char *argv[]){
+  const settings_field *field;
+  uint32_t value;
+  if ((argc != 3) || !(field = find_field(argv[1])) || !console_arg_uint(argv[2], &value)){
+    return false;
+  }
+  if ((value < field->min) || (value > field->max)){
+    console_printf("Settings: %s must be %lu to %lu %s\n", field->name, field->min, field->max, field->unit);
+    return false;
+  }
+  settings_values candidate = values;
+  *field_value(&candidate, field) = value;
+  if (!values_valid(&candidate)){
+    console_printf("Settings: relay_engage must be below power_engage, and each shed level set below the one before\n");
+    return false;
+  }
+  values = candidate;
+  unsaved = true;
+  apply();
+  return true;
+}
+
+bool settings_command(int argc, char *argv[]){
+  if ((argc == 0) || ((strcmp(argv[0], "get") == 0) && (argc == 1))){
+    console_printf("Settings: slot %c, sequence %lu%s\n", active_slot < 0 ? '-' : 'A' + active_slot, sequence,
+      unsaved ? ", unsaved changes" : "");
+    for (size_t i = 0; i < count_of(fields); i++){
+      print_field(&fields[i]);
+    }
+    return true;
+  }
+  if ((strcmp(argv[0], "get") == 0) && (argc == 2)){
+    const settings_field *field = find_field(argv[1]);
+    if (!field){
+      return false;
+    }
+    print_field(field);
+    return true;
+  }
+  if (strcmp(argv[0], "set") == 0){
+    return settings_set(argc, argv);
+  }
+  if (argc != 1){
+    return false;
+  }
+  if (strcmp(argv[0], "save") == 0){
+    if (!save()){
+      console_printf("Settings: flash write failed\n");
+      return false;
+    }
+    console_printf("Settings: saved to slot %c, sequence %lu\n", 'A' + active_slot, sequence);
+    return true;
+  }
+  if (strcmp(argv[0], "load") == 0){
+    if (!load()){
+      console_printf("Settings: nothing saved\n");
+      return false;
+    }
+    return true;
+  }
+  if (strcmp(argv[0], "default") == 0){
+    set_defaults(&values);
+    unsaved = true;
+    apply();
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,140 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "pico/stdlib.h"
+
+//Lifecycle timings and thresholds, which differ between vehicles and
+//Jetson images. They are kept in flash, loaded at boot and changed
+//from the console on USB or uart1:
+//
+//  cfg [get [name]]
+//  cfg set <name> <value>
+//  cfg save
+//  cfg load
+//  cfg default
+//
+//"cfg set" checks the value against the field's range and takes
+//effect straight away, "cfg save" keeps it over a reboot. "cfg get"
+//prints one "name value unit min max" line per field.
+
+//What the state machine reads, in the units it works in. Rebuilt
+//whenever a value changes, so reading one costs nothing.
+typedef struct smb_settings{
+  //Key off to the shutdown signal, in microseconds like all the times
+  uint64_t shutdown_delay;
+  //How long the Jetson holds the shutdown pin before the current is
+  //checked
+  uint64_t jetson_signal_time;
+  //Minimum time the Jetson is expected to take to shut down. Not used
+  //by the state machine yet.
+  uint64_t jetson_sd_delay;
+  //After shutdown_delay, power is cut this long after the shutdown
+  //signal regardless of the Jetson
+  uint64_t forced_shutdown;
+  //Key on to the main relay
+  uint64_t relay_engage;
+  //Key on to the regulators, the PoE switch and the Jetson
+  uint64_t power_engage;
+  //Raw ADC count on KEY_Voltage above which the key is on
+  uint32_t volt_threshold;
+  //Drop in Jetson current, in amps, taken to mean it has shut down
+  double delta_current_thresh;
+  //Parked with the key off this long before going to standby, 0 for
+  //never, see standby.h
+  uint64_t standby_delay;
+  //Load shedding, see loadshed.h. KEY_Voltage counts below which each
+  //stage sheds, 0 for a stage that never does by level
+  uint32_t shed_level[3];
+  //Fall in counts per millisecond that sheds the next stage ahead of
+  //its level, 0 for none
+  uint32_t shed_slope;
+  //Back above a stage's level this long before it is restored
+  uint64_t shed_restore;
+  //The stage each group of loads is shed at, 0 for never
+  uint32_t shed_lights;
+  uint32_t shed_outputs;
+  uint32_t shed_poe;
+  //Time to empty, see energy.h. Mux input the supply is read on and
+  //its reading taken as empty
+  uint32_t tte_mux;
+  uint32_t tte_empty;
+  //Time the Jetson needs from the shutdown signal to halted, 0 to
+  //leave the signal at shutdown_delay
+  uint64_t tte_reserve;
+  //Longest the signal waits on a supply that will last, if longer
+  //than shutdown_delay
+  uint64_t tte_hold;
+  //Power quality events, see power_quality.h. Percent of nominal below
+  //which a sag and a dropout start and above which a swell does
+  uint32_t pq_sag;
+  uint32_t pq_swell;
+  uint32_t pq_dropout;
+  //Nominal KEY_Voltage reading, 0 to track it
+  uint32_t pq_nominal;
+  //Flight recorder, see flight_recorder.h. FR_TRIGGER_BIT mask of the
+  //triggers that freeze it, percent of the ring kept from before the
+  //trigger, regulator current in amps that is an overcurrent, and
+  //whether a frozen recording is written to flash
+  uint32_t fr_triggers;
+  uint32_t fr_pre;
+  double fr_current;
+  uint32_t fr_save;
+} smb_settings;
+
+extern smb_settings settings;
+
+#define SETTINGS_VERSION 1
+//"SMBC" as stored
+#define SETTINGS_MAGIC 0x43424d53
+
+//Stored form, whole milliseconds, counts and milliamps. Fields are
+//only ever added at the end: an older record loads with defaults for
+//what it lacks and a newer one with what this firmware knows of it.
+typedef struct settings_values{
+  uint32_t shutdown_delay_ms;
+  uint32_t jetson_signal_time_ms;
+  uint32_t jetson_sd_delay_ms;
+  uint32_t forced_shutdown_ms;
+  uint32_t relay_engage_ms;
+  uint32_t power_engage_ms;
+  uint32_t volt_threshold;
+  uint32_t delta_current_ma;
+  uint32_t standby_delay_ms;
+  uint32_t shed_level1;
+  uint32_t shed_level2;
+  uint32_t shed_level3;
+  uint32_t shed_slope;
+  uint32_t shed_restore_ms;
+  uint32_t shed_lights;
+  uint32_t shed_outputs;
+  uint32_t shed_poe;
+  uint32_t tte_mux;
+  uint32_t tte_empty;
+  uint32_t tte_reserve_ms;
+  uint32_t tte_hold_ms;
+  uint32_t pq_sag;
+  uint32_t pq_swell;
+  uint32_t pq_dropout;
+  uint32_t pq_nominal;
+  uint32_t fr_triggers;
+  uint32_t fr_pre;
+  uint32_t fr_current_ma;
+  uint32_t fr_save;
+} settings_values;
+
+//Start of a record in either flash slot. The values follow, length
+//bytes of them, then the CRC-32 of the header and values. The slot
+//with the highest sequence that checks out is the one in use.
+typedef struct settings_header{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint32_t sequence;
+} settings_header;
+
+//Loads the newest good record from flash, or the defaults.
+void settings_init();
+//The "cfg" command, argv[0] is the subcommand if there is one.
+bool settings_command(int argc, char *argv[]);
+
+#endif
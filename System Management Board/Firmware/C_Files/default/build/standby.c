@@ -0,0 +1,80 @@
+#include "pico/stdlib.h"
+#include "standby.h"
+#include "settings.h"
+#include "console.h"
+#include "supervisor.h"
+#include "clock_policy.h"
+
+//Start of the current stretch the board could have been in standby
+static uint64_t parked_since;
+static uint32_t entries, samples;
+//Time spent in standby, split between asleep and awake sampling the
+//key. The clock profiles account for the rest of the time since boot.
+static uint64_t asleep_us, sampling_us;
+//From the nap that saw the wake to the clocks being back
+static uint32_t worst_wake_us;
+static bool last_by_pin;
+
+bool standby_due(bool parked){
+  uint64_t now = time_us_64();
+  if (!parked || !settings.standby_delay){
+    parked_since = now;
+    return false;
+  }
+  return now - parked_since >= settings.standby_delay;
+}
+
+void standby_run(uint32_t wake_pins, int (*key_on)()){
+  entries++;
+  standby_hw_enter(wake_pins);
+  clock_policy_set(CLOCK_CRYSTAL);
+  bool by_pin = false;
+  uint64_t woke;
+  while (true){
+    supervisor_begin(SUPERVISOR_STANDBY);
+    uint64_t start = time_us_64();
+    by_pin = standby_hw_nap(STANDBY_SAMPLE_MS*1000);
+    woke = time_us_64();
+    asleep_us += woke - start;
+    samples++;
+    bool done = by_pin || key_on();
+    sampling_us += time_us_64() - woke;
+    supervisor_end(SUPERVISOR_STANDBY);
+    supervisor_idle();
+    if (done){
+      break;
+    }
+  }
+  //The main loop moves on to the profile it wants from here
+  clock_policy_set(CLOCK_MONITOR);
+  standby_hw_exit();
+  uint64_t now = time_us_64();
+  if (now - woke > worst_wake_us){
+    worst_wake_us = (uint32_t)(now - woke);
+  }
+  last_by_pin = by_pin;
+  parked_since = now;
+}
+
+//Average current in microamps over the time since boot. Time on the
+//crystal outside a nap counts as sampling.
+static uint32_t average_ua(uint64_t total_us){
+  uint64_t crystal_us = clock_policy_time_us(CLOCK_CRYSTAL);
+  uint64_t awake_us = crystal_us > asleep_us ? crystal_us - asleep_us : 0;
+  uint64_t charge = clock_policy_time_us(CLOCK_FULL)*CLOCK_FULL_UA +
+    clock_policy_time_us(CLOCK_MONITOR)*CLOCK_MONITOR_UA + awake_us*CLOCK_CRYSTAL_UA + asleep_us*STANDBY_SLEEP_UA;
+  return total_us ? (uint32_t)(charge/total_us) : CLOCK_FULL_UA;
+}
+
+bool standby_command(int argc, char *argv[]){
+  uint64_t now = time_us_64();
+  console_printf("Standby: %lu entries, last woken by %s, worst wake %lu us, %lu key samples\n", entries,
+    entries ? (last_by_pin ? "pin" : "key") : "none", worst_wake_us, samples);
+  console_printf("Standby: full %lu s at %lu uA, monitor %lu s at %lu uA, sampling %lu ms at %lu uA, asleep %lu s at %lu uA\n",
+    (uint32_t)(clock_policy_time_us(CLOCK_FULL)/1000000), (uint32_t)CLOCK_FULL_UA,
+    (uint32_t)(clock_policy_time_us(CLOCK_MONITOR)/1000000), (uint32_t)CLOCK_MONITOR_UA,
+    (uint32_t)(sampling_us/1000), (uint32_t)CLOCK_CRYSTAL_UA, (uint32_t)(asleep_us/1000000),
+    (uint32_t)STANDBY_SLEEP_UA);
+  console_printf("Standby: average %lu uA since boot\n", average_ua(now));
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef STANDBY_H
+#define STANDBY_H
+
+#include "pico/stdlib.h"
+
+//Low power standby for a parked vehicle. Once the key is off, the
+//shutdown is over and nothing else needs the board, the main loop
+//goes on spinning for nothing. After settings standby_delay of that
+//the board detaches USB, drops to the crystal clock profile (see
+//clock_policy.h) and sleeps, waking every STANDBY_SAMPLE_MS to read the
+//key voltage. It comes back to the full clock and the main loop when
+//the key is on, or at once when a wake pin (the aux switch) is
+//pulled low, and stays awake for standby_delay after that.
+//
+//  sby
+//
+//prints how long was spent in each mode and the average current that
+//works out to, see the Firmware README.
+#define STANDBY_SAMPLE_MS 250
+
+//RP2040 supply current asleep with only the timer, watchdog and GPIO
+//clocked, in microamps. Like the clock profiles' figures in
+//clock_policy.h, an estimate from the datasheets.
+#define STANDBY_SLEEP_UA 1300
+
+//Call once per main loop with whether the board could be in standby.
+//True once it has been for settings standby_delay.
+bool standby_due(bool parked);
+//Sleeps until key_on returns true or a wake pin falls, feeding the
+//watchdog on the way, and returns with the clocks as they were.
+void standby_run(uint32_t wake_pins, int (*key_on)());
+//The "sby" command.
+bool standby_command(int argc, char *argv[]);
+
+//Sleep backend, standby_clocks.c on the board.
+//Detaches USB, before its clock stops, and arms wake_pins to end a
+//nap on a falling edge.
+void standby_hw_enter(uint32_t wake_pins);
+//Sleeps for up to us. True if a wake pin ended it early.
+bool standby_hw_nap(uint32_t us);
+//Disarms the pins and attaches USB again.
+void standby_hw_exit();
+
+#endif
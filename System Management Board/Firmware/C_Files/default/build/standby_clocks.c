@@ -0,0 +1,85 @@
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/structs/clocks.h"
+#include "hardware/structs/scb.h"
+#include "standby.h"
+#include "usb_ports.h"
+
+//Standby backend for the board. The clocks are the crystal profile's,
+//see clock_pll.c, and a nap is a WFI with SLEEPDEEP set, so sleep_en
+//gates off every clock but the timer's, the watchdog's and the
+//GPIO's. Dormant would go lower, but the key voltage is read through
+//the ADC mux and the RTC has no 32kHz clock to wake it.
+
+static uint32_t pins;
+static int alarm_num = -1;
+static volatile bool alarm_fired, pin_fell;
+
+static void alarm_callback(uint alarm){
+  alarm_fired = true;
+}
+
+static void pin_callback(uint gpio, uint32_t events){
+  pin_fell = true;
+}
+
+void standby_hw_enter(uint32_t wake_pins){
+  usb_ports_suspend();
+  if (alarm_num < 0){
+    alarm_num = hardware_alarm_claim_unused(true);
+  }
+  hardware_alarm_set_callback(alarm_num, alarm_callback);
+  pins = wake_pins;
+  pin_fell = false;
+  for (uint pin = 0; pin < 32; pin++){
+    if (pins & (1u << pin)){
+      gpio_set_irq_enabled_with_callback(pin, GPIO_IRQ_EDGE_FALL, true, pin_callback);
+    }
+  }
+}
+
+bool standby_hw_nap(uint32_t us){
+  alarm_fired = false;
+  if (pin_fell){
+    return true;
+  }
+  if (hardware_alarm_set_target(alarm_num, make_timeout_time_us(us))){
+    return pin_fell;
+  }
+  uint32_t en0 = clocks_hw->sleep_en0, en1 = clocks_hw->sleep_en1;
+  clocks_hw->sleep_en0 = CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS |
+    CLOCKS_SLEEP_EN0_CLK_SYS_CLOCKS_BITS;
+  clocks_hw->sleep_en1 = CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS | CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS |
+    CLOCKS_SLEEP_EN1_CLK_SYS_XOSC_BITS;
+  hw_set_bits(&scb_hw->scr, M0PLUS_SCR_SLEEPDEEP_BITS);
+  //Checked with interrupts off so one that comes in between still
+  //ends the WFI
+  while (true){
+    uint32_t status = save_and_disable_interrupts();
+    bool done = alarm_fired || pin_fell;
+    if (!done){
+      __wfi();
+    }
+    restore_interrupts(status);
+    if (done){
+      break;
+    }
+  }
+  hw_clear_bits(&scb_hw->scr, M0PLUS_SCR_SLEEPDEEP_BITS);
+  clocks_hw->sleep_en0 = en0;
+  clocks_hw->sleep_en1 = en1;
+  hardware_alarm_cancel(alarm_num);
+  return pin_fell;
+}
+
+void standby_hw_exit(){
+  for (uint pin = 0; pin < 32; pin++){
+    if (pins & (1u << pin)){
+      gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_FALL, false);
+    }
+  }
+  hardware_alarm_set_callback(alarm_num, NULL);
+  usb_ports_resume();
+}
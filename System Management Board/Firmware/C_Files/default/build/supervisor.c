@@ -0,0 +1,195 @@
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/watchdog.h"
+#include "hardware/structs/sio.h"
+#include "supervisor.h"
+#include "console.h"
+#include "hot_path.h"
+
+//Breadcrumbs live in watchdog scratch 0-3, which keep their values
+//over a watchdog reset. watchdog_enable writes 4, and the boot ROM
+//only reads 5-7 when 4 holds the magic of watchdog_reboot, so the
+//lifecycle for a warm restart goes in those.
+#define SCRATCH_MAGIC 0
+//task << 24 | phase << 16 | GPIO0-15 outputs, kept up to date
+#define SCRATCH_LIVE 1
+#define SCRATCH_PC 2
+//stalls since power on << 8 | supervisor_reason
+#define SCRATCH_STATUS 3
+//supervisor_state.engage_ms and shutdown_ms
+#define SCRATCH_ENGAGE 5
+#define SCRATCH_SHUTDOWN 6
+//RESUME_MARK << 24 | phase << 16 | jetson_ca, written last and
+//cleared first so a half written lifecycle is never resumed
+#define SCRATCH_RESUME 7
+#define RESUME_MARK 0xa5
+//"SUPV"
+#define SUPERVISOR_MAGIC 0x56505553
+#define SUPERVISOR_CHECK_US 100000
+//A board that keeps stalling right after the outputs are put back
+//starts cold instead
+#define SUPERVISOR_RESTORE_LIMIT 3
+
+static uint32_t expected;
+static volatile uint32_t checked;
+//time_us_32 when the watchdog was last fed
+static volatile uint32_t fed_us;
+static volatile bool stopped;
+//supervisor_reboot was called, the outputs stay off until it fires
+static volatile bool rebooting;
+static supervisor_report last;
+static supervisor_state kept;
+
+static const char *const task_names[] = {"none", "state", "console", "jetson_console", "outputs", "capture", "standby"};
+static const char *const reason_names[] = {"power on", "watchdog", "stall", "planned", "update"};
+
+static inline void set_reason(supervisor_reason reason){
+  watchdog_hw->scratch[SCRATCH_STATUS] = (watchdog_hw->scratch[SCRATCH_STATUS] & ~0xffu) | reason;
+}
+
+uint32_t supervisor_init(uint32_t tasks){
+  uint32_t restore = 0;
+  last = (supervisor_report){SUPERVISOR_POWER_ON, SUPERVISOR_NONE, 0, 0, 0, 0, false};
+  if (watchdog_caused_reboot() && (watchdog_hw->scratch[SCRATCH_MAGIC] == SUPERVISOR_MAGIC)){
+    uint32_t live = watchdog_hw->scratch[SCRATCH_LIVE];
+    uint32_t status = watchdog_hw->scratch[SCRATCH_STATUS];
+    last.reason = (supervisor_reason)(status & 0xff);
+    last.task = (supervisor_task)(live >> 24);
+    last.phase = (live >> 16) & 0xff;
+    last.outputs = live & 0xffff;
+    last.pc = watchdog_hw->scratch[SCRATCH_PC];
+    last.faults = status >> 8;
+    if ((last.reason == SUPERVISOR_RUNNING) || (last.reason == SUPERVISOR_STALL)){
+      last.faults++;
+      if (last.faults <= SUPERVISOR_RESTORE_LIMIT){
+        restore = last.outputs;
+      }
+    } else if (last.reason == SUPERVISOR_UPDATE){
+      restore = last.outputs;
+    }
+    if (last.task >= SUPERVISOR_TASK_COUNT){
+      last.task = SUPERVISOR_NONE;
+    }
+    if (last.reason > SUPERVISOR_UPDATE){
+      last = (supervisor_report){SUPERVISOR_POWER_ON, SUPERVISOR_NONE, 0, 0, 0, 0, false};
+      restore = 0;
+    }
+    uint32_t resume = watchdog_hw->scratch[SCRATCH_RESUME];
+    if (restore && ((resume >> 24) == RESUME_MARK)){
+      kept.phase = (resume >> 16) & 0xff;
+      kept.jetson_ca = (int16_t)(resume & 0xffff);
+      kept.engage_ms = watchdog_hw->scratch[SCRATCH_ENGAGE];
+      kept.shutdown_ms = watchdog_hw->scratch[SCRATCH_SHUTDOWN];
+      last.resumed = true;
+    }
+  }
+  watchdog_hw->scratch[SCRATCH_MAGIC] = SUPERVISOR_MAGIC;
+  watchdog_hw->scratch[SCRATCH_LIVE] = 0;
+  watchdog_hw->scratch[SCRATCH_PC] = 0;
+  watchdog_hw->scratch[SCRATCH_STATUS] = (last.faults << 8) | SUPERVISOR_RUNNING;
+  watchdog_hw->scratch[SCRATCH_RESUME] = 0;
+  watchdog_hw->scratch[SCRATCH_ENGAGE] = 0;
+  watchdog_hw->scratch[SCRATCH_SHUTDOWN] = 0;
+  expected = tasks;
+  checked = 0;
+  stopped = false;
+  rebooting = false;
+  fed_us = time_us_32();
+  watchdog_enable(SUPERVISOR_WATCHDOG_MS, 1);
+  supervisor_hw_start(SUPERVISOR_CHECK_US);
+  return restore;
+}
+
+void HOT_FUNC(supervisor_begin)(supervisor_task task){
+  watchdog_hw->scratch[SCRATCH_LIVE] = (watchdog_hw->scratch[SCRATCH_LIVE] & 0x00ffffff) | ((uint32_t)task << 24);
+}
+
+void HOT_FUNC(supervisor_end)(supervisor_task task){
+  watchdog_hw->scratch[SCRATCH_LIVE] &= 0x00ffffff;
+  checked |= SUPERVISOR_BIT(task);
+}
+
+void HOT_FUNC(supervisor_service)(uint8_t phase){
+  watchdog_hw->scratch[SCRATCH_LIVE] = (watchdog_hw->scratch[SCRATCH_LIVE] & 0xff000000) |
+    ((uint32_t)phase << 16) | (sio_hw->gpio_out & 0xffff);
+  if (stopped || ((checked & expected) != expected)){
+    return;
+  }
+  watchdog_update();
+  fed_us = time_us_32();
+  checked = 0;
+}
+
+void supervisor_idle(){
+  checked = expected;
+  supervisor_service((watchdog_hw->scratch[SCRATCH_LIVE] >> 16) & 0xff);
+}
+
+void supervisor_keep(const supervisor_state *state){
+  if (stopped){
+    return;
+  }
+  watchdog_hw->scratch[SCRATCH_RESUME] = 0;
+  watchdog_hw->scratch[SCRATCH_ENGAGE] = state->engage_ms;
+  watchdog_hw->scratch[SCRATCH_SHUTDOWN] = state->shutdown_ms;
+  watchdog_hw->scratch[SCRATCH_RESUME] = ((uint32_t)RESUME_MARK << 24) | ((uint32_t)state->phase << 16) |
+    (uint16_t)state->jetson_ca;
+}
+
+bool supervisor_resume(supervisor_state *state){
+  if (!last.resumed){
+    return false;
+  }
+  *state = kept;
+  return true;
+}
+
+void supervisor_reboot(uint32_t delay_ms){
+  stopped = true;
+  rebooting = true;
+  watchdog_hw->scratch[SCRATCH_RESUME] = 0;
+  set_reason(SUPERVISOR_PLANNED);
+  watchdog_enable(delay_ms, 1);
+}
+
+void supervisor_restart(uint32_t delay_ms){
+  stopped = true;
+  set_reason(SUPERVISOR_UPDATE);
+  watchdog_enable(delay_ms, 1);
+}
+
+bool HOT_FUNC(supervisor_rebooting)(){
+  return rebooting;
+}
+
+//From the timer interrupt. Resets the board at once if the watchdog
+//has gone hungry for too long, rather than leaving the outputs as
+//they are until it fires.
+void __not_in_flash_func(supervisor_check)(uint32_t pc){
+  if (stopped || (time_us_32() - fed_us < SUPERVISOR_STALL_MS*1000)){
+    return;
+  }
+  watchdog_hw->scratch[SCRATCH_PC] = pc;
+  set_reason(SUPERVISOR_STALL);
+  watchdog_enable(1, 1);
+  while (true){
+  }
+}
+
+const supervisor_report *supervisor_last_reset(){
+  return &last;
+}
+
+void supervisor_print(){
+  console_printf("Watchdog: last reset %s", reason_names[last.reason]);
+  if ((last.reason == SUPERVISOR_RUNNING) || (last.reason == SUPERVISOR_STALL) || (last.reason == SUPERVISOR_UPDATE)){
+    console_printf(" in %s, phase 0x%02x, outputs 0x%04x", task_names[last.task], last.phase, last.outputs);
+    if (last.pc){
+      console_printf(", pc 0x%08lx", last.pc);
+    }
+    if (last.resumed){
+      console_printf(", warm restart");
+    }
+  }
+  console_printf(", stalls since power on: %lu\n", last.faults);
+}
@@ -0,0 +1,123 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "pico/stdlib.h"
+
+//Keeps the main loop under the watchdog. Every task the loop runs
+//checks in once it has run, and the watchdog is only fed once all
+//the expected ones have, so a task that hangs or stops being called
+//resets the board.
+//
+//Before the hardware watchdog would fire, a timer interrupt notices
+//the stall and records what was running and where in the watchdog
+//scratch registers, then resets straight away. After the reboot they
+//are reported with "wd", and the power outputs that were on are put
+//back before anything else runs.
+//
+//The state machine also leaves where it is in its lifecycle with
+//supervisor_keep. After a stall that is handed back by
+//supervisor_resume, so an engage or a shutdown carries on from where
+//it was instead of the Jetson and the cameras being power cycled.
+#define SUPERVISOR_STALL_MS 1500
+#define SUPERVISOR_WATCHDOG_MS 2000
+
+typedef enum supervisor_task{
+  SUPERVISOR_NONE,
+  //The priority window running evaluate_state or shutdown_process
+  SUPERVISOR_STATE,
+  SUPERVISOR_CONSOLE,
+  SUPERVISOR_JETSON_CONSOLE,
+  SUPERVISOR_OUTPUTS,
+  SUPERVISOR_CAPTURE,
+  //A nap and key sample in standby, which runs instead of the rest
+  SUPERVISOR_STANDBY,
+  SUPERVISOR_TASK_COUNT
+} supervisor_task;
+
+#define SUPERVISOR_BIT(task) (1u << (task))
+//Every task the main loop runs
+#define SUPERVISOR_RUN_TASKS (SUPERVISOR_BIT(SUPERVISOR_STATE) | SUPERVISOR_BIT(SUPERVISOR_CONSOLE) | \
+  SUPERVISOR_BIT(SUPERVISOR_JETSON_CONSOLE) | SUPERVISOR_BIT(SUPERVISOR_OUTPUTS) | \
+  SUPERVISOR_BIT(SUPERVISOR_CAPTURE))
+
+typedef enum supervisor_reason{
+  //Power on, or the breadcrumbs did not survive
+  SUPERVISOR_POWER_ON,
+  //Running normally, so a reboot with this left was the hardware
+  //watchdog catching a stall the timer interrupt could not
+  SUPERVISOR_RUNNING,
+  SUPERVISOR_STALL,
+  //supervisor_reboot, the end of a shutdown
+  SUPERVISOR_PLANNED,
+  //supervisor_restart, into a new image after a field update
+  SUPERVISOR_UPDATE,
+} supervisor_reason;
+
+//What the last reset left behind.
+typedef struct supervisor_report{
+  supervisor_reason reason;
+  supervisor_task task;
+  //State machine flags from the phase argument of supervisor_service
+  uint8_t phase;
+  //GPIO0-15 as driven
+  uint16_t outputs;
+  //Where core 0 was when the stall was caught, 0 if not known
+  uint32_t pc;
+  //Resets by a stall since power on
+  uint32_t faults;
+  //The lifecycle was kept and is handed back by supervisor_resume
+  bool resumed;
+} supervisor_report;
+
+//Where the state machine is in its lifecycle.
+typedef struct supervisor_state{
+  //State machine flags, as for supervisor_service
+  uint8_t phase;
+  //Time since the engage and the shutdown started, in milliseconds
+  uint32_t engage_ms;
+  uint32_t shutdown_ms;
+  //Jetson current taken at its shutdown request, in centiamps
+  int16_t jetson_ca;
+} supervisor_state;
+
+//Reads and reports the breadcrumbs of the last reset, then arms the
+//watchdog. Returns the GPIO0-15 outputs that were on if the last
+//reset was a fault or supervisor_restart, for the caller to put back,
+//or 0.
+uint32_t supervisor_init(uint32_t tasks);
+//Marks a task as running, then as done.
+void supervisor_begin(supervisor_task task);
+void supervisor_end(supervisor_task task);
+//Updates the breadcrumbs and feeds the watchdog if every expected
+//task has checked in since it was last fed. Call once per loop.
+void supervisor_service(uint8_t phase);
+//Feeds the watchdog from a loop that runs in place of the main loop's
+//tasks, standby, keeping the last phase.
+void supervisor_idle();
+//Keeps the lifecycle for a warm restart. Call after each run of the
+//state machine.
+void supervisor_keep(const supervisor_state *state);
+//Hands back the lifecycle kept before the last reset, when
+//supervisor_init returned outputs to restore with it. False if there
+//was none, for example because the reset caught supervisor_keep
+//halfway.
+bool supervisor_resume(supervisor_state *state);
+//Stops feeding the watchdog so it reboots the board in delay_ms, as
+//the last step of a shutdown. The board starts cold after it.
+void supervisor_reboot(uint32_t delay_ms);
+//Whether supervisor_reboot has been called. The main loop then keeps
+//every output off and stops running the state machine, so nothing is
+//powered again in the time left.
+bool supervisor_rebooting();
+//Reboots the board in delay_ms into whatever the bootloader starts,
+//which picks up the outputs and the lifecycle as after a stall.
+void supervisor_restart(uint32_t delay_ms);
+const supervisor_report *supervisor_last_reset();
+void supervisor_print();
+
+//Timer backend, supervisor_alarm.c on the board. Calls
+//supervisor_check with the interrupted PC every period_us.
+void supervisor_hw_start(uint32_t period_us);
+void supervisor_check(uint32_t pc);
+
+#endif
@@ -0,0 +1,43 @@
+#include "pico/stdlib.h"
+#include "hardware/timer.h"
+#include "hardware/irq.h"
+#include "hardware/structs/timer.h"
+#include "supervisor.h"
+
+//Runs supervisor_check from a timer alarm of its own at the highest
+//interrupt priority, so it still gets in when the main loop is stuck
+//in a loop or behind another interrupt handler. Only a hang with
+//interrupts off is left to the watchdog.
+static int alarm_num = -1;
+static uint32_t alarm_period;
+
+//Gets the exception frame the interrupted code's registers were
+//stacked in: r0-r3, r12, lr, pc, xpsr.
+void __not_in_flash_func(supervisor_alarm_frame)(uint32_t *frame){
+  timer_hw->intr = 1u << alarm_num;
+  timer_hw->alarm[alarm_num] = timer_hw->timerawl + alarm_period;
+  supervisor_check(frame[6]);
+}
+
+//The frame is at sp on entry, before a C prologue pushes anything
+//on top of it.
+static void __attribute__((naked)) __not_in_flash_func(supervisor_alarm_irq)(){
+  __asm volatile(
+    "mov r0, sp\n"
+    "ldr r1, =supervisor_alarm_frame\n"
+    "bx r1\n"
+  );
+}
+
+void supervisor_hw_start(uint32_t period_us){
+  if (alarm_num < 0){
+    alarm_num = hardware_alarm_claim_unused(true);
+    uint irq = TIMER_IRQ_0 + alarm_num;
+    irq_set_exclusive_handler(irq, supervisor_alarm_irq);
+    irq_set_priority(irq, PICO_HIGHEST_IRQ_PRIORITY);
+    hw_set_bits(&timer_hw->inte, 1u << alarm_num);
+    irq_set_enabled(irq, true);
+  }
+  alarm_period = period_us;
+  timer_hw->alarm[alarm_num] = timer_hw->timerawl + alarm_period;
+}
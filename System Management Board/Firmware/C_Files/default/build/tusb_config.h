@@ -0,0 +1,27 @@
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+//TinyUSB device configuration for usb_ports.c: two CDC ports and
+//nothing else, see usb_descriptors.c.
+
+#ifndef CFG_TUSB_RHPORT0_MODE
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+#endif
+
+#define CFG_TUSB_OS OPT_OS_PICO
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+#define CFG_TUD_CDC 2
+#define CFG_TUD_MSC 0
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 0
+
+//TinyUSB's own FIFOs. usb_ports.c moves data between them and its
+//rings, which take the bursts.
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+#define CFG_TUD_CDC_EP_BUFSIZE 64
+
+#endif
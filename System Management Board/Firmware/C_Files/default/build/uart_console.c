@@ -0,0 +1,42 @@
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "uart_console.h"
+#include "uart_rx_hw.h"
+
+static uart_inst_t *port;
+static char tx_buffer[UART_CONSOLE_TX_BUFFER];
+static size_t tx_head, tx_count;
+static uint8_t rx_buffer[UART_CONSOLE_RX_BUFFER] __attribute__((aligned(UART_CONSOLE_RX_BUFFER)));
+static uint32_t rx_tail;
+
+void uart_console_init(uart_inst_t *uart){
+  port = uart;
+  tx_head = tx_count = 0;
+  rx_tail = 0;
+  uart_rx_hw_start(uart, rx_buffer, UART_CONSOLE_RX_BUFFER);
+}
+
+int uart_console_read(){
+  if (rx_tail == uart_rx_hw_head()){
+    return -1;
+  }
+  uint8_t c = rx_buffer[rx_tail];
+  rx_tail = (rx_tail + 1) % UART_CONSOLE_RX_BUFFER;
+  return c;
+}
+
+//Output that does not fit in the buffer is dropped.
+void uart_console_write(const char *text, size_t length){
+  for (size_t i = 0; (i < length) && (tx_count < UART_CONSOLE_TX_BUFFER); i++){
+    tx_buffer[(tx_head + tx_count) % UART_CONSOLE_TX_BUFFER] = text[i];
+    tx_count++;
+  }
+}
+
+void uart_console_flush(){
+  while (tx_count && uart_is_writable(port)){
+    uart_putc_raw(port, tx_buffer[tx_head]);
+    tx_head = (tx_head + 1) % UART_CONSOLE_TX_BUFFER;
+    tx_count--;
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef UART_CONSOLE_H
+#define UART_CONSOLE_H
+
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+
+//Console port on the Jetson's uart1. Replies go into a buffer that
+//uart_console_flush drains as the FIFO has room, so a long one does
+//not hold up the main loop for the 87us each character takes.
+//Received characters go into a ring by DMA, so none are lost while
+//the main loop is held up, by a flash write for example. 8 KB is
+//0.7 s of uninterrupted input at 115200 baud.
+#define UART_CONSOLE_TX_BUFFER 1024
+#define UART_CONSOLE_RX_BUFFER 8192
+
+void uart_console_init(uart_inst_t *uart);
+//read and write for console_init
+int uart_console_read();
+void uart_console_write(const char *text, size_t length);
+//Moves buffered output into the FIFO, call from the main loop.
+void uart_console_flush();
+
+#endif
@@ -0,0 +1,35 @@
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/uart.h"
+#include "uart_rx_hw.h"
+
+//Two DMA channels take turns copying the RX FIFO into the ring, each
+//chained to the other. A turn is a whole number of laps, so the next
+//one starts where the last left off and nothing is lost in between.
+#define RX_TURN_TRANSFERS (1u << 31)
+
+static int channels[2];
+static uint8_t *ring;
+static uint32_t ring_mask;
+
+void uart_rx_hw_start(uart_inst_t *uart, uint8_t *buffer, uint32_t size){
+  ring = buffer;
+  ring_mask = size - 1;
+  channels[0] = dma_claim_unused_channel(true);
+  channels[1] = dma_claim_unused_channel(true);
+  for (int i = 0; i < 2; i++){
+    dma_channel_config config = dma_channel_get_default_config(channels[i]);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, __builtin_ctz(size));
+    channel_config_set_dreq(&config, uart_get_dreq(uart, false));
+    channel_config_set_chain_to(&config, channels[1 - i]);
+    dma_channel_configure(channels[i], &config, buffer, &uart_get_hw(uart)->dr, RX_TURN_TRANSFERS, i == 0);
+  }
+}
+
+uint32_t uart_rx_hw_head(){
+  int channel = dma_channel_is_busy(channels[1]) ? channels[1] : channels[0];
+  return (dma_channel_hw_addr(channel)->write_addr - (uintptr_t)ring) & ring_mask;
+}
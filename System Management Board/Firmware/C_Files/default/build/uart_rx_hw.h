@@ -0,0 +1,17 @@
+#ifndef UART_RX_HW_H
+#define UART_RX_HW_H
+
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+
+//Between uart_console.c and what receives for it: uart_rx_dma.c on
+//the board, which keeps receiving with interrupts off, for example
+//while flash is written, or a stand-in in the emulator.
+
+//Starts receiving into buffer as a ring. size is a power of two and
+//buffer is aligned to it.
+void uart_rx_hw_start(uart_inst_t *uart, uint8_t *buffer, uint32_t size);
+//Ring index the next byte received goes to.
+uint32_t uart_rx_hw_head();
+
+#endif
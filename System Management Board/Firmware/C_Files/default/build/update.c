@@ -0,0 +1,296 @@
+#include "stdio.h"
+#include "stdarg.h"
+#include "string.h"
+#include "pico/stdlib.h"
+#include "update.h"
+#include "boot_record.h"
+#include "flash_ops.h"
+#include "crc32.h"
+#include "console.h"
+#include "uart_console.h"
+#include "supervisor.h"
+
+//Start byte, offset and length
+#define FRAME_HEADER 7
+#define FRAME_MAX (FRAME_HEADER + UPDATE_CHUNK_MAX + sizeof(uint32_t))
+//A frame that has not all arrived by then is dropped, and the sender
+//told where to carry on
+#define FRAME_TIMEOUT_US 500000
+//Long enough for the answer to "upd apply" to go out
+#define RESTART_DELAY_MS 100
+
+//Without the bootloader in front of it the image is at the start of
+//flash, where the boot record and the slots would be
+#ifdef SMB_FIELD_UPDATE
+static const bool available = true;
+#else
+static const bool available = false;
+#endif
+
+static boot_record record;
+static uint64_t boot_us;
+//Slot being received into, -1 if none
+static int target = -1;
+static uint32_t image_length, image_crc;
+//Bytes of the image received so far and their CRC-32
+static uint32_t received, received_crc;
+//All of it is in and the CRC matches
+static bool image_ok;
+//The sector being received, written out once it is full
+static uint8_t sector[FLASH_SECTOR_SIZE];
+static uint8_t frame[FRAME_MAX];
+static size_t frame_fill;
+static uint64_t frame_start_us;
+
+static const char *const state_names[] = {"confirmed", "trial", "on trial"};
+
+#ifdef SMB_BOOT_IN_FIRMWARE
+//The emulator runs the same program from either slot
+static bool any_slot(int slot){
+  return true;
+}
+#endif
+
+void update_init(){
+  boot_us = time_us_64();
+  if (!available){
+    return;
+  }
+  boot_record_load(&record);
+#ifdef SMB_BOOT_IN_FIRMWARE
+  //No bootloader ran before this build, so its choice is made here
+  boot_record_select(&record, any_slot);
+#endif
+}
+
+//Frame answers go straight to uart1, they are not part of a command.
+static void answer(const char *format, ...){
+  char text[48];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (length > 0){
+    uart_console_write(text, length < (int)sizeof(text) ? length : sizeof(text) - 1);
+  }
+}
+
+//Adds data to the sector being received, and writes the sector out
+//when it is full or the image is complete.
+static bool take_data(const uint8_t *data, uint32_t length){
+  while (length){
+    uint32_t at = received % FLASH_SECTOR_SIZE;
+    uint32_t part = length < FLASH_SECTOR_SIZE - at ? length : FLASH_SECTOR_SIZE - at;
+    memcpy(sector + at, data, part);
+    received_crc = crc32_update(received_crc, data, part);
+    received += part;
+    data += part;
+    length -= part;
+    if ((received % FLASH_SECTOR_SIZE == 0) || (received == image_length)){
+      uint32_t start = (received - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+      if (!flash_ops_write_sector(FLASH_SLOT_OFFSET(target) + start, sector, received - start)){
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void take_frame(uint32_t length){
+  uint32_t offset, stored_crc;
+  memcpy(&offset, frame + 1, sizeof(offset));
+  memcpy(&stored_crc, frame + FRAME_HEADER + length, sizeof(stored_crc));
+  if ((crc32_update(0, frame + 1, FRAME_HEADER - 1 + length) != stored_crc) || (offset != received) ||
+    (length > image_length - received)){
+    answer("Update: resend %lu\n", received);
+    return;
+  }
+  if (!take_data(frame + FRAME_HEADER, length)){
+    target = -1;
+    answer("Update: flash write failed\n");
+    return;
+  }
+  answer("Update: ack %lu\n", received);
+  if (received == image_length){
+    image_ok = received_crc == image_crc;
+    if (!image_ok){
+      target = -1;
+    }
+    answer(image_ok ? "Update: image ok\n" : "Update: image CRC mismatch\n");
+  }
+}
+
+int update_read(){
+  while (true){
+    int c = uart_console_read();
+    if (c < 0){
+      return -1;
+    }
+    if (!frame_fill){
+      if ((c != UPDATE_FRAME_START) || (target < 0)){
+        return c;
+      }
+      frame_start_us = time_us_64();
+    }
+    frame[frame_fill++] = (uint8_t)c;
+    if (frame_fill < FRAME_HEADER){
+      continue;
+    }
+    uint16_t length;
+    memcpy(&length, frame + 5, sizeof(length));
+    if ((length == 0) || (length > UPDATE_CHUNK_MAX)){
+      frame_fill = 0;
+      answer("Update: resend %lu\n", received);
+    } else if (frame_fill == FRAME_HEADER + length + sizeof(uint32_t)){
+      frame_fill = 0;
+      take_frame(length);
+    }
+  }
+}
+
+static void confirm(){
+  record.state = BOOT_CONFIRMED;
+  if (boot_record_store(&record)){
+    printf("Update: slot %c confirmed\n", 'A' + record.active);
+  } else {
+    //Tried again after another UPDATE_HEALTH_MS
+    record.state = BOOT_TRYING;
+    boot_us = time_us_64();
+    printf("Update: boot record write failed\n");
+  }
+}
+
+void update_poll(){
+  uint64_t now = time_us_64();
+  if (frame_fill && (now - frame_start_us > FRAME_TIMEOUT_US)){
+    frame_fill = 0;
+    answer("Update: resend %lu\n", received);
+  }
+  if (available && (record.state == BOOT_TRYING) && (now - boot_us >= (uint64_t)UPDATE_HEALTH_MS*1000)){
+    confirm();
+  }
+}
+
+bool update_busy(){
+  return (target >= 0) || (available && (record.state != BOOT_CONFIRMED));
+}
+
+static void print_status(){
+  console_printf("Update: running slot %c, %s", 'A' + record.active, state_names[record.state]);
+  if (target >= 0){
+    console_printf(", %s slot %c, %lu of %lu bytes", image_ok ? "received" : "receiving", 'A' + target,
+      received, image_length);
+  }
+  console_printf("\n");
+}
+
+//"upd begin <length> <crc32>"
+static bool update_begin(int argc, char *argv[]){
+  uint32_t length, crc;
+  if ((argc != 3) || !console_arg_uint(argv[1], &length) || !console_arg_uint(argv[2], &crc)){
+    return false;
+  }
+  if (record.state != BOOT_CONFIRMED){
+    console_printf("Update: slot %c is on trial, the other slot holds the image to go back to\n", 'A' + record.active);
+    return false;
+  }
+  if ((length == 0) || (length > FLASH_SLOT_SIZE)){
+    console_printf("Update: an image is 1 to %lu bytes\n", (uint32_t)FLASH_SLOT_SIZE);
+    return false;
+  }
+  if ((target < 0) || (length != image_length) || (crc != image_crc)){
+    target = (record.active + 1) % FLASH_SLOT_COUNT;
+    image_length = length;
+    image_crc = crc;
+    received = 0;
+    received_crc = 0;
+    image_ok = false;
+  }
+  frame_fill = 0;
+  print_status();
+  return true;
+}
+
+//Makes slot active in state and restarts into it.
+static bool restart_into(int slot, boot_state state){
+  record.active = slot;
+  record.state = state;
+  if (!boot_record_store(&record)){
+    console_printf("Update: boot record write failed\n");
+    boot_record_load(&record);
+    return false;
+  }
+  console_printf("Update: starting slot %c\n", 'A' + slot);
+  supervisor_restart(RESTART_DELAY_MS);
+  return true;
+}
+
+//"upd apply". The image is read back and checked once more, as it
+//will be started without the bootloader checking it.
+static bool update_apply(){
+  if ((target < 0) || !image_ok){
+    console_printf("Update: no image received\n");
+    return false;
+  }
+  if ((crc32_update(0, flash_ops_read(FLASH_SLOT_OFFSET(target)), image_length) != image_crc) ||
+    !boot_image_startable(target)){
+    console_printf("Update: slot %c does not hold an image linked for it\n", 'A' + target);
+    target = -1;
+    return false;
+  }
+  record.image_length[target] = image_length;
+  record.image_crc[target] = image_crc;
+  int slot = target;
+  target = -1;
+  return restart_into(slot, BOOT_TRIAL);
+}
+
+//"upd rollback"
+static bool update_rollback(){
+  int other = (record.active + 1) % FLASH_SLOT_COUNT;
+  if (target >= 0){
+    console_printf("Update: slot %c is being received into, abort first\n", 'A' + target);
+    return false;
+  }
+  if (!boot_image_startable(other)){
+    console_printf("Update: slot %c holds no image to go back to\n", 'A' + other);
+    return false;
+  }
+  return restart_into(other, BOOT_CONFIRMED);
+}
+
+bool update_command(int argc, char *argv[]){
+  if (!available){
+    console_printf("Update: this build has no bootloader, see the Firmware README\n");
+    return false;
+  }
+  if ((argc == 0) || ((strcmp(argv[0], "status") == 0) && (argc == 1))){
+    print_status();
+    return true;
+  }
+  if (strcmp(argv[0], "begin") == 0){
+    return update_begin(argc, argv);
+  }
+  if (argc != 1){
+    return false;
+  }
+  if (strcmp(argv[0], "apply") == 0){
+    return update_apply();
+  }
+  if (strcmp(argv[0], "abort") == 0){
+    target = -1;
+    frame_fill = 0;
+    return true;
+  }
+  if (strcmp(argv[0], "confirm") == 0){
+    if (record.state == BOOT_TRYING){
+      confirm();
+    }
+    print_status();
+    return true;
+  }
+  if (strcmp(argv[0], "rollback") == 0){
+    return update_rollback();
+  }
+  return false;
+}
@@ -0,0 +1,52 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include "pico/stdlib.h"
+
+//Field update from the Jetson over uart1. The bootloader at the start
+//of flash starts one of two slots, see boot_record.h. A new image is
+//received into the other one while this one keeps running the board:
+//
+//  upd [status]
+//  upd begin <length> <crc32>
+//  upd apply
+//  upd abort
+//  upd confirm
+//  upd rollback
+//
+//"upd begin" starts receiving an image of length bytes, or carries on
+//with the one being received if length and CRC match, and prints how
+//much of it is already in. The image itself follows as frames:
+//
+//  0x02, uint32 offset, uint16 length, data, CRC-32 of offset to data
+//
+//all little endian, with at most UPDATE_CHUNK_MAX bytes of data. Each
+//one is answered "Update: ack <bytes received>", or "Update: resend
+//<bytes received>" if it was corrupt or not at the offset expected,
+//and the sender goes on from there. Frames may be sent ahead of their
+//answers, as long as no more than UPDATE_WINDOW bytes are unanswered.
+//"Update: image ok" follows the last answer once the image is checked.
+//
+//"upd apply" makes the new image active on trial and restarts into it,
+//picking up the outputs and lifecycle as after a stall. Once it has
+//run the board for UPDATE_HEALTH_MS it confirms itself. If the board
+//resets before that, the bootloader goes back to the previous image.
+#define UPDATE_FRAME_START 0x02
+#define UPDATE_CHUNK_MAX 1024
+#define UPDATE_WINDOW 4096
+#define UPDATE_HEALTH_MS 30000
+
+//Reads the boot record, call once at boot.
+void update_init();
+//Sits between uart1 and the Jetson's console, taking the frames out
+//of what is received. Used as the console's read.
+int update_read();
+//Confirms a trial image once it is healthy and drops a frame that
+//stopped halfway. Call from the main loop.
+void update_poll();
+//An image is being received, or the running one is still on trial.
+bool update_busy();
+//The "upd" command, argv[0] is the subcommand if there is one.
+bool update_command(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,109 @@
+#include "string.h"
+#include "tusb.h"
+#include "pico/unique_id.h"
+
+//Descriptors for the two CDC ports of usb_ports.h. Each port is an
+//interface association of a control and a data interface, which is
+//what makes Linux, macOS and Windows all load their own CDC driver
+//for it without an inf file or libusb.
+
+//Raspberry Pi's VID with the PID the SDK's USB stdio uses. bcdDevice
+//differs from the SDK's so hosts that cache the interfaces of a
+//VID/PID see the second port.
+#define USB_VID 0x2e8a
+#define USB_PID 0x000a
+#define USB_BCD_DEVICE 0x0200
+#define USB_MAX_POWER_MA 250
+
+enum {
+  ITF_CONSOLE,
+  ITF_CONSOLE_DATA,
+  ITF_DATA,
+  ITF_DATA_DATA,
+  ITF_COUNT
+};
+
+enum {
+  STR_LANGUAGE,
+  STR_MANUFACTURER,
+  STR_PRODUCT,
+  STR_SERIAL,
+  STR_CONSOLE,
+  STR_DATA,
+  STR_COUNT
+};
+
+#define EP_CONSOLE_NOTIFY 0x81
+#define EP_CONSOLE_OUT 0x02
+#define EP_CONSOLE_IN 0x82
+#define EP_DATA_NOTIFY 0x83
+#define EP_DATA_OUT 0x04
+#define EP_DATA_IN 0x84
+
+#define CONFIG_LENGTH (TUD_CONFIG_DESC_LEN + 2*TUD_CDC_DESC_LEN)
+
+static const tusb_desc_device_t device_descriptor = {
+  .bLength = sizeof(tusb_desc_device_t),
+  .bDescriptorType = TUSB_DESC_DEVICE,
+  .bcdUSB = 0x0200,
+  .bDeviceClass = TUSB_CLASS_MISC,
+  .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+  .bDeviceProtocol = MISC_PROTOCOL_IAD,
+  .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor = USB_VID,
+  .idProduct = USB_PID,
+  .bcdDevice = USB_BCD_DEVICE,
+  .iManufacturer = STR_MANUFACTURER,
+  .iProduct = STR_PRODUCT,
+  .iSerialNumber = STR_SERIAL,
+  .bNumConfigurations = 1
+};
+
+static const uint8_t config_descriptor[CONFIG_LENGTH] = {
+  TUD_CONFIG_DESCRIPTOR(1, ITF_COUNT, 0, CONFIG_LENGTH, 0, USB_MAX_POWER_MA),
+  TUD_CDC_DESCRIPTOR(ITF_CONSOLE, STR_CONSOLE, EP_CONSOLE_NOTIFY, 8, EP_CONSOLE_OUT, EP_CONSOLE_IN,
+    CFG_TUD_CDC_EP_BUFSIZE),
+  TUD_CDC_DESCRIPTOR(ITF_DATA, STR_DATA, EP_DATA_NOTIFY, 8, EP_DATA_OUT, EP_DATA_IN, CFG_TUD_CDC_EP_BUFSIZE)
+};
+
+//The serial number is the flash chip's unique ID, so boards can be
+//told apart in /dev/serial/by-id
+static char serial[2*PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+
+static const char *const strings[STR_COUNT] = {
+  [STR_MANUFACTURER] = "PlantMap3D",
+  [STR_PRODUCT] = "System Management Board",
+  [STR_SERIAL] = serial,
+  [STR_CONSOLE] = "SMB console",
+  [STR_DATA] = "SMB data"
+};
+
+const uint8_t *tud_descriptor_device_cb(){
+  return (const uint8_t *)&device_descriptor;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index){
+  return config_descriptor;
+}
+
+//String descriptors are UTF-16, built in one buffer when asked for.
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid){
+  static uint16_t descriptor[32];
+  uint8_t length;
+  if (index == STR_LANGUAGE){
+    descriptor[1] = 0x0409;
+    length = 1;
+  } else if (index < STR_COUNT){
+    if (!serial[0]){
+      pico_get_unique_board_id_string(serial, sizeof(serial));
+    }
+    const char *text = strings[index];
+    for (length = 0; text[length] && (length < 31); length++){
+      descriptor[1 + length] = text[length];
+    }
+  } else {
+    return NULL;
+  }
+  descriptor[0] = (TUSB_DESC_STRING << 8) | (2*length + 2);
+  return descriptor;
+}
@@ -0,0 +1,201 @@
+#include "string.h"
+#include "pico/stdlib.h"
+#include "pico/stdio/driver.h"
+#include "pico/bootrom.h"
+#include "hardware/irq.h"
+#include "tusb.h"
+#include "usb_ports.h"
+
+//Ring sizes, powers of two. Transmit takes a burst of console output
+//or a frame being written while the host catches up.
+#define RX_RING_SIZE 512
+#define TX_RING_SIZE 2048
+#define TASK_INTERVAL_MS 1
+//Like the SDK's USB stdio, opening the console at 1200 baud restarts
+//into BOOTSEL, which is how picotool and the IDEs load a new image
+#define RESET_BAUD 1200
+
+//The main loop fills tx and empties rx, the task interrupt does the
+//other side. head and tail run freely and wrap at 2^32.
+typedef struct ring{
+  uint8_t *data;
+  uint32_t mask;
+  volatile uint32_t head, tail;
+} ring;
+
+static uint8_t rx_data[USB_PORT_COUNT][RX_RING_SIZE];
+static uint8_t tx_data[USB_PORT_COUNT][TX_RING_SIZE];
+static ring rx[USB_PORT_COUNT], tx[USB_PORT_COUNT];
+static volatile bool connected[USB_PORT_COUNT];
+static uint task_irq;
+static repeating_timer_t task_timer;
+
+//Moves what TinyUSB has received into the port's ring. Whatever does
+//not fit stays in TinyUSB's FIFO, and the host is held off.
+static void receive(uint8_t port){
+  ring *in = &rx[port];
+  while (tud_cdc_n_available(port)){
+    uint32_t room = in->mask + 1 - (in->head - in->tail);
+    uint32_t at = in->head & in->mask;
+    uint32_t part = room < in->mask + 1 - at ? room : in->mask + 1 - at;
+    if (!part){
+      return;
+    }
+    in->head += tud_cdc_n_read(port, in->data + at, part);
+  }
+}
+
+//Hands queued output to TinyUSB as its FIFO has room. Nobody is
+//listening on a closed port, so what was queued for it is dropped.
+static void transmit(uint8_t port){
+  ring *out = &tx[port];
+  if (!connected[port]){
+    out->tail = out->head;
+    return;
+  }
+  while (out->tail != out->head){
+    uint32_t at = out->tail & out->mask;
+    uint32_t part = out->head - out->tail;
+    if (part > out->mask + 1 - at){
+      part = out->mask + 1 - at;
+    }
+    uint32_t written = tud_cdc_n_write(port, out->data + at, part);
+    if (!written){
+      break;
+    }
+    out->tail += written;
+  }
+  tud_cdc_n_write_flush(port);
+}
+
+//The only place TinyUSB runs, at the lowest interrupt priority so it
+//never holds off the supervisor or the capture.
+static void usb_task(){
+  tud_task();
+  for (uint8_t port = 0; port < USB_PORT_COUNT; port++){
+    connected[port] = tud_cdc_n_connected(port);
+    transmit(port);
+    receive(port);
+  }
+}
+
+static void raise_task(){
+  irq_set_pending(task_irq);
+}
+
+static bool task_tick(repeating_timer_t *timer){
+  raise_task();
+  return true;
+}
+
+//From tud_task, so already in the task interrupt
+void tud_cdc_rx_cb(uint8_t port){
+  receive(port);
+}
+
+void tud_cdc_line_coding_cb(uint8_t port, const cdc_line_coding_t *coding){
+  if ((port == USB_CONSOLE) && (coding->bit_rate == RESET_BAUD)){
+    reset_usb_boot(0, 0);
+  }
+}
+
+bool usb_port_connected(usb_port port){
+  return connected[port];
+}
+
+size_t usb_port_write(usb_port port, const void *data, size_t length){
+  ring *out = &tx[port];
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t written = 0;
+  absolute_time_t deadline = make_timeout_time_ms(USB_WRITE_TIMEOUT_MS);
+  while ((written < length) && connected[port]){
+    uint32_t room = out->mask + 1 - (out->head - out->tail);
+    if (!room){
+      raise_task();
+      if (time_reached(deadline)){
+        break;
+      }
+      continue;
+    }
+    uint32_t at = out->head & out->mask;
+    uint32_t part = room < out->mask + 1 - at ? room : out->mask + 1 - at;
+    if (part > length - written){
+      part = length - written;
+    }
+    memcpy(out->data + at, bytes + written, part);
+    __compiler_memory_barrier();
+    out->head += part;
+    written += part;
+    deadline = make_timeout_time_ms(USB_WRITE_TIMEOUT_MS);
+  }
+  raise_task();
+  return written;
+}
+
+int usb_port_read(usb_port port){
+  ring *in = &rx[port];
+  if (in->tail == in->head){
+    return -1;
+  }
+  uint8_t c = in->data[in->tail & in->mask];
+  __compiler_memory_barrier();
+  in->tail++;
+  return c;
+}
+
+//stdio on the console port, in place of the SDK's USB stdio
+
+static void stdio_out_chars(const char *buffer, int length){
+  usb_port_write(USB_CONSOLE, buffer, length);
+}
+
+static int stdio_in_chars(char *buffer, int length){
+  int count = 0;
+  int c;
+  while ((count < length) && ((c = usb_port_read(USB_CONSOLE)) >= 0)){
+    buffer[count++] = (char)c;
+  }
+  return count ? count : PICO_ERROR_NO_DATA;
+}
+
+static stdio_driver_t stdio_usb_ports = {
+  .out_chars = stdio_out_chars,
+  .out_flush = raise_task,
+  .in_chars = stdio_in_chars,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+  .crlf_enabled = PICO_STDIO_DEFAULT_CRLF
+#endif
+};
+
+void usb_ports_init(){
+  for (int port = 0; port < USB_PORT_COUNT; port++){
+    rx[port] = (ring){rx_data[port], RX_RING_SIZE - 1, 0, 0};
+    tx[port] = (ring){tx_data[port], TX_RING_SIZE - 1, 0, 0};
+  }
+  task_irq = user_irq_claim_unused(true);
+  irq_set_exclusive_handler(task_irq, usb_task);
+  irq_set_priority(task_irq, PICO_LOWEST_IRQ_PRIORITY);
+  irq_set_enabled(task_irq, true);
+  tusb_init();
+  //Every USB event gets the task going, the timer catches the rest
+  irq_add_shared_handler(USBCTRL_IRQ, raise_task, PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY);
+  add_repeating_timer_ms(TASK_INTERVAL_MS, task_tick, NULL, &task_timer);
+  stdio_set_driver_enabled(&stdio_usb_ports, true);
+}
+
+void usb_ports_suspend(){
+  cancel_repeating_timer(&task_timer);
+  irq_set_enabled(task_irq, false);
+  tud_disconnect();
+  irq_set_enabled(USBCTRL_IRQ, false);
+  for (int port = 0; port < USB_PORT_COUNT; port++){
+    connected[port] = false;
+  }
+}
+
+void usb_ports_resume(){
+  irq_set_enabled(USBCTRL_IRQ, true);
+  tud_connect();
+  irq_set_enabled(task_irq, true);
+  add_repeating_timer_ms(TASK_INTERVAL_MS, task_tick, NULL, &task_timer);
+}
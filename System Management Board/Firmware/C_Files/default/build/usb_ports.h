@@ -0,0 +1,38 @@
+#ifndef USB_PORTS_H
+#define USB_PORTS_H
+
+#include "pico/stdlib.h"
+
+//The board is a composite USB device with two CDC ports, so two
+//serial devices on the host (/dev/ttyACM0 and /dev/ttyACM1 on Linux):
+//the text console, which is also stdio, and a data port the binary
+//frames go to while a host has it open, see binary_out.h.
+//
+//TinyUSB only ever runs from a low priority interrupt, raised by USB
+//events and every millisecond. It moves what is received into a ring
+//per port and what is queued from the rings out, so the main loop
+//only reads and writes memory.
+typedef enum usb_port{
+  USB_CONSOLE,
+  USB_DATA,
+  USB_PORT_COUNT
+} usb_port;
+
+//Starts the device and makes the console port a stdio driver. Call
+//after stdio_init_all.
+void usb_ports_init();
+//Whether a host has the port open.
+bool usb_port_connected(usb_port port);
+//Queues data, waiting up to USB_WRITE_TIMEOUT_MS for room while the
+//port is open. Returns how much was queued.
+size_t usb_port_write(usb_port port, const void *data, size_t length);
+//Next byte received, or -1.
+int usb_port_read(usb_port port);
+//Detaches from the host and stops running TinyUSB, before clk_usb is
+//stopped, and attaches again once it is back. Used by standby.
+void usb_ports_suspend();
+void usb_ports_resume();
+
+#define USB_WRITE_TIMEOUT_MS 500
+
+#endif
@@ -0,0 +1,23 @@
+# Lists the functions that the linker placed in .time_critical (SRAM)
+# by reading the map file. Run as a post build step:
+#   cmake -DMAP_FILE=main.elf.map -DREPORT_FILE=ram_functions.txt -P ram_report.cmake
+file(READ ${MAP_FILE} map_contents)
+string(REGEX MATCHALL "\\.time_critical\\.[A-Za-z0-9_]+[ \t\r\n]+0x[0-9a-f]+[ \t]+0x[0-9a-f]+"
+    ram_sections "${map_contents}")
+
+set(report "Functions placed in SRAM (.time_critical)\n")
+set(total 0)
+foreach(section ${ram_sections})
+    string(REGEX REPLACE "[ \t\r\n]+" ";" fields "${section}")
+    list(GET fields 0 name)
+    list(GET fields 1 address)
+    list(GET fields 2 size)
+    string(REPLACE ".time_critical." "" name "${name}")
+    math(EXPR size_dec "${size}")
+    math(EXPR total "${total} + ${size_dec}")
+    string(APPEND report "${address}  ${size_dec}\t${name}\n")
+endforeach()
+string(APPEND report "Total: ${total} bytes\n")
+
+file(WRITE ${REPORT_FILE} "${report}")
+message(STATUS "SRAM function report written to ${REPORT_FILE}")
@@ -0,0 +1,274 @@
+#include "stdio.h"
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include "hardware/gpio.h"
+#include "hardware/adc.h"
+#include "hardware/uart.h"
+#include "pins.h"
+#include "selftest.h"
+
+#define V_REF_MV 3250
+//Time for a pad, the loopback wiring and the mux to settle
+#define PIN_SETTLE_US 200
+#define MUX_SETTLE_US 20
+//Time for the relay contacts and a regulator to come up into the
+//jig load, or to drop out again
+#define POWER_SETTLE_MS 100
+#define ADC_SAMPLES 8
+#define CURRENT_SAMPLES 16
+//Largest spread of the samples on one ADC input
+#define ADC_NOISE_MAX 40
+//Current monitors with no load, and the least current the jig loads
+//draw, both relative to the zero offset measured at the start
+#define OFFSET_MAX_MA 100
+#define LOAD_MIN_MA 300
+#define LOAD_MAX_MA 10000
+#define UART_BAUDRATE 115200
+#define UART_BYTES 256
+//About 20 character times at 115200
+#define UART_BYTE_TIMEOUT_US 2000
+
+//Pins that only carry signals and can be walked freely. The power
+//enables and the relay are checked by the current tests.
+static const struct {const char *name; uint pin;} walk_pins[] = {
+  {"OUT0", OUT0}, {"OUT1", OUT1}, {"OUT2", OUT2},
+  {"LEDA", LEDA}, {"LEDB", LEDB},
+  {"LIGHT_A", LIGHT_A}, {"LIGHT_B", LIGHT_B},
+  {"MUX_S0", MUX_S0}, {"MUX_S1", MUX_S1}, {"MUX_S2", MUX_S2},
+  {"JET_ON", JET_ON}, {"BUILT_IN_LED", BUILT_IN_LED},
+};
+
+//Each OUT is wired to the IN with the same number on the jig.
+static const struct {const char *name; uint out; uint in;} loopbacks[] = {
+  {"OUT0-IN0", OUT0, IN0}, {"OUT1-IN1", OUT1, IN1}, {"OUT2-IN2", OUT2, IN2},
+};
+
+//Expected raw counts on each mux input. The key input is fed
+//between 1.2V and 2.8V, inputs 1-5 are grounded and 6-7 are the
+//temperature sensors at 15-40C (0.65V to 0.9V).
+static const struct {const char *name; uint min; uint max;} mux_inputs[8] = {
+  {"KEY", 1500, 3500},
+  {"MUX1", 0, 100}, {"MUX2", 0, 100}, {"MUX3", 0, 100}, {"MUX4", 0, 100}, {"MUX5", 0, 100},
+  {"TEMP1", 800, 1150}, {"TEMP2", 800, 1150},
+};
+
+static const uint32_t power_pins = (1 << SWITCH_PWR_EN) | (1 << COMP_PWR_EN) | (1 << MAIN_RELAY);
+
+static char board_id[2*PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+static uint32_t passed;
+static uint32_t failed;
+
+//Prints one result line and counts it.
+static bool report(const char *test, const char *item, long value, long min, long max){
+  bool pass = (value >= min) && (value <= max);
+  if (pass){
+    passed++;
+  } else {
+    failed++;
+  }
+  printf("{\"test\":\"%s\",\"item\":\"%s\",\"pass\":%s,\"value\":%ld,\"min\":%ld,\"max\":%ld}\n",
+    test, item, pass ? "true" : "false", value, min, max);
+  return pass;
+}
+
+static uint32_t walk_mask(){
+  uint32_t pins = 0;
+  for (size_t i = 0; i < count_of(walk_pins); i++){
+    pins |= 1u << walk_pins[i].pin;
+  }
+  return pins;
+}
+
+static uint32_t loopback_in_mask(){
+  uint32_t pins = 0;
+  for (size_t i = 0; i < count_of(loopbacks); i++){
+    pins |= 1u << loopbacks[i].in;
+  }
+  return pins;
+}
+
+//Drives each signal output high on its own and reads the pads back.
+//The pin itself must read high and every other walked pin low, which
+//finds open drivers and shorts between neighbours.
+static void test_output_walk(){
+  uint32_t pins = walk_mask();
+  for (size_t i = 0; i < count_of(walk_pins); i++){
+    uint32_t pin_mask = 1u << walk_pins[i].pin;
+    gpio_put_masked(pins, pin_mask);
+    sleep_us(PIN_SETTLE_US);
+    uint32_t levels = gpio_get_all();
+    report("pad", walk_pins[i].name, (levels & pin_mask) != 0, 1, 1);
+    report("isolation", walk_pins[i].name, __builtin_popcount(levels & pins & ~pin_mask), 0, 0);
+  }
+  gpio_put_masked(pins, 0);
+}
+
+//Reads each IN with its OUT driven low and then high.
+static void test_loopback(){
+  char item[16];
+  for (size_t i = 0; i < count_of(loopbacks); i++){
+    for (int level = 0; level <= 1; level++){
+      gpio_put(loopbacks[i].out, level);
+      sleep_us(PIN_SETTLE_US);
+      snprintf(item, sizeof(item), "%s:%d", loopbacks[i].name, level);
+      report("loopback", item, gpio_get(loopbacks[i].in), level, level);
+    }
+    gpio_put(loopbacks[i].out, 0);
+  }
+}
+
+//Mean of a burst of samples on the selected ADC input, and how far
+//apart the lowest and highest were.
+static uint adc_sample(uint count, uint *spread){
+  uint32_t total = 0;
+  uint low = 4095;
+  uint high = 0;
+  for (uint i = 0; i < count; i++){
+    uint data = adc_read();
+    total += data;
+    low = data < low ? data : low;
+    high = data > high ? data : high;
+  }
+  *spread = high - low;
+  return total/count;
+}
+
+//Selects every mux input in turn through S2-S0 and checks the
+//reading against what the jig puts on it.
+static void test_mux_sweep(){
+  adc_select_input(ADC_MUX_CHANNEL);
+  for (uint channel = 0; channel < count_of(mux_inputs); channel++){
+    gpio_put(MUX_S2, (channel >> 2) & 1);
+    gpio_put(MUX_S1, (channel >> 1) & 1);
+    gpio_put(MUX_S0, channel & 1);
+    sleep_us(MUX_SETTLE_US);
+    uint spread;
+    uint mean = adc_sample(ADC_SAMPLES, &spread);
+    report("mux", mux_inputs[channel].name, mean, mux_inputs[channel].min, mux_inputs[channel].max);
+    report("mux_noise", mux_inputs[channel].name, spread, 0, ADC_NOISE_MAX);
+  }
+  gpio_put_masked((1 << MUX_S2) | (1 << MUX_S1) | (1 << MUX_S0), 0);
+}
+
+//Current on a regulator monitor in milliamps, with the regulator
+//datasheet formula main.c uses: I = (V - 0.23V)/0.055.
+static long current_ma(uint pin){
+  adc_select_input(pin - 26);
+  uint spread;
+  long millivolts = (long)adc_sample(CURRENT_SAMPLES, &spread)*V_REF_MV/4096;
+  return (millivolts - 230)*1000/55;
+}
+
+//Sets the power pins and gives them time to take effect.
+static void set_power(uint32_t values){
+  gpio_put_masked(power_pins, values);
+  sleep_ms(POWER_SETTLE_MS);
+}
+
+//Checks both current monitors against the zero offsets, the one in
+//loaded against the load and the other against no load.
+static void check_currents(const char *step, long switch_offset, long comp_offset, int loaded){
+  char item[32];
+  snprintf(item, sizeof(item), "%s:switch", step);
+  long current = current_ma(SWITCH_I_MONITOR) - switch_offset;
+  if (loaded == SWITCH_PWR_EN){
+    report("relay", item, current, LOAD_MIN_MA, LOAD_MAX_MA);
+  } else {
+    report("relay", item, current, -OFFSET_MAX_MA, OFFSET_MAX_MA);
+  }
+  snprintf(item, sizeof(item), "%s:comp", step);
+  current = current_ma(COMP_I_MONITOR) - comp_offset;
+  if (loaded == COMP_PWR_EN){
+    report("relay", item, current, LOAD_MIN_MA, LOAD_MAX_MA);
+  } else {
+    report("relay", item, current, -OFFSET_MAX_MA, OFFSET_MAX_MA);
+  }
+}
+
+//The relay has no feedback pin, so it is checked by what it does to
+//the regulator currents. With only the relay closed nothing draws
+//current, each regulator then draws its jig load on its own, and
+//opening the relay under the switch load must drop it again.
+static void test_power(){
+  set_power(0);
+  long switch_offset = current_ma(SWITCH_I_MONITOR);
+  long comp_offset = current_ma(COMP_I_MONITOR);
+  report("offset", "switch", switch_offset, -OFFSET_MAX_MA, OFFSET_MAX_MA);
+  report("offset", "comp", comp_offset, -OFFSET_MAX_MA, OFFSET_MAX_MA);
+
+  set_power(1 << MAIN_RELAY);
+  check_currents("relay_only", switch_offset, comp_offset, -1);
+  set_power((1 << MAIN_RELAY) | (1 << COMP_PWR_EN));
+  check_currents("comp_on", switch_offset, comp_offset, COMP_PWR_EN);
+  set_power((1 << MAIN_RELAY) | (1 << SWITCH_PWR_EN));
+  check_currents("switch_on", switch_offset, comp_offset, SWITCH_PWR_EN);
+  set_power(1 << SWITCH_PWR_EN);
+  check_currents("relay_open", switch_offset, comp_offset, -1);
+  set_power(0);
+}
+
+//Sends a counting pattern out of uart1 and reads it back through the
+//jig's TX to RX link.
+static void test_uart(){
+  uart_init(uart1, UART_BAUDRATE);
+  gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
+  gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
+  while (uart_is_readable(uart1)){
+    uart_getc(uart1);
+  }
+  long matched = 0;
+  for (uint i = 0; i < UART_BYTES; i++){
+    char sent = (char)(i ^ 0x55);
+    uart_putc_raw(uart1, sent);
+    uint64_t deadline = time_us_64() + UART_BYTE_TIMEOUT_US;
+    while (!uart_is_readable(uart1) && (time_us_64() < deadline)){
+    }
+    if (!uart_is_readable(uart1)){
+      break;
+    }
+    if (uart_getc(uart1) == sent){
+      matched++;
+    }
+  }
+  report("uart", "uart1", matched, UART_BYTES, UART_BYTES);
+  uart_deinit(uart1);
+  gpio_set_function(UART_TX_PIN, GPIO_FUNC_SIO);
+  gpio_set_function(UART_RX_PIN, GPIO_FUNC_SIO);
+}
+
+//Puts every pin the test uses in a known state: outputs low, the
+//loopback inputs pulled down so a missing link reads low.
+static void setup_pins(){
+  uint32_t outputs = walk_mask() | power_pins;
+  uint32_t inputs = loopback_in_mask();
+  gpio_init_mask(outputs | inputs);
+  gpio_set_dir_out_masked(outputs);
+  gpio_set_dir_in_masked(inputs);
+  gpio_put_masked(outputs, 0);
+  for (size_t i = 0; i < count_of(loopbacks); i++){
+    gpio_pull_down(loopbacks[i].in);
+  }
+  adc_init();
+  adc_gpio_init(ADC_MUX);
+  adc_gpio_init(SWITCH_I_MONITOR);
+  adc_gpio_init(COMP_I_MONITOR);
+}
+
+bool selftest_run(){
+  uint64_t start = time_us_64();
+  passed = 0;
+  failed = 0;
+  pico_get_unique_board_id_string(board_id, sizeof(board_id));
+  printf("{\"selftest\":\"start\",\"board\":\"%s\",\"version\":%d}\n", board_id, SELFTEST_VERSION);
+  setup_pins();
+  test_output_walk();
+  test_loopback();
+  test_mux_sweep();
+  test_power();
+  test_uart();
+  uint32_t elapsed_ms = (uint32_t)((time_us_64() - start)/1000);
+  printf("{\"selftest\":\"done\",\"board\":\"%s\",\"passed\":%lu,\"failed\":%lu,\"ms\":%lu,\"result\":\"%s\"}\n",
+    board_id, passed, failed, elapsed_ms, failed ? "fail" : "pass");
+  stdio_flush();
+  return failed == 0;
+}
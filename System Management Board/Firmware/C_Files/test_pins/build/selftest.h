@@ -0,0 +1,24 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+#include "pico/stdlib.h"
+
+//Production self-test of a board fitted to the test jig. The jig
+//loops OUT0-2 back to IN0-2 and the uart1 TX pin to RX, grounds the
+//spare mux inputs, feeds a key voltage and puts a load on both
+//regulators. Results are printed one JSON object per line:
+//
+//  {"selftest":"start","board":"<unique id>","version":1}
+//  {"test":"<group>","item":"<name>","pass":true,"value":N,"min":N,"max":N}
+//  ...
+//  {"selftest":"done","board":"<unique id>","passed":N,"failed":N,"ms":N,"result":"pass"}
+//
+//value, min and max are in the unit of the test: 0/1 for pins, raw
+//counts for the ADC and milliamps for the current monitors.
+#define SELFTEST_VERSION 1
+
+//Runs every check and leaves all pins low. Returns true if all of
+//them passed.
+bool selftest_run();
+
+#endif
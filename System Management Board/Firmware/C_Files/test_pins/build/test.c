@@ -5,8 +5,8 @@
 #include "hardware/gpio.h"
 #include "hardware/adc.h"
 #include "hardware/watchdog.h"
-
-#define MAIN_RELAY 2
+#include "pins.h"
+#include "selftest.h"
 
 uint32_t output_pins = 0x1a7cd01f;
 //0b1 1010 0111 1100 1101 0000 0001 1111
@@ -35,15 +35,38 @@ void next_pin(){
     current_pin_num = current_pin_num + 1;
 }
 
+//Sets every pin of the walk back to a low output.
+void walk_init(){
+    gpio_init_mask(output_pins);
+    gpio_set_dir_out_masked(output_pins);
+    gpio_put_masked(output_pins,0);
+    current_pin_mask = 1;
+    current_pin_num = 0;
+}
+
+//Runs the self-test once at power up, then waits for commands:
+//'t' runs it again and 'w' starts or stops the pin walk.
 int main(){
     stdio_init_all();
     //The USB setup is non-blocking, but it needs time. 
     sleep_ms(1000);
-    gpio_init_mask(output_pins);
-    gpio_set_dir_out_masked(output_pins);
-    gpio_put_masked(output_pins,0);
+    selftest_run();
+    bool walking = false;
     bool hold = false;
     while (true){
+        int input = getchar_timeout_us(0);
+        if (input == 't'){
+            walking = false;
+            selftest_run();
+        }
+        else if (input == 'w'){
+            walking = !walking;
+            walk_init();
+            printf("Pin walk %s\n", walking ? "on" : "off");
+        }
+        if (!walking){
+            continue;
+        }
         uint64_t time = time_us_64();
         if ((time % delay_time_us)<(delay_time_us/5)){
             if (!hold){
@@ -32,6 +32,11 @@ int threshold = 100;
 
 bool American = false; 
 
+//Serial commands are read into this fixed buffer instead of a String
+//so the sketch never touches the heap.
+#define LINE_MAX 32
+char line_buffer[LINE_MAX];
+
 //Since there are several 3-bit interfaces, a dedicated structure
 //seemed useful. 
 struct bits{
@@ -92,7 +97,26 @@ void toggle(int pin_to_toggle, bool state){
   digitalWrite(pin_to_toggle,!state);
 }
 
-void parser(String input_string){
+//Reads one line into line_buffer without the newline or surrounding
+//whitespace and returns its length.
+int read_line(){
+  int length = Serial.readBytesUntil(10, line_buffer, LINE_MAX-1);
+  while ((length > 0) && isspace(line_buffer[length-1])){
+    length--;
+  }
+  line_buffer[length] = 0;
+  int start = 0;
+  while (isspace(line_buffer[start])){
+    start++;
+  }
+  if (start > 0){
+    memmove(line_buffer, line_buffer+start, length-start+1);
+    length -= start;
+  }
+  return length;
+}
+
+void parser(const char *input_string){
   int input_char = (int)input_string[0];
   switch (input_char) {
     //"M" toggles the main relay
@@ -142,17 +166,16 @@ void parser(String input_string){
     break;
     //"O" enables output pin control parsing expects 4 chars like "O001" MSB (2) to LSB (0)
     case 79:
+      if (strlen(input_string) < 4) break;
       digitalWrite(OUT0,((int)input_string[3])-48);
       digitalWrite(OUT1,((int)input_string[2])-48);
       digitalWrite(OUT2,((int)input_string[1])-48);
     break;
     //"I" enables input pin value reading
     case 73:{
-      String holder = "";
-      holder.concat(digitalRead(IN2));
-      holder.concat(digitalRead(IN1));
-      holder.concat(digitalRead(IN0));
-      Serial.println(holder);
+      Serial.print(digitalRead(IN2));
+      Serial.print(digitalRead(IN1));
+      Serial.println(digitalRead(IN0));
     }
     break;
     //"K" runs shutdown procedure
@@ -233,9 +256,8 @@ void setup() {
   for (int i = 0; i<10;i++){
     delay(1000);
     if (Serial.available()>0){
-      String data = Serial.readStringUntil(10);
-      data.trim();
-      parser(data);
+      read_line();
+      parser(line_buffer);
     }
   }
   digitalWrite(MAIN_RELAY,1);
@@ -243,9 +265,8 @@ void setup() {
   for (int i = 0; i<10;i++){
     delay(1000);
     if (Serial.available()>0){
-      String data = Serial.readStringUntil(10);
-      data.trim();
-      parser(data);
+      read_line();
+      parser(line_buffer);
     }
   }
   //check_pow();
@@ -272,8 +293,7 @@ void loop() {
     }
   }
   if (Serial.available()>0){
-    String data = Serial.readStringUntil(10);
-    data.trim();
-    parser(data); 
+    read_line();
+    parser(line_buffer); 
   }
 }
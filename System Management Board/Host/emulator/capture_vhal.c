@@ -0,0 +1,103 @@
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "capture_hw.h"
+
+//Stand-in for capture_pio.c. There is no PIO or second core, so the
+//pins are read each time the main loop polls the capture and held
+//for all the samples due since the last poll. An edge therefore lands
+//on the first sample after the poll before it, the resolution is the
+//main loop period rather than the sample rate.
+
+static capture_config active;
+static uint64_t start_us;
+//Samples written so far, and at the trigger
+static uint64_t total;
+static uint64_t trigger_total;
+static uint32_t trigger_word;
+static uint32_t previous;
+
+static uint32_t width_mask(uint width){
+  return width == 32 ? 0xffffffff : (1u << width) - 1;
+}
+
+//Writes count samples of the same pins into the ring. Only the last
+//lap's worth is actually written.
+static void put_samples(uint32_t pins, uint64_t count){
+  uint32_t per_word = 32/active.width;
+  uint64_t ring_samples = (uint64_t)CAPTURE_WORDS*per_word;
+  if (count > ring_samples){
+    total += count - ring_samples;
+    count = ring_samples;
+  }
+  uint32_t value = (pins >> active.base) & width_mask(active.width);
+  for (uint64_t i = 0; i < count; i++, total++){
+    uint32_t word = (uint32_t)((total/per_word) % CAPTURE_WORDS);
+    uint32_t shift = (uint32_t)(total % per_word)*active.width;
+    capture_buffer[word] = (capture_buffer[word] & ~(width_mask(active.width) << shift)) | (value << shift);
+  }
+}
+
+static void finish(void){
+  uint32_t per_word = 32/active.width;
+  uint64_t words = total/per_word;
+  capture_hw_done((uint32_t)(words % CAPTURE_WORDS), words < CAPTURE_WORDS ? (uint32_t)words : CAPTURE_WORDS,
+    trigger_word);
+}
+
+bool capture_hw_start(capture_config *config){
+  if ((config->rate_hz == 0) || (config->rate_hz > clock_get_hz(clk_sys))){
+    return false;
+  }
+  active = *config;
+  start_us = time_us_64();
+  total = 0;
+  trigger_total = 0;
+  trigger_word = CAPTURE_NO_TRIGGER;
+  previous = gpio_get_all();
+  if (active.trigger == CAPTURE_TRIGGER_NONE){
+    capture_status = CAPTURE_TRIGGERED;
+  }
+  return true;
+}
+
+void capture_hw_poll(void){
+  if (capture_stop_request){
+    finish();
+    return;
+  }
+  uint32_t per_word = 32/active.width;
+  uint64_t due = (time_us_64() - start_us)*active.rate_hz/1000000;
+  if (due <= total){
+    return;
+  }
+  uint32_t pins = gpio_get_all();
+  uint64_t count = due - total;
+  if ((capture_status == CAPTURE_FILLING) && (total + count >= (uint64_t)active.pre_words*per_word)){
+    capture_status = CAPTURE_WAITING;
+  }
+  if ((capture_status == CAPTURE_WAITING) && capture_trigger_hit(&active, previous, pins)){
+    trigger_total = total;
+    trigger_word = (uint32_t)((total/per_word) % CAPTURE_WORDS);
+    capture_status = CAPTURE_TRIGGERED;
+  }
+  if (capture_status == CAPTURE_TRIGGERED){
+    uint64_t end = trigger_total + (uint64_t)active.post_words*per_word;
+    if (total + count >= end){
+      put_samples(pins, end - total);
+      finish();
+      return;
+    }
+  }
+  put_samples(pins, count);
+  previous = pins;
+}
+
+void capture_hw_release(void){
+}
+
+//Nothing runs beside the firmware.
+void capture_hw_hold(void){
+}
+
+void capture_hw_resume(void){
+}
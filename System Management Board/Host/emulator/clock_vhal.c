@@ -0,0 +1,17 @@
+#include "pico/stdlib.h"
+#include "clock_policy.h"
+#include "vhal.h"
+
+//Stand-in for clock_pll.c. The emulator runs as fast as it runs, the
+//profile only changes what clock_get_hz and SysTick report.
+
+static const uint32_t profile_khz[] = {CLOCK_FULL_KHZ, CLOCK_MONITOR_KHZ, CLOCK_CRYSTAL_KHZ};
+
+void clock_policy_hw_init(){
+  vhal_set_clocks(CLOCK_FULL_KHZ*1000, CLOCK_MONITOR_KHZ*1000);
+}
+
+void clock_policy_hw_apply(clock_profile profile){
+  uint32_t peri_khz = profile == CLOCK_CRYSTAL ? CLOCK_CRYSTAL_KHZ : CLOCK_MONITOR_KHZ;
+  vhal_set_clocks(profile_khz[profile]*1000, peri_khz*1000);
+}
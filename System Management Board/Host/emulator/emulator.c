@@ -0,0 +1,223 @@
+//Runs the board firmware on Linux behind a pseudo-terminal, so host
+//tools can be developed and load tested without a board.
+//
+//  smb_emulator [--link PATH] [--script FILE] [--set CHANNEL=VALUE]...
+//               [--idle-us N] [--stdio] [--jig] [--flash FILE]
+//               [--uart1 PATH] [--data PATH]
+//
+//The flash the firmware writes its settings to is kept in FILE, or
+//otherwise only for as long as the emulator runs. --uart1 puts the
+//Jetson's uart1 on a second pseudo-terminal, linked from PATH, and
+//--data the USB data port the binary frames go to on another.
+//
+//smb_selftest_emulator is the same program around the test_pins
+//self-test firmware, normally run with --jig.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "vhal.h"
+#include "waveform.h"
+
+//main() of main.c or test.c, renamed when it is built into the
+//emulator
+int firmware_main(void);
+
+//Carries the open terminal, flash and waveform clock across a
+//watchdog reboot, which re-executes the emulator, and the watchdog
+//scratch registers across the reboot itself.
+#define STATE_ENV "SMB_EMULATOR_STATE"
+#define WATCHDOG_ENV "SMB_EMULATOR_WATCHDOG"
+
+static char **saved_argv;
+static const char *link_path, *uart1_path, *data_path;
+static int in_fd = -1, out_fd = -1, slave_fd = -1, flash_fd = -1;
+static int uart1_fd = 0, uart1_slave_fd = -1;
+static int data_fd = 0, data_slave_fd = -1;
+static uint64_t wave_epoch_ns;
+
+static void usage(void){
+  fprintf(stderr,
+    "usage: smb_emulator [--link PATH] [--script FILE] [--set CHANNEL=VALUE]...\n"
+    "                    [--idle-us N] [--stdio] [--jig] [--flash FILE]\n"
+    "                    [--uart1 PATH] [--data PATH]\n"
+    "channels:");
+  for (int i = 0; i < WAVE_CHANNEL_COUNT; i++){
+    fprintf(stderr, " %s", wave_channel_name((wave_channel)i));
+  }
+  fprintf(stderr, "\n");
+}
+
+static void reboot(void){
+  char state[160];
+  snprintf(state, sizeof(state), "%d,%d,%d,%d,%d,%d,%d,%d,%llu", in_fd, out_fd, slave_fd, flash_fd, uart1_fd,
+    uart1_slave_fd, data_fd, data_slave_fd, (unsigned long long)wave_epoch_ns);
+  setenv(STATE_ENV, state, 1);
+  uint32_t *scratch = vhal_watchdog_scratch();
+  char registers[96];
+  snprintf(registers, sizeof(registers), "%x,%x,%x,%x,%x,%x,%x,%x", scratch[0], scratch[1], scratch[2],
+    scratch[3], scratch[4], scratch[5], scratch[6], scratch[7]);
+  setenv(WATCHDOG_ENV, registers, 1);
+  execv("/proc/self/exe", saved_argv);
+  perror("emulator: reboot");
+  exit(1);
+}
+
+static void stop(int signal_number){
+  if (link_path){
+    unlink(link_path);
+  }
+  if (uart1_path){
+    unlink(uart1_path);
+  }
+  if (data_path){
+    unlink(data_path);
+  }
+  _exit(0);
+}
+
+//The slave end is kept open by the emulator as well, so the
+//terminal keeps its raw settings and does not hang up between
+//clients. Output nobody reads is dropped like on USB.
+static bool open_terminal(const char *what, const char *path, int *master_fd, int *kept_fd){
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((master < 0) || (grantpt(master) < 0) || (unlockpt(master) < 0)){
+    perror("emulator: pseudo-terminal");
+    return false;
+  }
+  const char *name = ptsname(master);
+  *kept_fd = open(name, O_RDWR | O_NOCTTY);
+  if (*kept_fd < 0){
+    perror(name);
+    return false;
+  }
+  struct termios tty;
+  tcgetattr(*kept_fd, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(*kept_fd, TCSANOW, &tty);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  *master_fd = master;
+  fprintf(stderr, "emulator: %s on %s\n", what, name);
+  if (path){
+    unlink(path);
+    if (symlink(name, path) < 0){
+      perror(path);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]){
+  saved_argv = argv;
+  static wave_set waves;
+  wave_set_init(&waves);
+  uint32_t idle_us = 100;
+  bool use_stdio = false;
+  bool jig = false;
+  const char *flash_path = NULL;
+  for (int i = 1; i < argc; i++){
+    const char *arg = argv[i];
+    const char *value = (i+1 < argc) ? argv[i+1] : NULL;
+    if (strcmp(arg, "--stdio") == 0){
+      use_stdio = true;
+    } else if (strcmp(arg, "--jig") == 0){
+      jig = true;
+    } else if ((strcmp(arg, "--flash") == 0) && value){
+      flash_path = value;
+      i++;
+    } else if ((strcmp(arg, "--uart1") == 0) && value){
+      uart1_path = value;
+      i++;
+    } else if ((strcmp(arg, "--data") == 0) && value){
+      data_path = value;
+      i++;
+    } else if ((strcmp(arg, "--link") == 0) && value){
+      link_path = value;
+      i++;
+    } else if ((strcmp(arg, "--script") == 0) && value){
+      char error[256];
+      if (!wave_set_load(&waves, value, error, sizeof(error))){
+        fprintf(stderr, "emulator: %s\n", error);
+        return 2;
+      }
+      i++;
+    } else if ((strcmp(arg, "--set") == 0) && value){
+      if (!wave_set_constant(&waves, value)){
+        fprintf(stderr, "emulator: bad --set \"%s\"\n", value);
+        return 2;
+      }
+      i++;
+    } else if ((strcmp(arg, "--idle-us") == 0) && value){
+      idle_us = (uint32_t)strtoul(value, NULL, 10);
+      i++;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  const char *state = getenv(STATE_ENV);
+  const char *registers = getenv(WATCHDOG_ENV);
+  bool watchdog_reboot = registers != NULL;
+  if (state){
+    unsigned long long epoch;
+    sscanf(state, "%d,%d,%d,%d,%d,%d,%d,%d,%llu", &in_fd, &out_fd, &slave_fd, &flash_fd, &uart1_fd,
+      &uart1_slave_fd, &data_fd, &data_slave_fd, &epoch);
+    wave_epoch_ns = epoch;
+  } else {
+    wave_epoch_ns = vhal_monotonic_ns();
+    if (use_stdio){
+      in_fd = STDIN_FILENO;
+      out_fd = dup(STDOUT_FILENO);
+      fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+    } else if (open_terminal("console", link_path, &in_fd, &slave_fd)){
+      out_fd = in_fd;
+    } else {
+      return 1;
+    }
+    if (uart1_path && !open_terminal("uart1", uart1_path, &uart1_fd, &uart1_slave_fd)){
+      return 1;
+    }
+    if (data_path && !open_terminal("data", data_path, &data_fd, &data_slave_fd)){
+      return 1;
+    }
+    flash_fd = flash_path ? open(flash_path, O_RDWR | O_CREAT, 0644) : memfd_create("smb_flash", 0);
+    if (flash_fd < 0){
+      perror(flash_path ? flash_path : "emulator: flash");
+      return 1;
+    }
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  vhal_config config = {
+    .in_fd = in_fd,
+    .out_fd = out_fd,
+    .epoch_ns = wave_epoch_ns,
+    .idle_us = idle_us,
+    .waves = &waves,
+    .jig = jig,
+    .flash_fd = flash_fd,
+    .uart1_fd = uart1_fd,
+    .data_fd = data_fd,
+    .reboot = reboot,
+  };
+  vhal_configure(&config);
+  vhal_boot(watchdog_reboot);
+  if (watchdog_reboot){
+    uint32_t *scratch = vhal_watchdog_scratch();
+    sscanf(registers, "%x,%x,%x,%x,%x,%x,%x,%x", &scratch[0], &scratch[1], &scratch[2], &scratch[3],
+      &scratch[4], &scratch[5], &scratch[6], &scratch[7]);
+    unsetenv(WATCHDOG_ENV);
+  }
+  return firmware_main();
+}
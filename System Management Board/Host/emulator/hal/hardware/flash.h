@@ -0,0 +1,26 @@
+#ifndef _HARDWARE_FLASH_H
+#define _HARDWARE_FLASH_H
+
+#include "pico/types.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define FLASH_BLOCK_SIZE (1u << 16)
+
+//The Pico's W25Q16JV
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+
+//The emulated flash chip. The firmware reads it through XIP_BASE as
+//on the board, it only holds what the firmware programmed itself.
+extern uint8_t *vhal_flash;
+#define XIP_BASE ((uintptr_t)vhal_flash)
+
+//Like the real chip, an erase sets a sector to 0xff and programming
+//can only clear bits. Offsets and sizes must be sector and page
+//aligned.
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif
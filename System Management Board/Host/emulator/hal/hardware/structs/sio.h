@@ -0,0 +1,28 @@
+#ifndef _HARDWARE_STRUCTS_SIO_H
+#define _HARDWARE_STRUCTS_SIO_H
+
+#include "pico/types.h"
+
+typedef struct {
+  uint32_t cpuid;
+  uint32_t gpio_in;
+  uint32_t gpio_hi_in;
+  uint32_t _pad0;
+  uint32_t gpio_out;
+  uint32_t gpio_set;
+  uint32_t gpio_clr;
+  uint32_t gpio_togl;
+  uint32_t gpio_oe;
+  uint32_t gpio_oe_set;
+  uint32_t gpio_oe_clr;
+  uint32_t gpio_oe_togl;
+} sio_hw_t;
+
+//The set, clear and xor aliases only act on gpio_out when the next
+//access goes through sio_hw, which applies the previous write first.
+//Every statement in the firmware touches one register, so this
+//behaves like the hardware.
+sio_hw_t *vhal_sio(void);
+#define sio_hw (vhal_sio())
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _HARDWARE_STRUCTS_SYSTICK_H
+#define _HARDWARE_STRUCTS_SYSTICK_H
+
+#include "pico/types.h"
+
+typedef struct {
+  uint32_t csr;
+  uint32_t rvr;
+  uint32_t cvr;
+  uint32_t calib;
+} systick_hw_t;
+
+//cvr is recomputed from the emulated time at clk_sys on each access.
+systick_hw_t *vhal_systick(void);
+#define systick_hw (vhal_systick())
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _HARDWARE_STRUCTS_WATCHDOG_H
+#define _HARDWARE_STRUCTS_WATCHDOG_H
+
+#include "pico/types.h"
+
+typedef struct {
+  uint32_t ctrl;
+  uint32_t load;
+  uint32_t reason;
+  uint32_t scratch[8];
+  uint32_t tick;
+} watchdog_hw_t;
+
+//Only the scratch registers do anything. Like on the board they keep
+//their values over a watchdog reboot and are cleared at power on.
+watchdog_hw_t *vhal_watchdog_hw(void);
+#define watchdog_hw (vhal_watchdog_hw())
+
+#endif
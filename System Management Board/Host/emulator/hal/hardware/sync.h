@@ -0,0 +1,22 @@
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include "pico/types.h"
+
+//The emulated board runs the firmware on one thread, so the spin
+//locks and interrupt masking only have to keep their signatures.
+typedef volatile uint32_t spin_lock_t;
+
+spin_lock_t *spin_lock_init(uint lock_num);
+int spin_lock_claim_unused(bool required);
+uint32_t spin_lock_blocking(spin_lock_t *lock);
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq);
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+static inline void __dmb(void){}
+static inline void __wfi(void){}
+static inline void __wfe(void){}
+static inline void __sev(void){}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _HARDWARE_UART_H
+#define _HARDWARE_UART_H
+
+#include "pico/types.h"
+
+typedef struct uart_inst uart_inst_t;
+
+extern uart_inst_t *const vhal_uart0;
+extern uart_inst_t *const vhal_uart1;
+#define uart0 vhal_uart0
+#define uart1 vhal_uart1
+
+uint uart_init(uart_inst_t *uart, uint baudrate);
+void uart_deinit(uart_inst_t *uart);
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate);
+bool uart_is_readable(uart_inst_t *uart);
+bool uart_is_writable(uart_inst_t *uart);
+char uart_getc(uart_inst_t *uart);
+void uart_putc_raw(uart_inst_t *uart, char c);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _HARDWARE_WATCHDOG_H
+#define _HARDWARE_WATCHDOG_H
+
+#include "pico/types.h"
+
+//An expired watchdog restarts the emulator process with the same
+//pseudo-terminal, like the board rebooting.
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+void watchdog_update(void);
+bool watchdog_caused_reboot(void);
+bool watchdog_enable_caused_reboot(void);
+void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms);
+uint32_t watchdog_get_count(void);
+
+#endif
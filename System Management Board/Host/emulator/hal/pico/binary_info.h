@@ -0,0 +1,8 @@
+#ifndef _PICO_BINARY_INFO_H
+#define _PICO_BINARY_INFO_H
+
+#define bi_decl(...)
+#define bi_program_description(...)
+#define bi_1pin_with_name(...)
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _PICO_PLATFORM_H
+#define _PICO_PLATFORM_H
+
+#include "pico/types.h"
+
+//Everything runs from host memory, so the placement attributes
+//used by the firmware are accepted and ignored.
+#define __not_in_flash_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __uninitialized_ram(group) group
+#define __in_flash(group)
+
+#define count_of(a) (sizeof(a)/sizeof((a)[0]))
+
+static inline void tight_loop_contents(void){}
+
+void panic(const char *fmt, ...);
+
+#endif
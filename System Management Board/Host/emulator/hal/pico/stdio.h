@@ -0,0 +1,15 @@
+#ifndef _PICO_STDIO_H
+#define _PICO_STDIO_H
+
+#include "pico/types.h"
+
+#define PICO_ERROR_TIMEOUT (-1)
+
+//stdout and these functions go to the emulator's pseudo-terminal
+//with the same newline translation as the USB CDC stdio driver.
+bool stdio_init_all(void);
+int getchar_timeout_us(uint32_t timeout_us);
+int putchar_raw(int c);
+void stdio_flush(void);
+
+#endif
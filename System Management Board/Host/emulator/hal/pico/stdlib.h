@@ -0,0 +1,14 @@
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+//Virtual HAL used to run the firmware on Linux. Only the parts of
+//the Pico SDK the firmware uses are declared, with the same names
+//and signatures, and implemented by vhal.c.
+#include "pico/types.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "pico/stdio.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#endif
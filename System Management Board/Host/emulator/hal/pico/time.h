@@ -0,0 +1,14 @@
+#ifndef _PICO_TIME_H
+#define _PICO_TIME_H
+
+#include "pico/types.h"
+
+//Microseconds since the emulated board booted.
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void busy_wait_us(uint64_t us);
+
+#endif
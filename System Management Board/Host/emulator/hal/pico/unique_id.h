@@ -0,0 +1,11 @@
+#ifndef _PICO_UNIQUE_ID_H
+#define _PICO_UNIQUE_ID_H
+
+#include "pico/types.h"
+
+#define PICO_UNIQUE_BOARD_ID_SIZE_BYTES 8
+
+//Writes the ID as hex digits, len includes the terminator.
+void pico_get_unique_board_id_string(char *id_out, uint len);
+
+#endif
@@ -0,0 +1,79 @@
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "scope_hw.h"
+
+//Stand-in for scope_adc.c. There is no free running ADC or DMA, so
+//the samples due since the last look are written each time the count
+//is asked for, each input read once and held for all of them. The
+//waveform is therefore only followed as closely as the main loop
+//period, though the rate and the number of samples are the board's.
+
+#define SCOPE_CONVERSION_CLOCKS 96
+
+static scope_config active;
+static bool running;
+static uint64_t start_us;
+static uint32_t total;
+
+//Writes the samples due by now into the ring. Only the last lap's
+//worth is actually written.
+static void put_samples(void){
+  uint64_t due = (time_us_64() - start_us)*active.rate_hz/1000000;
+  if (due <= total){
+    return;
+  }
+  uint32_t channels = __builtin_popcount(active.inputs);
+  uint16_t values[SCOPE_INPUTS];
+  uint slots = 0;
+  uint selected = adc_get_selected_input();
+  for (uint input = 0; input < SCOPE_INPUTS; input++){
+    if (active.inputs & (1u << input)){
+      adc_select_input(input);
+      values[slots++] = adc_read();
+    }
+  }
+  adc_select_input(selected);
+  uint32_t count = (uint32_t)(due - total);
+  if (count > SCOPE_SAMPLES){
+    total += count - SCOPE_SAMPLES;
+    count = SCOPE_SAMPLES;
+  }
+  for (uint32_t i = 0; i < count; i++, total++){
+    scope_buffer[total % SCOPE_SAMPLES] = values[total % channels];
+  }
+}
+
+bool scope_hw_start(scope_config *config){
+  uint32_t adc_hz = clock_get_hz(clk_adc);
+  if ((config->rate_hz == 0) || !config->inputs || (config->inputs >> SCOPE_INPUTS)){
+    return false;
+  }
+  uint64_t period = ((uint64_t)adc_hz*256)/config->rate_hz;
+  if (period < SCOPE_CONVERSION_CLOCKS*256){
+    period = SCOPE_CONVERSION_CLOCKS*256;
+  }
+  if (period - 256 >= (65536ull << 8)){
+    return false;
+  }
+  config->rate_hz = (uint32_t)(((uint64_t)adc_hz*256)/period);
+  active = *config;
+  start_us = time_us_64();
+  total = 0;
+  running = true;
+  return true;
+}
+
+uint32_t scope_hw_count(void){
+  if (running){
+    put_samples();
+  }
+  return total;
+}
+
+void scope_hw_stop(void){
+  if (running){
+    put_samples();
+  }
+  running = false;
+}
@@ -0,0 +1,19 @@
+#include "pico/stdlib.h"
+#include "standby.h"
+#include "vhal.h"
+
+//Stand-in for standby_clocks.c. The emulator has no clocks to slow,
+//a nap just lets the time go by.
+
+static uint32_t pins;
+
+void standby_hw_enter(uint32_t wake_pins){
+  pins = wake_pins;
+}
+
+bool standby_hw_nap(uint32_t us){
+  return vhal_nap(us, pins);
+}
+
+void standby_hw_exit(){
+}
@@ -0,0 +1,7 @@
+#include "pico/stdlib.h"
+#include "supervisor.h"
+
+//Stand-in for supervisor_alarm.c. The emulator has no interrupts, so
+//a stall is only caught by the watchdog itself and leaves no PC.
+void supervisor_hw_start(uint32_t period_us){
+}
@@ -0,0 +1,26 @@
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "uart_rx_hw.h"
+
+//Stand-in for uart_rx_dma.c. There is no DMA, so the ring is filled
+//from the UART whenever the console asks how far it has got.
+
+static uart_inst_t *port;
+static uint8_t *ring;
+static uint32_t ring_mask;
+static uint32_t head;
+
+void uart_rx_hw_start(uart_inst_t *uart, uint8_t *buffer, uint32_t size){
+  port = uart;
+  ring = buffer;
+  ring_mask = size - 1;
+  head = 0;
+}
+
+uint32_t uart_rx_hw_head(){
+  while (uart_is_readable(port)){
+    ring[head] = (uint8_t)uart_getc(port);
+    head = (head + 1) & ring_mask;
+  }
+  return head;
+}
@@ -0,0 +1,32 @@
+#include "pico/stdlib.h"
+#include "usb_ports.h"
+#include "vhal.h"
+
+//Stand-in for usb_ports.c and TinyUSB. The console port is the
+//emulator's stdio and the data port vhal's data_fd.
+
+void usb_ports_init(){
+}
+
+bool usb_port_connected(usb_port port){
+  return port == USB_CONSOLE ? vhal_console_connected() : vhal_data_connected();
+}
+
+size_t usb_port_write(usb_port port, const void *data, size_t length){
+  if (port == USB_DATA){
+    return vhal_data_write(data, length);
+  }
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < length; i++){
+    putchar_raw(bytes[i]);
+  }
+  return length;
+}
+
+int usb_port_read(usb_port port){
+  if (port == USB_DATA){
+    return vhal_data_read();
+  }
+  int c = getchar_timeout_us(0);
+  return c < 0 ? -1 : c;
+}
@@ -0,0 +1,867 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/sio.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/watchdog.h"
+#include "pins.h"
+#include "vhal.h"
+
+#define SYS_CLOCK_HZ 125000000u
+#define ADC_VREF 3.25
+//How long stdout waits for the host to read before dropping output,
+//PICO_STDIO_USB_STDOUT_TIMEOUT_US in the SDK
+#define STDOUT_TIMEOUT_MS 500
+#define IN_BUFFER_SIZE 4096
+#define OUT_BUFFER_SIZE 16384
+#define FEED_BUFFER_SIZE 65536
+#define UART_FIFO_SIZE 32
+//Typical W25Q16JV erase and program times, the firmware stalls for
+//this long
+#define FLASH_ERASE_US 45000
+#define FLASH_PROGRAM_US 400
+//A nap in real time looks at the wake pins this often
+#define NAP_POLL_US 10000
+
+static vhal_config config;
+static uint64_t virtual_us;
+static uint64_t boot_us;
+//clk_sys and clk_peri as the firmware last set them, and the SysTick
+//cycles counted before clk_sys last changed
+static uint32_t sys_hz, peri_hz;
+static uint64_t clock_changed_us, cycles_before;
+static double override_values[WAVE_CHANNEL_COUNT];
+static bool overridden[WAVE_CHANNEL_COUNT];
+static uint32_t reported_outputs;
+static bool watchdog_rebooted;
+
+static sio_hw_t sio;
+static systick_hw_t systick;
+static watchdog_hw_t watchdog;
+static uint32_t pull_ups;
+static uint adc_input;
+
+static uint8_t in_buffer[IN_BUFFER_SIZE];
+static size_t in_head, in_tail;
+static uint8_t out_buffer[OUT_BUFFER_SIZE];
+static size_t out_length;
+static bool last_ended_with_cr;
+//The host stopped reading, drop output until it drains
+static bool out_stalled;
+
+//Bytes queued by vhal_feed_input, virtual time only
+static uint8_t feed_buffer[FEED_BUFFER_SIZE];
+static size_t feed_head, feed_tail;
+
+static bool watchdog_armed;
+static spin_lock_t spin_locks[32];
+static uint next_spin_lock;
+static uint32_t watchdog_delay_ms;
+static uint64_t watchdog_deadline_us;
+
+uint64_t vhal_monotonic_ns(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec*1000000000u + (uint64_t)now.tv_nsec;
+}
+
+uint64_t vhal_time_us(void){
+  if (config.virtual_time){
+    return virtual_us;
+  }
+  return (vhal_monotonic_ns() - config.epoch_ns)/1000;
+}
+
+static double wave_time(void){
+  return (double)vhal_time_us()/1e6;
+}
+
+static double input_value(wave_channel channel, double time){
+  if (overridden[channel]){
+    return override_values[channel];
+  }
+  return wave_value(config.waves, channel, time);
+}
+
+static void flush_output(void);
+static void uart_reset(void);
+static void flash_map(void);
+
+static void check_watchdog(uint64_t now_us){
+  if (watchdog_armed && (now_us >= watchdog_deadline_us)){
+    watchdog_armed = false;
+    flush_output();
+    if (!config.virtual_time){
+      fprintf(stderr, "emulator: watchdog reboot\n");
+    }
+    config.reboot();
+  }
+}
+
+static void *out_cookie;
+
+//stdout of the firmware. Like the USB CDC stdio driver, a '\n' goes
+//out as "\r\n" unless it already follows a '\r'.
+static ssize_t stdout_write(void *cookie, const char *data, size_t length){
+  for (size_t i = 0; i < length; i++){
+    if ((data[i] == '\n') && !last_ended_with_cr){
+      putchar_raw('\r');
+    }
+    putchar_raw((uint8_t)data[i]);
+    last_ended_with_cr = data[i] == '\r';
+  }
+  return (ssize_t)length;
+}
+
+void vhal_configure(const vhal_config *new_config){
+  config = *new_config;
+  cookie_io_functions_t functions = {NULL, stdout_write, NULL, NULL};
+  FILE *out = fopencookie(out_cookie, "w", functions);
+  if (!out){
+    perror("emulator: stdout");
+    exit(1);
+  }
+  setvbuf(out, NULL, _IONBF, 0);
+  stdout = out;
+  flash_map();
+}
+
+void vhal_boot(bool watchdog_reboot){
+  watchdog_rebooted = watchdog_reboot;
+  if (!watchdog_reboot){
+    memset(watchdog.scratch, 0, sizeof(watchdog.scratch));
+  }
+  //A reset releases every pin
+  if (reported_outputs && config.outputs_changed){
+    config.outputs_changed(reported_outputs, 0);
+  }
+  memset(&sio, 0, sizeof(sio));
+  memset(&systick, 0, sizeof(systick));
+  reported_outputs = 0;
+  pull_ups = 0;
+  adc_input = 0;
+  watchdog_armed = false;
+  //The SDK claims the low half itself
+  next_spin_lock = 16;
+  in_head = in_tail = 0;
+  out_length = 0;
+  last_ended_with_cr = false;
+  uart_reset();
+  boot_us = vhal_time_us();
+  sys_hz = peri_hz = SYS_CLOCK_HZ;
+  clock_changed_us = boot_us;
+  cycles_before = 0;
+}
+
+void vhal_advance_to(uint64_t time_us){
+  if (time_us > virtual_us){
+    virtual_us = time_us;
+  }
+}
+
+void vhal_reset(void){
+  virtual_us = 0;
+  if (!config.flash_fd){
+    memset(vhal_flash, 0xff, PICO_FLASH_SIZE_BYTES);
+  }
+  feed_head = feed_tail = 0;
+  memset(overridden, 0, sizeof(overridden));
+  reported_outputs = 0;
+}
+
+void vhal_feed_input(const void *data, size_t length){
+  if (feed_head == feed_tail){
+    feed_head = feed_tail = 0;
+  }
+  if (length > FEED_BUFFER_SIZE - feed_tail){
+    memmove(feed_buffer, feed_buffer+feed_head, feed_tail-feed_head);
+    feed_tail -= feed_head;
+    feed_head = 0;
+  }
+  if (length > FEED_BUFFER_SIZE - feed_tail){
+    length = FEED_BUFFER_SIZE - feed_tail;
+  }
+  memcpy(feed_buffer+feed_tail, data, length);
+  feed_tail += length;
+}
+
+bool vhal_input_pending(void){
+  return (feed_head != feed_tail) || (in_head != in_tail);
+}
+
+void vhal_override(wave_channel channel, double value){
+  override_values[channel] = value;
+  overridden[channel] = true;
+}
+
+void vhal_release(wave_channel channel){
+  overridden[channel] = false;
+}
+
+double vhal_input(wave_channel channel){
+  return input_value(channel, wave_time());
+}
+
+bool vhal_watchdog_deadline(uint64_t *time_us){
+  *time_us = watchdog_deadline_us;
+  return watchdog_armed;
+}
+
+//Time
+
+uint64_t time_us_64(void){
+  uint64_t now = vhal_time_us();
+  check_watchdog(now);
+  return now - boot_us;
+}
+
+uint32_t time_us_32(void){
+  return (uint32_t)time_us_64();
+}
+
+void busy_wait_us(uint64_t us){
+  if (config.virtual_time){
+    sleep_us(us);
+    return;
+  }
+  uint64_t end = time_us_64() + us;
+  while (time_us_64() < end){
+  }
+}
+
+//Short sleeps spin, the scheduler would turn 10us into 60us.
+void sleep_us(uint64_t us){
+  if (config.virtual_time){
+    virtual_us += us;
+    check_watchdog(virtual_us);
+    return;
+  }
+  if (us < 1000){
+    busy_wait_us(us);
+    return;
+  }
+  struct timespec delay = {(time_t)(us/1000000), (long)(us%1000000)*1000};
+  while (nanosleep(&delay, &delay) < 0 && (errno == EINTR)){
+  }
+  check_watchdog(vhal_time_us());
+}
+
+void sleep_ms(uint32_t ms){
+  sleep_us((uint64_t)ms*1000);
+}
+
+void panic(const char *fmt, ...){
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "emulator: panic: ");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  flush_output();
+  exit(1);
+}
+
+//Console
+
+static void flush_output(void){
+  if (config.virtual_time){
+    if (out_length && config.output){
+      config.output(out_buffer, out_length);
+    }
+    out_length = 0;
+    return;
+  }
+  size_t sent = 0;
+  while (sent < out_length){
+    ssize_t count = write(config.out_fd, out_buffer+sent, out_length-sent);
+    if (count > 0){
+      sent += (size_t)count;
+      out_stalled = false;
+      continue;
+    }
+    if ((count < 0) && (errno == EINTR)){
+      continue;
+    }
+    if ((count < 0) && (errno == EAGAIN) && !out_stalled){
+      struct pollfd writable = {config.out_fd, POLLOUT, 0};
+      if (poll(&writable, 1, STDOUT_TIMEOUT_MS) > 0){
+        continue;
+      }
+    }
+    out_stalled = true;
+    break;
+  }
+  out_length = 0;
+}
+
+bool stdio_init_all(void){
+  return true;
+}
+
+int putchar_raw(int c){
+  if (out_length == OUT_BUFFER_SIZE){
+    flush_output();
+  }
+  out_buffer[out_length++] = (uint8_t)c;
+  return c;
+}
+
+void stdio_flush(void){
+  fflush(stdout);
+  flush_output();
+}
+
+static bool fill_input(int timeout_us){
+  in_head = in_tail = 0;
+  if (config.virtual_time){
+    size_t count = feed_tail - feed_head;
+    if (count > sizeof(in_buffer)){
+      count = sizeof(in_buffer);
+    }
+    memcpy(in_buffer, feed_buffer+feed_head, count);
+    feed_head += count;
+    in_tail = count;
+    return count > 0;
+  }
+  if (timeout_us > 0){
+    struct pollfd readable = {config.in_fd, POLLIN, 0};
+    struct timespec timeout = {timeout_us/1000000, (long)(timeout_us%1000000)*1000};
+    if (ppoll(&readable, 1, &timeout, NULL) <= 0){
+      return false;
+    }
+  }
+  ssize_t count = read(config.in_fd, in_buffer, sizeof(in_buffer));
+  if (count <= 0){
+    return false;
+  }
+  in_tail = (size_t)count;
+  return true;
+}
+
+//Reads are served from a buffer so the firmware's byte at a time
+//polling does not cost a system call per byte. Output is sent
+//whenever the firmware runs out of input.
+int getchar_timeout_us(uint32_t timeout_us){
+  if (in_head == in_tail){
+    flush_output();
+    if (config.virtual_time && !fill_input(0)){
+      config.idle();
+      if (!fill_input(0)){
+        check_watchdog(virtual_us);
+        return PICO_ERROR_TIMEOUT;
+      }
+    } else if (!fill_input(0)){
+      uint32_t wait = timeout_us ? timeout_us : config.idle_us;
+      if ((wait == 0) || !fill_input((int)wait)){
+        check_watchdog(vhal_time_us());
+        return PICO_ERROR_TIMEOUT;
+      }
+    }
+  }
+  return in_buffer[in_head++];
+}
+
+//GPIO. Inputs that are not driven by the board come from the
+//waveforms.
+
+static uint32_t external_inputs(void){
+  double time = wave_time();
+  uint32_t inputs = 0;
+  static const struct {wave_channel channel; uint pin;} digital[] = {
+    {WAVE_IN0, IN0}, {WAVE_IN1, IN1}, {WAVE_IN2, IN2}, {WAVE_AUX, AUX_SW},
+  };
+  for (size_t i = 0; i < count_of(digital); i++){
+    if (input_value(digital[i].channel, time) >= 0.5){
+      inputs |= 1u << digital[i].pin;
+    }
+  }
+  if (config.jig){
+    static const struct {uint out; uint in;} loopbacks[] = {{OUT0, IN0}, {OUT1, IN1}, {OUT2, IN2}};
+    for (size_t i = 0; i < count_of(loopbacks); i++){
+      inputs &= ~(1u << loopbacks[i].in);
+      if ((sio.gpio_out & sio.gpio_oe) & (1u << loopbacks[i].out)){
+        inputs |= 1u << loopbacks[i].in;
+      }
+    }
+  }
+  return inputs;
+}
+
+sio_hw_t *vhal_sio(void){
+  sio.gpio_out = ((sio.gpio_out | sio.gpio_set) & ~sio.gpio_clr) ^ sio.gpio_togl;
+  sio.gpio_set = sio.gpio_clr = sio.gpio_togl = 0;
+  sio.gpio_oe = ((sio.gpio_oe | sio.gpio_oe_set) & ~sio.gpio_oe_clr) ^ sio.gpio_oe_togl;
+  sio.gpio_oe_set = sio.gpio_oe_clr = sio.gpio_oe_togl = 0;
+  sio.gpio_in = (sio.gpio_out & sio.gpio_oe) | (external_inputs() & ~sio.gpio_oe);
+  if ((sio.gpio_out != reported_outputs) && config.outputs_changed){
+    uint32_t before = reported_outputs;
+    reported_outputs = sio.gpio_out;
+    config.outputs_changed(before, sio.gpio_out);
+  }
+  reported_outputs = sio.gpio_out;
+  return &sio;
+}
+
+void gpio_init(uint gpio){
+  gpio_init_mask(1u << gpio);
+}
+
+void gpio_init_mask(uint32_t gpio_mask){
+  vhal_sio()->gpio_oe &= ~gpio_mask;
+  sio.gpio_out &= ~gpio_mask;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn){
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down){
+  if (up){
+    pull_ups |= 1u << gpio;
+  } else {
+    pull_ups &= ~(1u << gpio);
+  }
+}
+
+void gpio_pull_up(uint gpio){
+  gpio_set_pulls(gpio, true, false);
+}
+
+void gpio_pull_down(uint gpio){
+  gpio_set_pulls(gpio, false, true);
+}
+
+void gpio_disable_pulls(uint gpio){
+  gpio_set_pulls(gpio, false, false);
+}
+
+void gpio_set_dir(uint gpio, bool out){
+  if (out){
+    vhal_sio()->gpio_oe |= 1u << gpio;
+  } else {
+    vhal_sio()->gpio_oe &= ~(1u << gpio);
+  }
+}
+
+void gpio_set_dir_out_masked(uint32_t mask){
+  vhal_sio()->gpio_oe |= mask;
+}
+
+void gpio_set_dir_in_masked(uint32_t mask){
+  vhal_sio()->gpio_oe &= ~mask;
+}
+
+void gpio_put(uint gpio, bool value){
+  gpio_put_masked(1u << gpio, value ? (1u << gpio) : 0);
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value){
+  sio_hw_t *hw = vhal_sio();
+  hw->gpio_out = (hw->gpio_out & ~mask) | (value & mask);
+}
+
+void gpio_put_all(uint32_t value){
+  vhal_sio()->gpio_out = value;
+}
+
+void gpio_set_mask(uint32_t mask){
+  vhal_sio()->gpio_out |= mask;
+}
+
+void gpio_clr_mask(uint32_t mask){
+  vhal_sio()->gpio_out &= ~mask;
+}
+
+void gpio_xor_mask(uint32_t mask){
+  vhal_sio()->gpio_out ^= mask;
+}
+
+bool gpio_get(uint gpio){
+  return (vhal_sio()->gpio_in >> gpio) & 1;
+}
+
+uint32_t vhal_outputs(void){
+  return vhal_sio()->gpio_out;
+}
+
+uint32_t gpio_get_all(void){
+  return vhal_sio()->gpio_in;
+}
+
+bool gpio_get_out_level(uint gpio){
+  return (vhal_sio()->gpio_out >> gpio) & 1;
+}
+
+bool gpio_is_dir_out(uint gpio){
+  return (vhal_sio()->gpio_oe >> gpio) & 1;
+}
+
+//SysTick counts down from rvr at clk_sys while enabled.
+systick_hw_t *vhal_systick(void){
+  if (systick.csr & 1){
+    uint64_t cycles = cycles_before + (vhal_time_us() - clock_changed_us)*(sys_hz/1000000);
+    uint64_t period = (uint64_t)systick.rvr + 1;
+    systick.cvr = (uint32_t)(systick.rvr - (cycles % period));
+  }
+  return &systick;
+}
+
+//ADC. Input 0 is the mux on GPIO26, 1 and 2 the regulator current
+//monitors, 3 VSYS/3 and 4 the on-chip temperature sensor.
+
+static double current_monitor_volts(wave_channel channel, uint enable_pin, double time){
+  bool fed = !config.jig || gpio_get_out_level(MAIN_RELAY);
+  double amps = (fed && gpio_get_out_level(enable_pin)) ? input_value(channel, time) : 0.0;
+  return 0.23 + 0.055*amps;
+}
+
+static double mux_volts(uint selected, double time){
+  switch (selected){
+    case 0: return input_value(WAVE_KEY, time);
+    case 6: return 0.5 + 0.01*input_value(WAVE_TEMP1, time);
+    case 7: return 0.5 + 0.01*input_value(WAVE_TEMP2, time);
+    default: return input_value((wave_channel)(WAVE_MUX1 + selected - 1), time);
+  }
+}
+
+void adc_init(void){
+}
+
+void adc_gpio_init(uint gpio){
+  gpio_set_function(gpio, GPIO_FUNC_NULL);
+  gpio_disable_pulls(gpio);
+}
+
+void adc_select_input(uint input){
+  adc_input = input;
+}
+
+uint adc_get_selected_input(void){
+  return adc_input;
+}
+
+uint16_t adc_read(void){
+  double time = wave_time();
+  double volts = 0.0;
+  uint32_t out = vhal_sio()->gpio_out;
+  uint selected = (((out >> MUX_S2) & 1) << 2) | (((out >> MUX_S1) & 1) << 1) | ((out >> MUX_S0) & 1);
+  switch (adc_input){
+    case 0: volts = mux_volts(selected, time); break;
+    case 1: volts = current_monitor_volts(WAVE_SWITCH_I, SWITCH_PWR_EN, time); break;
+    case 2: volts = current_monitor_volts(WAVE_COMP_I, COMP_PWR_EN, time); break;
+    case 3: volts = 5.0/3.0; break;
+    case 4: volts = 0.706; break;
+  }
+  long raw = lround(volts/ADC_VREF*4096.0);
+  if (raw < 0){
+    raw = 0;
+  } else if (raw > 4095){
+    raw = 4095;
+  }
+  return (uint16_t)raw;
+}
+
+//Clocks, the SDK defaults until clock_vhal.c changes them
+
+void vhal_set_clocks(uint32_t new_sys_hz, uint32_t new_peri_hz){
+  uint64_t now = vhal_time_us();
+  cycles_before += (now - clock_changed_us)*(sys_hz/1000000);
+  clock_changed_us = now;
+  sys_hz = new_sys_hz;
+  peri_hz = new_peri_hz;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index){
+  switch (clk_index){
+    case clk_ref: return 12000000;
+    case clk_sys: return sys_hz;
+    case clk_peri: return peri_hz;
+    case clk_usb: return 48000000;
+    case clk_adc: return 48000000;
+    case clk_rtc: return 46875;
+    default: return 0;
+  }
+}
+
+//Sync
+
+
+spin_lock_t *spin_lock_init(uint lock_num){
+  spin_locks[lock_num] = 0;
+  return &spin_locks[lock_num];
+}
+
+int spin_lock_claim_unused(bool required){
+  if (next_spin_lock >= count_of(spin_locks)){
+    if (required){
+      panic("No spin locks are available");
+    }
+    return -1;
+  }
+  return (int)next_spin_lock++;
+}
+
+uint32_t spin_lock_blocking(spin_lock_t *lock){
+  *lock = 1;
+  return 0;
+}
+
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq){
+  *lock = 0;
+}
+
+uint32_t save_and_disable_interrupts(void){
+  return 0;
+}
+
+void restore_interrupts(uint32_t status){
+}
+
+//Watchdog
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug){
+  watchdog_delay_ms = delay_ms;
+  watchdog_update();
+  watchdog_armed = true;
+}
+
+void watchdog_update(void){
+  watchdog_deadline_us = vhal_time_us() + (uint64_t)watchdog_delay_ms*1000;
+}
+
+watchdog_hw_t *vhal_watchdog_hw(void){
+  return &watchdog;
+}
+
+uint32_t *vhal_watchdog_scratch(void){
+  return watchdog.scratch;
+}
+
+bool watchdog_caused_reboot(void){
+  return watchdog_rebooted;
+}
+
+bool watchdog_enable_caused_reboot(void){
+  return watchdog_rebooted;
+}
+
+void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms){
+  watchdog_enable(delay_ms, false);
+}
+
+uint32_t watchdog_get_count(void){
+  if (!watchdog_armed){
+    return 0;
+  }
+  uint64_t now = vhal_time_us();
+  return now >= watchdog_deadline_us ? 0 : (uint32_t)(watchdog_deadline_us - now);
+}
+
+//UART1 to the Jetson goes to uart1_fd if there is one, otherwise
+//writes are dropped and nothing is ever received. On the jig what is
+//sent comes back into the receive FIFO, where it stays until read or
+//the FIFO overflows.
+
+struct uart_inst {
+  uint baudrate;
+  uint8_t fifo[UART_FIFO_SIZE];
+  size_t fifo_head, fifo_count;
+};
+
+static struct uart_inst uart_instances[2];
+uart_inst_t *const vhal_uart0 = &uart_instances[0];
+uart_inst_t *const vhal_uart1 = &uart_instances[1];
+
+static void uart_reset(void){
+  memset(uart_instances, 0, sizeof(uart_instances));
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate){
+  uart->baudrate = baudrate;
+  uart->fifo_head = uart->fifo_count = 0;
+  return baudrate;
+}
+
+void uart_deinit(uart_inst_t *uart){
+  uart->baudrate = 0;
+}
+
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate){
+  uart->baudrate = baudrate;
+  return baudrate;
+}
+
+bool uart_is_readable(uart_inst_t *uart){
+  if (!uart->fifo_count && config.uart1_fd && (uart == vhal_uart1) && uart->baudrate){
+    ssize_t got = read(config.uart1_fd, uart->fifo, UART_FIFO_SIZE);
+    uart->fifo_head = 0;
+    uart->fifo_count = got > 0 ? (size_t)got : 0;
+  }
+  return uart->fifo_count > 0;
+}
+
+bool uart_is_writable(uart_inst_t *uart){
+  return true;
+}
+
+char uart_getc(uart_inst_t *uart){
+  if (!uart->fifo_count){
+    return 0;
+  }
+  char c = (char)uart->fifo[uart->fifo_head];
+  uart->fifo_head = (uart->fifo_head + 1) % UART_FIFO_SIZE;
+  uart->fifo_count--;
+  return c;
+}
+
+void uart_putc_raw(uart_inst_t *uart, char c){
+  if (config.uart1_fd && (uart == vhal_uart1) && uart->baudrate){
+    //Like the console, output nobody reads is dropped
+    ssize_t written = write(config.uart1_fd, &c, 1);
+    (void)written;
+    return;
+  }
+  if (!config.jig || (uart != vhal_uart1) || !uart->baudrate || (uart->fifo_count == UART_FIFO_SIZE)){
+    return;
+  }
+  uart->fifo[(uart->fifo_head + uart->fifo_count) % UART_FIFO_SIZE] = (uint8_t)c;
+  uart->fifo_count++;
+}
+
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len){
+  for (size_t i = 0; i < len; i++){
+    uart_putc_raw(uart, (char)src[i]);
+  }
+}
+
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len){
+  for (size_t i = 0; i < len; i++){
+    dst[i] = uart_is_readable(uart) ? (uint8_t)uart_getc(uart) : 0;
+  }
+}
+
+//USB data port on data_fd. The emulator cannot tell whether anyone
+//has the terminal open, so the port counts as open whenever there is
+//one, and like the console what is not read in time is dropped.
+
+bool vhal_data_connected(void){
+  return config.data_fd != 0;
+}
+
+size_t vhal_data_write(const void *data, size_t length){
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t sent = 0;
+  while (config.data_fd && (sent < length)){
+    ssize_t count = write(config.data_fd, bytes+sent, length-sent);
+    if (count > 0){
+      sent += (size_t)count;
+      continue;
+    }
+    if ((count < 0) && (errno == EINTR)){
+      continue;
+    }
+    struct pollfd writable = {config.data_fd, POLLOUT, 0};
+    if ((count < 0) && (errno == EAGAIN) && (poll(&writable, 1, STDOUT_TIMEOUT_MS) > 0)){
+      continue;
+    }
+    break;
+  }
+  return sent;
+}
+
+int vhal_data_read(void){
+  uint8_t c;
+  if (!config.data_fd || (read(config.data_fd, &c, 1) != 1)){
+    return -1;
+  }
+  return c;
+}
+
+//Standby. Queued console input stands in for a host opening the
+//console, which on the board takes the aux switch.
+
+bool vhal_console_connected(void){
+  return !config.virtual_time || vhal_input_pending();
+}
+
+bool vhal_nap(uint64_t us, uint32_t wake_pins){
+  uint64_t end = vhal_time_us() + us;
+  flush_output();
+  while (true){
+    if (vhal_input_pending() || (~gpio_get_all() & wake_pins)){
+      return true;
+    }
+    uint64_t now = vhal_time_us();
+    if (now >= end){
+      return false;
+    }
+    if (config.virtual_time){
+      config.idle();
+      check_watchdog(virtual_us);
+    } else if (fill_input((int)(end - now < NAP_POLL_US ? end - now : NAP_POLL_US))){
+      return true;
+    }
+  }
+}
+
+//Unique ID of the flash chip. The emulator has none, so it reports
+//the same made up one every time.
+void pico_get_unique_board_id_string(char *id_out, uint len){
+  snprintf(id_out, len, "%s", "E000000000000001");
+}
+
+//Flash. Only the firmware's own writes are emulated, the program
+//itself is not in it.
+
+uint8_t *vhal_flash;
+
+static void flash_map(void){
+  if (config.flash_fd){
+    if (ftruncate(config.flash_fd, PICO_FLASH_SIZE_BYTES) < 0){
+      perror("emulator: flash");
+      exit(1);
+    }
+    vhal_flash = mmap(NULL, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, config.flash_fd, 0);
+  } else {
+    vhal_flash = mmap(NULL, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if (vhal_flash == MAP_FAILED){
+    perror("emulator: flash");
+    exit(1);
+  }
+  if (!config.flash_fd){
+    memset(vhal_flash, 0xff, PICO_FLASH_SIZE_BYTES);
+  }
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count){
+  if ((flash_offs % FLASH_SECTOR_SIZE) || (count % FLASH_SECTOR_SIZE) || (flash_offs + count > PICO_FLASH_SIZE_BYTES)){
+    panic("flash_range_erase(0x%x, %zu) not sector aligned", flash_offs, count);
+  }
+  memset(vhal_flash + flash_offs, 0xff, count);
+  sleep_us((uint64_t)FLASH_ERASE_US*(count/FLASH_SECTOR_SIZE));
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count){
+  if ((flash_offs % FLASH_PAGE_SIZE) || (count % FLASH_PAGE_SIZE) || (flash_offs + count > PICO_FLASH_SIZE_BYTES)){
+    panic("flash_range_program(0x%x, %zu) not page aligned", flash_offs, count);
+  }
+  for (size_t i = 0; i < count; i++){
+    vhal_flash[flash_offs + i] &= data[i];
+  }
+  sleep_us((uint64_t)FLASH_PROGRAM_US*(count/FLASH_PAGE_SIZE));
+}
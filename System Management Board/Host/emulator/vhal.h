@@ -0,0 +1,97 @@
+#ifndef VHAL_H
+#define VHAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "waveform.h"
+
+//Emulator side of the virtual HAL. The firmware only sees the Pico
+//SDK headers in hal/, this configures what is behind them.
+typedef struct vhal_config {
+  //Run on a virtual clock that only moves when the firmware sleeps or
+  //the idle hook advances it. The console then goes through the idle
+  //and output hooks instead of file descriptors.
+  bool virtual_time;
+  //Console bytes in and out, the pseudo-terminal master or stdio
+  int in_fd;
+  int out_fd;
+  //CLOCK_MONOTONIC nanoseconds the emulator clock counts from.
+  //Survives watchdog reboots.
+  uint64_t epoch_ns;
+  //How long an empty console poll may block, so an idle emulator
+  //does not spin a whole core. 0 polls like the board does.
+  uint32_t idle_us;
+  wave_set *waves;
+  //The production test jig is fitted: IN0-2 follow OUT0-2, uart1
+  //TX is looped to RX and the regulators are only fed through the
+  //main relay.
+  bool jig;
+  //File the flash chip is kept in, PICO_FLASH_SIZE_BYTES long, so it
+  //survives watchdog reboots. 0 keeps it in memory that vhal_reset
+  //erases.
+  int flash_fd;
+  //Both ends of uart1 to the Jetson, normally a second
+  //pseudo-terminal. 0 leaves it unconnected.
+  int uart1_fd;
+  //Both ends of the USB data port, see usb_ports.h, normally another
+  //pseudo-terminal. 0 leaves it closed and the frames on the console.
+  int data_fd;
+  //Restarts the firmware when the watchdog expires. Does not return.
+  void (*reboot)(void);
+  //Virtual time only. Called when the firmware polls the console and
+  //nothing is waiting, normally to feed input or advance the clock.
+  void (*idle)(void);
+  //Virtual time only. Receives the console output.
+  void (*output)(const uint8_t *data, size_t length);
+  //Optional. Called when gpio_out changes.
+  void (*outputs_changed)(uint32_t before, uint32_t after);
+} vhal_config;
+
+//Takes over stdout. Call once before the first vhal_boot.
+void vhal_configure(const vhal_config *config);
+//Puts the board in its power-on state, call before each run of the
+//firmware's main.
+void vhal_boot(bool watchdog_reboot);
+
+uint64_t vhal_monotonic_ns(void);
+//Microseconds since the emulator started, unlike time_us_64 this
+//does not restart on reboot. Waveforms run on this clock.
+uint64_t vhal_time_us(void);
+//Virtual time only. Moves the clock forward, never back.
+void vhal_advance_to(uint64_t time_us);
+//Virtual time only. Starts the clock again from zero with no input or
+//overrides, to run several simulations in one process. Follow with
+//vhal_boot.
+void vhal_reset(void);
+//Virtual time only. Queues bytes for the console to read.
+void vhal_feed_input(const void *data, size_t length);
+bool vhal_input_pending(void);
+//Holds a channel at a value regardless of the waveform, used to
+//model things that react to the board.
+void vhal_override(wave_channel channel, double value);
+void vhal_release(wave_channel channel);
+double vhal_input(wave_channel channel);
+uint32_t vhal_outputs(void);
+//When the armed watchdog will expire, on the vhal_time_us clock.
+bool vhal_watchdog_deadline(uint64_t *time_us);
+//The watchdog scratch registers, for carrying them over a reboot
+//that restarts the emulator process.
+uint32_t *vhal_watchdog_scratch(void);
+//clk_sys and clk_peri for clock_vhal.c, what clock_get_hz returns and
+//SysTick counts at from now on.
+void vhal_set_clocks(uint32_t sys_hz, uint32_t peri_hz);
+//The USB data port for usb_ports_vhal.c, on data_fd.
+bool vhal_data_connected(void);
+size_t vhal_data_write(const void *data, size_t length);
+int vhal_data_read(void);
+//The console for usb_ports_vhal.c. Always open in real time. In
+//virtual time only while input is queued, so the parked board can go
+//to standby between commands.
+bool vhal_console_connected(void);
+//Standby for standby_vhal.c. Waits up to us, true if it was cut short
+//by console input or one of wake_pins reading low.
+bool vhal_nap(uint64_t us, uint32_t wake_pins);
+
+#endif
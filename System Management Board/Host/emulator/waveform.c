@@ -0,0 +1,202 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "waveform.h"
+
+static const char *const channel_names[WAVE_CHANNEL_COUNT] = {
+  "key", "mux1", "mux2", "mux3", "mux4", "mux5", "temp1", "temp2",
+  "comp_i", "switch_i", "in0", "in1", "in2", "aux",
+};
+
+static const double channel_defaults[WAVE_CHANNEL_COUNT] = {
+  2.0, 0.0, 0.0, 0.0, 0.0, 0.0, 25.0, 25.0,
+  1.5, 0.8, 0.0, 0.0, 0.0, 1.0,
+};
+
+int wave_channel_by_name(const char *name){
+  for (int i = 0; i < WAVE_CHANNEL_COUNT; i++){
+    if (strcmp(channel_names[i], name) == 0){
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char *wave_channel_name(wave_channel channel){
+  return channel_names[channel];
+}
+
+static void add_point(waveform *wave, double time, double value, bool step){
+  if (wave->count == wave->capacity){
+    wave->capacity = wave->capacity ? wave->capacity*2 : 8;
+    wave->points = realloc(wave->points, wave->capacity*sizeof(wave_point));
+    if (!wave->points){
+      perror("emulator");
+      exit(1);
+    }
+  }
+  //Keep the points sorted, scripts are usually in order already
+  size_t i = wave->count;
+  while ((i > 0) && (wave->points[i-1].time > time)){
+    wave->points[i] = wave->points[i-1];
+    i--;
+  }
+  wave->points[i] = (wave_point){time, value, step};
+  wave->count++;
+  wave->cursor = 0;
+}
+
+//The first scripted point of a channel replaces its default.
+static void claim(waveform *wave){
+  if (!wave->scripted){
+    wave->count = 0;
+    wave->scripted = true;
+  }
+}
+
+void wave_set_add(wave_set *set, wave_channel channel, double time, double value, bool step){
+  claim(&set->channels[channel]);
+  add_point(&set->channels[channel], time, value, step);
+}
+
+void wave_set_init(wave_set *set){
+  memset(set, 0, sizeof(*set));
+  for (int i = 0; i < WAVE_CHANNEL_COUNT; i++){
+    add_point(&set->channels[i], 0.0, channel_defaults[i], false);
+  }
+}
+
+void wave_set_free(wave_set *set){
+  for (int i = 0; i < WAVE_CHANNEL_COUNT; i++){
+    free(set->channels[i].points);
+  }
+  memset(set, 0, sizeof(*set));
+}
+
+bool wave_set_parse_line(wave_set *set, const char *line, char *error, size_t error_size){
+  char copy[256];
+  snprintf(copy, sizeof(copy), "%s", line);
+  char *comment = strchr(copy, '#');
+  if (comment){
+    *comment = 0;
+  }
+  char *fields[5];
+  int count = 0;
+  for (char *token = strtok(copy, " \t\r\n"); token && (count < 5); token = strtok(NULL, " \t\r\n")){
+    fields[count++] = token;
+  }
+  if (count == 0){
+    return true;
+  }
+  char *end;
+  if (strcmp(fields[0], "repeat") == 0){
+    if (count != 2){
+      snprintf(error, error_size, "repeat takes one period");
+      return false;
+    }
+    set->repeat = strtod(fields[1], &end);
+    if (*end || (set->repeat <= 0)){
+      snprintf(error, error_size, "bad repeat period \"%s\"", fields[1]);
+      return false;
+    }
+    return true;
+  }
+  if ((count < 3) || (count > 4) || ((count == 4) && (strcmp(fields[3], "step") != 0))){
+    snprintf(error, error_size, "expected \"<seconds> <channel> <value> [step]\"");
+    return false;
+  }
+  double time = strtod(fields[0], &end);
+  if (*end || (time < 0)){
+    snprintf(error, error_size, "bad time \"%s\"", fields[0]);
+    return false;
+  }
+  int channel = wave_channel_by_name(fields[1]);
+  if (channel < 0){
+    snprintf(error, error_size, "unknown channel \"%s\"", fields[1]);
+    return false;
+  }
+  double value = strtod(fields[2], &end);
+  if (*end){
+    snprintf(error, error_size, "bad value \"%s\"", fields[2]);
+    return false;
+  }
+  wave_set_add(set, (wave_channel)channel, time, value, count == 4);
+  return true;
+}
+
+bool wave_set_load(wave_set *set, const char *path, char *error, size_t error_size){
+  FILE *file = fopen(path, "r");
+  if (!file){
+    snprintf(error, error_size, "%s: %s", path, strerror(errno));
+    return false;
+  }
+  char line[256];
+  int number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), file)){
+    number++;
+    char reason[128];
+    if (!wave_set_parse_line(set, line, reason, sizeof(reason))){
+      snprintf(error, error_size, "%s:%d: %s", path, number, reason);
+      ok = false;
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+bool wave_set_constant(wave_set *set, const char *assignment){
+  const char *equals = strchr(assignment, '=');
+  if (!equals){
+    return false;
+  }
+  char name[32];
+  size_t length = (size_t)(equals - assignment);
+  if (length >= sizeof(name)){
+    return false;
+  }
+  memcpy(name, assignment, length);
+  name[length] = 0;
+  int channel = wave_channel_by_name(name);
+  char *end;
+  double value = strtod(equals+1, &end);
+  if ((channel < 0) || *end || (end == equals+1)){
+    return false;
+  }
+  waveform *wave = &set->channels[channel];
+  wave->count = 0;
+  wave->scripted = true;
+  add_point(wave, 0.0, value, false);
+  return true;
+}
+
+double wave_value(wave_set *set, wave_channel channel, double time){
+  waveform *wave = &set->channels[channel];
+  if (set->repeat > 0){
+    time = fmod(time, set->repeat);
+  }
+  const wave_point *points = wave->points;
+  if ((wave->count == 0) || (time <= points[0].time)){
+    return wave->count ? points[0].value : 0.0;
+  }
+  if (time >= points[wave->count-1].time){
+    return points[wave->count-1].value;
+  }
+  size_t i = wave->cursor;
+  if ((i >= wave->count-1) || (points[i].time > time)){
+    i = 0;
+  }
+  while (points[i+1].time < time){
+    i++;
+  }
+  wave->cursor = i;
+  const wave_point *from = &points[i];
+  const wave_point *to = &points[i+1];
+  if (to->step || (to->time == from->time)){
+    return from->value;
+  }
+  return from->value + (to->value - from->value)*(time - from->time)/(to->time - from->time);
+}
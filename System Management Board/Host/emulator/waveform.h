@@ -0,0 +1,70 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//Scripted inputs of the emulated board. Each channel is a piecewise
+//linear waveform over seconds since the emulator started.
+//
+//Script lines are "<seconds> <channel> <value> [step]", with '#'
+//starting a comment. Between two points the value ramps linearly,
+//unless the later point is marked step, in which case it jumps there.
+//"repeat <seconds>" loops the whole script with that period.
+typedef enum wave_channel {
+  WAVE_KEY,       //Key voltage at the ADC pin, volts (mux 0)
+  WAVE_MUX1,      //Spare mux inputs, volts
+  WAVE_MUX2,
+  WAVE_MUX3,
+  WAVE_MUX4,
+  WAVE_MUX5,
+  WAVE_TEMP1,     //Temperature sensors, degrees C (mux 6 and 7)
+  WAVE_TEMP2,
+  WAVE_COMP_I,    //Regulator currents, amps, read as 0 while disabled
+  WAVE_SWITCH_I,
+  WAVE_IN0,       //Digital inputs from the Jetson, 0 or 1
+  WAVE_IN1,
+  WAVE_IN2,
+  WAVE_AUX,       //Auxiliary switch, 1 when released
+  WAVE_CHANNEL_COUNT
+} wave_channel;
+
+typedef struct wave_point {
+  double time;
+  double value;
+  bool step;
+} wave_point;
+
+typedef struct waveform {
+  wave_point *points;
+  size_t count;
+  size_t capacity;
+  //Segment of the last lookup, time mostly moves forwards
+  size_t cursor;
+  //Set once a script or --set replaces the default
+  bool scripted;
+} waveform;
+
+typedef struct wave_set {
+  waveform channels[WAVE_CHANNEL_COUNT];
+  double repeat;
+} wave_set;
+
+//Fills every channel with a constant default: key on, 25 degrees,
+//regulators drawing current, inputs low and the switch released.
+void wave_set_init(wave_set *set);
+void wave_set_free(wave_set *set);
+//Adds the points in a script file. On failure error holds the reason.
+bool wave_set_load(wave_set *set, const char *path, char *error, size_t error_size);
+//Parses one script line.
+bool wave_set_parse_line(wave_set *set, const char *line, char *error, size_t error_size);
+//Adds one point, replacing the channel's default on first use.
+void wave_set_add(wave_set *set, wave_channel channel, double time, double value, bool step);
+//Replaces a channel with a constant, from "channel=value".
+bool wave_set_constant(wave_set *set, const char *assignment);
+double wave_value(wave_set *set, wave_channel channel, double time);
+
+int wave_channel_by_name(const char *name);
+const char *wave_channel_name(wave_channel channel);
+
+#endif
@@ -0,0 +1,430 @@
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "firmware_module.h"
+#include "fuzz_harness.h"
+#include "jetson.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "pins.h"
+#include "vhal.h"
+
+#define SECONDS(s) ((uint64_t)((s)*1000000.0))
+//How long the board runs on after the last action
+#define SETTLE_TIME SECONDS(150)
+//Actions stop being read after this much simulated time
+#define INPUT_TIME_LIMIT SECONDS(3600)
+//shutdown_delay + the 45 s forced shutdown + the 500 ms watchdog,
+//with some slack for the 50 ms state machine period
+#define SHUTDOWN_LIMIT SECONDS(57)
+#define KEY_THRESHOLD_COUNTS 1000
+#define ADC_VREF 3.25
+
+enum {
+  ACTION_KEY,
+  ACTION_PIN,
+  ACTION_CONSOLE,
+  ACTION_WINDOWS,
+  ACTION_JUMP,
+  ACTION_RUN,
+  ACTION_JETSON,
+  ACTION_WATCHDOG,
+  ACTION_COUNT
+};
+
+//Around the 1000 count threshold, which is 0.79 V at the ADC pin
+static const double key_levels[] = {0.0, 0.3, 0.78, 0.80, 0.82, 1.2, 2.0, 3.3};
+static const wave_channel pin_channels[] = {WAVE_IN0, WAVE_IN1, WAVE_IN2, WAVE_AUX};
+//Console bytes. The debug commands that switch power pins by hand
+//are left out, the state machine is not expected to cope with them.
+static const char console_bytes[] = "dKRTLIVUjpab0137;#\n\n\n";
+
+static const char *const property_names[PROP_COUNT - INV_COUNT] = {
+  "timer_underflow", "stuck_shutdown",
+};
+
+//Same layout as monitor in main.c
+typedef struct firmware_monitor {
+  bool in_process;
+  uint64_t start_time;
+} firmware_monitor;
+
+//The state machine's globals in the loaded firmware
+static struct {
+  firmware_monitor *sd_now;
+  firmware_monitor *engage;
+  firmware_monitor *debug;
+  bool *early_start;
+  bool *end_sd;
+  bool *coordinated_sd;
+  bool *debug_force_sd;
+  uint64_t *debug_time;
+  uint32_t (*shed_pins)(void);
+} firmware;
+
+static bool ignored[PROP_COUNT];
+static FILE *trace;
+static uint64_t states_reached[128];
+
+//The run in progress
+static const uint8_t *input;
+static size_t input_size;
+static size_t input_next;
+static fuzz_result *result;
+static jmp_buf run_jump;
+static jmp_buf boot_jump;
+static invariants checks;
+static jetson model;
+static double pin_values[4];
+static uint64_t run_until;
+static bool settling;
+static bool in_shutdown;
+//A jump outlasted the watchdog, so the reboot that follows is part
+//of the stall, until the firmware is back in its loop
+static bool stalled;
+static int stall_reboots;
+static uint64_t shutdown_since_active;
+static char console_line[128];
+static size_t console_length;
+
+const char *fuzz_property_name(int property){
+  if (property < INV_COUNT){
+    return invariant_name((invariant_id)property);
+  }
+  return property_names[property - INV_COUNT];
+}
+
+bool fuzz_ignore(const char *names){
+  char list[256];
+  snprintf(list, sizeof(list), "%s", names);
+  for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")){
+    int property = 0;
+    while ((property < PROP_COUNT) && (strcmp(fuzz_property_name(property), name) != 0)){
+      property++;
+    }
+    if (property == PROP_COUNT){
+      fprintf(stderr, "fuzz: unknown property %s\n", name);
+      return false;
+    }
+    ignored[property] = true;
+  }
+  return true;
+}
+
+void fuzz_set_trace(FILE *file){
+  trace = file;
+}
+
+static void print_time(FILE *file, uint64_t time_us){
+  fprintf(file, "%7.3f ", (double)time_us/1e6);
+}
+
+static void fail(int property, const char *detail){
+  if (ignored[property] || result->failed){
+    return;
+  }
+  result->failed = true;
+  result->property = property;
+  result->time_us = vhal_time_us();
+  snprintf(result->detail, sizeof(result->detail), "%s", detail);
+  if (trace){
+    print_time(trace, result->time_us);
+    fprintf(trace, "FAILED %s: %s\n", fuzz_property_name(property), detail);
+  }
+  longjmp(run_jump, 1);
+}
+
+//Turns new invariant violations into a failure.
+static void check_invariants(void){
+  for (int i = 0; i < INV_COUNT; i++){
+    if (checks.violations[i] && !ignored[i]){
+      fail(i, invariant_name((invariant_id)i));
+    }
+  }
+}
+
+static void check_timers(void){
+  uint64_t board_time = time_us_64();
+  if ((int64_t)(board_time - *firmware.debug_time) < 0){
+    fail(PROP_TIMER_UNDERFLOW, "debug_time is ahead of time_us_64(), time_ref wraps");
+  }
+  uint64_t time_ref = board_time - *firmware.debug_time;
+  if (!firmware.sd_now->in_process && ((int64_t)(time_ref - firmware.engage->start_time) < 0)){
+    fail(PROP_TIMER_UNDERFLOW, "engage.start_time is ahead of time_ref, evaluate_state's time wraps");
+  }
+  if (firmware.sd_now->in_process && ((int64_t)(time_ref - firmware.sd_now->start_time) < 0)){
+    fail(PROP_TIMER_UNDERFLOW, "sd_now.start_time is ahead of time_ref, shutdown_process's relative_time wraps");
+  }
+}
+
+static void check_shutdown(void){
+  bool shutting_down = firmware.sd_now->in_process;
+  if (shutting_down && !in_shutdown){
+    shutdown_since_active = checks.active_us;
+  }
+  in_shutdown = shutting_down;
+  if (shutting_down && (checks.active_us - shutdown_since_active > SHUTDOWN_LIMIT)){
+    fail(PROP_STUCK_SHUTDOWN, "sd_now.in_process for longer than the forced shutdown");
+  }
+}
+
+static void record_state(void){
+  unsigned state = firmware.sd_now->in_process | (firmware.engage->in_process << 1) |
+    (*firmware.early_start << 2) | (*firmware.end_sd << 3) | (*firmware.coordinated_sd << 4) |
+    (*firmware.debug_force_sd << 5) | (firmware.debug->in_process << 6);
+  states_reached[state]++;
+}
+
+static bool key_on(void){
+  return vhal_input(WAVE_KEY)/ADC_VREF*4096.0 > KEY_THRESHOLD_COUNTS;
+}
+
+//Everything that is checked whenever the firmware goes idle.
+static void observe(uint64_t now){
+  uint32_t outputs = vhal_outputs();
+  jetson_update(&model, now, outputs);
+  if (stalled && (result->reboots != stall_reboots)){
+    stalled = false;
+    invariants_pause(&checks, now, false);
+  }
+  invariants_tick(&checks, now, outputs, key_on(), vhal_input(WAVE_IN2) >= 0.5);
+  check_invariants();
+  check_timers();
+  check_shutdown();
+  record_state();
+}
+
+static uint8_t take_byte(void){
+  return input_next < input_size ? input[input_next++] : 0;
+}
+
+//Reads and applies the next action, false when there are none left.
+static bool next_action(uint64_t now){
+  if ((input_next >= input_size) || (now > INPUT_TIME_LIMIT)){
+    return false;
+  }
+  int action = take_byte() % ACTION_COUNT;
+  uint8_t argument = take_byte();
+  result->actions++;
+  if (trace){
+    print_time(trace, now);
+  }
+  switch (action){
+    case ACTION_KEY: {
+      double volts = key_levels[argument % count_of(key_levels)];
+      vhal_override(WAVE_KEY, volts);
+      if (trace){
+        fprintf(trace, "key %.2f V\n", volts);
+      }
+      break;
+    }
+    case ACTION_PIN: {
+      int pin = argument % count_of(pin_channels);
+      pin_values[pin] = 1.0 - pin_values[pin];
+      vhal_override(pin_channels[pin], pin_values[pin]);
+      if (trace){
+        fprintf(trace, "pin %d -> %.0f\n", pin, pin_values[pin]);
+      }
+      break;
+    }
+    case ACTION_CONSOLE: {
+      char c = argument < 0xe0 ? console_bytes[argument % (sizeof(console_bytes)-1)] : (char)argument;
+      vhal_feed_input(&c, 1);
+      if (trace){
+        fprintf(trace, (c >= ' ') && (c < 0x7f) ? "send '%c'\n" : "send 0x%02x\n", (uint8_t)c);
+      }
+      break;
+    }
+    case ACTION_WINDOWS:
+      run_until = now + (uint64_t)(argument % 32 + 1)*50000;
+      if (trace){
+        fprintf(trace, "run %d windows\n", argument % 32 + 1);
+      }
+      break;
+    case ACTION_JUMP: {
+      uint64_t jump_ms = ((uint64_t)argument << 8) | take_byte();
+      //The firmware stalls through the jump, so it does not count
+      //towards the time limits of the invariants
+      invariants_pause(&checks, now, true);
+      uint64_t deadline;
+      stalled = vhal_watchdog_deadline(&deadline) && (deadline <= now + jump_ms*1000);
+      stall_reboots = result->reboots;
+      vhal_advance_to(now + jump_ms*1000);
+      if (!stalled){
+        invariants_pause(&checks, now + jump_ms*1000, false);
+      }
+      if (trace){
+        fprintf(trace, "jump %llu ms\n", (unsigned long long)jump_ms);
+      }
+      break;
+    }
+    case ACTION_RUN:
+      run_until = now + SECONDS(argument + 1);
+      if (trace){
+        fprintf(trace, "run %d s\n", argument + 1);
+      }
+      break;
+    case ACTION_JETSON:
+      jetson_set_behaviour(&model, (jetson_behaviour)(argument % JETSON_BEHAVIOUR_COUNT));
+      if (trace){
+        fprintf(trace, "jetson %s\n", jetson_behaviour_name(model.behaviour));
+      }
+      break;
+    case ACTION_WATCHDOG: {
+      uint64_t deadline;
+      if (vhal_watchdog_deadline(&deadline)){
+        run_until = deadline;
+      }
+      if (trace){
+        fprintf(trace, "wait for the watchdog\n");
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+static uint64_t earliest(uint64_t a, uint64_t b){
+  return a < b ? a : b;
+}
+
+static void idle(void){
+  uint64_t now = vhal_time_us();
+  observe(now);
+  if (vhal_input_pending()){
+    return;
+  }
+  if (now >= run_until){
+    if (next_action(now)){
+      return;
+    }
+    if (settling){
+      longjmp(run_jump, 1);
+    }
+    settling = true;
+    run_until = now + SETTLE_TIME;
+    if (trace){
+      print_time(trace, now);
+      fprintf(trace, "settle\n");
+    }
+  }
+  uint64_t target = earliest(firmware_next_window(now), run_until);
+  target = earliest(target, jetson_next_event(&model));
+  uint64_t deadline;
+  if (vhal_watchdog_deadline(&deadline)){
+    target = earliest(target, deadline);
+  }
+  vhal_advance_to(target > now ? target : now + 1);
+}
+
+static void output(const uint8_t *data, size_t length){
+  if (!trace){
+    return;
+  }
+  for (size_t i = 0; i < length; i++){
+    char c = (char)data[i];
+    if (c == '\r'){
+      continue;
+    }
+    if ((c != '\n') && (console_length < sizeof(console_line)-1)){
+      console_line[console_length++] = (c >= ' ') && (c < 0x7f) ? c : '.';
+      continue;
+    }
+    if (c == '\n'){
+      console_line[console_length] = 0;
+      console_length = 0;
+      print_time(trace, vhal_time_us());
+      fprintf(trace, "< %s\n", console_line);
+    }
+  }
+}
+
+static void outputs_changed(uint32_t before, uint32_t after){
+  uint64_t now = vhal_time_us();
+  invariants_outputs(&checks, now, before, after, &model);
+  if (trace && ((before ^ after) & ~((1u << BUILT_IN_LED) | (1u << MUX_S2) | (1u << MUX_S1) | (1u << MUX_S0)))){
+    print_time(trace, now);
+    fprintf(trace, "outputs %08lx -> %08lx\n", (unsigned long)before, (unsigned long)after);
+  }
+  check_invariants();
+}
+
+static void reboot(void){
+  longjmp(boot_jump, 1);
+}
+
+void fuzz_init(const char *module_path){
+  firmware_load(module_path);
+  firmware.sd_now = firmware_symbol("sd_now");
+  firmware.engage = firmware_symbol("engage");
+  firmware.debug = firmware_symbol("debug");
+  firmware.early_start = firmware_symbol("early_start");
+  firmware.end_sd = firmware_symbol("end_sd");
+  firmware.coordinated_sd = firmware_symbol("coordinated_sd");
+  firmware.debug_force_sd = firmware_symbol("debug_force_sd");
+  firmware.debug_time = firmware_symbol("debug_time");
+  firmware.shed_pins = (uint32_t (*)(void))firmware_symbol("output_shed_pins");
+  vhal_config config = {
+    .virtual_time = true,
+    .reboot = reboot,
+    .idle = idle,
+    .output = output,
+    .outputs_changed = outputs_changed,
+  };
+  static wave_set waves;
+  wave_set_init(&waves);
+  config.waves = &waves;
+  vhal_configure(&config);
+}
+
+bool fuzz_run(const uint8_t *data, size_t size, fuzz_result *run_result){
+  memset(run_result, 0, sizeof(*run_result));
+  result = run_result;
+  input = data;
+  input_size = size;
+  input_next = 0;
+  run_until = 0;
+  settling = false;
+  in_shutdown = false;
+  stalled = false;
+  console_length = 0;
+  pin_values[0] = pin_values[1] = pin_values[2] = 0;
+  pin_values[3] = 1;
+  vhal_reset();
+  invariants_init(&checks, trace);
+  checks.shed_pins = firmware.shed_pins;
+  jetson_init(&model, JETSON_COOPERATIVE, 1);
+  if (setjmp(run_jump)){
+    return !result->failed;
+  }
+  bool watchdog_reboot = false;
+  if (setjmp(boot_jump)){
+    result->reboots++;
+    watchdog_reboot = true;
+    if (trace){
+      print_time(trace, vhal_time_us());
+      fprintf(trace, "watchdog reboot\n");
+    }
+  }
+  firmware_restore();
+  vhal_boot(watchdog_reboot);
+  firmware_run();
+  return true;
+}
+
+void fuzz_report_states(FILE *out){
+  int reached = 0;
+  fprintf(out, "sd_now engage early_start end_sd coordinated_sd debug_force_sd debug: times reached\n");
+  for (int state = 0; state < 128; state++){
+    if (!states_reached[state]){
+      continue;
+    }
+    reached++;
+    for (int bit = 0; bit < 7; bit++){
+      fprintf(out, "%d", (state >> bit) & 1);
+    }
+    fprintf(out, ": %llu\n", (unsigned long long)states_reached[state]);
+  }
+  fprintf(out, "%d of 128 flag combinations reached\n", reached);
+}
@@ -0,0 +1,64 @@
+#ifndef FUZZ_HARNESS_H
+#define FUZZ_HARNESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "invariants.h"
+
+//Property-based fuzzing of the power state machine and the console.
+//An input is read as a list of actions, an opcode byte followed by
+//its arguments:
+//
+//  0 level   key voltage from a table around the 1000 count threshold
+//  1 pin     toggle IN0, IN1, IN2 or the auxiliary switch
+//  2 byte    a console byte, mostly commands like 'd', 'K' and 'R'
+//  3 n       run n+1 state machine windows (50 ms each)
+//  4 hi lo   jump the clock by hi:lo milliseconds in one step
+//  5 n       run for n+1 seconds
+//  6 b       Jetson behaviour from the next power up
+//  7 -       run until the watchdog fires, if it is armed
+//
+//The opcode is the first byte modulo 8. After the last action the
+//board runs on for a while so lockups can show. The firmware is reset
+//between inputs by restoring its data, and on watchdog reboots within
+//an input.
+
+//Everything that is checked. The sim invariants come first, see
+//invariants.h, then the properties that look inside the firmware.
+typedef enum fuzz_property {
+  //time -= engage.start_time in evaluate_state, input_time -
+  //sd_now.start_time in shutdown_process or time_us_64() - debug_time
+  //would come out negative
+  PROP_TIMER_UNDERFLOW = INV_COUNT,
+  //sd_now.in_process for longer than the forced shutdown takes
+  PROP_STUCK_SHUTDOWN,
+  PROP_COUNT
+} fuzz_property;
+
+typedef struct fuzz_result {
+  bool failed;
+  int property;
+  char detail[160];
+  uint64_t time_us;
+  size_t actions;
+  uint64_t reboots;
+} fuzz_result;
+
+//Loads the firmware module and takes over the virtual HAL.
+void fuzz_init(const char *module_path);
+//Comma separated property names that are not reported, for known
+//findings that would otherwise hide everything else.
+bool fuzz_ignore(const char *names);
+//Writes the actions, console output and output changes of each run.
+void fuzz_set_trace(FILE *trace);
+//Runs one input, returns false if a property failed.
+bool fuzz_run(const uint8_t *data, size_t size, fuzz_result *result);
+const char *fuzz_property_name(int property);
+//Which combinations of the state machine flags were reached over all
+//runs so far.
+void fuzz_report_states(FILE *out);
+
+#endif
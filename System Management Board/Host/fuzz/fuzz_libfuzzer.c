@@ -0,0 +1,40 @@
+//libFuzzer entry points, used when the host tools are built with
+//clang:
+//
+//  smb_fuzz -max_len=512 corpus/
+//  SMB_FUZZ_TRACE=1 smb_fuzz crash-...
+//
+//SMB_FUZZ_IGNORE takes a comma separated list of properties that are
+//not reported, like timer_underflow.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fuzz_harness.h"
+
+static void report_states(void){
+  fuzz_report_states(stderr);
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv){
+  fuzz_init(SMB_FIRMWARE_MODULE);
+  const char *ignore = getenv("SMB_FUZZ_IGNORE");
+  if (ignore && !fuzz_ignore(ignore)){
+    exit(2);
+  }
+  if (getenv("SMB_FUZZ_TRACE")){
+    fuzz_set_trace(stderr);
+  }
+  atexit(report_states);
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+  fuzz_result result;
+  if (!fuzz_run(data, size, &result)){
+    fprintf(stderr, "fuzz: %s at %.3f s after %zu actions and %llu reboots: %s\n",
+      fuzz_property_name(result.property), (double)result.time_us/1e6, result.actions,
+      (unsigned long long)result.reboots, result.detail);
+    abort();
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+//Standalone driver for the fuzz harness when libFuzzer is not
+//available. It runs random inputs, shrinks the first one that fails
+//and writes it out, or replays input files with a trace:
+//
+//  smb_fuzz [-runs=N] [-seed=N] [-max_len=N] [-ignore=P,P] [-keep_going=1]
+//  smb_fuzz crash-1-42
+//
+//The flags follow libFuzzer's so the same commands work with either
+//build.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fuzz_harness.h"
+#include "sim_random.h"
+
+static uint64_t failures[PROP_COUNT];
+//The real stdout, the firmware gets stdout itself
+static FILE *out;
+
+static bool flag(const char *arg, const char *name, const char **value){
+  size_t length = strlen(name);
+  if ((strncmp(arg, name, length) == 0) && (arg[length] == '=')){
+    *value = arg + length + 1;
+    return true;
+  }
+  return false;
+}
+
+static bool fails_with(const uint8_t *data, size_t size, int property){
+  fuzz_result result;
+  return !fuzz_run(data, size, &result) && (result.property == property);
+}
+
+//Removes ever smaller chunks of the input while it still fails the
+//same way.
+static size_t shrink(uint8_t *data, size_t size, int property){
+  uint8_t *candidate = malloc(size);
+  for (size_t chunk = size/2; chunk > 0; chunk /= 2){
+    size_t start = 0;
+    while (start + chunk <= size){
+      memcpy(candidate, data, start);
+      memcpy(candidate + start, data + start + chunk, size - start - chunk);
+      if (fails_with(candidate, size - chunk, property)){
+        size -= chunk;
+        memcpy(data, candidate, size);
+      } else {
+        start += chunk;
+      }
+    }
+  }
+  free(candidate);
+  return size;
+}
+
+static int replay(const char *path){
+  FILE *file = fopen(path, "rb");
+  if (!file){
+    perror(path);
+    return 2;
+  }
+  static uint8_t data[1 << 16];
+  size_t size = fread(data, 1, sizeof(data), file);
+  fclose(file);
+  fuzz_set_trace(out);
+  fuzz_result result;
+  bool passed = fuzz_run(data, size, &result);
+  fuzz_set_trace(NULL);
+  fprintf(out, "%s: %s\n", path, passed ? "passed" : fuzz_property_name(result.property));
+  fflush(out);
+  return passed ? 0 : 1;
+}
+
+int main(int argc, char *argv[]){
+  uint64_t runs = 10000;
+  uint32_t seed = 1;
+  size_t max_len = 256;
+  bool keep_going = false;
+  int files = 0;
+  out = fdopen(dup(STDOUT_FILENO), "w");
+  fuzz_init(SMB_FIRMWARE_MODULE);
+  for (int i = 1; i < argc; i++){
+    const char *value;
+    if (flag(argv[i], "-runs", &value)){
+      runs = strtoull(value, NULL, 0);
+    } else if (flag(argv[i], "-seed", &value)){
+      seed = (uint32_t)strtoul(value, NULL, 0);
+    } else if (flag(argv[i], "-max_len", &value)){
+      max_len = strtoul(value, NULL, 0);
+    } else if (flag(argv[i], "-ignore", &value)){
+      if (!fuzz_ignore(value)){
+        return 2;
+      }
+    } else if (flag(argv[i], "-keep_going", &value)){
+      keep_going = atoi(value) != 0;
+    } else if (argv[i][0] == '-'){
+      fprintf(stderr, "fuzz: unknown flag %s\n", argv[i]);
+      return 2;
+    } else {
+      files++;
+    }
+  }
+  if (files){
+    int status = 0;
+    for (int i = 1; i < argc; i++){
+      if (argv[i][0] != '-'){
+        int file_status = replay(argv[i]);
+        status = file_status > status ? file_status : status;
+      }
+    }
+    return status;
+  }
+  if (max_len < 2){
+    max_len = 2;
+  }
+
+  uint32_t rng = seed ? seed : 1;
+  uint8_t *data = malloc(max_len);
+  uint64_t failed = 0;
+  uint64_t run;
+  for (run = 0; run < runs; run++){
+    size_t size = 2 + sim_random(&rng) % (max_len - 1);
+    for (size_t i = 0; i < size; i++){
+      data[i] = (uint8_t)sim_random(&rng);
+    }
+    fuzz_result result;
+    if (fuzz_run(data, size, &result)){
+      continue;
+    }
+    failed++;
+    failures[result.property]++;
+    if (failures[result.property] > 1){
+      continue;
+    }
+    size = shrink(data, size, result.property);
+    char path[64];
+    snprintf(path, sizeof(path), "crash-%lu-%llu", (unsigned long)seed, (unsigned long long)run);
+    FILE *file = fopen(path, "wb");
+    if (file){
+      fwrite(data, 1, size, file);
+      fclose(file);
+    }
+    fprintf(stderr, "fuzz: run %llu: %s: %s, %zu bytes written to %s\n", (unsigned long long)run,
+      fuzz_property_name(result.property), result.detail, size, path);
+    if (!keep_going){
+      run++;
+      break;
+    }
+  }
+  fprintf(stderr, "\n%llu runs, %llu failed\n", (unsigned long long)run, (unsigned long long)failed);
+  for (int i = 0; i < PROP_COUNT; i++){
+    if (failures[i]){
+      fprintf(stderr, "  %-18s %llu\n", fuzz_property_name(i), (unsigned long long)failures[i]);
+    }
+  }
+  fuzz_report_states(stderr);
+  free(data);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+#include "smb_capture.h"
+
+#include <cmath>
+
+namespace smb {
+
+//capture_format in capture.h
+static constexpr uint8_t format_raw = 0;
+static constexpr uint8_t format_rle = 1;
+static constexpr uint32_t no_trigger = 0xffffffff;
+
+std::optional<CaptureHeader> parse_capture_header(const BinaryFrame &frame) {
+  if (frame.tag != "LAH1" || !frame.crc_ok || frame.payload.size() != 36) return std::nullopt;
+  const uint8_t *data = frame.payload.data();
+  CaptureHeader header;
+  header.version = data[0];
+  header.format = data[1];
+  header.base = data[2];
+  header.width = data[3];
+  header.pins = read_u32(data + 4);
+  header.rate_hz = read_u32(data + 8);
+  header.samples = read_u32(data + 12);
+  uint32_t trigger = read_u32(data + 16);
+  if (trigger != no_trigger) header.trigger_sample = trigger;
+  header.data_bytes = read_u32(data + 20);
+  header.chunk_bytes = read_u16(data + 24);
+  header.trigger = data[26];
+  header.trigger_mask = read_u32(data + 28);
+  header.trigger_value = read_u32(data + 32);
+  if (header.width == 0 || header.width > 32 || (32 % header.width) != 0) return std::nullopt;
+  return header;
+}
+
+std::optional<std::pair<uint32_t, std::vector<uint8_t>>> parse_capture_chunk(const BinaryFrame &frame) {
+  if (frame.tag != "LAD1" || !frame.crc_ok || frame.payload.size() < 4) return std::nullopt;
+  return std::make_pair(read_u32(frame.payload.data()),
+                        std::vector<uint8_t>(frame.payload.begin() + 4, frame.payload.end()));
+}
+
+std::optional<std::vector<CaptureChange>> decode_capture(const CaptureHeader &header,
+                                                         const std::vector<uint8_t> &data) {
+  if (data.size() != header.data_bytes) return std::nullopt;
+  uint32_t value_mask = header.width == 32 ? 0xffffffffu : (1u << header.width) - 1;
+  uint32_t pins = (header.pins >> header.base) & value_mask;
+  std::vector<CaptureChange> changes;
+  auto add = [&](uint64_t sample, uint32_t value) {
+    uint32_t gpio = uint32_t(uint64_t(value & pins) << header.base);
+    if (changes.empty() || changes.back().pins != gpio) changes.push_back({sample, gpio});
+  };
+  uint64_t sample = 0;
+  if (header.format == format_raw) {
+    size_t per_word = 32 / header.width;
+    for (size_t word = 0; word + 4 <= data.size(); word += 4) {
+      uint32_t bits = read_u32(data.data() + word);
+      for (size_t i = 0; i < per_word; i++, sample++) {
+        add(sample, (bits >> (i * header.width)) & value_mask);
+      }
+    }
+  } else if (header.format == format_rle) {
+    size_t value_bytes = (header.width + 7) / 8;
+    size_t at = 0;
+    while (at < data.size()) {
+      if (at + value_bytes > data.size()) return std::nullopt;
+      uint32_t value = 0;
+      for (size_t i = 0; i < value_bytes; i++) value |= uint32_t(data[at + i]) << (8 * i);
+      at += value_bytes;
+      uint64_t run = 0;
+      for (int shift = 0;; shift += 7) {
+        if (at >= data.size() || shift > 28) return std::nullopt;
+        uint8_t byte = data[at++];
+        run |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+      }
+      add(sample, value);
+      sample += run;
+    }
+  } else {
+    return std::nullopt;
+  }
+  if (sample != header.samples) return std::nullopt;
+  return changes;
+}
+
+//VCD identifiers are short printable strings.
+static std::string vcd_id(size_t index) {
+  std::string id;
+  do {
+    id += char('!' + index % 94);
+    index /= 94;
+  } while (index);
+  return id;
+}
+
+void write_vcd(std::ostream &out, const Capture &capture, std::string (*pin_name)(int gpio)) {
+  const CaptureHeader &header = capture.header;
+  std::vector<int> gpios;
+  for (int gpio = 0; gpio < 32; gpio++) {
+    if (header.pins & (1u << gpio)) gpios.push_back(gpio);
+  }
+  std::string trigger_id = vcd_id(gpios.size());
+  out << "$version smbvcd $end\n";
+  out << "$comment " << header.samples << " samples at " << header.rate_hz << " Hz $end\n";
+  out << "$timescale 1ns $end\n";
+  out << "$scope module smb $end\n";
+  for (size_t i = 0; i < gpios.size(); i++) {
+    out << "$var wire 1 " << vcd_id(i) << " " << pin_name(gpios[i]) << " $end\n";
+  }
+  out << "$var wire 1 " << trigger_id << " trigger $end\n";
+  out << "$upscope $end\n$enddefinitions $end\n";
+
+  auto time_ns = [&](uint64_t sample) {
+    return uint64_t(std::llround(double(sample) * 1e9 / header.rate_hz));
+  };
+  //The initial values, then the changes with the trigger merged in
+  //in time order
+  bool trigger_pending = header.trigger_sample.has_value();
+  uint32_t last = 0;
+  for (size_t c = 0; c < capture.changes.size(); c++) {
+    const CaptureChange &change = capture.changes[c];
+    if (trigger_pending && *header.trigger_sample < change.sample) {
+      out << "#" << time_ns(*header.trigger_sample) << "\n1" << trigger_id << "\n";
+      trigger_pending = false;
+    }
+    out << "#" << time_ns(change.sample) << "\n";
+    if (c == 0) out << "$dumpvars\n";
+    for (size_t i = 0; i < gpios.size(); i++) {
+      uint32_t bit = 1u << gpios[i];
+      if (c == 0 || ((change.pins ^ last) & bit)) out << ((change.pins & bit) ? "1" : "0") << vcd_id(i) << "\n";
+    }
+    if (trigger_pending && *header.trigger_sample == change.sample) {
+      out << "1" << trigger_id << "\n";
+      trigger_pending = false;
+    } else if (c == 0) {
+      out << "0" << trigger_id << "\n";
+    }
+    if (c == 0) out << "$end\n";
+    last = change.pins;
+  }
+  if (trigger_pending) out << "#" << time_ns(*header.trigger_sample) << "\n1" << trigger_id << "\n";
+  out << "#" << time_ns(header.samples) << "\n";
+}
+
+}  // namespace smb
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "smb_protocol.h"
+
+//Logic analyzer captures read with "cap read", see capture.h in the
+//firmware for the frame layouts.
+namespace smb {
+
+struct CaptureHeader {
+  uint8_t version = 0;
+  uint8_t format = 0;
+  uint8_t base = 0;
+  uint8_t width = 0;
+  uint32_t pins = 0;
+  uint32_t rate_hz = 0;
+  uint32_t samples = 0;
+  std::optional<uint32_t> trigger_sample;
+  uint32_t data_bytes = 0;
+  uint16_t chunk_bytes = 0;
+  uint8_t trigger = 0;
+  uint32_t trigger_mask = 0;
+  uint32_t trigger_value = 0;
+  size_t chunks() const { return chunk_bytes ? (data_bytes + chunk_bytes - 1) / chunk_bytes : 0; }
+};
+
+//A point where any captured pin changes. pins holds the GPIO bank,
+//so bit i is GPIO i, limited to the pins asked for.
+struct CaptureChange {
+  uint64_t sample = 0;
+  uint32_t pins = 0;
+};
+
+struct Capture {
+  CaptureHeader header;
+  std::vector<CaptureChange> changes;
+};
+
+std::optional<CaptureHeader> parse_capture_header(const BinaryFrame &frame);
+//The chunk number and data of an "LAD1" frame.
+std::optional<std::pair<uint32_t, std::vector<uint8_t>>> parse_capture_chunk(const BinaryFrame &frame);
+//Turns the data of all chunks in order into changes, the first at
+//sample 0. Fails if the data does not match the header.
+std::optional<std::vector<CaptureChange>> decode_capture(const CaptureHeader &header,
+                                                         const std::vector<uint8_t> &data);
+
+//Writes the capture as a Value Change Dump, one wire per pin named by
+//pin_name(gpio), plus a "trigger" wire that rises at the trigger.
+void write_vcd(std::ostream &out, const Capture &capture, std::string (*pin_name)(int gpio));
+
+}  // namespace smb
@@ -0,0 +1,313 @@
+#include "smb_client.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <system_error>
+
+namespace smb {
+
+const char *const default_socket_path = "/run/smbd.sock";
+
+//Reads one '\n' terminated line starting at pos. Returns false if the
+//line is not complete yet.
+static bool next_line(const std::string &buffer, size_t &pos, std::string &line) {
+  size_t end = buffer.find('\n', pos);
+  if (end == std::string::npos) return false;
+  line = buffer.substr(pos, end - pos);
+  pos = end + 1;
+  return true;
+}
+
+//Takes one whole reply off the front of pending_, or leaves pending_
+//alone and returns false if it has not all arrived.
+bool ResponseParser::take(std::vector<Response> &responses) {
+  size_t pos = 0;
+  std::string header;
+  if (!next_line(pending_, pos, header)) return false;
+  std::istringstream fields(header);
+  std::string id;
+  size_t line_count = 0, frame_count = 0;
+  Response response;
+  fields >> id >> response.status >> line_count >> frame_count;
+  response.id = id == "*" ? 0 : std::stoull(id);
+  for (size_t i = 0; i < line_count; i++) {
+    std::string line;
+    if (!next_line(pending_, pos, line)) return false;
+    response.lines.push_back(line);
+  }
+  for (size_t i = 0; i < frame_count; i++) {
+    std::string frame_header;
+    if (!next_line(pending_, pos, frame_header)) return false;
+    std::istringstream frame_fields(frame_header);
+    BinaryFrame frame;
+    size_t length = 0;
+    int crc_ok = 0;
+    frame_fields >> frame.tag >> length >> crc_ok;
+    if (pending_.size() < pos + length) return false;
+    frame.payload.assign(pending_.begin() + pos, pending_.begin() + pos + length);
+    frame.crc_ok = crc_ok != 0;
+    pos += length;
+    response.frames.push_back(std::move(frame));
+  }
+  pending_.erase(0, pos);
+  responses.push_back(std::move(response));
+  return true;
+}
+
+void ResponseParser::feed(const char *data, size_t length, std::vector<Response> &responses) {
+  pending_.append(data, length);
+  while (take(responses)) {
+  }
+}
+
+Client::Client(const std::string &socket_path) {
+  fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "socket");
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  if (connect(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+    int error = errno;
+    close(fd_);
+    throw std::system_error(error, std::generic_category(), "connect " + socket_path);
+  }
+  reader_thread_ = std::thread(&Client::reader, this);
+}
+
+Client::~Client() {
+  shutdown(fd_, SHUT_RDWR);
+  if (reader_thread_.joinable()) reader_thread_.join();
+  close(fd_);
+}
+
+//Delivers replies to their futures and events to the handler. When
+//the daemon goes away every outstanding request fails.
+void Client::reader() {
+  ResponseParser parser;
+  char buffer[4096];
+  while (true) {
+    ssize_t count = recv(fd_, buffer, sizeof(buffer), 0);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) break;
+    std::vector<Response> responses;
+    parser.feed(buffer, size_t(count), responses);
+    for (auto &response : responses) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (response.status == "event") {
+        EventHandler handler = event_handler_;
+        lock.unlock();
+        if (handler) handler(response);
+        continue;
+      }
+      auto entry = waiting_.find(response.id);
+      if (entry == waiting_.end()) continue;
+      entry->second.set_value(std::move(response));
+      waiting_.erase(entry);
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : waiting_) {
+    Response response;
+    response.id = entry.first;
+    response.status = "disconnected";
+    entry.second.set_value(std::move(response));
+  }
+  waiting_.clear();
+}
+
+std::future<Response> Client::send(const std::string &command) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t id = next_id_++;
+  std::promise<Response> promise;
+  std::future<Response> future = promise.get_future();
+  std::string line = std::to_string(id) + " " + command + "\n";
+  size_t sent = 0;
+  while (sent < line.size()) {
+    ssize_t count = ::send(fd_, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) {
+      Response response;
+      response.id = id;
+      response.status = "disconnected";
+      promise.set_value(std::move(response));
+      return future;
+    }
+    sent += size_t(count);
+  }
+  waiting_.emplace(id, std::move(promise));
+  return future;
+}
+
+Response Client::request(const std::string &command, std::chrono::milliseconds timeout) {
+  std::future<Response> future = send(command);
+  if (future.wait_for(timeout) != std::future_status::ready) {
+    Response response;
+    response.status = "timeout";
+    return response;
+  }
+  return future.get();
+}
+
+Response Client::subscribe(EventHandler handler) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    event_handler_ = std::move(handler);
+  }
+  return request("@subscribe");
+}
+
+bool Client::enter_debug() { return request("d").ok(); }
+
+bool Client::exit_debug() { return request("d").ok(); }
+
+std::optional<CurrentReading> Client::read_currents() {
+  Response response = request("U");
+  if (!response.ok()) return std::nullopt;
+  return parse_currents(response.lines);
+}
+
+std::optional<Temperatures> Client::read_temperatures() {
+  Response response = request("T");
+  if (!response.ok()) return std::nullopt;
+  return parse_temperatures(response.lines);
+}
+
+std::optional<InputPins> Client::read_inputs() {
+  Response response = request("I");
+  if (!response.ok()) return std::nullopt;
+  return parse_inputs(response.lines);
+}
+
+std::optional<MuxReading> Client::read_mux(int channel) {
+  Response response = request(channel < 0 ? std::string("V") : "V " + std::to_string(channel));
+  if (!response.ok()) return std::nullopt;
+  return parse_mux(response.lines, channel);
+}
+
+std::optional<uint32_t> Client::reference_time() {
+  Response response = request("T");
+  if (!response.ok()) return std::nullopt;
+  return parse_reference_time(response.lines);
+}
+
+std::optional<LoopLatency> Client::loop_latency() {
+  Response response = request("L");
+  if (!response.ok()) return std::nullopt;
+  return parse_loop_latency(response.lines);
+}
+
+std::optional<EnergyReading> Client::read_energy() {
+  Response response = request("tte");
+  if (!response.ok()) return std::nullopt;
+  return parse_energy(response.lines);
+}
+
+std::optional<ProbeTable> Client::read_probes() {
+  Response response = request("P");
+  if (!response.ok()) return std::nullopt;
+  for (const auto &frame : response.frames) {
+    if (auto table = parse_probe_table(frame)) return table;
+  }
+  return std::nullopt;
+}
+
+std::optional<PowerQuality> Client::read_power_quality() {
+  Response response = request("pq frame");
+  if (!response.ok()) return std::nullopt;
+  for (const auto &frame : response.frames) {
+    if (auto quality = parse_power_quality(frame)) return quality;
+  }
+  return std::nullopt;
+}
+
+std::optional<Rollups> Client::read_rollups(RollupResolution resolution, size_t buckets) {
+  static const char *const names[] = {"1s", "1m", "1h"};
+  std::string command = std::string("roll read ") + names[int(resolution)];
+  if (buckets) command += " " + std::to_string(buckets);
+  Response response = request(command);
+  if (!response.ok()) return std::nullopt;
+  for (const auto &frame : response.frames) {
+    if (auto rollups = parse_rollups(frame)) return rollups;
+  }
+  return std::nullopt;
+}
+
+std::optional<Capture> Client::read_capture() {
+  Response response = request("cap read");
+  if (!response.ok()) return std::nullopt;
+  Capture capture;
+  std::optional<CaptureHeader> header;
+  for (const auto &frame : response.frames) {
+    if ((header = parse_capture_header(frame))) break;
+  }
+  if (!header) return std::nullopt;
+  capture.header = *header;
+  std::vector<std::future<Response>> replies;
+  for (size_t i = 0; i < header->chunks(); i++) replies.push_back(send("cap read " + std::to_string(i)));
+  std::vector<uint8_t> data;
+  for (size_t i = 0; i < replies.size(); i++) {
+    Response chunk_response = replies[i].get();
+    if (!chunk_response.ok() || chunk_response.frames.empty()) return std::nullopt;
+    auto chunk = parse_capture_chunk(chunk_response.frames.front());
+    if (!chunk || chunk->first != i) return std::nullopt;
+    data.insert(data.end(), chunk->second.begin(), chunk->second.end());
+  }
+  auto changes = decode_capture(*header, data);
+  if (!changes) return std::nullopt;
+  capture.changes = std::move(*changes);
+  return capture;
+}
+
+std::optional<FlightRecord> Client::read_flight_record() {
+  Response response = request("fr read");
+  if (!response.ok()) return std::nullopt;
+  FlightRecord record;
+  std::optional<FlightHeader> header;
+  for (const auto &frame : response.frames) {
+    if ((header = parse_flight_header(frame))) break;
+  }
+  if (!header) return std::nullopt;
+  record.header = *header;
+  std::vector<std::future<Response>> replies;
+  for (size_t i = 0; i < header->chunks(); i++) replies.push_back(send("fr read " + std::to_string(i)));
+  for (size_t i = 0; i < replies.size(); i++) {
+    Response chunk_response = replies[i].get();
+    if (!chunk_response.ok() || chunk_response.frames.empty()) return std::nullopt;
+    auto chunk = parse_flight_chunk(chunk_response.frames.front());
+    if (!chunk || chunk->first != i || chunk->second.size() != header->chunk_bytes[i]) return std::nullopt;
+    size_t samples = std::min(flight_chunk_samples, header->samples - flight_chunk_samples * i);
+    if (!decode_flight_chunk(chunk->second, samples, record.samples)) return std::nullopt;
+  }
+  return record;
+}
+
+std::optional<Scope> Client::read_scope() {
+  Response response = request("scope read");
+  if (!response.ok()) return std::nullopt;
+  Scope scope;
+  std::optional<ScopeHeader> header;
+  for (const auto &frame : response.frames) {
+    if ((header = parse_scope_header(frame))) break;
+  }
+  if (!header) return std::nullopt;
+  scope.header = *header;
+  std::vector<std::future<Response>> replies;
+  for (size_t i = 0; i < header->chunks(); i++) replies.push_back(send("scope read " + std::to_string(i)));
+  for (size_t i = 0; i < replies.size(); i++) {
+    Response chunk_response = replies[i].get();
+    if (!chunk_response.ok() || chunk_response.frames.empty()) return std::nullopt;
+    auto chunk = parse_scope_chunk(chunk_response.frames.front());
+    if (!chunk || chunk->first != i) return std::nullopt;
+    scope.samples.insert(scope.samples.end(), chunk->second.begin(), chunk->second.end());
+  }
+  if (scope.samples.size() != header->samples) return std::nullopt;
+  return scope;
+}
+
+}  // namespace smb
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "smb_capture.h"
+#include "smb_protocol.h"
+#include "smb_recorder.h"
+#include "smb_scope.h"
+
+//Client side of the smbd Unix socket.
+//
+//Requests are one line, "<id> <command>\n", where the command is
+//anything the board console accepts (several commands may be joined
+//with ';') or a daemon command starting with '@'. Every request gets
+//exactly one reply, in any order relative to other clients:
+//
+//  <id> <status> <line count> <frame count>\n
+//  <line>\n                       (line count times)
+//  <tag> <length> <crc ok>\n<payload bytes>   (frame count times)
+//
+//status is done, error, timeout, disconnected or invalid. Lines the
+//board prints on its own are sent to subscribed clients with "*" as
+//the id and status "event".
+namespace smb {
+
+extern const char *const default_socket_path;
+
+struct Response {
+  uint64_t id = 0;
+  std::string status;
+  std::vector<std::string> lines;
+  std::vector<BinaryFrame> frames;
+  bool ok() const { return status == "done"; }
+};
+
+//Incrementally parses replies from the daemon.
+class ResponseParser {
+ public:
+  //Returns the complete replies contained in the bytes fed so far.
+  void feed(const char *data, size_t length, std::vector<Response> &responses);
+
+ private:
+  bool take(std::vector<Response> &responses);
+  std::string pending_;
+};
+
+class Client {
+ public:
+  using EventHandler = std::function<void(const Response &)>;
+
+  //Connects to the daemon. Throws std::system_error on failure.
+  explicit Client(const std::string &socket_path = default_socket_path);
+  ~Client();
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  //Queues a command without waiting, so many can be in flight at once.
+  std::future<Response> send(const std::string &command);
+  //Sends and waits. A reply that does not arrive in time has status
+  //"timeout".
+  Response request(const std::string &command,
+                   std::chrono::milliseconds timeout = std::chrono::milliseconds(5000));
+
+  //Events are delivered on the client's reader thread.
+  Response subscribe(EventHandler handler);
+
+  //Typed helpers. Readings other than reference_time, loop_latency
+  //read_energy and read_power_quality need the board in debug mode
+  //(enter_debug).
+  bool enter_debug();
+  bool exit_debug();
+  std::optional<CurrentReading> read_currents();
+  std::optional<Temperatures> read_temperatures();
+  std::optional<InputPins> read_inputs();
+  std::optional<MuxReading> read_mux(int channel = -1);
+  std::optional<uint32_t> reference_time();
+  std::optional<LoopLatency> loop_latency();
+  std::optional<EnergyReading> read_energy();
+  std::optional<ProbeTable> read_probes();
+  std::optional<PowerQuality> read_power_quality();
+  //Reads the last buckets of a resolution, all the board keeps if
+  //buckets is 0, in one frame.
+  std::optional<Rollups> read_rollups(RollupResolution resolution, size_t buckets = 0);
+  //Reads a finished logic analyzer capture, chunk requests pipelined.
+  std::optional<Capture> read_capture();
+  //Reads the flight recorder's frozen recording, chunk requests
+  //pipelined.
+  std::optional<FlightRecord> read_flight_record();
+  //Reads a finished scope burst, chunk requests pipelined.
+  std::optional<Scope> read_scope();
+
+ private:
+  void reader();
+
+  int fd_ = -1;
+  std::thread reader_thread_;
+  std::mutex mutex_;
+  uint64_t next_id_ = 1;
+  std::map<uint64_t, std::promise<Response>> waiting_;
+  EventHandler event_handler_;
+};
+
+}  // namespace smb
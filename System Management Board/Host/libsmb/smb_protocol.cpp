@@ -0,0 +1,348 @@
+#include "smb_protocol.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace smb {
+
+uint32_t crc32(const void *data, size_t length, uint32_t crc) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+uint16_t read_u16(const uint8_t *data) {
+  return uint16_t(data[0] | (data[1] << 8));
+}
+
+uint32_t read_u32(const uint8_t *data) {
+  return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) |
+         (uint32_t(data[3]) << 24);
+}
+
+uint64_t read_u64(const uint8_t *data) {
+  return uint64_t(read_u32(data)) | (uint64_t(read_u32(data + 4)) << 32);
+}
+
+static bool is_tag(const uint8_t *data) {
+  for (int i = 0; i < 3; i++) {
+    if (data[i] < 'A' || data[i] > 'Z') return false;
+  }
+  return data[3] >= '0' && data[3] <= '9';
+}
+
+void BoardStream::reset() { pending_.clear(); }
+
+//Takes a frame off the front of pending_ if one is complete. Returns
+//false when more bytes are needed or the front is not a frame.
+bool BoardStream::take_frame(std::vector<Item> &items) {
+  uint32_t length = read_u32(pending_.data() + 4);
+  size_t total = 8 + size_t(length) + 4;
+  if (pending_.size() < total) return false;
+  Item item;
+  item.kind = Item::Kind::frame;
+  item.frame.tag.assign(reinterpret_cast<const char *>(pending_.data()), 4);
+  item.frame.payload.assign(pending_.begin() + 8, pending_.begin() + 8 + length);
+  uint32_t sent_crc = read_u32(pending_.data() + 8 + length);
+  item.frame.crc_ok = sent_crc == crc32(item.frame.payload.data(), length);
+  pending_.erase(pending_.begin(), pending_.begin() + total);
+  items.push_back(std::move(item));
+  return true;
+}
+
+void BoardStream::feed(const uint8_t *data, size_t length, std::vector<Item> &items) {
+  pending_.insert(pending_.end(), data, data + length);
+  while (!pending_.empty()) {
+    //Leftover line endings between a frame and the next line
+    if (pending_[0] == '\r' || pending_[0] == '\n') {
+      pending_.erase(pending_.begin());
+      continue;
+    }
+    size_t newline = 0;
+    while (newline < pending_.size() && newline < 8 && pending_[newline] != '\n') newline++;
+    bool could_be_frame = newline >= 4 && is_tag(pending_.data());
+    if (could_be_frame && pending_.size() < 8) return;
+    if (could_be_frame && read_u32(pending_.data() + 4) <= max_frame) {
+      if (!take_frame(items)) return;
+      continue;
+    }
+    auto end = std::find(pending_.begin(), pending_.end(), uint8_t('\n'));
+    if (end == pending_.end()) return;
+    Item item;
+    item.kind = Item::Kind::line;
+    item.line.assign(pending_.begin(), end);
+    while (!item.line.empty() && item.line.back() == '\r') item.line.pop_back();
+    pending_.erase(pending_.begin(), end + 1);
+    items.push_back(std::move(item));
+  }
+}
+
+static bool quoted_marker(const std::string &line, const char *prefix, const char *suffix,
+                          bool anywhere, std::string *name) {
+  size_t start = anywhere ? line.find(prefix) : (line.rfind(prefix, 0) == 0 ? 0 : std::string::npos);
+  if (start == std::string::npos) return false;
+  size_t name_start = start + strlen(prefix);
+  size_t name_end = line.find(suffix, name_start);
+  if (name_end == std::string::npos) return false;
+  if (name) *name = line.substr(name_start, name_end - name_start);
+  return true;
+}
+
+bool is_done_line(const std::string &line, std::string *name) {
+  return quoted_marker(line, "Input \"", "\": done", true, name);
+}
+
+bool is_error_line(const std::string &line, std::string *name) {
+  if (line.rfind("Error:", 0) == 0) {
+    if (name) name->clear();
+    return true;
+  }
+  return quoted_marker(line, "Error \"", "\":", false, name);
+}
+
+bool is_async_line(const std::string &line) {
+  static const char *const async_lines[] = {
+      "Entering debug mode", "Ready!", "Exiting debug mode", "Auxiliary switch pressed",
+  };
+  for (const char *prefix : async_lines) {
+    if (line.rfind(prefix, 0) == 0) return true;
+  }
+  return false;
+}
+
+bool is_frame_line(const std::string &line, std::string *tag, uint32_t *length) {
+  char text[5];
+  unsigned long size;
+  if (sscanf(line.c_str(), "Frame: %4s %lu", text, &size) != 2 || strlen(text) != 4) return false;
+  if (tag) *tag = text;
+  if (length) *length = uint32_t(size);
+  return true;
+}
+
+const char *const probe_names[] = {
+    "main_loop",    "evaluate_state", "shutdown_process",     "check_input_pattern",
+    "blink_pattern", "read_ADC_MUX",  "current_monitor_read", "parser",
+};
+const size_t probe_name_count = sizeof(probe_names) / sizeof(probe_names[0]);
+
+std::optional<CurrentReading> parse_currents(const std::vector<std::string> &lines) {
+  std::optional<double> comp, sw;
+  for (const auto &line : lines) {
+    double value;
+    if (sscanf(line.c_str(), "Comp I-Monitor: %lfA", &value) == 1) comp = value;
+    if (sscanf(line.c_str(), "Switch I-Monitor: %lfA", &value) == 1) sw = value;
+  }
+  if (!comp || !sw) return std::nullopt;
+  return CurrentReading{*comp, *sw};
+}
+
+std::optional<Temperatures> parse_temperatures(const std::vector<std::string> &lines) {
+  for (const auto &line : lines) {
+    double first, second;
+    //The firmware prints a UTF-8 degree sign, so skip whatever is
+    //between the numbers.
+    char unit[16];
+    if (sscanf(line.c_str(), "%lf%15s %lf", &first, unit, &second) == 3) {
+      return Temperatures{first, second};
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<InputPins> parse_inputs(const std::vector<std::string> &lines) {
+  for (const auto &line : lines) {
+    if (line.size() >= 4 && line[0] == 'I') {
+      bool digits = true;
+      for (int i = 1; i < 4; i++) digits = digits && (line[i] == '0' || line[i] == '1');
+      if (digits) return InputPins{line[3] == '1', line[2] == '1', line[1] == '1'};
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<MuxReading> parse_mux(const std::vector<std::string> &lines, int channel) {
+  for (const auto &line : lines) {
+    int pin;
+    unsigned raw;
+    if (sscanf(line.c_str(), "MUX Pin %d: %u", &pin, &raw) == 2) return MuxReading{pin, raw};
+    if (channel < 0 && sscanf(line.c_str(), "%u", &raw) == 1) return MuxReading{0, raw};
+  }
+  return std::nullopt;
+}
+
+std::optional<uint32_t> parse_reference_time(const std::vector<std::string> &lines) {
+  for (const auto &line : lines) {
+    unsigned long value;
+    if (sscanf(line.c_str(), "Reference time: %lu", &value) == 1) return uint32_t(value);
+  }
+  return std::nullopt;
+}
+
+std::optional<LoopLatency> parse_loop_latency(const std::vector<std::string> &lines) {
+  for (const auto &line : lines) {
+    unsigned long cycles, micros;
+    if (sscanf(line.c_str(), "Loop worst: %lu cycles, %lu us", &cycles, &micros) == 2) {
+      return LoopLatency{uint32_t(cycles), uint32_t(micros)};
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<EnergyReading> parse_energy(const std::vector<std::string> &lines) {
+  for (const auto &line : lines) {
+    unsigned long read, level, load, tte;
+    double fall;
+    int used = 0;
+    if (sscanf(line.c_str(), "Energy: read %lu counts, level %lu falling %lf counts/s, load %lu mA, time to empty %n",
+               &read, &level, &fall, &load, &used) != 4 || !used) {
+      continue;
+    }
+    EnergyReading reading{uint32_t(read), uint32_t(level), fall, uint32_t(load), std::nullopt};
+    if (sscanf(line.c_str() + used, "%lu ms", &tte) == 1) reading.time_to_empty_ms = uint32_t(tte);
+    return reading;
+  }
+  return std::nullopt;
+}
+
+//"PRB1": 8 byte header then one probe_stats per probe, each
+//count, min, max, reserved, uint64 total and the histogram.
+std::optional<ProbeTable> parse_probe_table(const BinaryFrame &frame) {
+  if (frame.tag != "PRB1" || !frame.crc_ok || frame.payload.size() < 8) return std::nullopt;
+  const uint8_t *data = frame.payload.data();
+  ProbeTable table;
+  table.version = data[0];
+  size_t probes = data[1];
+  size_t buckets = data[2];
+  table.enabled = data[3] != 0;
+  table.cycles_per_us = read_u32(data + 4);
+  size_t stride = 24 + 4 * buckets;
+  if (frame.payload.size() != 8 + probes * stride) return std::nullopt;
+  for (size_t i = 0; i < probes; i++) {
+    const uint8_t *entry = data + 8 + i * stride;
+    ProbeStats stats;
+    stats.count = read_u32(entry);
+    stats.min = read_u32(entry + 4);
+    stats.max = read_u32(entry + 8);
+    stats.total = read_u64(entry + 16);
+    for (size_t b = 0; b < buckets; b++) stats.buckets.push_back(read_u32(entry + 24 + 4 * b));
+    table.probes.push_back(stats);
+  }
+  return table;
+}
+
+static PowerSession parse_power_session(const uint8_t *entry) {
+  PowerSession session;
+  uint64_t sum = read_u64(entry);
+  session.start_s = read_u32(entry + 8);
+  session.length_ms = read_u32(entry + 12);
+  session.samples = read_u32(entry + 16);
+  session.longest_ms = read_u32(entry + 20);
+  session.nominal = read_u16(entry + 24);
+  session.min = read_u16(entry + 26);
+  session.max = read_u16(entry + 28);
+  session.lowest_pct = read_u16(entry + 30);
+  session.highest_pct = read_u16(entry + 32);
+  session.sags = read_u16(entry + 34);
+  session.swells = read_u16(entry + 36);
+  session.dropouts = read_u16(entry + 38);
+  session.boot = read_u16(entry + 40);
+  session.mean = session.samples ? double(sum) / session.samples : 0.0;
+  const uint8_t *cell = entry + 44;
+  session.sag_table.assign(5, std::vector<uint16_t>(7));
+  session.swell_table.assign(3, std::vector<uint16_t>(7));
+  for (auto &row : session.sag_table) {
+    for (auto &count : row) {
+      count = read_u16(cell);
+      cell += 2;
+    }
+  }
+  for (auto &row : session.swell_table) {
+    for (auto &count : row) {
+      count = read_u16(cell);
+      cell += 2;
+    }
+  }
+  for (size_t i = 0; i < 16; i++) session.levels.push_back(read_u32(entry + 156 + 4 * i));
+  return session;
+}
+
+std::optional<PowerQuality> parse_power_quality(const BinaryFrame &frame) {
+  if (frame.tag != "PQS1" || !frame.crc_ok || frame.payload.size() < 20) return std::nullopt;
+  const uint8_t *data = frame.payload.data();
+  PowerQuality quality;
+  quality.version = data[0];
+  size_t sessions = data[1];
+  size_t events = data[2];
+  bool current = data[3] != 0;
+  size_t session_bytes = read_u16(data + 4);
+  size_t event_bytes = read_u16(data + 6);
+  quality.session_count = read_u32(data + 8);
+  quality.event_count = read_u32(data + 12);
+  quality.boots = read_u32(data + 16);
+  if (session_bytes < 220 || event_bytes < 13 || (current && !sessions)) return std::nullopt;
+  if (frame.payload.size() != 20 + sessions * session_bytes + events * event_bytes) return std::nullopt;
+  for (size_t i = 0; i < sessions; i++) {
+    PowerSession session = parse_power_session(data + 20 + i * session_bytes);
+    if (current && i == 0) {
+      quality.current = session;
+    } else {
+      quality.finished.push_back(session);
+    }
+  }
+  for (size_t i = 0; i < events; i++) {
+    const uint8_t *entry = data + 20 + sessions * session_bytes + i * event_bytes;
+    if (entry[12] > 2) return std::nullopt;
+    PowerEvent event;
+    event.start_ms = read_u32(entry);
+    event.length_ms = read_u32(entry + 4);
+    event.boot = read_u16(entry + 8);
+    event.extreme_pct = read_u16(entry + 10);
+    event.kind = PowerEventKind(entry[12]);
+    quality.events.push_back(event);
+  }
+  return quality;
+}
+
+const char *const rollup_channel_names[] = {"key", "temp1", "temp2", "comp", "switch", "in0", "in1", "in2"};
+const size_t rollup_channel_count = sizeof(rollup_channel_names) / sizeof(rollup_channel_names[0]);
+
+std::optional<Rollups> parse_rollups(const BinaryFrame &frame) {
+  if (frame.tag != "RUP1" || !frame.crc_ok || frame.payload.size() < 16) return std::nullopt;
+  const uint8_t *data = frame.payload.data();
+  Rollups rollups;
+  rollups.version = data[0];
+  if (data[1] > 2) return std::nullopt;
+  rollups.resolution = RollupResolution(data[1]);
+  size_t channels = data[2];
+  size_t stat_bytes = data[3];
+  rollups.period_s = read_u32(data + 4);
+  uint32_t newest = read_u32(data + 8);
+  size_t buckets = read_u16(data + 12);
+  if (stat_bytes < 8 || !buckets || buckets > size_t(newest) + 1) return std::nullopt;
+  if (frame.payload.size() != 16 + buckets * channels * stat_bytes) return std::nullopt;
+  for (size_t i = 0; i < buckets; i++) {
+    RollupBucket bucket;
+    bucket.number = uint32_t(newest - (buckets - 1 - i));
+    for (size_t channel = 0; channel < channels; channel++) {
+      const uint8_t *entry = data + 16 + (i * channels + channel) * stat_bytes;
+      RollupStat stat;
+      stat.min = read_u16(entry);
+      stat.max = read_u16(entry + 2);
+      stat.mean = read_u16(entry + 4);
+      stat.last = read_u16(entry + 6);
+      stat.empty = stat.min > stat.max;
+      bucket.channels.push_back(stat);
+    }
+    rollups.buckets.push_back(std::move(bucket));
+  }
+  return rollups;
+}
+
+}  // namespace smb
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+//Decoding of what the system management board sends over its console:
+//text lines, binary frames (see binary_out.h in the firmware) and the
+//typed readings behind each debug command.
+namespace smb {
+
+//Frames are a 4 byte tag, a uint32 payload length, the payload and a
+//CRC-32 of the payload, all little endian.
+struct BinaryFrame {
+  std::string tag;
+  std::vector<uint8_t> payload;
+  bool crc_ok = false;
+};
+
+uint32_t crc32(const void *data, size_t length, uint32_t crc = 0);
+
+//Splits the raw byte stream into text lines and binary frames. A frame
+//can only start at the beginning of a line and its tag is three
+//capital letters and a digit, like "PRB1".
+class BoardStream {
+ public:
+  struct Item {
+    enum class Kind { line, frame } kind;
+    std::string line;
+    BinaryFrame frame;
+  };
+
+  void feed(const uint8_t *data, size_t length, std::vector<Item> &items);
+  void reset();
+
+  //Frames larger than this are taken to be text that happens to
+  //look like a tag.
+  static constexpr uint32_t max_frame = 4 * 1024 * 1024;
+
+ private:
+  bool take_frame(std::vector<Item> &items);
+  std::vector<uint8_t> pending_;
+};
+
+//Reply lines that end a command, 'Input "X": done' or 'Error "X": ...'.
+//The done marker can follow other text on the same line.
+bool is_done_line(const std::string &line, std::string *name = nullptr);
+bool is_error_line(const std::string &line, std::string *name = nullptr);
+
+//Lines the firmware prints on its own rather than in reply to a
+//command, like "Entering debug mode".
+bool is_async_line(const std::string &line);
+
+//"Frame: <tag> <length>", printed on the console for each frame that
+//goes out on the USB data port instead, in the order they are sent.
+bool is_frame_line(const std::string &line, std::string *tag = nullptr, uint32_t *length = nullptr);
+
+//Typed readings. Each parser takes the reply lines of one command and
+//returns nothing if they do not contain the expected reading.
+struct CurrentReading {
+  double comp_amps = 0;
+  double switch_amps = 0;
+};
+
+struct Temperatures {
+  double sensor1_c = 0;
+  double sensor2_c = 0;
+};
+
+struct InputPins {
+  bool in0 = false;
+  bool in1 = false;
+  bool in2 = false;
+};
+
+struct MuxReading {
+  int channel = 0;
+  unsigned raw = 0;
+};
+
+struct LoopLatency {
+  uint32_t cycles = 0;
+  uint32_t micros = 0;
+};
+
+//"tte": the last supply reading and the level from the line fitted
+//to the recent ones, in ADC counts, how fast it is falling in counts
+//per second and the load in mA. time_to_empty_ms is empty if the
+//supply is not falling.
+struct EnergyReading {
+  uint32_t read_counts = 0;
+  uint32_t level_counts = 0;
+  double fall = 0;
+  uint32_t load_ma = 0;
+  std::optional<uint32_t> time_to_empty_ms;
+};
+
+struct ProbeStats {
+  uint32_t count = 0;
+  uint32_t min = 0;
+  uint32_t max = 0;
+  uint64_t total = 0;
+  std::vector<uint32_t> buckets;
+  double mean() const { return count ? double(total) / count : 0.0; }
+};
+
+struct ProbeTable {
+  uint8_t version = 0;
+  bool enabled = false;
+  uint32_t cycles_per_us = 0;
+  std::vector<ProbeStats> probes;
+};
+
+//"pq frame": power sessions and events of KEY_Voltage, see the
+//firmware's power_quality.h. Readings in ADC counts, depths in percent
+//of the session's nominal, times from the start of the boot numbered.
+struct PowerSession {
+  uint16_t boot = 0;
+  uint32_t start_s = 0;
+  uint32_t length_ms = 0;
+  uint32_t samples = 0;
+  uint16_t nominal = 0;
+  uint16_t min = 0;
+  uint16_t max = 0;
+  double mean = 0;
+  uint16_t sags = 0;
+  uint16_t swells = 0;
+  uint16_t dropouts = 0;
+  uint32_t longest_ms = 0;
+  uint16_t lowest_pct = 100;
+  uint16_t highest_pct = 100;
+  //Depth rows against length columns: sag rows down to 80, 70, 40%,
+  //deeper and dropouts, swell rows up to 120, 140% and higher, columns
+  //up to 10ms, 100ms, 500ms, 1s, 3s, 20s and longer
+  std::vector<std::vector<uint16_t>> sag_table;
+  std::vector<std::vector<uint16_t>> swell_table;
+  //Readings below 50%, in 5% bins up to 120%, and above
+  std::vector<uint32_t> levels;
+};
+
+enum class PowerEventKind { sag, swell, dropout };
+
+struct PowerEvent {
+  PowerEventKind kind = PowerEventKind::sag;
+  uint16_t boot = 0;
+  uint32_t start_ms = 0;
+  uint32_t length_ms = 0;
+  uint16_t extreme_pct = 0;
+};
+
+struct PowerQuality {
+  uint8_t version = 0;
+  uint32_t session_count = 0;
+  uint32_t event_count = 0;
+  uint32_t boots = 0;
+  //The session under way, if there is one
+  std::optional<PowerSession> current;
+  //Newest first
+  std::vector<PowerSession> finished;
+  //Oldest first
+  std::vector<PowerEvent> events;
+};
+
+//"roll read": rollups of the board's readings at one resolution, see
+//the firmware's rollups.h. The analog channels are ADC counts, and
+//the mean of an input is its duty in hundredths of a percent.
+enum class RollupResolution { second, minute, hour };
+
+//Channels in firmware rollup_channel order.
+extern const char *const rollup_channel_names[];
+extern const size_t rollup_channel_count;
+
+struct RollupStat {
+  //Nothing was read in the bucket
+  bool empty = true;
+  uint16_t min = 0;
+  uint16_t max = 0;
+  uint16_t mean = 0;
+  uint16_t last = 0;
+};
+
+struct RollupBucket {
+  //Start since boot, in units of the bucket length
+  uint32_t number = 0;
+  std::vector<RollupStat> channels;
+};
+
+struct Rollups {
+  uint8_t version = 0;
+  RollupResolution resolution = RollupResolution::second;
+  uint32_t period_s = 0;
+  //Oldest first, the last one is still under way
+  std::vector<RollupBucket> buckets;
+};
+
+//Names of the probes in firmware probe_id order.
+extern const char *const probe_names[];
+extern const size_t probe_name_count;
+
+std::optional<CurrentReading> parse_currents(const std::vector<std::string> &lines);
+std::optional<Temperatures> parse_temperatures(const std::vector<std::string> &lines);
+std::optional<InputPins> parse_inputs(const std::vector<std::string> &lines);
+std::optional<MuxReading> parse_mux(const std::vector<std::string> &lines, int channel);
+std::optional<uint32_t> parse_reference_time(const std::vector<std::string> &lines);
+std::optional<LoopLatency> parse_loop_latency(const std::vector<std::string> &lines);
+std::optional<EnergyReading> parse_energy(const std::vector<std::string> &lines);
+std::optional<ProbeTable> parse_probe_table(const BinaryFrame &frame);
+std::optional<PowerQuality> parse_power_quality(const BinaryFrame &frame);
+std::optional<Rollups> parse_rollups(const BinaryFrame &frame);
+
+//Little endian field access for frame payloads.
+uint16_t read_u16(const uint8_t *data);
+uint32_t read_u32(const uint8_t *data);
+uint64_t read_u64(const uint8_t *data);
+
+}  // namespace smb
@@ -0,0 +1,64 @@
+#include "smb_recorder.h"
+
+namespace smb {
+
+const char *flight_trigger_name(FlightTrigger trigger) {
+  static const char *const names[] = {"none", "sag", "overcurrent", "shutdown", "watchdog", "hand"};
+  return names[size_t(trigger)];
+}
+
+std::optional<FlightHeader> parse_flight_header(const BinaryFrame &frame) {
+  if (frame.tag != "FRH1" || !frame.crc_ok || frame.payload.size() < 16) return std::nullopt;
+  const uint8_t *data = frame.payload.data();
+  FlightHeader header;
+  header.version = data[0];
+  if (data[1] > uint8_t(FlightTrigger::hand)) return std::nullopt;
+  header.trigger = FlightTrigger(data[1]);
+  size_t chunks = data[2];
+  header.saved = data[3] != 0;
+  header.samples = read_u16(data + 4);
+  header.trigger_sample = read_u16(data + 6);
+  header.interval_us = read_u32(data + 8);
+  header.trigger_ms = read_u32(data + 12);
+  if (frame.payload.size() < 16 + 2 * chunks) return std::nullopt;
+  if (chunks != (header.samples + flight_chunk_samples - 1) / flight_chunk_samples) return std::nullopt;
+  for (size_t i = 0; i < chunks; i++) header.chunk_bytes.push_back(read_u16(data + 16 + 2 * i));
+  return header;
+}
+
+std::optional<std::pair<uint32_t, std::vector<uint8_t>>> parse_flight_chunk(const BinaryFrame &frame) {
+  if (frame.tag != "FRD1" || !frame.crc_ok || frame.payload.size() < 4) return std::nullopt;
+  return std::make_pair(read_u32(frame.payload.data()),
+                        std::vector<uint8_t>(frame.payload.begin() + 4, frame.payload.end()));
+}
+
+bool decode_flight_chunk(const std::vector<uint8_t> &data, size_t samples, std::vector<FlightSample> &out) {
+  size_t at = 0;
+  auto next = [&](uint32_t &value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+      if (at >= data.size() || shift > 28) return false;
+      uint8_t byte = data[at++];
+      value |= uint32_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return true;
+    }
+  };
+  auto signed_next = [&](uint16_t &value) {
+    uint32_t zigzag;
+    if (!next(zigzag)) return false;
+    value = uint16_t(value + ((zigzag >> 1) ^ -(zigzag & 1)));
+    return true;
+  };
+  FlightSample sample;
+  for (size_t i = 0; i < samples; i++) {
+    uint32_t gpio;
+    if (!signed_next(sample.key) || !signed_next(sample.comp) || !signed_next(sample.sw) || !next(gpio)) {
+      return false;
+    }
+    sample.gpio = uint16_t(sample.gpio ^ gpio);
+    out.push_back(sample);
+  }
+  return at == data.size();
+}
+
+}  // namespace smb
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "smb_protocol.h"
+
+//Flight recordings read with "fr read", see flight_recorder.h in the
+//firmware for the frame layouts.
+namespace smb {
+
+//FR_CHUNK_SAMPLES in flight_recorder.h
+constexpr size_t flight_chunk_samples = 256;
+
+//fr_trigger in flight_recorder.h
+enum class FlightTrigger { none, sag, overcurrent, shutdown, watchdog, hand };
+
+const char *flight_trigger_name(FlightTrigger trigger);
+
+struct FlightHeader {
+  uint8_t version = 0;
+  FlightTrigger trigger = FlightTrigger::none;
+  //Loaded from the board's flash rather than frozen since
+  bool saved = false;
+  uint16_t samples = 0;
+  uint16_t trigger_sample = 0;
+  uint32_t interval_us = 0;
+  //Time since boot of the trigger
+  uint32_t trigger_ms = 0;
+  std::vector<uint16_t> chunk_bytes;
+  size_t chunks() const { return chunk_bytes.size(); }
+};
+
+//Raw ADC counts of KEY_Voltage and the two current monitors, and
+//GPIO0-15.
+struct FlightSample {
+  uint16_t key = 0;
+  uint16_t comp = 0;
+  uint16_t sw = 0;
+  uint16_t gpio = 0;
+};
+
+struct FlightRecord {
+  FlightHeader header;
+  std::vector<FlightSample> samples;
+};
+
+std::optional<FlightHeader> parse_flight_header(const BinaryFrame &frame);
+//The chunk number and data of an "FRD1" frame.
+std::optional<std::pair<uint32_t, std::vector<uint8_t>>> parse_flight_chunk(const BinaryFrame &frame);
+//Appends the samples of one chunk. Fails if the data does not hold
+//exactly samples of them.
+bool decode_flight_chunk(const std::vector<uint8_t> &data, size_t samples, std::vector<FlightSample> &out);
+
+}  // namespace smb
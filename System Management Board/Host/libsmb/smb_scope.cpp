@@ -0,0 +1,110 @@
+#include "smb_scope.h"
+
+namespace smb {
+
+static constexpr uint32_t no_trigger = 0xffffffff;
+//SCOPE_TRIGGER_RISE in scope.h
+static constexpr uint8_t trigger_rise = 1;
+//ADC inputs the scope can sample, SCOPE_INPUTS in scope_hw.h
+static constexpr int adc_inputs = 3;
+
+size_t ScopeHeader::channels() const {
+  size_t count = 0;
+  for (int input = 0; input < adc_inputs; input++) {
+    if (inputs & (1u << input)) count++;
+  }
+  return count;
+}
+
+std::optional<ScopeHeader> parse_scope_header(const BinaryFrame &frame) {
+  if (frame.tag != "SCH1" || !frame.crc_ok || frame.payload.size() != 24) return std::nullopt;
+  const uint8_t *data = frame.payload.data();
+  ScopeHeader header;
+  header.version = data[0];
+  header.inputs = data[1];
+  header.mux = data[2];
+  header.trigger = data[3];
+  header.rate_hz = read_u32(data + 4);
+  header.samples = read_u32(data + 8);
+  uint32_t trigger = read_u32(data + 12);
+  if (trigger != no_trigger) header.trigger_sample = trigger;
+  header.trigger_level = read_u16(data + 16);
+  header.trigger_input = data[18];
+  header.chunk_bytes = read_u16(data + 20);
+  if (header.channels() == 0 || (header.inputs >> adc_inputs) || header.chunk_bytes % 2) return std::nullopt;
+  return header;
+}
+
+std::optional<std::pair<uint32_t, std::vector<uint16_t>>> parse_scope_chunk(const BinaryFrame &frame) {
+  if (frame.tag != "SCD1" || !frame.crc_ok || frame.payload.size() < 4 || frame.payload.size() % 2) {
+    return std::nullopt;
+  }
+  std::vector<uint16_t> samples;
+  for (size_t at = 4; at < frame.payload.size(); at += 2) samples.push_back(read_u16(frame.payload.data() + at));
+  return std::make_pair(read_u32(frame.payload.data()), std::move(samples));
+}
+
+//Mux inputs with names of their own, see input_names in scope.c.
+static std::string mux_input_name(uint8_t mux) {
+  switch (mux) {
+    case 0: return "key";
+    case 6: return "temp1";
+    case 7: return "temp2";
+    default: return "mux" + std::to_string(mux);
+  }
+}
+
+std::vector<std::string> scope_input_names(const ScopeHeader &header) {
+  std::vector<std::string> names;
+  if (header.inputs & 1) names.push_back(mux_input_name(header.mux));
+  if (header.inputs & 2) names.push_back("switch");
+  if (header.inputs & 4) names.push_back("comp");
+  return names;
+}
+
+void write_scope_csv(std::ostream &out, const Scope &scope) {
+  const ScopeHeader &header = scope.header;
+  std::vector<std::string> names = scope_input_names(header);
+  size_t channels = names.size();
+  //Rounds start with the lowest input, the trigger is timed to its
+  //own round
+  double origin = header.trigger_sample ? double(*header.trigger_sample / channels) : 0.0;
+  double round_us = 1e6 * channels / header.rate_hz;
+  out << "# " << header.rate_hz << " samples/s over " << channels << " inputs";
+  if (header.trigger_sample) {
+    out << ", " << (header.trigger == trigger_rise ? "rising" : "falling") << " trigger at " << header.trigger_level
+        << " counts";
+  }
+  out << "\n";
+  out << "time_us";
+  for (const auto &name : names) out << ',' << name;
+  out << '\n';
+  for (size_t round = 0; (round + 1) * channels <= scope.samples.size(); round++) {
+    out << (double(round) - origin) * round_us;
+    for (size_t i = 0; i < channels; i++) out << ',' << scope.samples[round * channels + i];
+    out << '\n';
+  }
+}
+
+void write_scope_npy(std::ostream &out, const Scope &scope) {
+  size_t channels = scope.header.channels();
+  size_t rounds = scope.samples.size() / channels;
+  std::string dict = "{'descr': '<u2', 'fortran_order': False, 'shape': (" + std::to_string(rounds) + ", " +
+                     std::to_string(channels) + "), }";
+  //Magic, version and header length come to 10 bytes, and the data
+  //has to start 64 byte aligned after the padded header and its
+  //newline
+  size_t total = 10 + dict.size() + 1;
+  dict.append((64 - total % 64) % 64, ' ');
+  dict += '\n';
+  out.write("\x93NUMPY\x01\x00", 8);
+  uint8_t length[2] = {uint8_t(dict.size() & 0xff), uint8_t(dict.size() >> 8)};
+  out.write(reinterpret_cast<const char *>(length), 2);
+  out << dict;
+  for (size_t i = 0; i < rounds * channels; i++) {
+    uint8_t bytes[2] = {uint8_t(scope.samples[i] & 0xff), uint8_t(scope.samples[i] >> 8)};
+    out.write(reinterpret_cast<const char *>(bytes), 2);
+  }
+}
+
+}  // namespace smb
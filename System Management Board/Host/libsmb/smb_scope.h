@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "smb_protocol.h"
+
+//Scope mode bursts read with "scope read", see scope.h in the
+//firmware for the frame layouts.
+namespace smb {
+
+struct ScopeHeader {
+  uint8_t version = 0;
+  //Mask of ADC inputs, and the mux input on ADC input 0
+  uint8_t inputs = 0;
+  uint8_t mux = 0;
+  uint8_t trigger = 0;
+  uint32_t rate_hz = 0;
+  uint32_t samples = 0;
+  std::optional<uint32_t> trigger_sample;
+  uint16_t trigger_level = 0;
+  uint8_t trigger_input = 0;
+  uint16_t chunk_bytes = 0;
+  size_t channels() const;
+  size_t chunks() const { return chunk_bytes ? (size_t(samples) * 2 + chunk_bytes - 1) / chunk_bytes : 0; }
+};
+
+//Samples as read, the inputs in turn from the lowest ADC input.
+struct Scope {
+  ScopeHeader header;
+  std::vector<uint16_t> samples;
+};
+
+std::optional<ScopeHeader> parse_scope_header(const BinaryFrame &frame);
+//The chunk number and samples of an "SCD1" frame.
+std::optional<std::pair<uint32_t, std::vector<uint16_t>>> parse_scope_chunk(const BinaryFrame &frame);
+
+//Names of the sampled inputs in the order they come, as "scope arm"
+//takes them.
+std::vector<std::string> scope_input_names(const ScopeHeader &header);
+
+//Writes the burst as CSV, a line per round of the inputs: the time
+//from the trigger (or the start) in microseconds, then the counts of
+//each input.
+void write_scope_csv(std::ostream &out, const Scope &scope);
+//Writes the counts as a NumPy .npy file of uint16, one row per round
+//of the inputs and one column per input.
+void write_scope_npy(std::ostream &out, const Scope &scope);
+
+}  // namespace smb
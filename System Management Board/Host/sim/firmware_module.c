@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "firmware_module.h"
+#include "pico/time.h"
+
+#define MAX_SEGMENTS 4
+//PRIORITY_CONST in main.c. The state machine runs once in the second
+//half of each period and is re-armed in the first quarter.
+#define PRIORITY_PERIOD_US 50000
+
+typedef struct data_segment {
+  uint8_t *address;
+  size_t size;
+  uint8_t *initial;
+} data_segment;
+
+static char *module_path;
+static void *module;
+static int (*module_main)(void);
+static uint64_t *debug_time;
+static data_segment segments[MAX_SEGMENTS];
+static int segment_count;
+
+static void *lookup(const char *name){
+  void *symbol = dlsym(module, name);
+  if (!symbol){
+    fprintf(stderr, "firmware: %s has no %s\n", module_path, name);
+    exit(2);
+  }
+  return symbol;
+}
+
+//Finds the writable segments of the module, leaving out the part
+//that is made read-only after relocation.
+static int find_segments(struct dl_phdr_info *info, size_t size, void *data){
+  struct link_map *map = data;
+  if (info->dlpi_addr != map->l_addr){
+    return 0;
+  }
+  uintptr_t relro_start = 0;
+  uintptr_t relro_end = 0;
+  for (int i = 0; i < info->dlpi_phnum; i++){
+    const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+    if (header->p_type == PT_GNU_RELRO){
+      relro_start = info->dlpi_addr + header->p_vaddr;
+      relro_end = relro_start + header->p_memsz;
+    }
+  }
+  segment_count = 0;
+  for (int i = 0; i < info->dlpi_phnum; i++){
+    const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+    if ((header->p_type != PT_LOAD) || !(header->p_flags & PF_W)){
+      continue;
+    }
+    uintptr_t start = info->dlpi_addr + header->p_vaddr;
+    uintptr_t end = start + header->p_memsz;
+    if ((relro_start <= start) && (relro_end > start)){
+      start = relro_end;
+    }
+    if ((start >= end) || (segment_count == MAX_SEGMENTS)){
+      continue;
+    }
+    segments[segment_count].address = (uint8_t *)start;
+    segments[segment_count].size = end - start;
+    segments[segment_count].initial = NULL;
+    segment_count++;
+  }
+  return 1;
+}
+
+static void open_module(void){
+  module = dlopen(module_path, RTLD_NOW | RTLD_LOCAL);
+  if (!module){
+    fprintf(stderr, "firmware: %s\n", dlerror());
+    exit(2);
+  }
+  module_main = (int (*)(void))lookup("firmware_main");
+  debug_time = lookup("debug_time");
+  //dlclose only unloads a module nothing else holds on to
+  if (*debug_time != 0){
+    fprintf(stderr, "firmware: %s was not reloaded\n", module_path);
+    exit(2);
+  }
+}
+
+//Keeps a copy of the module's data as it is before main runs.
+static void snapshot(void){
+  for (int i = 0; i < segment_count; i++){
+    free(segments[i].initial);
+  }
+  struct link_map *map;
+  if ((dlinfo(module, RTLD_DI_LINKMAP, &map) != 0) || !dl_iterate_phdr(find_segments, map)){
+    fprintf(stderr, "firmware: cannot find the data of %s\n", module_path);
+    exit(2);
+  }
+  for (int i = 0; i < segment_count; i++){
+    segments[i].initial = malloc(segments[i].size);
+    if (!segments[i].initial){
+      perror("firmware");
+      exit(2);
+    }
+    memcpy(segments[i].initial, segments[i].address, segments[i].size);
+  }
+}
+
+void firmware_load(const char *path){
+  module_path = strdup(path);
+  open_module();
+  snapshot();
+}
+
+void firmware_reload(void){
+  dlclose(module);
+  open_module();
+  snapshot();
+}
+
+void firmware_restore(void){
+  for (int i = 0; i < segment_count; i++){
+    memcpy(segments[i].address, segments[i].initial, segments[i].size);
+  }
+}
+
+void firmware_run(void){
+  module_main();
+}
+
+void *firmware_symbol(const char *name){
+  return lookup(name);
+}
+
+uint64_t firmware_next_window(uint64_t now_us){
+  uint64_t time_ref = time_us_64() - *debug_time;
+  uint64_t phase = time_ref % PRIORITY_PERIOD_US;
+  if (phase <= PRIORITY_PERIOD_US/2){
+    return now_us + (PRIORITY_PERIOD_US/2 + 1 - phase);
+  }
+  return now_us + (PRIORITY_PERIOD_US - phase);
+}
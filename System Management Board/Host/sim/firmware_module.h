@@ -0,0 +1,30 @@
+#ifndef FIRMWARE_MODULE_H
+#define FIRMWARE_MODULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//The firmware built as a shared module (smb_firmware) and run inside
+//a host program. A reset of the board needs the firmware's globals
+//back at their initial values, which is done either by reloading the
+//module or by restoring a copy of its writable data.
+
+//Loads the module and keeps a copy of its initial data. Exits on
+//failure.
+void firmware_load(const char *path);
+//Unloads and loads the module again. Slow, but lets gcov write out
+//the counters of the old instance.
+void firmware_reload(void);
+//Puts the module's globals back to their initial values in place.
+//Much faster than a reload, for running many short inputs.
+void firmware_restore(void);
+//Runs the firmware's main. It never returns, the host leaves it by
+//longjmp from one of the vhal hooks.
+void firmware_run(void);
+//Where main.c next runs or re-arms its state machine, given the
+//current time on the vhal_time_us clock.
+uint64_t firmware_next_window(uint64_t now_us);
+//Address of a global in the firmware, exits if it is missing.
+void *firmware_symbol(const char *name);
+
+#endif
@@ -0,0 +1,171 @@
+#include <string.h>
+
+#include "invariants.h"
+#include "pins.h"
+
+#define SECONDS(s) ((uint64_t)((s)*1000000.0))
+//How late a deadline may be met, the state machine only runs every
+//PRIORITY_CONST (50 ms) and more is lost to rounding in main.c
+#define SLACK SECONDS(0.5)
+#define MAIN_ENGAGE SECONDS(10)
+#define COMP_ENGAGE SECONDS(20)
+//shutdown_delay + 45 s forced shutdown
+#define FORCED_SHUTDOWN SECONDS(55)
+#define JETSON_GRACE SECONDS(45)
+//A shutdown already under way when the key returns finishes within
+//FORCED_SHUTDOWN, then the watchdog reboots and engages again.
+#define LOCKUP_LIMIT (FORCED_SHUTDOWN + COMP_ENGAGE + SECONDS(5))
+//Reports per invariant written to the log
+#define LOG_LIMIT 20
+
+#define POWER_PINS ((1u << MAIN_RELAY) | (1u << COMP_PWR_EN) | (1u << SWITCH_PWR_EN))
+
+static const char *const names[INV_COUNT] = {
+  "relay_drop", "power_order", "early_engage", "shutdown_overdue", "jetson_cut", "lockup",
+};
+
+const char *invariant_name(invariant_id id){
+  return names[id];
+}
+
+void invariants_init(invariants *checks, FILE *log){
+  memset(checks, 0, sizeof(*checks));
+  checks->log = log;
+}
+
+//Whether every power pin is on, counting the PoE switch as on while
+//the load shedding holds it off on a weak supply.
+static bool all_powered(const invariants *checks, uint32_t outputs){
+  if (checks->shed_pins){
+    outputs |= checks->shed_pins() & (1u << SWITCH_PWR_EN);
+  }
+  return (outputs & POWER_PINS) == POWER_PINS;
+}
+
+//Keeps active_us, the time not paused, up to date.
+static void advance(invariants *checks, uint64_t now_us){
+  if (!checks->paused && (now_us > checks->last_us)){
+    checks->active_us += now_us - checks->last_us;
+  }
+  checks->last_us = now_us;
+}
+
+static void violation(invariants *checks, invariant_id id, uint64_t now_us, const char *detail){
+  checks->violations[id]++;
+  if (checks->log && (checks->violations[id] <= LOG_LIMIT)){
+    uint64_t seconds = now_us/1000000;
+    fprintf(checks->log, "%3llud %02llu:%02llu:%02llu.%03llu  %-16s %s\n",
+      (unsigned long long)(seconds/86400), (unsigned long long)(seconds/3600%24),
+      (unsigned long long)(seconds/60%60), (unsigned long long)(seconds%60),
+      (unsigned long long)(now_us/1000%1000), names[id], detail);
+  }
+}
+
+void invariants_pause(invariants *checks, uint64_t now_us, bool paused){
+  advance(checks, now_us);
+  checks->paused = paused;
+}
+
+static uint64_t later(uint64_t a, uint64_t b){
+  return a > b ? a : b;
+}
+
+static bool rose(uint32_t before, uint32_t after, int pin){
+  return !((before >> pin) & 1) && ((after >> pin) & 1);
+}
+
+static bool fell(uint32_t before, uint32_t after, int pin){
+  return ((before >> pin) & 1) && !((after >> pin) & 1);
+}
+
+void invariants_outputs(invariants *checks, uint64_t now_us, uint32_t before, uint32_t after,
+  const jetson *model){
+  advance(checks, now_us);
+  if (rose(before, after, SHUTDOWN_WRITE_PIN) && ((after >> COMP_PWR_EN) & 1)){
+    checks->shutdowns_signalled++;
+    checks->signalled = true;
+    checks->signal_us = now_us;
+    checks->shutdown_logged = true;
+  }
+  if (rose(before, after, COMP_PWR_EN)){
+    checks->power_ups++;
+    checks->signalled = false;
+    checks->shutdown_logged = false;
+  }
+  if (all_powered(checks, before)){
+    checks->powered_active = checks->active_us;
+  }
+  if ((before & POWER_PINS) && !(after & POWER_PINS)){
+    checks->down_us = now_us;
+  }
+  if (fell(before, after, COMP_PWR_EN)){
+    if (jetson_is_running(model)){
+      checks->cuts_running++;
+    } else {
+      checks->cuts_halted++;
+    }
+  }
+  if (checks->paused){
+    return;
+  }
+  if (fell(before, after, MAIN_RELAY) && ((before >> COMP_PWR_EN) & 1) && !checks->shutdown_logged){
+    violation(checks, INV_RELAY_DROP, now_us, "MAIN_RELAY dropped with COMP_PWR_EN high, no shutdown logged");
+  }
+  if ((rose(before, after, COMP_PWR_EN) || rose(before, after, SWITCH_PWR_EN)) && !((after >> MAIN_RELAY) & 1)){
+    violation(checks, INV_POWER_ORDER, now_us, "regulator enabled with MAIN_RELAY off");
+  }
+  uint64_t waited = checks->key_on ?
+    now_us - later(checks->key_since_us, checks->down_us) : 0;
+  if (rose(before, after, MAIN_RELAY) && (waited + SLACK < MAIN_ENGAGE)){
+    violation(checks, INV_EARLY_ENGAGE, now_us, "MAIN_RELAY on less than 10 s after the key or a power down");
+  }
+  if (rose(before, after, COMP_PWR_EN) && (waited + SLACK < COMP_ENGAGE)){
+    violation(checks, INV_EARLY_ENGAGE, now_us, "COMP_PWR_EN on less than 20 s after the key or a power down");
+  }
+  if (fell(before, after, COMP_PWR_EN) && jetson_is_running(model) &&
+      !(checks->signalled && (now_us - checks->signal_us + SLACK >= JETSON_GRACE))){
+    violation(checks, INV_JETSON_CUT, now_us, "Jetson running and told to shut down less than 45 s ago");
+  }
+}
+
+void invariants_tick(invariants *checks, uint64_t now_us, uint32_t outputs, bool key_on, bool in2){
+  advance(checks, now_us);
+  if (key_on != checks->key_on){
+    checks->key_on = key_on;
+    checks->key_since_us = now_us;
+    checks->key_since_active = checks->active_us;
+    checks->overdue_reported = false;
+    checks->lockup_reported = false;
+  }
+  if (in2 && !checks->in2 && ((outputs >> COMP_PWR_EN) & 1)){
+    checks->jetson_requests++;
+    checks->shutdown_logged = true;
+  }
+  checks->in2 = in2;
+  bool powered = all_powered(checks, outputs);
+  if (powered || in2){
+    checks->powered_active = checks->active_us;
+    checks->lockup_reported = false;
+  }
+  if (checks->paused){
+    return;
+  }
+  uint64_t held = checks->active_us - checks->key_since_active;
+  if (!key_on && (outputs & POWER_PINS) && (held > FORCED_SHUTDOWN + SLACK) && !checks->overdue_reported){
+    checks->overdue_reported = true;
+    violation(checks, INV_SHUTDOWN_OVERDUE, now_us, "power still on 55 s after the key went off");
+  }
+  uint64_t unpowered = checks->active_us - later(checks->key_since_active, checks->powered_active);
+  if (key_on && !powered && (unpowered > LOCKUP_LIMIT) && !checks->lockup_reported){
+    checks->lockup_reported = true;
+    violation(checks, INV_LOCKUP, now_us, "key on but the board is not powered up");
+  }
+}
+
+uint64_t invariants_total(const invariants *checks){
+  uint64_t total = 0;
+  for (int i = 0; i < INV_COUNT; i++){
+    total += checks->violations[i];
+  }
+  return total;
+}
@@ -0,0 +1,81 @@
+#ifndef INVARIANTS_H
+#define INVARIANTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "jetson.h"
+
+//Safety properties of the power sequencing, checked from what is
+//visible outside the board: its outputs, the key voltage, IN2 and
+//the console. Debug mode holds the state machine's clock, so deadlines
+//count only time outside it while minimum waits count all time.
+typedef enum invariant_id {
+  //MAIN_RELAY dropped while COMP_PWR_EN was high and no shutdown had
+  //been signalled or requested
+  INV_RELAY_DROP,
+  //A regulator was enabled while MAIN_RELAY was off
+  INV_POWER_ORDER,
+  //MAIN_RELAY came on less than 10 s, or COMP_PWR_EN less than 20 s,
+  //after the key or after everything was last switched off
+  INV_EARLY_ENGAGE,
+  //Power stayed on more than shutdown_delay + 45 s after the key went
+  //off
+  INV_SHUTDOWN_OVERDUE,
+  //The Jetson lost power while running, less than 45 s after it was
+  //told to shut down
+  INV_JETSON_CUT,
+  //The key has been on long enough, and nothing asks for a shutdown,
+  //but the board is not fully on. The PoE switch is excused while the
+  //load shedding holds it off
+  INV_LOCKUP,
+  INV_COUNT
+} invariant_id;
+
+typedef struct invariants {
+  uint64_t violations[INV_COUNT];
+  //Event counts for the report
+  uint64_t power_ups;
+  uint64_t cuts_halted;
+  uint64_t cuts_running;
+  uint64_t shutdowns_signalled;
+  uint64_t jetson_requests;
+
+  FILE *log;
+  //Time that does not count, see invariants_pause
+  bool paused;
+  uint64_t last_us;
+  uint64_t active_us;
+  bool key_on;
+  uint64_t key_since_us;
+  uint64_t key_since_active;
+  //When the power pins were last all off, and last all on
+  uint64_t down_us;
+  uint64_t powered_active;
+  bool signalled;
+  uint64_t signal_us;
+  bool shutdown_logged;
+  bool in2;
+  //Only the first report of a long lasting condition is counted
+  bool overdue_reported;
+  bool lockup_reported;
+  //output_shed_pins in the loaded firmware, set after invariants_init.
+  //The one look inside the board, so a shed PoE switch is not taken
+  //for a lockup
+  uint32_t (*shed_pins)(void);
+} invariants;
+
+void invariants_init(invariants *checks, FILE *log);
+//Stops and starts the checks, and the time the limits count, for
+//example while the firmware is made to sleep through a clock jump.
+void invariants_pause(invariants *checks, uint64_t now_us, bool paused);
+//Called on every change of the board outputs.
+void invariants_outputs(invariants *checks, uint64_t now_us, uint32_t before, uint32_t after,
+  const jetson *model);
+//Called whenever the simulation stops at a point in time.
+void invariants_tick(invariants *checks, uint64_t now_us, uint32_t outputs, bool key_on, bool in2);
+uint64_t invariants_total(const invariants *checks);
+const char *invariant_name(invariant_id id);
+
+#endif
@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "jetson.h"
+#include "pins.h"
+#include "sim_random.h"
+#include "vhal.h"
+
+#define AMPS_BOOTING 1.0
+#define AMPS_RUNNING 1.5
+#define AMPS_HALTED 0.2
+
+static const char *const behaviour_names[JETSON_BEHAVIOUR_COUNT] = {
+  "cooperative", "initiates", "hung",
+};
+
+const char *jetson_behaviour_name(jetson_behaviour behaviour){
+  return behaviour_names[behaviour];
+}
+
+int jetson_behaviour_by_name(const char *name){
+  for (int i = 0; i < JETSON_BEHAVIOUR_COUNT; i++){
+    if (strcmp(behaviour_names[i], name) == 0){
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void enter(jetson *model, jetson_state state, uint64_t until_us){
+  model->state = state;
+  model->until_us = until_us;
+  vhal_override(WAVE_IN2, state == JETSON_REQUESTING ? 1.0 : 0.0);
+  switch (state){
+    case JETSON_BOOTING: vhal_override(WAVE_COMP_I, AMPS_BOOTING); break;
+    case JETSON_HALTED: vhal_override(WAVE_COMP_I, AMPS_HALTED); break;
+    default: vhal_override(WAVE_COMP_I, AMPS_RUNNING); break;
+  }
+}
+
+void jetson_init(jetson *model, jetson_behaviour behaviour, uint32_t seed){
+  memset(model, 0, sizeof(*model));
+  model->behaviour = behaviour;
+  model->rng = seed ? seed : 1;
+  enter(model, JETSON_OFF, UINT64_MAX);
+}
+
+void jetson_set_behaviour(jetson *model, jetson_behaviour behaviour){
+  model->behaviour = behaviour;
+}
+
+void jetson_update(jetson *model, uint64_t now_us, uint32_t outputs){
+  bool powered = (outputs >> COMP_PWR_EN) & 1;
+  bool shutdown_pin = (outputs >> SHUTDOWN_WRITE_PIN) & 1;
+  bool jet_on = (outputs >> JET_ON) & 1;
+  //JET_ON low is the power button held down
+  bool pressed = model->last_jet_on && !jet_on;
+  model->last_jet_on = jet_on;
+  if (!powered){
+    if (model->state != JETSON_OFF){
+      enter(model, JETSON_OFF, UINT64_MAX);
+    }
+    return;
+  }
+  bool asked = shutdown_pin || pressed;
+  switch (model->state){
+    case JETSON_OFF:
+      enter(model, JETSON_BOOTING, now_us + sim_random_us(&model->rng, 20, 40));
+      break;
+    case JETSON_BOOTING:
+      if (now_us >= model->until_us){
+        enter(model, JETSON_RUNNING, UINT64_MAX);
+        model->request_us = (model->behaviour == JETSON_INITIATES) ?
+          now_us + sim_random_us(&model->rng, 30, 7200) : UINT64_MAX;
+      }
+      break;
+    case JETSON_RUNNING:
+      if (asked && (model->behaviour != JETSON_HUNG)){
+        enter(model, JETSON_SHUTTING_DOWN, now_us + sim_random_us(&model->rng, 3, 30));
+      } else if (now_us >= model->request_us){
+        enter(model, JETSON_REQUESTING, now_us + sim_random_us(&model->rng, 1, 4));
+      }
+      break;
+    case JETSON_REQUESTING:
+      if (now_us >= model->until_us){
+        enter(model, JETSON_SHUTTING_DOWN, now_us + sim_random_us(&model->rng, 2, 8));
+      }
+      break;
+    case JETSON_SHUTTING_DOWN:
+      if (now_us >= model->until_us){
+        enter(model, JETSON_HALTED, UINT64_MAX);
+      }
+      break;
+    case JETSON_HALTED:
+      break;
+  }
+}
+
+uint64_t jetson_next_event(const jetson *model){
+  if (model->state == JETSON_RUNNING){
+    return model->request_us;
+  }
+  return model->until_us;
+}
+
+bool jetson_is_running(const jetson *model){
+  return (model->state != JETSON_OFF) && (model->state != JETSON_HALTED);
+}
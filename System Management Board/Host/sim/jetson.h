@@ -0,0 +1,53 @@
+#ifndef JETSON_H
+#define JETSON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Model of the Jetson as the board sees it: it draws current while
+//powered, boots, and shuts down when the board raises the shutdown
+//pin or presses its power button. It drives IN2 and the compute
+//current monitor through vhal overrides.
+typedef enum jetson_behaviour {
+  //Shuts down when asked
+  JETSON_COOPERATIVE,
+  //Also asks for a shutdown on its own by raising IN2
+  JETSON_INITIATES,
+  //Never shuts down, the board has to force it
+  JETSON_HUNG,
+  JETSON_BEHAVIOUR_COUNT
+} jetson_behaviour;
+
+typedef enum jetson_state {
+  JETSON_OFF,
+  JETSON_BOOTING,
+  JETSON_RUNNING,
+  JETSON_REQUESTING,
+  JETSON_SHUTTING_DOWN,
+  JETSON_HALTED,
+} jetson_state;
+
+typedef struct jetson {
+  jetson_behaviour behaviour;
+  jetson_state state;
+  //End of the current timed state
+  uint64_t until_us;
+  //JETSON_INITIATES: when it will ask to shut down
+  uint64_t request_us;
+  bool last_jet_on;
+  uint32_t rng;
+} jetson;
+
+void jetson_init(jetson *model, jetson_behaviour behaviour, uint32_t seed);
+//Takes effect at the next power up.
+void jetson_set_behaviour(jetson *model, jetson_behaviour behaviour);
+//Steps the model to now given the board outputs.
+void jetson_update(jetson *model, uint64_t now_us, uint32_t outputs);
+//When the model next changes on its own, UINT64_MAX if never.
+uint64_t jetson_next_event(const jetson *model);
+bool jetson_is_running(const jetson *model);
+
+const char *jetson_behaviour_name(jetson_behaviour behaviour);
+int jetson_behaviour_by_name(const char *name);
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jetson.h"
+#include "scenario.h"
+#include "sim_random.h"
+
+#define KEY_ON_VOLTS 2.0
+#define KEY_OFF_VOLTS 0.0
+//Below the 1000 count threshold but not zero, like a cranking sag
+#define KEY_SAG_VOLTS 0.3
+
+void scenario_init(scenario *plan, wave_set *waves){
+  memset(plan, 0, sizeof(*plan));
+  plan->waves = waves;
+}
+
+static sim_event *add_event(scenario *plan, double seconds, sim_event_kind kind){
+  if (plan->count == plan->capacity){
+    plan->capacity = plan->capacity ? plan->capacity*2 : 64;
+    plan->events = realloc(plan->events, plan->capacity*sizeof(sim_event));
+    if (!plan->events){
+      perror("sim");
+      exit(1);
+    }
+  }
+  sim_event *event = &plan->events[plan->count++];
+  memset(event, 0, sizeof(*event));
+  event->time_us = (uint64_t)(seconds*1e6);
+  event->kind = kind;
+  return event;
+}
+
+static void add_send(scenario *plan, double seconds, const char *text){
+  sim_event *event = add_event(plan, seconds, EVENT_SEND);
+  snprintf(event->text, sizeof(event->text), "%s", text);
+}
+
+static bool parse_line(scenario *plan, char *line, char *error, size_t error_size){
+  char *cursor = line + strspn(line, " \t");
+  if ((*cursor == 0) || (*cursor == '#') || (*cursor == '\n')){
+    return true;
+  }
+  if (strncmp(cursor, "end", 3) == 0){
+    double seconds;
+    if (sscanf(cursor+3, "%lf", &seconds) != 1){
+      snprintf(error, error_size, "bad end time");
+      return false;
+    }
+    plan->end_us = (uint64_t)(seconds*1e6);
+    return true;
+  }
+  double seconds;
+  int consumed;
+  char word[16];
+  if ((sscanf(cursor, "%lf %15s %n", &seconds, word, &consumed) == 2) && (seconds >= 0)){
+    char *rest = cursor + consumed;
+    rest[strcspn(rest, "\r\n")] = 0;
+    if (strcmp(word, "send") == 0){
+      add_send(plan, seconds, rest);
+      return true;
+    }
+    if (strcmp(word, "jetson") == 0){
+      int behaviour = jetson_behaviour_by_name(rest);
+      if (behaviour < 0){
+        snprintf(error, error_size, "unknown Jetson behaviour \"%s\"", rest);
+        return false;
+      }
+      add_event(plan, seconds, EVENT_JETSON)->behaviour = behaviour;
+      return true;
+    }
+  }
+  return wave_set_parse_line(plan->waves, line, error, error_size);
+}
+
+bool scenario_load(scenario *plan, const char *path, char *error, size_t error_size){
+  FILE *file = fopen(path, "r");
+  if (!file){
+    snprintf(error, error_size, "%s: cannot open", path);
+    return false;
+  }
+  char line[256];
+  int number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), file)){
+    number++;
+    char reason[128];
+    if (!parse_line(plan, line, reason, sizeof(reason))){
+      snprintf(error, error_size, "%s:%d: %s", path, number, reason);
+      ok = false;
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+static void key_step(scenario *plan, double seconds, double volts){
+  wave_set_add(plan->waves, WAVE_KEY, seconds, volts, true);
+}
+
+//One debug console session: enter, read everything, leave.
+static void debug_session(scenario *plan, uint32_t *rng, double start){
+  add_send(plan, start, "d");
+  add_send(plan, start + sim_random_range(rng, 0.5, 2), "U;T;I;V;j");
+  add_send(plan, start + sim_random_range(rng, 2.5, 60), "d");
+  plan->debug_sessions++;
+}
+
+//Brownouts during a key-on period. Most are short enough to ride
+//through, some last into the shutdown sequence.
+static void brownouts(scenario *plan, uint32_t *rng, double on, double off){
+  double time = on + sim_random_range(rng, 60, 7200);
+  while (time < off - 60){
+    double pick = sim_random_unit(rng);
+    double length = pick < 0.6 ? sim_random_range(rng, 0.05, 2) :
+      pick < 0.85 ? sim_random_range(rng, 2, 9.5) : sim_random_range(rng, 10.5, 30);
+    key_step(plan, time, KEY_SAG_VOLTS);
+    key_step(plan, time + length, KEY_ON_VOLTS);
+    plan->brownouts++;
+    time += length + sim_random_range(rng, 60, 7200);
+  }
+}
+
+void scenario_soak(scenario *plan, double days, uint32_t seed){
+  uint32_t rng = seed ? seed : 1;
+  double end = days*86400.0;
+  double time = 0;
+  bool lights = false;
+  key_step(plan, 0, KEY_OFF_VOLTS);
+  wave_set_add(plan->waves, WAVE_IN0, 0, 0, true);
+  while (time < end){
+    //Key on, sometimes only for a moment
+    double on_for = sim_random_unit(&rng) < 0.2 ? sim_random_range(&rng, 3, 60) :
+      sim_random_range(&rng, 120, 8*3600);
+    double off_at = time + on_for;
+    double pick = sim_random_unit(&rng);
+    int behaviour = pick < 0.7 ? JETSON_COOPERATIVE : pick < 0.9 ? JETSON_INITIATES : JETSON_HUNG;
+    add_event(plan, time, EVENT_JETSON)->behaviour = behaviour;
+    key_step(plan, time, KEY_ON_VOLTS);
+    plan->ignition_cycles++;
+    brownouts(plan, &rng, time, off_at);
+    //The Jetson switching the lights
+    for (double light = time + sim_random_range(&rng, 30, 1800); light < off_at;
+         light += sim_random_range(&rng, 30, 1800)){
+      lights = !lights;
+      wave_set_add(plan->waves, WAVE_IN0, light, lights, true);
+    }
+    if ((on_for > 300) && (sim_random_unit(&rng) < 0.2)){
+      debug_session(plan, &rng, time + sim_random_range(&rng, 60, on_for - 120));
+    }
+    key_step(plan, off_at, KEY_OFF_VOLTS);
+    //Key off, sometimes restarted straight away
+    double off_for = sim_random_unit(&rng) < 0.3 ? sim_random_range(&rng, 1, 15) :
+      sim_random_range(&rng, 60, 12*3600);
+    time = off_at + off_for;
+  }
+  plan->end_us = (uint64_t)(end*1e6);
+}
+
+void scenario_finish(scenario *plan){
+  //Stable, so sends at the same time keep their order. Events are
+  //nearly sorted already.
+  for (size_t i = 1; i < plan->count; i++){
+    sim_event event = plan->events[i];
+    size_t j = i;
+    while ((j > 0) && (plan->events[j-1].time_us > event.time_us)){
+      plan->events[j] = plan->events[j-1];
+      j--;
+    }
+    plan->events[j] = event;
+  }
+  plan->next = 0;
+}
+
+uint64_t scenario_next_time(const scenario *plan){
+  return plan->next < plan->count ? plan->events[plan->next].time_us : UINT64_MAX;
+}
+
+const sim_event *scenario_take(scenario *plan, uint64_t now_us){
+  if ((plan->next < plan->count) && (plan->events[plan->next].time_us <= now_us)){
+    return &plan->events[plan->next++];
+  }
+  return NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "waveform.h"
+
+//What happens to the simulated board and when. A scenario file is a
+//waveform script (see waveform.h) with three more kinds of line:
+//
+//  <seconds> send <text>        console input, a newline is added
+//  <seconds> jetson <behaviour> cooperative, initiates or hung, from
+//                               the next power up
+//  end <seconds>                length of the simulation
+typedef enum sim_event_kind {
+  EVENT_SEND,
+  EVENT_JETSON,
+} sim_event_kind;
+
+typedef struct sim_event {
+  uint64_t time_us;
+  sim_event_kind kind;
+  int behaviour;
+  char text[64];
+} sim_event;
+
+typedef struct scenario {
+  wave_set *waves;
+  sim_event *events;
+  size_t count;
+  size_t capacity;
+  size_t next;
+  uint64_t end_us;
+  //Filled in by scenario_soak for the report
+  uint64_t ignition_cycles;
+  uint64_t brownouts;
+  uint64_t debug_sessions;
+} scenario;
+
+void scenario_init(scenario *plan, wave_set *waves);
+bool scenario_load(scenario *plan, const char *path, char *error, size_t error_size);
+//Generates days of random ignition cycles, brownouts, Jetson
+//behaviours, light changes and debug console sessions.
+void scenario_soak(scenario *plan, double days, uint32_t seed);
+//Sorts the events, call once everything is added.
+void scenario_finish(scenario *plan);
+//Time of the next event, UINT64_MAX when there are none left.
+uint64_t scenario_next_time(const scenario *plan);
+//The next event if it is due by now_us.
+const sim_event *scenario_take(scenario *plan, uint64_t now_us);
+
+#endif
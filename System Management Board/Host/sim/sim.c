@@ -0,0 +1,266 @@
+//Runs the firmware on a virtual clock for days or weeks of simulated
+//operation and checks the power sequencing invariants on the way.
+//
+//  smb_sim [--soak DAYS] [--seed N] [--scenario FILE] [--end SECONDS]
+//          [--transcript FILE] [--stop] [--firmware PATH]
+//
+//The firmware is polled like the board would run it, but whenever it
+//goes idle (polls the console with nothing waiting) the clock jumps
+//to the next point where something can happen: the next state machine
+//window of main.c, a scripted event, a Jetson model step or the
+//watchdog. A watchdog reboot reloads the firmware module so it starts
+//from fresh globals, as after a real reset.
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "firmware_module.h"
+#include "invariants.h"
+#include "jetson.h"
+#include "pins.h"
+#include "scenario.h"
+#include "vhal.h"
+#include "waveform.h"
+
+//Default volt_threshold in settings.c, in ADC counts
+#define KEY_THRESHOLD_COUNTS 1000
+#define ADC_VREF 3.25
+
+static const char *firmware_path = SMB_FIRMWARE_MODULE;
+static jmp_buf boot_jump;
+
+static FILE *report;
+static FILE *transcript;
+static bool stop_on_violation;
+static wave_set waves;
+static scenario plan;
+static jetson model;
+static invariants checks;
+static uint64_t reboots;
+static uint64_t commands_sent;
+static uint64_t console_errors;
+static uint64_t idle_steps;
+static uint64_t wall_start_ns;
+
+static char console_line[256];
+static size_t console_length;
+
+static void print_time(FILE *file, uint64_t time_us){
+  uint64_t seconds = time_us/1000000;
+  fprintf(file, "%llud %02llu:%02llu:%02llu.%03llu", (unsigned long long)(seconds/86400),
+    (unsigned long long)(seconds/3600%24), (unsigned long long)(seconds/60%60),
+    (unsigned long long)(seconds%60), (unsigned long long)(time_us/1000%1000));
+}
+
+static void finish(void){
+  uint64_t now = vhal_time_us();
+  double wall = (double)(vhal_monotonic_ns() - wall_start_ns)/1e9;
+  fprintf(report, "\nsimulated ");
+  print_time(report, now);
+  fprintf(report, " in %.2f s wall, %.0fx real time, %llu steps\n", wall,
+    (double)now/1e6/(wall > 0 ? wall : 1e-9), (unsigned long long)idle_steps);
+  fprintf(report, "ignition cycles %llu, brownouts %llu, debug sessions %llu, commands %llu\n",
+    (unsigned long long)plan.ignition_cycles, (unsigned long long)plan.brownouts,
+    (unsigned long long)plan.debug_sessions, (unsigned long long)commands_sent);
+  fprintf(report, "power ups %llu, shutdowns signalled %llu, Jetson requests %llu\n",
+    (unsigned long long)checks.power_ups, (unsigned long long)checks.shutdowns_signalled,
+    (unsigned long long)checks.jetson_requests);
+  fprintf(report, "power cuts with Jetson halted %llu, running %llu, watchdog reboots %llu\n",
+    (unsigned long long)checks.cuts_halted, (unsigned long long)checks.cuts_running,
+    (unsigned long long)reboots);
+  fprintf(report, "console errors %llu\n", (unsigned long long)console_errors);
+  fprintf(report, "\ninvariant          violations\n");
+  for (int i = 0; i < INV_COUNT; i++){
+    fprintf(report, "%-18s %llu\n", invariant_name((invariant_id)i),
+      (unsigned long long)checks.violations[i]);
+  }
+  fflush(report);
+  if (transcript){
+    fclose(transcript);
+  }
+  exit(invariants_total(&checks) ? 1 : 0);
+}
+
+static bool key_on(void){
+  return vhal_input(WAVE_KEY)/ADC_VREF*4096.0 > KEY_THRESHOLD_COUNTS;
+}
+
+static uint64_t earliest(uint64_t a, uint64_t b){
+  return a < b ? a : b;
+}
+
+static void idle(void){
+  uint64_t now = vhal_time_us();
+  idle_steps++;
+  const sim_event *event;
+  while ((event = scenario_take(&plan, now))){
+    if (event->kind == EVENT_SEND){
+      vhal_feed_input(event->text, strlen(event->text));
+      vhal_feed_input("\n", 1);
+      commands_sent++;
+      if (transcript){
+        print_time(transcript, now);
+        fprintf(transcript, " > %s\n", event->text);
+      }
+    } else if (event->kind == EVENT_JETSON){
+      jetson_set_behaviour(&model, (jetson_behaviour)event->behaviour);
+    }
+  }
+  uint32_t outputs = vhal_outputs();
+  jetson_update(&model, now, outputs);
+  invariants_tick(&checks, now, outputs, key_on(), vhal_input(WAVE_IN2) >= 0.5);
+  if ((now >= plan.end_us) || (stop_on_violation && invariants_total(&checks))){
+    finish();
+  }
+  if (vhal_input_pending()){
+    return;
+  }
+  uint64_t target = firmware_next_window(now);
+  target = earliest(target, scenario_next_time(&plan));
+  target = earliest(target, jetson_next_event(&model));
+  target = earliest(target, plan.end_us);
+  uint64_t deadline;
+  if (vhal_watchdog_deadline(&deadline)){
+    target = earliest(target, deadline);
+  }
+  vhal_advance_to(target > now ? target : now + 1);
+}
+
+static void output(const uint8_t *data, size_t length){
+  for (size_t i = 0; i < length; i++){
+    char c = (char)data[i];
+    if (c == '\r'){
+      continue;
+    }
+    if ((c != '\n') && (console_length < sizeof(console_line)-1)){
+      console_line[console_length++] = c;
+      continue;
+    }
+    if (c != '\n'){
+      continue;
+    }
+    console_line[console_length] = 0;
+    console_length = 0;
+    uint64_t now = vhal_time_us();
+    if (strstr(console_line, "Error")){
+      console_errors++;
+    }
+    if (transcript){
+      print_time(transcript, now);
+      fprintf(transcript, " < %s\n", console_line);
+    }
+  }
+}
+
+static void outputs_changed(uint32_t before, uint32_t after){
+  uint64_t now = vhal_time_us();
+  invariants_outputs(&checks, now, before, after, &model);
+  //The mux selects move on every ADC read of the supply, see energy.h
+  if (transcript && ((before ^ after) & ~((1u << MUX_S2) | (1u << MUX_S1) | (1u << MUX_S0)))){
+    print_time(transcript, now);
+    fprintf(transcript, " outputs %08lx -> %08lx\n", (unsigned long)before, (unsigned long)after);
+  }
+}
+
+static void reboot(void){
+  longjmp(boot_jump, 1);
+}
+
+static void usage(void){
+  fprintf(stderr,
+    "usage: smb_sim [--soak DAYS] [--seed N] [--scenario FILE] [--end SECONDS]\n"
+    "               [--transcript FILE] [--stop] [--firmware PATH]\n");
+}
+
+int main(int argc, char *argv[]){
+  wave_set_init(&waves);
+  scenario_init(&plan, &waves);
+  double soak_days = 0;
+  uint32_t seed = 1;
+  double end_seconds = 0;
+  const char *scenario_path = NULL;
+  for (int i = 1; i < argc; i++){
+    const char *arg = argv[i];
+    const char *value = (i+1 < argc) ? argv[i+1] : NULL;
+    if (strcmp(arg, "--stop") == 0){
+      stop_on_violation = true;
+      continue;
+    }
+    if (!value){
+      usage();
+      return 2;
+    }
+    i++;
+    if (strcmp(arg, "--soak") == 0){
+      soak_days = atof(value);
+    } else if (strcmp(arg, "--seed") == 0){
+      seed = (uint32_t)strtoul(value, NULL, 0);
+    } else if (strcmp(arg, "--scenario") == 0){
+      scenario_path = value;
+    } else if (strcmp(arg, "--end") == 0){
+      end_seconds = atof(value);
+    } else if (strcmp(arg, "--transcript") == 0){
+      transcript = fopen(value, "w");
+      if (!transcript){
+        perror(value);
+        return 2;
+      }
+    } else if (strcmp(arg, "--firmware") == 0){
+      firmware_path = value;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (scenario_path){
+    char error[256];
+    if (!scenario_load(&plan, scenario_path, error, sizeof(error))){
+      fprintf(stderr, "sim: %s\n", error);
+      return 2;
+    }
+  }
+  if (soak_days > 0){
+    scenario_soak(&plan, soak_days, seed);
+  }
+  if (end_seconds > 0){
+    plan.end_us = (uint64_t)(end_seconds*1e6);
+  }
+  if (plan.end_us == 0){
+    fprintf(stderr, "sim: nothing to run, give --soak, --end or an end line in the scenario\n");
+    return 2;
+  }
+  scenario_finish(&plan);
+
+  report = fdopen(dup(STDOUT_FILENO), "w");
+  invariants_init(&checks, report);
+  jetson_init(&model, JETSON_COOPERATIVE, seed);
+  fprintf(report, "simulating ");
+  print_time(report, plan.end_us);
+  fprintf(report, ", seed %lu\n\n", (unsigned long)seed);
+
+  vhal_config config = {
+    .virtual_time = true,
+    .waves = &waves,
+    .reboot = reboot,
+    .idle = idle,
+    .output = output,
+    .outputs_changed = outputs_changed,
+  };
+  vhal_configure(&config);
+  wall_start_ns = vhal_monotonic_ns();
+  firmware_load(firmware_path);
+  bool watchdog_reboot = false;
+  if (setjmp(boot_jump)){
+    firmware_reload();
+    reboots++;
+    watchdog_reboot = true;
+    console_length = 0;
+  }
+  //A reload can move the module
+  checks.shed_pins = (uint32_t (*)(void))firmware_symbol("output_shed_pins");
+  vhal_boot(watchdog_reboot);
+  firmware_run();
+  return 0;
+}
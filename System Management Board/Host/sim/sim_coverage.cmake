@@ -0,0 +1,74 @@
+# Soaks the firmware in the simulator and reports gcov branch coverage
+# of the state machine. Run by the sim_coverage target of a build
+# configured with -DSMB_SIM_COVERAGE=ON:
+#   cmake -DSIM=smb_sim -DOBJECT_DIR=CMakeFiles/smb_firmware.dir
+#         -DSOAK_DAYS=28 -DREPORT_FILE=sim_coverage.txt -P sim_coverage.cmake
+cmake_minimum_required(VERSION 3.13)
+set(functions evaluate_state shutdown_process)
+
+file(GLOB_RECURSE old_counts ${OBJECT_DIR}/*.gcda)
+if(old_counts)
+    file(REMOVE ${old_counts})
+endif()
+
+# Violations are part of the report, they do not stop it
+execute_process(COMMAND ${SIM} --soak ${SOAK_DAYS} --seed 1 RESULT_VARIABLE sim_result)
+
+file(GLOB_RECURSE main_counts ${OBJECT_DIR}/*main.c.gcda)
+if(NOT main_counts)
+    message(FATAL_ERROR "No coverage data, configure with -DSMB_SIM_COVERAGE=ON")
+endif()
+string(REPLACE ".gcda" ".o" main_object "${main_counts}")
+get_filename_component(work_dir ${REPORT_FILE} DIRECTORY)
+set(work_dir ${work_dir}/sim_coverage)
+file(MAKE_DIRECTORY ${work_dir})
+execute_process(COMMAND gcov -b -c ${main_object}
+    WORKING_DIRECTORY ${work_dir} OUTPUT_QUIET RESULT_VARIABLE gcov_result)
+if(NOT gcov_result EQUAL 0 OR NOT EXISTS ${work_dir}/main.c.gcov)
+    message(FATAL_ERROR "gcov failed")
+endif()
+
+# Walks main.c.gcov, counting the branches of each function and where
+# the untaken ones are
+file(STRINGS ${work_dir}/main.c.gcov gcov_lines)
+set(current "")
+set(line_number 0)
+foreach(function ${functions})
+    set(${function}_total 0)
+    set(${function}_taken 0)
+    set(${function}_missed "")
+endforeach()
+foreach(gcov_line IN LISTS gcov_lines)
+    if(gcov_line MATCHES "^function ([A-Za-z0-9_]+) ")
+        set(current ${CMAKE_MATCH_1})
+        if(NOT current IN_LIST functions)
+            set(current "")
+        endif()
+    elseif(gcov_line MATCHES "^ *[-#=0-9*]+: *([0-9]+):")
+        set(line_number ${CMAKE_MATCH_1})
+    elseif(current AND gcov_line MATCHES "^branch +[0-9]+ (taken ([0-9]+)|never executed)")
+        math(EXPR ${current}_total "${${current}_total} + 1")
+        if(CMAKE_MATCH_2 AND NOT CMAKE_MATCH_2 EQUAL 0)
+            math(EXPR ${current}_taken "${${current}_taken} + 1")
+        else()
+            list(APPEND ${current}_missed ${line_number})
+        endif()
+    endif()
+endforeach()
+
+set(report "Branch coverage after a ${SOAK_DAYS} day soak (smb_sim exit ${sim_result})\n")
+foreach(function ${functions})
+    set(missed ${${function}_missed})
+    if(missed)
+        list(REMOVE_DUPLICATES missed)
+    endif()
+    string(REPLACE ";" " " missed "${missed}")
+    string(APPEND report "${function}: ${${function}_taken} of ${${function}_total} branches taken")
+    if(missed)
+        string(APPEND report ", untaken on main.c lines ${missed}")
+    endif()
+    string(APPEND report "\n")
+endforeach()
+
+file(WRITE ${REPORT_FILE} "${report}")
+message("${report}Annotated source in ${work_dir}/main.c.gcov")
@@ -0,0 +1,30 @@
+#ifndef SIM_RANDOM_H
+#define SIM_RANDOM_H
+
+#include <stdint.h>
+
+//Small seeded generator so a soak run can be repeated from its seed.
+static inline uint32_t sim_random(uint32_t *state){
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+//Uniform in [0, 1)
+static inline double sim_random_unit(uint32_t *state){
+  return (double)sim_random(state)/4294967296.0;
+}
+
+static inline double sim_random_range(uint32_t *state, double low, double high){
+  return low + (high - low)*sim_random_unit(state);
+}
+
+//Microseconds between low and high seconds
+static inline uint64_t sim_random_us(uint32_t *state, double low, double high){
+  return (uint64_t)(sim_random_range(state, low, high)*1e6);
+}
+
+#endif
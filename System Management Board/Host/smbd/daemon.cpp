@@ -0,0 +1,535 @@
+#include "daemon.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "serial_port.h"
+
+namespace smb {
+
+//Longest request sent to the board. The console line buffer is 128
+//bytes and the daemon adds the ";#<seq>" marker.
+static constexpr size_t max_command = 100;
+static constexpr int tick_ms = 50;
+static constexpr int reopen_ms = 1000;
+
+Daemon::Daemon(DaemonOptions options) : options_(std::move(options)) {}
+
+Daemon::~Daemon() {
+  for (auto &entry : clients_) close(entry.first);
+  if (serial_fd_ >= 0) close(serial_fd_);
+  if (data_fd_ >= 0) close(data_fd_);
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(options_.socket_path.c_str());
+  }
+  if (timer_fd_ >= 0) close(timer_fd_);
+  if (signal_fd_ >= 0) close(signal_fd_);
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+void Daemon::watch(int fd, uint32_t events) {
+  epoll_event event{};
+  event.events = events;
+  event.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+bool Daemon::setup() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+  signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  watch(signal_fd_, EPOLLIN);
+
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  itimerspec period{};
+  period.it_interval.tv_nsec = tick_ms * 1000000L;
+  period.it_value.tv_nsec = tick_ms * 1000000L;
+  timerfd_settime(timer_fd_, 0, &period, nullptr);
+  watch(timer_fd_, EPOLLIN);
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (options_.socket_path.size() >= sizeof(address.sun_path)) {
+    fprintf(stderr, "smbd: socket path too long\n");
+    return false;
+  }
+  strncpy(address.sun_path, options_.socket_path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(options_.socket_path.c_str());
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+      listen(listen_fd_, 16) < 0) {
+    fprintf(stderr, "smbd: %s: %s\n", options_.socket_path.c_str(), strerror(errno));
+    return false;
+  }
+  watch(listen_fd_, EPOLLIN);
+
+  open_serial();
+  return true;
+}
+
+void Daemon::open_serial() {
+  next_open_attempt_ = Clock::now() + std::chrono::milliseconds(reopen_ms);
+  serial_fd_ = open_serial_port(options_.device, options_.baud);
+  if (serial_fd_ < 0) {
+    fprintf(stderr, "smbd: %s: %s, retrying\n", options_.device.c_str(), strerror(errno));
+    return;
+  }
+  fprintf(stderr, "smbd: connected to %s\n", options_.device.c_str());
+  stream_.reset();
+  serial_out_.clear();
+  watch(serial_fd_, EPOLLIN);
+  open_data();
+  pump();
+}
+
+//Without the data port the board keeps its frames on the console, so
+//it failing to open is not an error.
+void Daemon::open_data() {
+  data_stream_.reset();
+  frame_owners_.clear();
+  early_frames_.clear();
+  if (options_.data_device.empty()) return;
+  data_fd_ = open_serial_port(options_.data_device, options_.baud);
+  if (data_fd_ < 0) {
+    fprintf(stderr, "smbd: %s: %s, frames stay on the console\n", options_.data_device.c_str(),
+            strerror(errno));
+    return;
+  }
+  fprintf(stderr, "smbd: data port %s\n", options_.data_device.c_str());
+  watch(data_fd_, EPOLLIN);
+}
+
+//Fails everything that was sent or waiting to be sent. The board
+//may have run some of it, but the replies are gone.
+void Daemon::close_serial(const char *reason) {
+  fprintf(stderr, "smbd: lost %s: %s\n", options_.device.c_str(), reason);
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, serial_fd_, nullptr);
+  close(serial_fd_);
+  serial_fd_ = -1;
+  if (data_fd_ >= 0) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, data_fd_, nullptr);
+    close(data_fd_);
+    data_fd_ = -1;
+  }
+  for (auto &request : in_flight_) {
+    if (!request.expired) complete(request, "disconnected");
+  }
+  for (auto &request : queued_) complete(request, "disconnected");
+  in_flight_.clear();
+  queued_.clear();
+  in_flight_bytes_ = 0;
+  next_open_attempt_ = Clock::now() + std::chrono::milliseconds(reopen_ms);
+}
+
+//Sends queued requests while the window has room.
+void Daemon::pump() {
+  if (serial_fd_ < 0) return;
+  while (!queued_.empty() && in_flight_.size() < options_.window) {
+    Request &next = queued_.front();
+    std::string line = next.command + ";#" + std::to_string(next.seq) + "\n";
+    if (!in_flight_.empty() && in_flight_bytes_ + line.size() > options_.window_bytes) break;
+    next.sent_bytes = line.size();
+    next.deadline = Clock::now() + std::chrono::milliseconds(options_.timeout_ms);
+    serial_out_ += line;
+    in_flight_bytes_ += line.size();
+    in_flight_.push_back(std::move(next));
+    queued_.pop_front();
+  }
+  serial_writable();
+}
+
+void Daemon::serial_writable() {
+  while (!serial_out_.empty()) {
+    ssize_t count = write(serial_fd_, serial_out_.data(), serial_out_.size());
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0 && errno == EAGAIN) break;
+    if (count < 0) {
+      close_serial(strerror(errno));
+      return;
+    }
+    serial_out_.erase(0, size_t(count));
+  }
+  watch(serial_fd_, serial_out_.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT));
+}
+
+void Daemon::serial_readable() {
+  uint8_t buffer[4096];
+  while (serial_fd_ >= 0) {
+    ssize_t count = read(serial_fd_, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0 && errno == EAGAIN) break;
+    if (count <= 0) {
+      close_serial(count == 0 ? "end of file" : strerror(errno));
+      return;
+    }
+    std::vector<BoardStream::Item> items;
+    stream_.feed(buffer, size_t(count), items);
+    for (auto &item : items) handle_item(item);
+  }
+}
+
+//Only frames come over the data port, anything else is dropped.
+void Daemon::data_readable() {
+  uint8_t buffer[4096];
+  while (data_fd_ >= 0) {
+    ssize_t count = read(data_fd_, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0 && errno == EAGAIN) break;
+    if (count <= 0) {
+      close_serial(count == 0 ? "data port end of file" : "data port gone");
+      return;
+    }
+    std::vector<BoardStream::Item> items;
+    data_stream_.feed(buffer, size_t(count), items);
+    for (auto &item : items) {
+      if (item.kind == BoardStream::Item::Kind::frame) deliver_frame(item.frame);
+    }
+  }
+}
+
+//The request console output currently belongs to, the oldest in
+//flight whose marker has not come back yet.
+Daemon::Request *Daemon::replying() {
+  for (auto &request : in_flight_) {
+    if (!request.marker_seen) return &request;
+  }
+  return nullptr;
+}
+
+//Routes one line or frame from the board's console.
+void Daemon::handle_item(BoardStream::Item &item) {
+  Request *request = replying();
+  if (item.kind == BoardStream::Item::Kind::frame) {
+    if (request) {
+      if (!request->expired) request->frames.push_back(std::move(item.frame));
+    } else {
+      broadcast_event("", &item.frame);
+    }
+    return;
+  }
+  const std::string &line = item.line;
+  if (!line.empty() && line[0] == '#') {
+    uint64_t seq = strtoull(line.c_str() + 1, nullptr, 10);
+    for (auto &sent : in_flight_) {
+      if (sent.seq > seq) break;
+      //Anything older lost its marker, most likely to a line overflow
+      if (!sent.marker_seen && sent.seq < seq) sent.error = true;
+      sent.marker_seen = true;
+    }
+    finish();
+    pump();
+    return;
+  }
+  if (is_frame_line(line)) {
+    announce_frame();
+    return;
+  }
+  if (is_async_line(line) || !request) {
+    broadcast_event(line, nullptr);
+    return;
+  }
+  //A late reply to a request that timed out
+  if (request->expired) return;
+  if (is_error_line(line)) request->error = true;
+  request->lines.push_back(line);
+}
+
+//A frame is on its way over the data port for whoever is being
+//replied to, or for the subscribers if nobody is.
+void Daemon::announce_frame() {
+  Request *request = replying();
+  if (request) request->frames_expected++;
+  frame_owners_.push_back(request ? request->seq : 0);
+  if (!early_frames_.empty()) {
+    BinaryFrame frame = std::move(early_frames_.front());
+    early_frames_.pop_front();
+    deliver_frame(frame);
+  }
+}
+
+//Hands a frame from the data port to its owner. The two ports are
+//read separately, so it can arrive before the line announcing it.
+void Daemon::deliver_frame(BinaryFrame &frame) {
+  if (frame_owners_.empty()) {
+    early_frames_.push_back(std::move(frame));
+    return;
+  }
+  uint64_t owner = frame_owners_.front();
+  frame_owners_.pop_front();
+  if (!owner) {
+    broadcast_event("", &frame);
+    return;
+  }
+  for (auto &request : in_flight_) {
+    if (request.seq == owner) {
+      if (!request.expired) request.frames.push_back(std::move(frame));
+      request.frames_expected--;
+      finish();
+      pump();
+      return;
+    }
+  }
+  //Its request timed out
+}
+
+//Replies in the order the requests were sent, each once its marker
+//and all its frames are in. One that timed out was answered then and
+//only leaves the window.
+void Daemon::finish() {
+  while (!in_flight_.empty() && in_flight_.front().marker_seen &&
+         (!in_flight_.front().frames_expected || in_flight_.front().expired)) {
+    Request &request = in_flight_.front();
+    if (!request.expired) complete(request, request.error ? "error" : "done");
+    in_flight_bytes_ -= request.sent_bytes;
+    in_flight_.pop_front();
+  }
+}
+
+void Daemon::complete(Request &request, const char *status) {
+  reply(request.client_fd, request.client_id, status, request.lines, request.frames);
+}
+
+void Daemon::reply(int client_fd, const std::string &id, const std::string &status,
+                   const std::vector<std::string> &lines, const std::vector<BinaryFrame> &frames) {
+  auto entry = clients_.find(client_fd);
+  if (entry == clients_.end()) return;
+  std::string out = id + " " + status + " " + std::to_string(lines.size()) + " " +
+                    std::to_string(frames.size()) + "\n";
+  for (const auto &line : lines) out += line + "\n";
+  for (const auto &frame : frames) {
+    out += frame.tag + " " + std::to_string(frame.payload.size()) + " " +
+           (frame.crc_ok ? "1" : "0") + "\n";
+    out.append(reinterpret_cast<const char *>(frame.payload.data()), frame.payload.size());
+  }
+  queue_output(entry->second, out);
+}
+
+void Daemon::broadcast_event(const std::string &line, const BinaryFrame *frame) {
+  std::vector<std::string> lines;
+  std::vector<BinaryFrame> frames;
+  if (frame) {
+    frames.push_back(*frame);
+  } else {
+    lines.push_back(line);
+  }
+  std::vector<int> subscribers;
+  for (auto &entry : clients_) {
+    if (entry.second.subscribed) subscribers.push_back(entry.first);
+  }
+  for (int fd : subscribers) reply(fd, "*", "event", lines, frames);
+}
+
+void Daemon::queue_output(Connection &connection, const std::string &data) {
+  connection.out += data;
+  client_writable(connection);
+}
+
+void Daemon::accept_clients() {
+  while (true) {
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    Connection &connection = clients_[fd];
+    connection.fd = fd;
+    watch(fd, EPOLLIN);
+  }
+}
+
+void Daemon::close_client(int fd) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  clients_.erase(fd);
+  //Replies to a closed client are dropped in reply()
+  for (auto &request : queued_) {
+    if (request.client_fd == fd) request.client_fd = -1;
+  }
+  for (auto &request : in_flight_) {
+    if (request.client_fd == fd) request.client_fd = -1;
+  }
+}
+
+void Daemon::client_readable(Connection &connection) {
+  char buffer[4096];
+  int fd = connection.fd;
+  while (true) {
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0 && errno == EAGAIN) break;
+    if (count <= 0) {
+      close_client(fd);
+      return;
+    }
+    connection.in.append(buffer, size_t(count));
+  }
+  size_t end;
+  while ((end = connection.in.find('\n')) != std::string::npos) {
+    std::string line = connection.in.substr(0, end);
+    connection.in.erase(0, end + 1);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (!line.empty()) handle_request(connection, line);
+  }
+}
+
+void Daemon::client_writable(Connection &connection) {
+  while (!connection.out.empty()) {
+    ssize_t count = send(connection.fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0 && errno == EAGAIN) break;
+    if (count < 0) {
+      connection.closing = true;
+      connection.out.clear();
+      break;
+    }
+    connection.out.erase(0, size_t(count));
+  }
+  if (!connection.closing) {
+    watch(connection.fd, connection.out.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT));
+  }
+}
+
+void Daemon::handle_request(Connection &connection, const std::string &line) {
+  size_t space = line.find(' ');
+  std::string id = line.substr(0, space);
+  std::string command = space == std::string::npos ? "" : line.substr(space + 1);
+  if (!command.empty() && command[0] == '@') {
+    daemon_command(connection, id, command);
+    return;
+  }
+  if (command.empty() || command.size() > max_command || command.find('#') != std::string::npos ||
+      id == "*") {
+    reply(connection.fd, id, "invalid", {}, {});
+    return;
+  }
+  if (serial_fd_ < 0) {
+    reply(connection.fd, id, "disconnected", {}, {});
+    return;
+  }
+  Request request;
+  request.seq = next_seq_++;
+  request.client_fd = connection.fd;
+  request.client_id = id;
+  request.command = command;
+  queued_.push_back(std::move(request));
+  pump();
+}
+
+void Daemon::daemon_command(Connection &connection, const std::string &id,
+                            const std::string &command) {
+  if (command == "@subscribe" || command == "@unsubscribe") {
+    connection.subscribed = command == "@subscribe";
+    reply(connection.fd, id, "done", {}, {});
+  } else if (command == "@status") {
+    std::vector<std::string> lines = {
+        std::string("link ") + (serial_fd_ >= 0 ? "up" : "down"),
+        "device " + options_.device,
+        "data " + (data_fd_ >= 0 ? options_.data_device : std::string("console")),
+        "queued " + std::to_string(queued_.size()),
+        "in_flight " + std::to_string(in_flight_.size()),
+        "clients " + std::to_string(clients_.size()),
+    };
+    reply(connection.fd, id, "done", lines, {});
+  } else {
+    reply(connection.fd, id, "invalid", {}, {});
+  }
+}
+
+//Answers requests the board has not replied to in time with a
+//timeout, and retries the serial device while it is missing. The
+//board may still be working through such a request, so it keeps its
+//place in the window until its marker comes back, or for another
+//timeout after which the line is taken as lost.
+void Daemon::tick() {
+  uint64_t expirations;
+  while (read(timer_fd_, &expirations, sizeof(expirations)) > 0) {
+  }
+  Clock::time_point now = Clock::now();
+  if (serial_fd_ < 0) {
+    if (now >= next_open_attempt_) open_serial();
+    return;
+  }
+  for (auto &request : in_flight_) {
+    if (request.expired || request.deadline >= now) continue;
+    complete(request, "timeout");
+    request.expired = true;
+    request.deadline = now + std::chrono::milliseconds(options_.timeout_ms);
+  }
+  bool released = false;
+  while (!in_flight_.empty() && in_flight_.front().expired && in_flight_.front().deadline < now) {
+    in_flight_bytes_ -= in_flight_.front().sent_bytes;
+    in_flight_.pop_front();
+    released = true;
+  }
+  if (released) {
+    finish();
+    pump();
+  }
+}
+
+int Daemon::run() {
+  if (!setup()) return 1;
+  epoll_event events[32];
+  while (running_) {
+    int count = epoll_wait(epoll_fd_, events, 32, -1);
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) {
+      perror("smbd: epoll_wait");
+      return 1;
+    }
+    for (int i = 0; i < count; i++) {
+      int fd = events[i].data.fd;
+      uint32_t flags = events[i].events;
+      if (fd == signal_fd_) {
+        running_ = false;
+      } else if (fd == timer_fd_) {
+        tick();
+      } else if (fd == listen_fd_) {
+        accept_clients();
+      } else if (fd == serial_fd_) {
+        if (flags & (EPOLLERR | EPOLLHUP)) {
+          close_serial("hang up");
+          continue;
+        }
+        if (flags & EPOLLOUT) serial_writable();
+        if (flags & EPOLLIN) serial_readable();
+      } else if (fd == data_fd_) {
+        if (flags & (EPOLLERR | EPOLLHUP)) {
+          close_serial("data port hang up");
+          continue;
+        }
+        data_readable();
+      } else {
+        auto entry = clients_.find(fd);
+        if (entry == clients_.end()) continue;
+        if (flags & EPOLLOUT) client_writable(entry->second);
+        entry = clients_.find(fd);
+        if (entry != clients_.end() && (flags & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+          client_readable(entry->second);
+        }
+        entry = clients_.find(fd);
+        if (entry != clients_.end() && entry->second.closing) close_client(fd);
+      }
+    }
+  }
+  fprintf(stderr, "smbd: exiting\n");
+  return 0;
+}
+
+}  // namespace smb
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "smb_protocol.h"
+
+namespace smb {
+
+struct DaemonOptions {
+  std::string device = "/dev/ttyACM0";
+  //The board's USB data port, normally /dev/ttyACM1. Empty leaves the
+  //frames on the console.
+  std::string data_device;
+  std::string socket_path;
+  int baud = 115200;
+  //How long the board has to answer a request once it was sent
+  int timeout_ms = 2000;
+  //Requests written to the board ahead of their replies
+  size_t window = 8;
+  //Bytes written to the board ahead of their replies, kept well under
+  //the board's USB receive buffer
+  size_t window_bytes = 192;
+};
+
+//Owns the serial link to the board and shares it between clients on a
+//Unix socket. Requests from all clients are queued, written to the
+//board several at a time, and each reply is found by the "#<seq>"
+//marker the daemon appends to the request. Frames on the data port
+//belong to whoever the "Frame:" line announcing them on the console
+//did. Everything runs on one epoll loop.
+class Daemon {
+ public:
+  explicit Daemon(DaemonOptions options);
+  ~Daemon();
+  //Runs until SIGINT or SIGTERM. Returns the process exit code.
+  int run();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Connection {
+    int fd = -1;
+    std::string in;
+    std::string out;
+    bool subscribed = false;
+    bool closing = false;
+  };
+
+  struct Request {
+    uint64_t seq = 0;
+    int client_fd = -1;
+    std::string client_id;
+    std::string command;
+    std::vector<std::string> lines;
+    std::vector<BinaryFrame> frames;
+    //Announced on the console but still to come on the data port
+    size_t frames_expected = 0;
+    bool marker_seen = false;
+    bool error = false;
+    //Timed out and answered, but the board may still reply. Its lines
+    //are dropped and its bytes held until its marker comes back, or
+    //until a second timeout
+    bool expired = false;
+    size_t sent_bytes = 0;
+    Clock::time_point deadline;
+  };
+
+  bool setup();
+  void watch(int fd, uint32_t events);
+  void open_serial();
+  void close_serial(const char *reason);
+  void open_data();
+  void serial_readable();
+  void serial_writable();
+  void data_readable();
+  void handle_item(BoardStream::Item &item);
+  Request *replying();
+  void announce_frame();
+  void deliver_frame(BinaryFrame &frame);
+  void finish();
+  void accept_clients();
+  void client_readable(Connection &connection);
+  void client_writable(Connection &connection);
+  void close_client(int fd);
+  void handle_request(Connection &connection, const std::string &line);
+  void daemon_command(Connection &connection, const std::string &id, const std::string &command);
+  void pump();
+  void complete(Request &request, const char *status);
+  void reply(int client_fd, const std::string &id, const std::string &status,
+             const std::vector<std::string> &lines, const std::vector<BinaryFrame> &frames);
+  void broadcast_event(const std::string &line, const BinaryFrame *frame);
+  void queue_output(Connection &connection, const std::string &data);
+  void tick();
+
+  DaemonOptions options_;
+  int epoll_fd_ = -1;
+  int listen_fd_ = -1;
+  int serial_fd_ = -1;
+  int data_fd_ = -1;
+  int timer_fd_ = -1;
+  int signal_fd_ = -1;
+  bool running_ = true;
+  Clock::time_point next_open_attempt_;
+  std::string serial_out_;
+  BoardStream stream_;
+  BoardStream data_stream_;
+  //Who each announced frame goes to in order, a request seq or 0 for
+  //subscribers, and frames that came before their announcement
+  std::deque<uint64_t> frame_owners_;
+  std::deque<BinaryFrame> early_frames_;
+  std::map<int, Connection> clients_;
+  std::deque<Request> queued_;
+  std::deque<Request> in_flight_;
+  size_t in_flight_bytes_ = 0;
+  uint64_t next_seq_ = 1;
+};
+
+}  // namespace smb
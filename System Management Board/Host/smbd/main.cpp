@@ -0,0 +1,49 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "daemon.h"
+#include "smb_client.h"
+
+static void usage() {
+  fprintf(stderr,
+          "usage: smbd [--device PATH] [--data-device PATH] [--socket PATH] [--baud N]\n"
+          "            [--timeout-ms N] [--window N]\n");
+}
+
+int main(int argc, char *argv[]) {
+  smb::DaemonOptions options;
+  options.socket_path = smb::default_socket_path;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return 0;
+    }
+    if (i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    const char *value = argv[++i];
+    if (arg == "--device") {
+      options.device = value;
+    } else if (arg == "--data-device") {
+      options.data_device = value;
+    } else if (arg == "--socket") {
+      options.socket_path = value;
+    } else if (arg == "--baud") {
+      options.baud = atoi(value);
+    } else if (arg == "--timeout-ms") {
+      options.timeout_ms = atoi(value);
+    } else if (arg == "--window") {
+      options.window = size_t(atoi(value));
+      if (options.window == 0) options.window = 1;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  smb::Daemon daemon(options);
+  return daemon.run();
+}
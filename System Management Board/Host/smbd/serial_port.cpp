@@ -0,0 +1,55 @@
+#include "serial_port.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace smb {
+
+static speed_t baud_constant(int baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    default: return B0;
+  }
+}
+
+int open_serial_port(const std::string &device, int baud) {
+  speed_t speed = baud_constant(baud);
+  if (speed == B0) {
+    errno = EINVAL;
+    return -1;
+  }
+  int fd = open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) return -1;
+  termios tty{};
+  //A pseudo-terminal (the emulator) accepts the same settings
+  if (tcgetattr(fd, &tty) == 0) {
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    //With VMIN 0 an empty non-blocking read returns 0 instead of EAGAIN
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    if (tcsetattr(fd, TCSANOW, &tty) < 0) {
+      int error = errno;
+      close(fd);
+      errno = error;
+      return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+  }
+  return fd;
+}
+
+}  // namespace smb
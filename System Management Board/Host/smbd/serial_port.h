@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+namespace smb {
+
+//Opens a tty in raw, non-blocking mode. The board's USB CDC port
+//ignores the baud rate, but a real UART (the Jetson's uart1 link)
+//needs it. Returns -1 and sets errno on failure.
+int open_serial_port(const std::string &device, int baud);
+
+}  // namespace smb
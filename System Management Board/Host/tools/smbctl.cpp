@@ -0,0 +1,66 @@
+//Sends console commands through smbd and prints the replies.
+//
+//  smbctl [--socket PATH] COMMAND...   one request per argument
+//  smbctl [--socket PATH] --watch      print board events until killed
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "smb_client.h"
+
+static void print_response(const std::string &command, const smb::Response &response) {
+  for (const auto &line : response.lines) printf("%s\n", line.c_str());
+  for (const auto &frame : response.frames) {
+    printf("[frame %s, %zu bytes%s]\n", frame.tag.c_str(), frame.payload.size(),
+           frame.crc_ok ? "" : ", bad CRC");
+  }
+  if (!response.ok()) fprintf(stderr, "%s: %s\n", command.c_str(), response.status.c_str());
+}
+
+int main(int argc, char *argv[]) {
+  std::string socket_path = smb::default_socket_path;
+  std::vector<std::string> commands;
+  bool watch = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--watch") == 0) {
+      watch = true;
+    } else {
+      commands.push_back(argv[i]);
+    }
+  }
+  if (!watch && commands.empty()) {
+    fprintf(stderr, "usage: smbctl [--socket PATH] (--watch | COMMAND...)\n");
+    return 2;
+  }
+  try {
+    smb::Client client(socket_path);
+    if (watch) {
+      client.subscribe([](const smb::Response &event) {
+        for (const auto &line : event.lines) printf("%s\n", line.c_str());
+        for (const auto &frame : event.frames) {
+          printf("[frame %s, %zu bytes]\n", frame.tag.c_str(), frame.payload.size());
+        }
+        fflush(stdout);
+      });
+      while (true) std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+    //All requests go out at once and the daemon pipelines them
+    std::vector<std::future<smb::Response>> replies;
+    for (const auto &command : commands) replies.push_back(client.send(command));
+    int status = 0;
+    for (size_t i = 0; i < commands.size(); i++) {
+      smb::Response response = replies[i].get();
+      print_response(commands[i], response);
+      if (!response.ok()) status = 1;
+    }
+    return status;
+  } catch (const std::exception &error) {
+    fprintf(stderr, "smbctl: %s\n", error.what());
+    return 1;
+  }
+}
@@ -0,0 +1,100 @@
+//Load test for smbd and the board (or the emulator) behind it.
+//
+//  smbload [--socket PATH] [--clients N] [--requests N] [--depth N] [COMMAND]
+//
+//Each client connection keeps depth requests outstanding until it
+//has sent its share, then the request rate and latency are printed.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "smb_client.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct ClientResult {
+  std::vector<double> latencies_us;
+  size_t failures = 0;
+};
+
+static void run_client(const std::string &socket_path, const std::string &command, size_t requests,
+                       size_t depth, ClientResult &result) {
+  smb::Client client(socket_path);
+  std::deque<std::pair<Clock::time_point, std::future<smb::Response>>> outstanding;
+  size_t sent = 0;
+  while (sent < requests || !outstanding.empty()) {
+    while (sent < requests && outstanding.size() < depth) {
+      outstanding.emplace_back(Clock::now(), client.send(command));
+      sent++;
+    }
+    smb::Response response = outstanding.front().second.get();
+    double latency = std::chrono::duration<double, std::micro>(Clock::now() - outstanding.front().first).count();
+    outstanding.pop_front();
+    if (response.ok()) {
+      result.latencies_us.push_back(latency);
+    } else {
+      result.failures++;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::string socket_path = smb::default_socket_path;
+  std::string command = "T";
+  size_t clients = 4, requests = 10000, depth = 4;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+      clients = std::max(1l, atol(argv[++i]));
+    } else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+      requests = std::max(1l, atol(argv[++i]));
+    } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      depth = std::max(1l, atol(argv[++i]));
+    } else if (argv[i][0] != '-') {
+      command = argv[i];
+    } else {
+      fprintf(stderr,
+              "usage: smbload [--socket PATH] [--clients N] [--requests N] [--depth N] [COMMAND]\n");
+      return 2;
+    }
+  }
+
+  std::vector<ClientResult> results(clients);
+  std::vector<std::thread> threads;
+  Clock::time_point start = Clock::now();
+  try {
+    for (size_t i = 0; i < clients; i++) {
+      size_t share = requests / clients + (i < requests % clients ? 1 : 0);
+      threads.emplace_back(run_client, socket_path, command, share, depth, std::ref(results[i]));
+    }
+    for (auto &thread : threads) thread.join();
+  } catch (const std::exception &error) {
+    fprintf(stderr, "smbload: %s\n", error.what());
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<double> latencies;
+  size_t failures = 0;
+  for (auto &result : results) {
+    latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+    failures += result.failures;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies.empty() ? 0.0 : latencies[size_t(p * double(latencies.size() - 1))];
+  };
+  printf("%zu requests in %.2f s, %.0f/s, %zu failed\n", latencies.size() + failures, seconds,
+         double(latencies.size() + failures) / seconds, failures);
+  printf("latency us: p50 %.0f  p90 %.0f  p99 %.0f  max %.0f\n", percentile(0.5), percentile(0.9),
+         percentile(0.99), percentile(1.0));
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+//Reads the flight recorder's frozen recording from the board through
+//smbd and writes it as CSV, one sample per line:
+//
+//  smbrec [--socket PATH] [--flash] [--arm] OUT.csv
+//
+//Columns are the time from the trigger in ms, the raw KEY_Voltage,
+//COMP_I_MONITOR and SWITCH_I_MONITOR counts and GPIO0-15 in hex. With
+//--flash the copy in the board's flash is loaded first, and with
+//--arm the recorder starts recording again once it has been read.
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "smb_client.h"
+
+int main(int argc, char *argv[]) {
+  std::string socket_path = smb::default_socket_path;
+  std::string out_path;
+  bool flash = false;
+  bool arm = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--flash") == 0) {
+      flash = true;
+    } else if (strcmp(argv[i], "--arm") == 0) {
+      arm = true;
+    } else if (argv[i][0] != '-' && out_path.empty()) {
+      out_path = argv[i];
+    } else {
+      out_path.clear();
+      break;
+    }
+  }
+  if (out_path.empty()) {
+    fprintf(stderr, "usage: smbrec [--socket PATH] [--flash] [--arm] OUT.csv\n");
+    return 2;
+  }
+  try {
+    smb::Client client(socket_path);
+    if (flash && !client.request("fr load").ok()) {
+      fprintf(stderr, "smbrec: no recording in flash\n");
+      return 1;
+    }
+    std::optional<smb::FlightRecord> record = client.read_flight_record();
+    if (!record) {
+      fprintf(stderr, "smbrec: could not read a recording\n");
+      return 1;
+    }
+    const smb::FlightHeader &header = record->header;
+    std::ofstream out(out_path);
+    out << "# " << smb::flight_trigger_name(header.trigger) << " at " << header.trigger_ms << " ms since boot, "
+        << header.interval_us << " us apart\n";
+    out << "time_ms,key,comp,switch,gpio\n";
+    for (size_t i = 0; i < record->samples.size(); i++) {
+      const smb::FlightSample &sample = record->samples[i];
+      double time_ms = (double(i) - header.trigger_sample) * header.interval_us / 1000.0;
+      char gpio[8];
+      snprintf(gpio, sizeof(gpio), "%04x", sample.gpio);
+      out << time_ms << ',' << sample.key << ',' << sample.comp << ',' << sample.sw << ',' << gpio << '\n';
+    }
+    if (!out) {
+      perror(out_path.c_str());
+      return 1;
+    }
+    fprintf(stderr, "%u samples, %s trigger at sample %u\n", header.samples, smb::flight_trigger_name(header.trigger),
+            header.trigger_sample);
+    if (arm && !client.request("fr arm").ok()) {
+      fprintf(stderr, "smbrec: could not arm the recorder\n");
+      return 1;
+    }
+    return 0;
+  } catch (const std::exception &error) {
+    fprintf(stderr, "smbrec: %s\n", error.what());
+    return 1;
+  }
+}
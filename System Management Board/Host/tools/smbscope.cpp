@@ -0,0 +1,113 @@
+//Reads a scope mode burst from the board through smbd and writes it
+//as CSV or as a NumPy .npy array, by the output's extension.
+//
+//  smbscope [--socket PATH] [--arm "INPUTS RATE [TRIGGER] [PRE]"] [--timeout-ms N] OUT.csv|OUT.npy
+//
+//With --arm a new burst is taken, otherwise the last finished one is
+//read. The arguments are those of "scope arm". The board only waits
+//a short while for a trigger before giving the ADC back, so a burst
+//that ends without one is armed again until the timeout.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "smb_client.h"
+
+//Polls "scope status" until the burst is done, and returns the
+//status line, empty if it did not finish in time.
+static std::string wait_done(smb::Client &client, std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    smb::Response response = client.request("scope status");
+    if (!response.ok()) return "";
+    for (const auto &line : response.lines) {
+      if (line.rfind("Scope: done", 0) == 0) return line;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return "";
+}
+
+static bool ends_with(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  std::string socket_path = smb::default_socket_path;
+  std::string arm;
+  std::string out_path;
+  long timeout_ms = 10000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--arm") == 0 && i + 1 < argc) {
+      arm = argv[++i];
+    } else if (strcmp(argv[i], "--timeout-ms") == 0 && i + 1 < argc) {
+      timeout_ms = strtol(argv[++i], nullptr, 10);
+    } else if (argv[i][0] != '-' && out_path.empty()) {
+      out_path = argv[i];
+    } else {
+      out_path.clear();
+      break;
+    }
+  }
+  if (out_path.empty()) {
+    fprintf(stderr,
+            "usage: smbscope [--socket PATH] [--arm \"INPUTS RATE [TRIGGER] [PRE]\"] [--timeout-ms N] "
+            "OUT.csv|OUT.npy\n");
+    return 2;
+  }
+  try {
+    smb::Client client(socket_path);
+    if (!arm.empty()) {
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+      size_t bursts = 0;
+      while (true) {
+        smb::Response response = client.request("scope arm " + arm);
+        if (!bursts) {
+          for (const auto &line : response.lines) fprintf(stderr, "%s\n", line.c_str());
+        }
+        if (!response.ok()) return 1;
+        bursts++;
+        std::string status = wait_done(client, std::chrono::milliseconds(2000));
+        if (status.empty()) {
+          fprintf(stderr, "smbscope: the burst did not finish\n");
+          return 1;
+        }
+        if (status.find("no trigger") == std::string::npos) break;
+        if (std::chrono::steady_clock::now() >= deadline) {
+          fprintf(stderr, "smbscope: no trigger in %zu bursts within %ld ms, keeping the last\n", bursts,
+                  timeout_ms);
+          break;
+        }
+      }
+    }
+    std::optional<smb::Scope> scope = client.read_scope();
+    if (!scope) {
+      fprintf(stderr, "smbscope: could not read a burst\n");
+      return 1;
+    }
+    std::ofstream out(out_path, std::ios::binary);
+    if (ends_with(out_path, ".npy")) {
+      smb::write_scope_npy(out, *scope);
+    } else {
+      smb::write_scope_csv(out, *scope);
+    }
+    if (!out) {
+      perror(out_path.c_str());
+      return 1;
+    }
+    const smb::ScopeHeader &header = scope->header;
+    fprintf(stderr, "%u samples at %u Hz", header.samples, header.rate_hz);
+    if (header.trigger_sample) fprintf(stderr, ", trigger at sample %u", *header.trigger_sample);
+    fprintf(stderr, "\n");
+    return 0;
+  } catch (const std::exception &error) {
+    fprintf(stderr, "smbscope: %s\n", error.what());
+    return 1;
+  }
+}
@@ -0,0 +1,223 @@
+//Records the board's time-to-empty readings through smbd, and replays
+//recorded traces through the firmware's estimator to see how close it
+//came to when the supply actually ran out.
+//
+//  smbtte [--socket PATH] [--interval-ms N] [--seconds N] --record OUT.csv
+//  smbtte [--empty COUNTS] TRACE.csv...
+//
+//Traces are CSV, one reading per line: time_ms,counts,load_ma and
+//optionally the board's own estimate, board_tte_ms, empty if it had
+//none. Lines starting with '#' or a letter are skipped.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "smb_client.h"
+
+extern "C" {
+#include "energy_model.h"
+}
+
+struct TracePoint {
+  uint32_t time_ms = 0;
+  uint32_t counts = 0;
+  uint32_t load_ma = 0;
+  bool board_known = false;
+  uint32_t board_tte_ms = 0;
+};
+
+//Polls "tte" until the time is up, the supply reads zero or the board
+//stops answering.
+static int record(smb::Client &client, const std::string &path, long interval_ms, long seconds) {
+  std::ofstream out(path);
+  if (!out) {
+    perror(path.c_str());
+    return 1;
+  }
+  out << "time_ms,counts,load_ma,board_tte_ms\n";
+  auto start = std::chrono::steady_clock::now();
+  auto next = start;
+  size_t readings = 0;
+  while (seconds <= 0 || std::chrono::steady_clock::now() - start < std::chrono::seconds(seconds)) {
+    std::optional<smb::EnergyReading> reading = client.read_energy();
+    //A supply that ran out takes the board with it
+    if (!reading) {
+      fprintf(stderr, "smbtte: the board stopped answering\n");
+      break;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    out << elapsed.count() << ',' << reading->read_counts << ',' << reading->load_ma << ',';
+    if (reading->time_to_empty_ms) out << *reading->time_to_empty_ms;
+    out << '\n' << std::flush;
+    readings++;
+    if (!reading->read_counts) break;
+    next += std::chrono::milliseconds(interval_ms);
+    std::this_thread::sleep_until(next);
+  }
+  fprintf(stderr, "%zu readings\n", readings);
+  return 0;
+}
+
+static bool load_trace(const std::string &path, std::vector<TracePoint> &points) {
+  std::ifstream in(path);
+  if (!in) {
+    perror(path.c_str());
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#' || isalpha((unsigned char)line[0])) continue;
+    std::vector<std::string> fields;
+    std::stringstream split(line);
+    std::string field;
+    while (std::getline(split, field, ',')) fields.push_back(field);
+    if (fields.size() < 3) {
+      fprintf(stderr, "%s: bad line \"%s\"\n", path.c_str(), line.c_str());
+      return false;
+    }
+    TracePoint point;
+    point.time_ms = uint32_t(strtoul(fields[0].c_str(), nullptr, 10));
+    point.counts = uint32_t(strtoul(fields[1].c_str(), nullptr, 10));
+    point.load_ma = uint32_t(strtoul(fields[2].c_str(), nullptr, 10));
+    if (fields.size() > 3 && !fields[3].empty() && fields[3] != "\r") {
+      point.board_known = true;
+      point.board_tte_ms = uint32_t(strtoul(fields[3].c_str(), nullptr, 10));
+    }
+    points.push_back(point);
+  }
+  return true;
+}
+
+//How far off the estimates before the supply ran out were. Within
+//20%, or a second since the readings are 100ms apart, counts as close.
+struct Errors {
+  size_t estimates = 0;
+  size_t within = 0;
+  double total = 0;
+  double worst = 0;
+  void add(double estimate_ms, double actual_ms) {
+    double error = fabs(estimate_ms - actual_ms) / actual_ms;
+    estimates++;
+    total += error;
+    if (error > worst) worst = error;
+    if (close(estimate_ms, actual_ms)) within++;
+  }
+  static bool close(double estimate_ms, double actual_ms) {
+    return fabs(estimate_ms - actual_ms) <= std::max(0.2 * actual_ms, 1000.0);
+  }
+  void print(const char *name) const {
+    if (!estimates) {
+      printf("  %s: no estimates\n", name);
+      return;
+    }
+    printf("  %s: %zu estimates, mean error %.1f%%, worst %.1f%%, %.0f%% close\n", name, estimates,
+           100.0 * total / estimates, 100.0 * worst, 100.0 * within / estimates);
+  }
+};
+
+//Runs a trace through the estimator. Only the readings up to the
+//supply reaching empty count, each against the time left from it.
+static bool replay(const std::string &path, uint32_t empty) {
+  std::vector<TracePoint> points;
+  if (!load_trace(path, points)) return false;
+  size_t empty_at = points.size();
+  for (size_t i = 0; i < points.size(); i++) {
+    if (points[i].counts <= empty) {
+      empty_at = i;
+      break;
+    }
+  }
+  printf("%s: %zu readings", path.c_str(), points.size());
+  if (empty_at == points.size()) {
+    printf(", never down to %u counts\n", empty);
+    return true;
+  }
+  uint32_t empty_ms = points[empty_at].time_ms;
+  printf(", empty after %.1f s\n", (empty_ms - points[0].time_ms) / 1000.0);
+
+  energy_model model;
+  energy_model_reset(&model);
+  Errors replayed, board;
+  //When the estimate first came close and stayed there
+  std::optional<uint32_t> settled_ms;
+  for (size_t i = 0; i < empty_at; i++) {
+    const TracePoint &point = points[i];
+    energy_model_add(&model, point.time_ms, point.counts, point.load_ma, empty);
+    double actual = double(empty_ms - point.time_ms);
+    if (actual <= 0) continue;
+    bool good = false;
+    if (model.tte_ms != ENERGY_UNKNOWN) {
+      replayed.add(model.tte_ms, actual);
+      good = Errors::close(model.tte_ms, actual);
+    }
+    if (point.board_known) board.add(point.board_tte_ms, actual);
+    if (!good) {
+      settled_ms.reset();
+    } else if (!settled_ms) {
+      settled_ms = point.time_ms;
+    }
+  }
+  replayed.print("replayed");
+  if (board.estimates) board.print("board");
+  if (settled_ms) {
+    printf("  close from %.1f s before empty\n", (empty_ms - *settled_ms) / 1000.0);
+  } else {
+    printf("  never close\n");
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  std::string socket_path = smb::default_socket_path;
+  std::string record_path;
+  std::vector<std::string> traces;
+  long interval_ms = 100;
+  long seconds = 0;
+  uint32_t empty = 900;
+  bool usage = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (strcmp(argv[i], "--interval-ms") == 0 && i + 1 < argc) {
+      interval_ms = strtol(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = strtol(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--empty") == 0 && i + 1 < argc) {
+      empty = uint32_t(strtoul(argv[++i], nullptr, 10));
+    } else if (argv[i][0] != '-') {
+      traces.push_back(argv[i]);
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || record_path.empty() == traces.empty() || interval_ms <= 0) {
+    fprintf(stderr,
+            "usage: smbtte [--socket PATH] [--interval-ms N] [--seconds N] --record OUT.csv\n"
+            "       smbtte [--empty COUNTS] TRACE.csv...\n");
+    return 2;
+  }
+  if (!record_path.empty()) {
+    try {
+      smb::Client client(socket_path);
+      return record(client, record_path, interval_ms, seconds);
+    } catch (const std::exception &error) {
+      fprintf(stderr, "smbtte: %s\n", error.what());
+      return 1;
+    }
+  }
+  int status = 0;
+  for (const auto &trace : traces) {
+    if (!replay(trace, empty)) status = 1;
+  }
+  return status;
+}
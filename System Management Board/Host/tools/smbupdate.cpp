@@ -0,0 +1,243 @@
+//Sends a new firmware image to the board over the Jetson's uart1 link
+//and starts it, see update.h in the firmware.
+//
+//  smbupdate --device PATH [--baud N] [--no-apply] MAIN.bin MAIN_B.bin
+//
+//MAIN.bin and MAIN_B.bin are the same firmware linked for slot A and
+//slot B, the one for the slot not running is sent. An update that was
+//cut off carries on where it stopped when run again.
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "serial_port.h"
+#include "smb_protocol.h"
+
+//From update.h
+constexpr uint8_t frame_start = 0x02;
+constexpr size_t chunk_max = 1024;
+constexpr size_t window = 4096;
+
+//No answer for this long and the transfer is picked up again with
+//"upd begin"
+constexpr auto answer_timeout = std::chrono::seconds(2);
+
+class Link {
+ public:
+  explicit Link(int fd) : fd_(fd) {}
+
+  bool send(const void *data, size_t length) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (length) {
+      ssize_t count = write(fd_, bytes, length);
+      if (count > 0) {
+        bytes += count;
+        length -= static_cast<size_t>(count);
+      } else if (count < 0 && errno != EAGAIN) {
+        return false;
+      } else {
+        pollfd writable{fd_, POLLOUT, 0};
+        poll(&writable, 1, 100);
+      }
+    }
+    return true;
+  }
+
+  bool send_line(const std::string &line) {
+    std::string text = line + "\n";
+    return send(text.data(), text.size());
+  }
+
+  //Next line starting "Update: " within timeout_ms, without it.
+  std::optional<std::string> answer(int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+      size_t end;
+      while ((end = pending_.find('\n')) != std::string::npos) {
+        std::string line = pending_.substr(0, end);
+        pending_.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t at = line.find("Update: ");
+        if (at != std::string::npos) return line.substr(at + 8);
+      }
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) return std::nullopt;
+      pollfd readable{fd_, POLLIN, 0};
+      if (poll(&readable, 1, static_cast<int>(left.count())) <= 0) continue;
+      char buffer[512];
+      ssize_t count = read(fd_, buffer, sizeof(buffer));
+      if (count > 0) pending_.append(buffer, static_cast<size_t>(count));
+    }
+  }
+
+ private:
+  int fd_;
+  std::string pending_;
+};
+
+static bool read_file(const char *path, std::vector<uint8_t> &data) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return !data.empty();
+}
+
+static bool starts_with(const std::string &text, const char *prefix) {
+  return text.rfind(prefix, 0) == 0;
+}
+
+//Bytes already received from the status line "upd begin" answers
+//with, "running slot A, confirmed, receiving slot B, N of M bytes".
+static std::optional<uint32_t> begin(Link &link, const std::vector<uint8_t> &image) {
+  char command[64];
+  snprintf(command, sizeof(command), "upd begin %zu %u", image.size(), smb::crc32(image.data(), image.size()));
+  if (!link.send_line(command)) return std::nullopt;
+  while (std::optional<std::string> line = link.answer(2000)) {
+    size_t at = line->find(" slot ", line->find("receiv"));
+    unsigned long received;
+    if (starts_with(*line, "running slot") && at != std::string::npos &&
+        sscanf(line->c_str() + at + 6, "%*c, %lu of", &received) == 1) {
+      return static_cast<uint32_t>(received);
+    }
+    if (!starts_with(*line, "ack") && !starts_with(*line, "resend")) {
+      fprintf(stderr, "smbupdate: %s\n", line->c_str());
+      return std::nullopt;
+    }
+  }
+  fprintf(stderr, "smbupdate: no answer to \"%s\"\n", command);
+  return std::nullopt;
+}
+
+static bool send_frame(Link &link, const std::vector<uint8_t> &image, uint32_t offset) {
+  uint16_t length = static_cast<uint16_t>(std::min(chunk_max, image.size() - offset));
+  std::vector<uint8_t> frame;
+  frame.push_back(frame_start);
+  for (int i = 0; i < 4; i++) frame.push_back(static_cast<uint8_t>(offset >> (8*i)));
+  frame.push_back(static_cast<uint8_t>(length));
+  frame.push_back(static_cast<uint8_t>(length >> 8));
+  frame.insert(frame.end(), image.begin() + offset, image.begin() + offset + length);
+  uint32_t crc = smb::crc32(frame.data() + 1, frame.size() - 1);
+  for (int i = 0; i < 4; i++) frame.push_back(static_cast<uint8_t>(crc >> (8*i)));
+  return link.send(frame.data(), frame.size());
+}
+
+//Keeps up to a window of frames ahead of the answers. A resend means
+//the board dropped that frame and, unanswered yet, every one after it,
+//so those answers are let pass before going on from where it says.
+static bool transfer(Link &link, const std::vector<uint8_t> &image) {
+  std::optional<uint32_t> start = begin(link, image);
+  if (!start) return false;
+  uint32_t acked = *start, sent = *start;
+  size_t in_flight = 0, stale = 0;
+  int resumes = 0;
+  auto started = std::chrono::steady_clock::now();
+  uint32_t last_report = 0;
+  while (true) {
+    while (sent < image.size() && sent + std::min(chunk_max, image.size() - sent) - acked <= window) {
+      if (!send_frame(link, image, sent)) return false;
+      sent += static_cast<uint32_t>(std::min(chunk_max, image.size() - sent));
+      in_flight++;
+    }
+    std::optional<std::string> line = link.answer(static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(answer_timeout).count()));
+    unsigned long offset = 0;
+    if (!line) {
+      if (++resumes > 5) {
+        fprintf(stderr, "smbupdate: the board stopped answering at %u bytes\n", acked);
+        return false;
+      }
+      start = begin(link, image);
+      if (!start) return false;
+      acked = sent = *start;
+      in_flight = stale = 0;
+      continue;
+    }
+    if (*line == "image ok") break;
+    if (sscanf(line->c_str(), "ack %lu", &offset) == 1) {
+      acked = static_cast<uint32_t>(offset);
+      if (in_flight) in_flight--;
+      resumes = 0;
+    } else if (sscanf(line->c_str(), "resend %lu", &offset) == 1) {
+      if (stale) {
+        stale--;
+        continue;
+      }
+      stale = in_flight ? in_flight - 1 : 0;
+      in_flight = 0;
+      acked = sent = static_cast<uint32_t>(offset);
+    } else {
+      fprintf(stderr, "smbupdate: %s\n", line->c_str());
+      return false;
+    }
+    if (acked - last_report >= 64*1024 || acked == image.size()) {
+      last_report = acked;
+      fprintf(stderr, "%u of %zu bytes\n", acked, image.size());
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  fprintf(stderr, "%zu bytes in %.1f s, %.0f bytes/s\n", image.size() - *start, seconds,
+    (image.size() - *start)/seconds);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  std::string device;
+  int baud = 115200;
+  bool apply = true;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      device = argv[++i];
+    } else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+      baud = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--no-apply") == 0) {
+      apply = false;
+    } else if (argv[i][0] != '-') {
+      paths.push_back(argv[i]);
+    } else {
+      paths.clear();
+      break;
+    }
+  }
+  if (device.empty() || paths.size() != 2) {
+    fprintf(stderr, "usage: smbupdate --device PATH [--baud N] [--no-apply] MAIN.bin MAIN_B.bin\n");
+    return 2;
+  }
+  int fd = smb::open_serial_port(device, baud);
+  if (fd < 0) {
+    perror(device.c_str());
+    return 1;
+  }
+  Link link(fd);
+  link.send_line("upd");
+  std::optional<std::string> status = link.answer(2000);
+  char running;
+  if (!status || sscanf(status->c_str(), "running slot %c", &running) != 1) {
+    fprintf(stderr, "smbupdate: %s\n", status ? status->c_str() : "no answer to \"upd\"");
+    return 1;
+  }
+  const char *path = paths[running == 'A' ? 1 : 0];
+  std::vector<uint8_t> image;
+  if (!read_file(path, image)) {
+    fprintf(stderr, "smbupdate: could not read %s\n", path);
+    return 1;
+  }
+  fprintf(stderr, "slot %c running, sending %s\n", running, path);
+  if (!transfer(link, image)) return 1;
+  if (!apply) return 0;
+  link.send_line("upd apply");
+  std::optional<std::string> line = link.answer(5000);
+  fprintf(stderr, "%s\n", line ? line->c_str() : "no answer to \"upd apply\"");
+  return line && starts_with(*line, "starting slot") ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+//Reads a logic analyzer capture from the board through smbd and writes
+//it as a VCD file for GTKWave, PulseView and the like.
+//
+//  smbvcd [--socket PATH] [--arm "PINS RATE [TRIGGER] [PRE]"] [--timeout-ms N] OUT.vcd
+//
+//With --arm a new capture is started and waited for, otherwise the
+//last finished one is read. The arguments are those of "cap arm".
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "smb_client.h"
+
+//Board signal names of the GPIOs, from pins.h in the firmware.
+static std::string pin_name(int gpio) {
+  switch (gpio) {
+    case 0: return "SWITCH_PWR_EN";
+    case 1: return "COMP_PWR_EN";
+    case 2: return "MAIN_RELAY";
+    case 3: return "LIGHT_A";
+    case 4: return "LIGHT_B";
+    case 5: return "OUT1_SHUTDOWN_WRITE";
+    case 6: return "OUT2";
+    case 7: return "OUT0";
+    case 8: return "UART_TX";
+    case 9: return "UART_RX";
+    case 10: return "IN1";
+    case 11: return "IN2_SHUTDOWN_READ";
+    case 12: return "IN0_LIGHTS";
+    case 13: return "AUX_SW";
+    case 15: return "JET_ON";
+    case 18: return "MUX_S0";
+    case 19: return "MUX_S1";
+    case 20: return "MUX_S2";
+    case 21: return "LEDB";
+    case 22: return "LEDA";
+    case 25: return "BUILT_IN_LED";
+    default: return "GPIO" + std::to_string(gpio);
+  }
+}
+
+//Polls "cap status" until the capture is done or the time runs out.
+static bool wait_done(smb::Client &client, std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    smb::Response response = client.request("cap status");
+    if (!response.ok()) return false;
+    for (const auto &line : response.lines) {
+      if (line.rfind("Capture: done", 0) == 0) return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  std::string socket_path = smb::default_socket_path;
+  std::string arm;
+  std::string out_path;
+  long timeout_ms = 60000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--arm") == 0 && i + 1 < argc) {
+      arm = argv[++i];
+    } else if (strcmp(argv[i], "--timeout-ms") == 0 && i + 1 < argc) {
+      timeout_ms = strtol(argv[++i], nullptr, 10);
+    } else if (argv[i][0] != '-' && out_path.empty()) {
+      out_path = argv[i];
+    } else {
+      out_path.clear();
+      break;
+    }
+  }
+  if (out_path.empty()) {
+    fprintf(stderr, "usage: smbvcd [--socket PATH] [--arm \"PINS RATE [TRIGGER] [PRE]\"] [--timeout-ms N] OUT.vcd\n");
+    return 2;
+  }
+  try {
+    smb::Client client(socket_path);
+    if (!arm.empty()) {
+      smb::Response response = client.request("cap arm " + arm);
+      for (const auto &line : response.lines) fprintf(stderr, "%s\n", line.c_str());
+      if (!response.ok()) return 1;
+      if (!wait_done(client, std::chrono::milliseconds(timeout_ms))) {
+        fprintf(stderr, "smbvcd: no trigger within %ld ms, stopping\n", timeout_ms);
+        client.request("cap stop");
+        if (!wait_done(client, std::chrono::milliseconds(2000))) return 1;
+      }
+    }
+    std::optional<smb::Capture> capture = client.read_capture();
+    if (!capture) {
+      fprintf(stderr, "smbvcd: could not read a capture\n");
+      return 1;
+    }
+    std::ofstream out(out_path);
+    smb::write_vcd(out, *capture, pin_name);
+    if (!out) {
+      perror(out_path.c_str());
+      return 1;
+    }
+    const smb::CaptureHeader &header = capture->header;
+    fprintf(stderr, "%u samples at %u Hz, %zu changes", header.samples, header.rate_hz, capture->changes.size());
+    if (header.trigger_sample) fprintf(stderr, ", trigger at sample %u", *header.trigger_sample);
+    fprintf(stderr, "\n");
+    return 0;
+  } catch (const std::exception &error) {
+    fprintf(stderr, "smbvcd: %s\n", error.what());
+    return 1;
+  }
+}